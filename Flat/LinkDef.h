@@ -8,6 +8,13 @@
 #include "PandaAnalysis/Flat/interface/TagAnalyzer.h"
 #include "PandaAnalysis/Flat/interface/PandaLeptonicAnalyzer.h"
 #include "PandaAnalysis/Flat/interface/genericTree.h"
+#include "PandaAnalysis/Flat/interface/EventGenerator.h"
+#include "PandaAnalysis/Flat/interface/CorrectionBundle.h"
+#include "PandaAnalysis/Flat/interface/BDTEngine.h"
+#include "PandaAnalysis/Flat/interface/BDTBranchAdder.h"
+#include "PandaAnalysis/Flat/interface/JECEngine.h"
+#include "PandaAnalysis/Flat/interface/JESSourceTable.h"
+#include "PandaAnalysis/Flat/interface/JERSmearer.h"
 
 
 #ifdef __CLING__
@@ -48,5 +55,12 @@
 #pragma link C++ class VariableMap;
 #pragma link C++ class Process;
 #pragma link C++ class Region;
+#pragma link C++ class EventGenerator;
+#pragma link C++ class CorrectionBundle;
+#pragma link C++ class BDTEngine;
+#pragma link C++ class BDTBranchAdder;
+#pragma link C++ class JECEngine;
+#pragma link C++ class JESSourceTable;
+#pragma link C++ class JERSmearer;
 
 #endif
@@ -0,0 +1,164 @@
+#!/usr/bin/env python
+
+'''
+Throughput benchmark for the Flat analyzers.
+Runs one analyzer over a fixed input with a fixed Analysis preset, a number of
+warmup trials followed by measured trials, each in a fresh process so that
+timing and peak RSS are not polluted by earlier trials. Reports events/s, peak
+RSS, output bytes per event and (for PandaAnalyzer) the per-module times
+from the profiling mode.
+
+  benchmark.py --input events.root --analyzer PandaAnalyzer --analysis monotop \
+               --events 5000 --warmup 1 --trials 3
+'''
+
+import sys
+from sys import exit,executable
+from os import getenv,path,remove,getpid
+from time import time
+import argparse
+import json
+import resource
+import subprocess
+
+parser = argparse.ArgumentParser(description='benchmark a Flat analyzer')
+parser.add_argument('--input',type=str,required=True)
+parser.add_argument('--analyzer',type=str,default='PandaAnalyzer',
+                    choices=['PandaAnalyzer','TagAnalyzer','PandaLeptonicAnalyzer'])
+parser.add_argument('--analysis',type=str,default='monotop',
+                    help='preset from PandaAnalysis.Flat.analysis (PandaAnalyzer only)')
+parser.add_argument('--events',type=int,default=-1,help='entries per trial; -1 => all')
+parser.add_argument('--warmup',type=int,default=1)
+parser.add_argument('--trials',type=int,default=3)
+parser.add_argument('--threads',type=int,default=1)
+parser.add_argument('--isData',action='store_true')
+parser.add_argument('--json',type=str,default=None,help='also write the summary here')
+parser.add_argument('--trial',type=str,default=None,help=argparse.SUPPRESS)
+args = parser.parse_args()
+
+
+def run_trial(outname):
+    '''run the analyzer once in this process and write a small report next to the output'''
+    import ROOT as root
+    from PandaCore.Tools.Load import Load
+    root.gROOT.SetBatch()
+
+    Load(args.analyzer)
+    skimmer = getattr(root,args.analyzer)(0)
+    if args.analyzer=='PandaAnalyzer':
+        import PandaAnalysis.Flat.analysis as analysis
+        a = getattr(analysis,args.analysis)()
+        skimmer.SetAnalysis(a)
+        skimmer.isData = args.isData
+        skimmer.nThreads = args.threads
+        skimmer.profile = True
+    elif args.analyzer=='PandaLeptonicAnalyzer':
+        skimmer.isData = args.isData
+    skimmer.firstEvent = 0
+    skimmer.lastEvent = args.events
+
+    fin = root.TFile.Open(args.input)
+    tree = fin.FindObjectAny('events')
+    hweights = fin.FindObjectAny('hSumW')
+    weights = fin.FindObjectAny('weights')
+
+    skimmer.SetDataDir(getenv('CMSSW_BASE')+'/src/PandaAnalysis/data/')
+    if args.analyzer=='TagAnalyzer':
+        skimmer.Init(tree,hweights)
+    else:
+        skimmer.Init(tree,hweights,weights if weights else None)
+    skimmer.SetOutputFile(outname)
+
+    start = time()
+    skimmer.Run()
+    elapsed = time() - start
+    skimmer.Terminate()
+
+    nevents = tree.GetEntries()
+    if args.events>=0:
+        nevents = min(nevents,args.events)
+    report = {
+        'events' : nevents,
+        'wall_s' : elapsed,
+        'peak_rss_mb' : resource.getrusage(resource.RUSAGE_SELF).ru_maxrss/1024.,
+        'output_bytes' : path.getsize(outname),
+    }
+    with open(outname.replace('.root','_trial.json'),'w') as freport:
+        json.dump(report,freport)
+
+
+if args.trial:
+    run_trial(args.trial)
+    exit(0)
+
+
+def mean(l):
+    return sum(l)/len(l) if l else 0
+
+
+results = []
+modules = {}
+for iT in xrange(args.warmup+args.trials):
+    outname = 'benchmark_%i_%i.root'%(getpid(),iT)
+    cmd = [executable,path.abspath(__file__),'--trial',outname] + sys.argv[1:]
+    if subprocess.call(cmd)!=0:
+        print 'trial %i failed'%iT
+        exit(1)
+    with open(outname.replace('.root','_trial.json')) as freport:
+        report = json.load(freport)
+    profile_name = outname.replace('.root','_profile.json')
+    if path.exists(profile_name):
+        with open(profile_name) as fprofile:
+            profile = json.load(fprofile)
+        report['getentry_s'] = profile['getentry_s']
+        report['compute_s'] = profile['compute_s']
+        if iT>=args.warmup:
+            for step in profile['steps']:
+                modules.setdefault(step['name'],[]).append(step['total_s'])
+        remove(profile_name)
+    remove(outname.replace('.root','_trial.json'))
+    remove(outname)
+
+    report['events_per_s'] = report['events']/report['wall_s'] if report['wall_s']>0 else 0
+    report['output_bytes_per_event'] = report['output_bytes']/float(max(1,report['events']))
+    tag = 'warmup' if iT<args.warmup else 'trial'
+    print '%6s %2i: %8.1f events/s  %8.1f MB peak RSS  %8.1f bytes/event'%(
+            tag,iT,report['events_per_s'],report['peak_rss_mb'],report['output_bytes_per_event'])
+    if iT>=args.warmup:
+        results.append(report)
+
+summary = {
+    'analyzer' : args.analyzer,
+    'analysis' : args.analysis,
+    'input' : args.input,
+    'threads' : args.threads,
+    'trials' : len(results),
+    'events_per_s' : mean([r['events_per_s'] for r in results]),
+    'events_per_s_min' : min([r['events_per_s'] for r in results]) if results else 0,
+    'events_per_s_max' : max([r['events_per_s'] for r in results]) if results else 0,
+    'peak_rss_mb' : max([r['peak_rss_mb'] for r in results]) if results else 0,
+    'output_bytes_per_event' : mean([r['output_bytes_per_event'] for r in results]),
+    'modules_s' : dict([(k,mean(v)) for k,v in modules.iteritems()]),
+}
+if results and 'getentry_s' in results[0]:
+    summary['getentry_s'] = mean([r['getentry_s'] for r in results])
+    summary['compute_s'] = mean([r['compute_s'] for r in results])
+
+print
+print '%s/%s over %s, %i trials'%(args.analyzer,args.analysis,args.input,len(results))
+print '  events/s      : %.1f (min %.1f, max %.1f)'%(summary['events_per_s'],
+                                                     summary['events_per_s_min'],
+                                                     summary['events_per_s_max'])
+print '  peak RSS      : %.1f MB'%(summary['peak_rss_mb'])
+print '  output/event  : %.1f bytes'%(summary['output_bytes_per_event'])
+if 'getentry_s' in summary:
+    print '  getEntry      : %.3f s'%(summary['getentry_s'])
+    print '  compute       : %.3f s'%(summary['compute_s'])
+if modules:
+    print '  per module (mean total seconds per trial):'
+    for name,t in sorted(summary['modules_s'].iteritems(),key=lambda x : -x[1]):
+        print '    %-24s %8.3f'%(name,t)
+
+if args.json:
+    with open(args.json,'w') as fjson:
+        json.dump(summary,fjson,indent=2)
@@ -0,0 +1,33 @@
+#!/usr/bin/env python
+
+'''
+Pack the binned corrections a given Analysis preset needs into one binary
+bundle. Jobs that find the bundle read it instead of opening the individual
+ROOT files; a bundle made for another preset, or from files that have
+changed since, is ignored and the files are read as usual.
+
+  compileCorrections.py --analysis monotop --output corrections.bin
+'''
+
+from os import getenv
+import argparse
+
+parser = argparse.ArgumentParser(description='compile a correction bundle')
+parser.add_argument('--analysis',type=str,default='monotop',
+                    help='preset from PandaAnalysis.Flat.analysis')
+parser.add_argument('--output',type=str,default='corrections.bin')
+parser.add_argument('--datadir',type=str,default=getenv('CMSSW_BASE')+'/src/PandaAnalysis/data/')
+args = parser.parse_args()
+
+import ROOT as root
+from PandaCore.Tools.Load import Load
+import PandaAnalysis.Flat.analysis as analysis
+root.gROOT.SetBatch()
+
+Load('PandaAnalyzer')
+
+skimmer = root.PandaAnalyzer(0)
+skimmer.SetAnalysis(getattr(analysis,args.analysis)())
+skimmer.SetDataDir(args.datadir)
+
+exit(0 if skimmer.WriteCorrectionBundle(args.output) else 1)
@@ -0,0 +1,49 @@
+#!/usr/bin/env python
+
+'''
+Write a synthetic panda-format input (events tree + hSumW) for local tests
+and benchmarks, e.g.
+
+  generateEvents.py --output synthetic.root --events 10000 --pfcands 1500
+  benchmark.py --input synthetic.root --analysis monotop
+'''
+
+import argparse
+
+parser = argparse.ArgumentParser(description='generate synthetic panda events')
+parser.add_argument('--output',type=str,default='synthetic.root')
+parser.add_argument('--events',type=int,default=10000)
+parser.add_argument('--seed',type=int,default=3393)
+parser.add_argument('--jets',type=float,default=6)
+parser.add_argument('--fatjets',type=float,default=1.2)
+parser.add_argument('--electrons',type=float,default=0.4)
+parser.add_argument('--muons',type=float,default=0.4)
+parser.add_argument('--taus',type=float,default=0.3)
+parser.add_argument('--photons',type=float,default=0.4)
+parser.add_argument('--genparticles',type=float,default=40)
+parser.add_argument('--pfcands',type=float,default=1500)
+parser.add_argument('--metscale',type=float,default=150)
+parser.add_argument('--ak8',action='store_true')
+parser.add_argument('--chs',action='store_true',help='fill chs instead of puppi fatjets')
+args = parser.parse_args()
+
+import ROOT as root
+from PandaCore.Tools.Load import Load
+root.gROOT.SetBatch()
+
+Load('PandaAnalyzer')
+
+gen = root.EventGenerator(args.seed)
+gen.nJets = args.jets
+gen.nFatjets = args.fatjets
+gen.nElectrons = args.electrons
+gen.nMuons = args.muons
+gen.nTaus = args.taus
+gen.nPhotons = args.photons
+gen.nGenParticles = args.genparticles
+gen.nPFCands = args.pfcands
+gen.metScale = args.metscale
+gen.ak8 = args.ak8
+gen.puppi = not args.chs
+
+exit(gen.Generate(args.output,args.events))
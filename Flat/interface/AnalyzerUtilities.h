@@ -9,12 +9,20 @@
 #include "PandaCore/Tools/interface/DataTools.h"
 #include "PandaCore/Tools/interface/JERReader.h"
 
+#include "PFCandCache.h"
+
+// ROOT
+#include "TTree.h"
+#include "TBranch.h"
+#include "TH1.h"
+
 // fastjet
 #include "fastjet/PseudoJet.hh"
 #include "fastjet/JetDefinition.hh"
 #include "fastjet/GhostedAreaSpec.hh"
 #include "fastjet/AreaDefinition.hh"
 #include "fastjet/ClusterSequenceArea.hh"
+#include "fastjet/ClusterSequenceActiveAreaExplicitGhosts.hh"
 #include "fastjet/contrib/SoftDrop.hh"
 #include "fastjet/contrib/MeasureDefinition.hh"
 
@@ -43,6 +51,24 @@ inline VPseudoJet ConvertPFCands(panda::RefVector<panda::PFCand> &incoll, bool p
   return ConvertPFCands(outcoll, puppi, minPt);
 }
 
+inline VPseudoJet ConvertPFCands(PFCandCache &cands, bool puppi, double minPt=0.001) {
+  if (puppi)
+    cands.BuildPuppi();
+  const double *px = puppi ? cands.pxW.data() : cands.px.data();
+  const double *py = puppi ? cands.pyW.data() : cands.py.data();
+  const double *pz = puppi ? cands.pzW.data() : cands.pz.data();
+  const double *e  = puppi ? cands.eW.data()  : cands.e.data();
+  const double *pt = puppi ? cands.ptW.data() : cands.pt.data();
+  VPseudoJet vpj;
+  vpj.reserve(cands.size());
+  for (unsigned iC=0; iC!=cands.size(); ++iC) {
+    if (pt[iC]<minPt)
+      continue;
+    vpj.emplace_back(px[iC],py[iC],pz[iC],e[iC]);
+  }
+  return vpj;
+}
+
 inline VPseudoJet ConvertPFCands(panda::PFCandCollection &incoll, bool puppi, double minPt=0.001) {
   std::vector<const panda::PFCand*> outcoll;
   outcoll.reserve(incoll.size());
@@ -54,6 +80,25 @@ inline VPseudoJet ConvertPFCands(panda::PFCandCollection &incoll, bool puppi, do
 
 ////////////////////////////////////////////////////////////////////////////////////
 
+// input branches that make up the named panda objects, e.g. "recoil" -> recoil.max, ...
+// these can be read on their own, before deciding whether to unpack the full event
+inline std::vector<TBranch*> GetObjectBranches(TTree *t, std::vector<TString> const& names) {
+  std::vector<TBranch*> branches;
+  TIter next(t->GetListOfBranches());
+  while (TBranch *b = (TBranch*)next()) {
+    TString bname(b->GetName());
+    for (auto &name : names) {
+      if (bname==name || bname.BeginsWith(name+".")) {
+        branches.push_back(b);
+        break;
+      }
+    }
+  }
+  return branches;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+
 inline double TTNLOToNNLO(double pt) {
     double a = 0.1102;
     double b = 0.1566;
@@ -99,10 +144,13 @@ public:
   bool puppi_jets = true;
   bool recluster = false;
   bool reclusterGen = false;
+  double reclusterCone = 0; // if >0, recluster only the PF candidates within this dR of fj1
   bool recoil = true;
+  bool reapplyJEC = false; // with rerunJES: re-correct the AK4 jets from rawPt, re-sort them and shift the puppi MET
   bool rerunJES = false;
   bool useCMVA = false;
   bool varyJES = false;
+  bool varyJESSources = false; // split JES variations by uncertainty source
   bool vbf = false;
 };
 
@@ -234,6 +282,144 @@ private:
 typedef THCorr<TH1D> THCorr1;
 typedef THCorr<TH2D> THCorr2;
 
+////////////////////////////////////////////////////////////////////////////////////
+// flat copy of a histogram axis, binned the same way as TAxis::FindBin:
+// arithmetically for uniform axes, by binary search over the edges otherwise
+class CorrAxis {
+public:
+  CorrAxis() {}
+  CorrAxis(const TAxis *axis) {
+    nBins = axis->GetNbins();
+    lo = axis->GetXmin();
+    hi = axis->GetXmax();
+    uniform = (axis->GetXbins()->GetSize()==0);
+    edges.resize(nBins+1);
+    for (int iB=0; iB<=nBins; ++iB)
+      edges[iB] = axis->GetBinLowEdge(iB+1);
+    loCenter = axis->GetBinCenter(1);
+    hiCenter = axis->GetBinCenter(nBins);
+  }
+  ~CorrAxis() {}
+
+  // 0-indexed bin of x, clamped to the first and last bin centers like THCorr
+  int FindBin(double x) const {
+    x = (x<loCenter) ? loCenter : ((x>hiCenter) ? hiCenter : x);
+    int iB;
+    if (uniform) {
+      iB = int(nBins*(x-lo)/(hi-lo));
+    } else {
+      const double *base = edges.data();
+      int n = nBins+1;
+      while (n>1) {
+        int half = n/2;
+        base = (base[half]<=x) ? base+half : base;
+        n -= half;
+      }
+      iB = base-edges.data();
+    }
+    return (iB<0) ? 0 : ((iB>=nBins) ? nBins-1 : iB);
+  }
+
+  int nBins=1;
+  double loCenter=0.5, hiCenter=0.5;
+
+private:
+  friend class CorrectionBundle;
+  bool uniform=true;
+  double lo=0, hi=1;
+  std::vector<double> edges = {0,1};
+};
+
+// contents and errors of a 1D or 2D histogram copied into one contiguous
+// array, so that lookups in the event loop need no ROOT (virtual) calls.
+// the histogram is only read at construction and is not owned
+class CorrTable {
+public:
+  CorrTable(const TH1 *h) {
+    dim = h->GetDimension();
+    xaxis = CorrAxis(h->GetXaxis());
+    if (dim>1)
+      yaxis = CorrAxis(h->GetYaxis());
+    bins.resize(xaxis.nBins*yaxis.nBins);
+    for (int iX=0; iX!=xaxis.nBins; ++iX) {
+      for (int iY=0; iY!=yaxis.nBins; ++iY) {
+        int hbin = (dim>1) ? h->GetBin(iX+1,iY+1) : iX+1;
+        bins[iX*yaxis.nBins+iY] = {h->GetBinContent(hbin),h->GetBinError(hbin)};
+      }
+    }
+  }
+  ~CorrTable() {}
+
+  double Eval(double x, double y=0) const { return bins[Index(x,y)].val; }
+  double Error(double x, double y=0) const { return bins[Index(x,y)].err; }
+  CorrAxis const& GetXaxis() const { return xaxis; }
+
+private:
+  friend class CorrectionBundle;
+  CorrTable() {} // filled by CorrectionBundle::Read
+  struct Bin {
+    double val, err;
+  };
+  int Index(double x, double y) const {
+    return (dim>1) ? xaxis.FindBin(x)*yaxis.nBins + yaxis.FindBin(y) : xaxis.FindBin(x);
+  }
+
+  int dim=1;
+  CorrAxis xaxis, yaxis;
+  std::vector<Bin> bins;
+};
+
+////////////////////////////////////////////////////////////////////////////////////
+// b-tag multiplicity probabilities P(k) in MC and data, for every SF shift at once.
+// candidates are folded in one at a time, P'(k) = P(k)*(1-p) + P(k-1)*p, so the
+// cost is linear in the number of candidates. shifts are in the order of 
+// GeneralTree::BTagShift: central, b/c up, b/c down, light up, light down
+class BTagWeightEngine {
+public:
+  static const unsigned nShifts = 5;
+  static const unsigned nTags = 3; //!< P(0), P(1), P(2) are kept exactly
+
+  BTagWeightEngine() { Reset(); }
+  ~BTagWeightEngine() {}
+  void Reset() {
+    nCands = 0;
+    for (unsigned iT=0; iT!=nTags; ++iT) {
+      pMC[iT] = (iT==0) ? 1 : 0;
+      for (unsigned iS=0; iS!=nShifts; ++iS)
+        pData[iS][iT] = pMC[iT];
+    }
+  }
+  // heavy (b/c) candidates move with the b/c shifts, the rest with the light ones
+  void AddCand(double eff, bool heavy, double sf, double sfUp, double sfDown) {
+    double sfs[nShifts] = {sf, 
+                           heavy ? sfUp : sf, heavy ? sfDown : sf,
+                           heavy ? sf : sfUp, heavy ? sf : sfDown};
+    Fold(pMC,eff);
+    for (unsigned iS=0; iS!=nShifts; ++iS)
+      Fold(pData[iS],eff*sfs[iS]);
+    ++nCands;
+  }
+  // data/MC ratio of P(exactly nTag tags); 1 if there are too few candidates
+  double SF(unsigned iS, unsigned nTag) const { 
+    return (nCands>0 && nCands>=nTag) ? pData[iS][nTag]/pMC[nTag] : 1; 
+  }
+  // data/MC ratio of P(at least one tag)
+  double SFGT0(unsigned iS) const {
+    return (nCands>0) ? (1-pData[iS][0])/(1-pMC[0]) : 1;
+  }
+
+private:
+  static void Fold(double *p, double prob) {
+    for (unsigned iT=nTags-1; iT!=0; --iT)
+      p[iT] = p[iT]*(1-prob) + p[iT-1]*prob;
+    p[0] *= (1-prob);
+  }
+
+  unsigned nCands;
+  double pMC[nTags];
+  double pData[nShifts][nTags];
+};
+
 ////////////////////////////////////////////////////////////////////////////////////
 
 namespace panda {
@@ -0,0 +1,41 @@
+#ifndef BDTBranchAdder_h
+#define BDTBranchAdder_h
+
+// STL
+#include <vector>
+
+// ROOT
+#include "TString.h"
+
+#include "BDTEngine.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// BDTBranchAdder: adds the response of a BDTEngine as a new branch to a tree
+// in an existing file. The interface follows TMVABranchAdder, so the skim
+// scripts only need to change the class name: inputs are tree formulae, in
+// the training order, and entries failing presel get defaultValue.
+// Entries are evaluated in blocks through the engine's batched call.
+class BDTBranchAdder {
+public :
+    BDTBranchAdder() { }
+    ~BDTBranchAdder() { }
+
+    void AddVariable(TString name, TString formula) { names.push_back(name); formulae.push_back(formula); }
+    void AddFormula(TString name, TString formula) { AddVariable(name,formula); }
+    void AddSpectator(TString name) { } //!< not needed to evaluate, kept for compatibility
+    bool BookMVA(TString branchName_, TString weightsPath);
+    bool RunFile(TString fpath);
+
+    TString treename = "events";
+    TString presel = "";
+    float defaultValue = -1;
+    unsigned blockSize = 1024;
+
+private:
+    BDTEngine engine;
+    bool booked=false; //!< the last BookMVA succeeded
+    TString branchName;
+    std::vector<TString> names, formulae;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef BDTEngine_h
+#define BDTEngine_h
+
+// STL
+#include <vector>
+
+// ROOT
+#include "TString.h"
+#include "TXMLEngine.h"
+#include "TMVA/Reader.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// BDTEngine: evaluates a TMVA BDT straight from its weights XML, without
+// a TMVA::Reader. All trees are stored in one flat node array, and inputs
+// are passed as plain float rows in the training variable order, so
+// several candidates can be evaluated in one call. The arithmetic follows
+// MethodBDT: float inputs are compared to float cuts, leaf values are
+// summed in double. Supported are Grad, AdaBoost (YesNoLeaf or purity)
+// and Bagging for classification, Grad and averaged forests for
+// regression, without input transformations; Load() refuses anything
+// else, so callers can fall back to TMVA.
+class BDTEngine {
+public :
+    BDTEngine() { }
+    ~BDTEngine() { }
+
+    bool Load(TString weightsPath);
+    bool loaded() const { return forest.size()>0; }
+    unsigned NVar() const { return variables.size(); }
+    std::vector<TString> const& Variables() const { return variables; } //!< TMVA expressions
+    bool IsRegression() const { return regression; }
+
+    // MVA value (classification) or target (regression) of one row of NVar() inputs
+    double Evaluate(const float *x) const;
+    // nRows rows, row i starts at x+i*NVar()
+    void Evaluate(const float *x, unsigned nRows, double *out) const;
+
+    // largest |engine - reader|/max(|reader|,1) over nPoints random points inside
+    // the training ranges; the reader must have this BDT booked as method, reading
+    // readerVars. Above kTolerance the engine should not be used
+    double Validate(TMVA::Reader &reader, float *readerVars, TString method,
+                    unsigned nPoints=1000) const;
+
+    static constexpr double kTolerance = 1e-5;
+
+private:
+    struct Node {
+      int var;         //!< input index, -1 for a leaf
+      float cut;
+      bool cutType;    //!< true: go right if x>=cut, false: go right if x<cut
+      unsigned left, right;
+      float value;     //!< leaf response, purity or node type, depending on the boost type
+    };
+    enum LeafValue {
+      kResponse,
+      kNodeType,
+      kPurity
+    };
+    enum Combination {
+      kSum,            //!< Grad: sum of leaf responses
+      kWeightedMean    //!< AdaBoost, Bagging: boost-weighted mean of leaf values
+    };
+
+    // appends the subtree under xmlNode, returns the index of its root or -1
+    int ReadNode(TXMLEngine &xml, XMLNodePointer_t xmlNode, LeafValue leafValue);
+
+    std::vector<Node> nodes;
+    std::vector<unsigned> forest;      //!< root node of each tree
+    std::vector<double> boostWeights;  //!< one per tree
+    std::vector<TString> variables;
+    std::vector<float> varMin, varMax; //!< training ranges, only used by Validate
+    Combination combination=kSum;
+    bool regression=false;
+    double offset=0;                   //!< added to a Grad regression
+    double sumBoostWeights=0;
+};
+
+#endif
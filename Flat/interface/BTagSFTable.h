@@ -0,0 +1,63 @@
+#ifndef BTagSFTable_h
+#define BTagSFTable_h
+
+// STL
+#include <vector>
+#include <string>
+
+#include "CondFormats/BTauObjects/interface/BTagEntry.h"
+#include "CondFormats/BTauObjects/interface/BTagCalibration.h"
+#include "CondTools/BTau/interface/BTagCalibrationReader.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// BTagSFTable: central/up/down b-tag SFs of one operating point, tabulated
+// from a BTagCalibrationReader so that the event loop does not evaluate
+// formula strings. For every flavour, the eta and pt bins of the payload
+// are read from the BTagCalibration entries; inside each (eta,pt) bin the
+// reader is sampled on a uniform pt grid and interpolated linearly, so
+// bin boundaries are reproduced exactly. Out-of-range pt is handled like
+// eval_auto_bounds: evaluated at the edge, with the uncertainty doubled.
+class BTagSFTable {
+public :
+    BTagSFTable() { }
+    ~BTagSFTable() { }
+
+    // tabulate one flavour; measurement is the payload's measurement type (e.g. "comb")
+    void Load(BTagCalibration const& calib, BTagCalibrationReader const& reader,
+              BTagEntry::OperatingPoint op, BTagEntry::JetFlavor jf, std::string measurement);
+    void Eval(BTagEntry::JetFlavor jf, double eta, double pt,
+              double &sf, double &sfUp, double &sfDown) const;
+    // largest |table - reader| over a grid of nEta x nPt points and the eta bin
+    // edges, over all loaded flavours; above tolerance the table should not be used
+    double Validate(BTagCalibrationReader const& reader, unsigned nEta=50, unsigned nPt=500) const;
+
+    double ptStep = 1;       //!< target spacing of the pt grid inside a bin
+    double tolerance = 1e-3; //!< largest |table - reader| Validate accepts
+
+private:
+    struct Node {
+      double sf, up, down;
+    };
+    struct PtBin {
+      double lo, hi, invStep;
+      unsigned first, n; //!< nodes[first,first+n) sample (lo,hi]
+    };
+    struct EtaBin {
+      double lo, hi;        //!< eta range
+      double ptMin, ptMax;  //!< reader's pt bounds for this eta
+      std::vector<double> ptEdges;
+      std::vector<PtBin> ptBins;
+    };
+    struct Flavor {
+      bool loaded=false;
+      bool absEta=false;
+      std::vector<EtaBin> etaBins;
+      std::vector<Node> nodes;
+    };
+
+    Node Interpolate(Flavor const& fl, EtaBin const& eb, double pt) const;
+
+    Flavor flavors[3]; //!< indexed by BTagEntry::JetFlavor
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef CorrectionBundle_h
+#define CorrectionBundle_h
+
+// STL
+#include <vector>
+#include <cstdint>
+
+// ROOT
+#include <TString.h>
+
+#include "AnalyzerUtilities.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// CorrectionBundle: all binned corrections of one Analysis configuration
+// packed into a single binary file, so that jobs can skip opening and
+// reading the individual ROOT files. The file is
+//   header : magic, format version, payload size, payload checksum
+//   payload: configuration key,
+//            source files with their size, mtime and checksum,
+//            (CorrectionType, CorrTable) pairs
+// and is read with mmap. Source files under dataDir are stored relative to
+// it and looked up under the dataDir of the reading job, so a bundle made
+// in one CMSSW area is valid in another (e.g. on the grid). A bundle is
+// rejected (and the caller is expected to fall back to the ROOT files) if
+// the version, checksum or configuration key do not match, or if the
+// contents of any source file differ from the ones it was made from. A
+// source is only hashed again if its mtime changed; a different size
+// rejects the bundle outright.
+class CorrectionBundle {
+public :
+    static const uint32_t version = 3;
+
+    static bool Write(TString path, TString configKey, TString dataDir, std::vector<TString> const& sources,
+                      std::vector<CorrTable*> const& tables);
+    // fills tables[ct] for every table in the bundle; tables is untouched on failure
+    static bool Read(TString path, TString configKey, TString dataDir, std::vector<CorrTable*> &tables);
+
+private:
+    static void WriteAxis(std::vector<char> &buf, CorrAxis const& axis);
+    static bool ReadAxis(const char *&p, const char *end, CorrAxis &axis);
+};
+
+#endif
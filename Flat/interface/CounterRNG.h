@@ -0,0 +1,78 @@
+#ifndef CounterRNG_h
+#define CounterRNG_h
+
+// STL
+#include <cmath>
+#include <cstdint>
+
+/////////////////////////////////////////////////////////////////////////////
+// CounterRNG: random numbers that only depend on what they are drawn for.
+// A stream is identified by (run, lumi, event, object index, purpose), and
+// its n-th block of four 32-bit words is Philox4x32-10 (Salmon et al., SC11)
+// of the counter (n, object|purpose<<24, run, lumi) under the key (event,
+// event>>32 + seed). Nothing is carried from one stream to the next, so a
+// draw does not depend on the order in which events are processed, on
+// which other events the job sees, or on the thread it runs in: split
+// jobs, threaded runs and reruns get bit-identical numbers. A block is ten
+// rounds of two 32x32 multiplications, cheaper than a TRandom3 draw.
+class CounterRNG {
+public :
+    // what a stream is used for; streams of the same object with different
+    // purposes are independent. Values must stay below 256
+    enum Purpose {
+      kFatjetJER=1,   //!< stochastic smearing of a fatjet
+      kSubjetJER,     //!< stochastic smearing of a subjet; object is fatjet<<8|subjet
+      kRochester,     //!< Rochester scale and smearing of a muon
+    };
+
+    class Stream {
+    public :
+      Stream(uint32_t k0, uint32_t k1, uint32_t c1, uint32_t c2, uint32_t c3) :
+        key{k0,k1}, ctr{0,c1,c2,c3} { }
+
+      // uniform in (0,1), never 0 or 1
+      double Uniform() {
+        if (used==4) {
+          CounterRNG::Philox(ctr,key,block);
+          ++ctr[0];
+          used = 0;
+        }
+        return (block[used++] + 0.5) * (1./4294967296.);
+      }
+      // Box-Muller; every call uses two uniforms
+      double Gaus(double mean=0, double sigma=1) {
+        double u1 = Uniform(), u2 = Uniform();
+        return mean + sigma * std::sqrt(-2*std::log(u1)) * std::cos(2*M_PI*u2);
+      }
+
+    private:
+      uint32_t key[2];
+      uint32_t ctr[4];
+      uint32_t block[4] = {0,0,0,0};
+      unsigned used = 4;
+    };
+
+    explicit CounterRNG(uint32_t seed_=3393) : seed(seed_) { }
+
+    Stream Get(uint32_t run, uint32_t lumi, uint64_t event, uint32_t object, Purpose purpose) const {
+      return Stream(uint32_t(event), uint32_t(event>>32)+seed,
+                    (object & 0xffffff) | (uint32_t(purpose)<<24), run, lumi);
+    }
+
+    // one block of Philox4x32-10
+    static void Philox(const uint32_t *ctr, const uint32_t *key, uint32_t *out) {
+      uint32_t c0=ctr[0], c1=ctr[1], c2=ctr[2], c3=ctr[3];
+      uint32_t k0=key[0], k1=key[1];
+      for (int iR=0; iR!=10; ++iR) {
+        uint64_t p0 = uint64_t(0xD2511F53)*c0, p1 = uint64_t(0xCD9E8D57)*c2;
+        uint32_t n0 = uint32_t(p1>>32)^c1^k0, n2 = uint32_t(p0>>32)^c3^k1;
+        c0 = n0; c1 = uint32_t(p1); c2 = n2; c3 = uint32_t(p0);
+        k0 += 0x9E3779B9; k1 += 0xBB67AE85;
+      }
+      out[0]=c0; out[1]=c1; out[2]=c2; out[3]=c3;
+    }
+
+    uint32_t seed;
+};
+
+#endif
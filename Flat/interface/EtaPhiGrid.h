@@ -0,0 +1,42 @@
+#ifndef EtaPhiGrid_h
+#define EtaPhiGrid_h
+
+// STL
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+// EtaPhiGrid: spatial index over the (eta,phi) positions of one collection,
+// so that "everything within dR of (eta,phi)" only looks at nearby cells
+// instead of scanning the whole collection. Objects are Add()-ed with their
+// index in the collection, then Finalize() sorts them into cells. Phi wraps
+// around; objects beyond +-etaMax are kept in the outermost cells, so no
+// object is ever missed. Query returns collection indices in increasing
+// order, i.e. the order a linear scan would have visited them in.
+class EtaPhiGrid {
+public :
+    EtaPhiGrid(double cellSize_=0.4, double etaMax_=5.);
+    ~EtaPhiGrid() { }
+
+    void Clear();
+    void Add(unsigned idx, double eta, double phi);
+    void Finalize();
+    // indices of the objects with DeltaR2 < dr2, in increasing order
+    void Query(double eta, double phi, double dr2, std::vector<unsigned> &out) const;
+    unsigned size() const { return items.size(); }
+
+private:
+    struct Item {
+      unsigned idx;
+      float eta, phi;
+    };
+    int EtaCell(double eta) const;
+    int PhiCell(double phi) const;
+
+    double cellSize, etaMax;
+    int nEta, nPhi;
+    std::vector<Item> staged;       //!< added since the last Finalize
+    std::vector<Item> items;        //!< sorted by cell
+    std::vector<unsigned> offsets;  //!< items of cell c are [offsets[c],offsets[c+1])
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef EventContext_h
+#define EventContext_h
+
+// STL
+#include "vector"
+#include "map"
+
+// ROOT
+#include <TTree.h>
+#include <TFile.h>
+#include <TRandom3.h>
+#include <TVector2.h>
+#include <TF1.h>
+
+#include "AnalyzerUtilities.h"
+#include "GeneralTree.h"
+#include "ModuleProfiler.h"
+#include "EtaPhiGrid.h"
+#include "GenDecayGraph.h"
+#include "PFCandCache.h"
+#include "FourVector.h"
+#include "JECEngine.h"
+#include "JetCorrector.h"
+
+// btag
+#include "CondTools/BTau/interface/BTagCalibrationReader.h"
+
+// JEC
+#include "CondFormats/JetMETObjects/interface/FactorizedJetCorrector.h"
+#include "CondFormats/JetMETObjects/interface/JetCorrectionUncertainty.h"
+
+// TMVA
+#include "TMVA/Reader.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// EventContext: everything PandaAnalyzer touches while processing one event.
+// The analyzer itself only holds configuration, so several contexts can
+// run at once over the same analyzer (see PandaAnalyzer::RunThreaded).
+class EventContext {
+public :
+    EventContext() { }
+    ~EventContext();
+    void Reset(); //!< clear the state passed between modules
+
+    //////////////////////////////////////////////////////////////////////////////////////
+
+    // IO, not owned by the context
+    panda::Event event;
+    GeneralTree *gt = 0;
+    TimeReporter *tr = 0;
+    TTree *tIn = 0;
+    TTree *tOut = 0;
+    TFile *fOut = 0;
+    std::vector<TBranch*> preselBranches; //!< read ahead of the full event to preselect
+    ModuleProfiler *profiler = 0; //!< owned; only set when profiling
+
+    //////////////////////////////////////////////////////////////////////////////////////
+
+    // tools that change state on every evaluation, one copy per context
+    std::vector<BTagCalibrationReader*> btagReaders;
+        //!< maps PandaAnalyzer::BTagType to a reader
+    std::map<TString,JetCorrectionUncertainty*> ak8UncReader; //!< calculate JES unc on the fly
+    JERReader *ak8JERReader{0}; //!< fatjet jet energy resolution reader
+    std::map<TString,JetCorrectionUncertainty*> ak4UncReader; //!< calculate JES unc on the fly
+    std::map<TString,FactorizedJetCorrector*> ak4ScaleReader; //!< calculate JES on the fly
+    JERReader *ak4JERReader{0}; //!< fatjet jet energy resolution reader
+    JetCorrectionUncertainty *uncReader=0;
+    JetCorrectionUncertainty *uncReaderAK4=0;
+    FactorizedJetCorrector *scaleReaderAK4=0;
+    const JECEngine *jecEngineAK4=0; //!< not owned; if set, used instead of scaleReaderAK4
+    std::vector<JetCorrectionUncertainty*> jesSourceReaders; //!< one per GeneralTree::jesSources, if the table fails
+    JetCorrector *jetCorrector=0; //!< re-corrects the AK4 jets in place, with the shared engines
+    TMVA::Reader *bjetreg_reader = 0;
+    float *bjetreg_vars = 0;
+    // clones of the analyzer's TF1 corrections: TF1::Eval writes into the
+    // function, so contexts cannot share them
+    std::vector<TF1*> f1Corrs; //!< maps CorrectionType to a TF1, or 0
+    TF1 *puppisd_corrGEN=0, *puppisd_corrRECO_cen=0, *puppisd_corrRECO_for=0;
+    unsigned int nReclusterChecked=0, nReclusterDiffer=0; //!< PandaAnalyzer::validateRecluster
+
+    //////////////////////////////////////////////////////////////////////////////////////
+
+    // stuff for matching objects
+    std::map<panda::GenParticle const*,float> genObjects;
+        //!< particles we want to match the jets to, and the 'size' of the daughters
+    std::vector<panda::Particle*> matchPhos, matchEles, matchLeps;
+    // spatial indices over the gen collections, built once per MC event after getEntry
+    EtaPhiGrid genGrid;      //!< all gen particles
+    EtaPhiGrid finalGrid;    //!< final-state gen particles
+    EtaPhiGrid partonGrid;   //!< udscb quarks and gluons
+    EtaPhiGrid genJetGrid;   //!< ak4GenJets
+    GenDecayGraph genGraph;  //!< parent/daughter links of genParticles
+    void BuildGenIndex();
+
+    // stuff that gets passed between modules
+    std::vector<panda::Lepton*> looseLeps, tightLeps;
+    std::vector<panda::Photon*> loosePhos;
+    FourVector vPFMET, vPuppiMET;
+    TVector2 vMETNoMu;
+    FourVector vpfUW, vpfUZ, vpfUA, vpfU;
+    FourVector vpuppiUW, vpuppiUZ, vpuppiUA, vpuppiU;
+    panda::FatJet *fj1 = 0;
+    std::vector<panda::Jet*> cleanedJets, isoJets, btaggedJets, centralJets;
+    std::vector<int> btagindices;
+    FourVector vJet, vBarrelJets;
+    panda::FatJetCollection *fatjets = 0;
+    panda::JetCollection *jets = 0;
+    panda::Jet *jot1 = 0, *jot2 = 0;
+    panda::Jet *jotUp1 = 0, *jotUp2 = 0;
+    panda::Jet *jotDown1 = 0, *jotDown2 = 0;
+    panda::Jet *jetUp1 = 0, *jetUp2 = 0;
+    panda::Jet *jetDown1 = 0, *jetDown2 = 0;
+    std::vector<panda::Jet*> jesSourceJets; //!< cleaned jets of any pt, varied per JES source
+    std::vector<panda::GenJet> genJetsNu;
+    // PF candidates unpacked into arrays; built by the first module that asks in each event
+    PFCandCache pfCands;
+    PFCandCache &PFCands() {
+      if (!pfCands.built())
+        pfCands.Build(event.pfCandidates);
+      return pfCands;
+    }
+    int looseLep1PdgId, looseLep2PdgId;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef EventGenerator_h
+#define EventGenerator_h
+
+// STL
+#include "vector"
+
+// ROOT
+#include <TString.h>
+#include <TRandom3.h>
+
+// PandaProd Objects
+#include "PandaTree/Objects/interface/Event.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// EventGenerator: writes a panda-format events tree and hSumW histogram
+// with made-up content, so the analyzers can be run and benchmarked
+// without staging real ntuples. Nothing here is physics: kinematics
+// follow simple falling spectra, and a fraction of the PF candidates is
+// sprayed around the jet axes so reclustering finds something.
+// Only MC is generated, because data would need a trigger menu.
+class EventGenerator {
+public :
+    EventGenerator(unsigned seed=3393);
+    ~EventGenerator() { }
+    int Generate(TString outPath, unsigned nEvents);
+
+    // mean multiplicities per event, drawn from a Poisson
+    double nJets = 6;
+    double nFatjets = 1.2;
+    double nElectrons = 0.4;
+    double nMuons = 0.4;
+    double nTaus = 0.3;
+    double nPhotons = 0.4;
+    double nGenParticles = 40;
+    double nPFCands = 1500;
+    double fracPFInJets = 0.4;  //!< fraction of PF candidates placed around jet axes
+    double metScale = 150;      //!< slope of the MET spectrum; sets how many events pass recoil>175
+    bool ak8 = false;           //!< fill AK8 instead of CA15 fatjets
+    bool puppi = true;          //!< fill puppi instead of chs fatjets
+
+private:
+    void FillEvent(panda::Event &event, unsigned iE);
+    double FallingPt(double ptMin, double slope) { return ptMin + rng.Exp(slope); }
+
+    TRandom3 rng;
+    std::vector<double> axisEta, axisPhi; //!< jet axes of the current event
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef FourVector_h
+#define FourVector_h
+
+// STL
+#include <cmath>
+
+/////////////////////////////////////////////////////////////////////////////
+// FourVector: a plain (px,py,pz,E) value type for the places where a
+// TLorentzVector was only built to take a sum, a pt, a mass or a delta-phi.
+// It is not a TObject, has no virtual functions, and everything is inlined;
+// sums and scalings are constexpr. The interface is the subset of
+// TLorentzVector the analyzers use, and every setter and getter evaluates
+// the same double-precision expression as TLorentzVector, so switching
+// between the two does not change any output.
+class FourVector {
+public :
+    constexpr FourVector() : fX(0), fY(0), fZ(0), fE(0) { }
+    constexpr FourVector(double px, double py, double pz, double e) : fX(px), fY(py), fZ(pz), fE(e) { }
+
+    static FourVector PtEtaPhiM(double pt, double eta, double phi, double m) {
+      FourVector v; v.SetPtEtaPhiM(pt,eta,phi,m); return v;
+    }
+    static FourVector PtEtaPhiE(double pt, double eta, double phi, double e) {
+      FourVector v; v.SetPtEtaPhiE(pt,eta,phi,e); return v;
+    }
+
+    void SetPxPyPzE(double px, double py, double pz, double e) {
+      fX = px; fY = py; fZ = pz; fE = e;
+    }
+    void SetXYZM(double x, double y, double z, double m) {
+      double p2 = x*x+y*y+z*z;
+      SetPxPyPzE(x,y,z,(m>=0) ? std::sqrt(p2+m*m) : std::sqrt(std::fmax(p2-m*m,0.)));
+    }
+    void SetPtEtaPhiM(double pt, double eta, double phi, double m) {
+      pt = std::fabs(pt);
+      SetXYZM(pt*std::cos(phi),pt*std::sin(phi),pt*std::sinh(eta),m);
+    }
+    void SetPtEtaPhiE(double pt, double eta, double phi, double e) {
+      pt = std::fabs(pt);
+      SetPxPyPzE(pt*std::cos(phi),pt*std::sin(phi),pt*std::sinh(eta),e);
+    }
+
+    constexpr double Px() const { return fX; }
+    constexpr double Py() const { return fY; }
+    constexpr double Pz() const { return fZ; }
+    constexpr double E() const { return fE; }
+
+    constexpr double Perp2() const { return fX*fX+fY*fY; }
+    constexpr double P2() const { return fX*fX+fY*fY+fZ*fZ; }
+    constexpr double M2() const { return fE*fE-P2(); }
+    double Pt() const { return std::sqrt(Perp2()); }
+    double P() const { return std::sqrt(P2()); }
+    double M() const {
+      double mm = M2();
+      return (mm<0) ? -std::sqrt(-mm) : std::sqrt(mm);
+    }
+    double Phi() const { return (fX==0 && fY==0) ? 0 : std::atan2(fY,fX); }
+    double Eta() const {
+      double p = P();
+      double cosTheta = (p==0) ? 1 : fZ/p;
+      if (cosTheta*cosTheta<1)
+        return -0.5*std::log((1.0-cosTheta)/(1.0+cosTheta));
+      if (fZ==0)
+        return 0;
+      return (fZ>0) ? 10e10 : -10e10; // as TVector3::PseudoRapidity
+    }
+    double Rapidity() const { return 0.5*std::log((fE+fZ)/(fE-fZ)); }
+
+    // in [-pi,pi)
+    double DeltaPhi(FourVector const& v) const { return PhiMPiPi(Phi()-v.Phi()); }
+    double DeltaR2(FourVector const& v) const {
+      double dEta = Eta()-v.Eta(), dPhi = DeltaPhi(v);
+      return dEta*dEta+dPhi*dPhi;
+    }
+
+    constexpr FourVector operator+(FourVector const& v) const {
+      return FourVector(fX+v.fX,fY+v.fY,fZ+v.fZ,fE+v.fE);
+    }
+    constexpr FourVector operator-(FourVector const& v) const {
+      return FourVector(fX-v.fX,fY-v.fY,fZ-v.fZ,fE-v.fE);
+    }
+    FourVector& operator+=(FourVector const& v) {
+      fX += v.fX; fY += v.fY; fZ += v.fZ; fE += v.fE;
+      return *this;
+    }
+    constexpr FourVector operator*(double a) const { return FourVector(a*fX,a*fY,a*fZ,a*fE); }
+
+    static double PhiMPiPi(double x) {
+      if (std::isnan(x))
+        return x;
+      while (x >= M_PI) x -= 2*M_PI;
+      while (x < -M_PI) x += 2*M_PI;
+      return x;
+    }
+
+private:
+    double fX, fY, fZ, fE;
+};
+
+inline constexpr FourVector operator*(double a, FourVector const& v) { return v*a; }
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef GenDecayGraph_h
+#define GenDecayGraph_h
+
+// STL
+#include <vector>
+
+#include "PandaTree/Objects/interface/Event.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// GenDecayGraph: parent/daughter structure of the gen particle collection,
+// built once per event so that decay-chain questions do not need a scan of
+// the whole collection per particle. panda only stores the parent of each
+// particle; Build() inverts that into per-particle daughter lists (CSR, in
+// increasing index order, i.e. the order a linear scan would visit them)
+// and links every particle to the first and last copy of its chain, where
+// a copy is a daughter with the same pdgid.
+class GenDecayGraph {
+public :
+    // [begin,end) over the indices of the daughters of one particle
+    struct Range {
+      const unsigned *b, *e;
+      const unsigned *begin() const { return b; }
+      const unsigned *end() const { return e; }
+      unsigned size() const { return e-b; }
+    };
+
+    GenDecayGraph() { }
+    ~GenDecayGraph() { }
+
+    void Clear();
+    void Build(panda::GenParticleCollection const& gens);
+
+    unsigned size() const { return parents.size(); }
+    // entry of a Ref into the collection the graph was built from, -1 if the
+    // Ref is null or its index is out of range
+    int Index(panda::Ref<panda::GenParticle> const& ref) const;
+    int Parent(unsigned i) const { return parents[i]; } //!< -1 if there is none
+    Range Daughters(unsigned i) const {
+      return {children.data()+offsets[i], children.data()+offsets[i+1]};
+    }
+    bool IsLastCopy(unsigned i) const { return lastCopies[i]==(int)i; }
+    unsigned LastCopy(unsigned i) const { return lastCopies[i]; }
+    unsigned FirstCopy(unsigned i) const { return firstCopies[i]; }
+    // true if ancestor is reached by following parents up from i (i itself excluded);
+    // answers are cached for the most recent ancestor
+    bool IsDescendantOf(unsigned i, unsigned ancestor) const;
+
+private:
+    std::vector<int> pdgids;
+    std::vector<int> parents;
+    std::vector<unsigned> offsets;     //!< daughters of i are children[offsets[i],offsets[i+1])
+    std::vector<unsigned> children;
+    std::vector<int> lastCopies;
+    std::vector<int> firstCopies;
+
+    // memo for IsDescendantOf: 0 = unknown, 1 = yes, 2 = no
+    mutable int memoAncestor=-1;
+    mutable std::vector<char> memo;
+    mutable std::vector<unsigned> path;
+};
+
+#endif
@@ -34,6 +34,13 @@ class GeneralTree : public genericTree {
         }
       };
 
+      // fj1ECFNs is a flat array, ecfIndex(order,N,ibeta) is the slot of one ECF
+      static constexpr int nECFOrders=3, nECFNs=4, nECFBetas=4;
+      static constexpr int nECF=nECFOrders*nECFNs*nECFBetas;
+      static constexpr int ecfIndex(int order, int N, int ibeta) {
+        return ((order-1)*nECFNs + (N-1))*nECFBetas + ibeta;
+      }
+
       enum BTagShift {
         bCent=0,
         bBUp,
@@ -110,6 +117,10 @@ class GeneralTree : public genericTree {
         csvCErr2up,
         csvCErr2down
       };
+
+      // JES uncertainty sources, in the order of the *JESUp/*JESDown arrays
+      static constexpr int nJESSources=25;
+      static const char *const jesSources[nJESSources];
         
     private:
         std::vector<double> betas = {0.5, 1.0, 2.0, 4.0};
@@ -196,10 +207,10 @@ class GeneralTree : public genericTree {
         
       // public config
       bool monohiggs=false, vbf=false, fatjet=true, leptonic=false, hfCounting=false;
-      bool btagWeights=false, useCMVA=false;
+      bool btagWeights=false, useCMVA=false, varyJESSources=false;
 
 //STARTCUSTOMDEF
-      std::map<ECFParams,float> fj1ECFNs;
+      float fj1ECFNs[nECF];
       std::map<BTagParams,float> sf_btags;
       std::map<BTagParams,float> sf_alt_btags;
       std::map<TString,float> signal_weights;
@@ -239,6 +250,16 @@ class GeneralTree : public genericTree {
       float jetRegFac[2];
 
       float scale[6];
+
+      // one entry per JES source, see jesSources
+      float jot1PtJESUp[nJESSources];
+      float jot1PtJESDown[nJESSources];
+      float jot12MassJESUp[nJESSources];
+      float jot12MassJESDown[nJESSources];
+      float pfUmagJESUp[nJESSources];
+      float pfUmagJESDown[nJESSources];
+      float fj1PtJESUp_sj[nJESSources];
+      float fj1PtJESDown_sj[nJESSources];
       
       float muonPt[NLEP];
       float muonEta[NLEP];
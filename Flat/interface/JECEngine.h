@@ -0,0 +1,100 @@
+#ifndef JECEngine_h
+#define JECEngine_h
+
+// STL
+#include <vector>
+#include <string>
+
+// ROOT
+#include "TString.h"
+
+#include "CondFormats/JetMETObjects/interface/FactorizedJetCorrector.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// JECEngine: applies a chain of jet energy corrections (L1FastJet,
+// L2Relative, ...) read from the standard text files, to a whole jet
+// collection per call. Each level keeps its bins in flat arrays and its
+// formula compiled once into a small stack program, which is run on a
+// block of jets at a time, so there is no TFormula and no setter chain per
+// jet. The arithmetic follows FactorizedJetCorrector: float inputs,
+// parameter variables clamped to the bin ranges, the formula evaluated in
+// double and returned as float, and the jet pt and energy multiplied by it
+// after every level. Overlapping bins are resolved in the order of their
+// lower edges, as JetCorrectorParameters sorts its records. Load() refuses
+// files it cannot reproduce (response levels, unknown variables or
+// functions), so callers can fall back to CMSSW.
+class JECEngine {
+public :
+    JECEngine() { }
+    ~JECEngine() { }
+
+    // one file per level, applied in the given order
+    bool Load(std::vector<TString> const& paths);
+    bool loaded() const { return levels.size()>0; }
+    unsigned NLevels() const { return levels.size(); }
+
+    // total correction of nJets jets from their raw pt, eta, phi, E and area
+    void Correct(unsigned nJets, const float *pt, const float *eta, const float *phi,
+                 const float *e, const float *area, float rho, float *factor) const;
+    float Correct(float pt, float eta, float phi, float e, float area, float rho) const;
+
+    // largest relative |engine - corrector| over nPoints random jets; the
+    // corrector must be built from the same files. Above kTolerance the
+    // engine should not be used
+    double Validate(FactorizedJetCorrector &corrector, unsigned nPoints=10000) const;
+
+    static const unsigned kBlock = 64;    //!< jets that go through a formula together
+    static constexpr double kTolerance = 1e-6;
+
+private:
+    enum Var {
+      kJetEta=0,
+      kJetPt,
+      kJetPhi,
+      kJetE,
+      kJetA,
+      kRho,
+      kJetEMF,
+      kNVar
+    };
+    enum OpCode {
+      kConst,   //!< push value
+      kX,       //!< push parameter variable arg (x,y,z,t)
+      kParam,   //!< push formula parameter [arg]
+      kAdd, kSub, kMul, kDiv, kPow, kMax, kMin,
+      kNeg, kExp, kLog, kLog10, kSqrt, kAbs, kErf
+    };
+    struct Op {
+      OpCode code;
+      int arg;
+      double value;
+    };
+    struct Level {
+      TString name;
+      std::vector<int> binVars, parVars;   //!< Var of each bin and parameter variable
+      std::vector<float> binMin, binMax;   //!< [record*nBinVar+i]
+      std::vector<float> parMin, parMax;   //!< [record*nParVar+i]
+      std::vector<double> params;          //!< [record*nParams+k]; records sorted by binMin[record*nBinVar]
+      unsigned nRecords=0, nParams=0;
+      bool disjoint=false;                 //!< one bin variable and no overlaps: binary search
+      std::vector<Op> program;             //!< formula in reverse polish notation
+    };
+
+    bool LoadLevel(TString path, Level &level);
+    int FindBin(Level const& level, const float *x) const;
+
+    // recursive descent over the formula string, appending to prog
+    bool Compile(std::string const& formula, std::vector<Op> &prog) const;
+    bool ParseSum(const char *&s, std::vector<Op> &prog) const;
+    bool ParseProduct(const char *&s, std::vector<Op> &prog) const;
+    bool ParseUnary(const char *&s, std::vector<Op> &prog) const;
+    bool ParsePrimary(const char *&s, std::vector<Op> &prog) const;
+
+    // corrects n<=kBlock jets; vars are per-jet inputs, updated level by level
+    void CorrectBlock(unsigned n, float vars[][kBlock], float *factor) const;
+
+    std::vector<Level> levels;
+    static const unsigned kMaxStack = 16;
+};
+
+#endif
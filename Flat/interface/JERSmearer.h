@@ -0,0 +1,55 @@
+#ifndef JERSmearer_h
+#define JERSmearer_h
+
+// STL
+#include <vector>
+
+// ROOT
+#include "TString.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// JERSmearer: stochastic jet energy resolution smearing from a
+// JetResolution pt resolution file and its scale factor file, like
+// JERReader::getStochasticSmear, except that the Gaussian number is passed
+// in instead of being drawn from the reader's own generator. With the draw
+// coming from a CounterRNG stream, the smearing of a jet is fixed by the
+// jet, not by how many jets were smeared before it. The resolution records
+// are binned in eta and rho, the first record containing the jet is used,
+// and pt is clamped to the record's range, as in JetResolutionObject. Load()
+// refuses resolution files with any formula other than the standard
+// sqrt([0]*abs([0])/(x*x)+[1]*[1]*pow(x,[3])+[2]*[2]).
+class JERSmearer {
+public :
+    JERSmearer() { }
+    ~JERSmearer() { }
+
+    bool Load(TString sfPath, TString resPath);
+    bool loaded() const { return resRecords.size()>0 && sfRecords.size()>0; }
+
+    // relative pt resolution; 0 if no record contains the jet
+    double Resolution(double pt, double eta, double rho) const;
+    // nominal, up and down data/MC resolution scale factors; 1 outside the eta bins
+    void ScaleFactors(double eta, double &sf, double &sfUp, double &sfDown) const;
+    // smear = 1 + gaus*resolution*sqrt(max(sf^2-1,0)), with gaus drawn from N(0,1);
+    // up and down use the same draw
+    void GetStochasticSmear(double pt, double eta, double rho, double gaus,
+                            double &smear, double &smearUp, double &smearDown) const;
+
+private:
+    struct ResRecord {
+      float etaMin, etaMax, rhoMin, rhoMax, ptMin, ptMax;
+      float par[4];
+    };
+    struct SFRecord {
+      float etaMin, etaMax;
+      float sf, sfDown, sfUp; //!< order of the file
+    };
+
+    bool ReadResolution(TString path);
+    bool ReadScaleFactors(TString path);
+
+    std::vector<ResRecord> resRecords; //!< in file order
+    std::vector<SFRecord> sfRecords;   //!< in file order
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef JESSourceTable_h
+#define JESSourceTable_h
+
+// STL
+#include <vector>
+#include <string>
+
+// ROOT
+#include "TString.h"
+
+#include "CondFormats/JetMETObjects/interface/JetCorrectionUncertainty.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// JESSourceTable: relative JES uncertainties of a list of sources from one
+// UncertaintySources text file, evaluated for all sources at once. The
+// sections of such a file share their eta bins and pt nodes, so the table
+// keeps one eta axis and one pt grid per eta bin, with the values of all
+// sources stored next to each other at every node: a jet costs one eta and
+// one pt search, however many sources are loaded. The arithmetic follows
+// SimpleJetCorrectionUncertainty: float linear interpolation in pt,
+// clamped to the first and last node. Load() refuses files whose sources
+// do not share a grid.
+class JESSourceTable {
+public :
+    JESSourceTable() { }
+    ~JESSourceTable() { }
+
+    // sources are section names, e.g. "AbsoluteStat"; the order is kept
+    bool Load(TString path, std::vector<TString> const& sources);
+    bool loaded() const { return nSources>0; }
+    unsigned NSources() const { return nSources; }
+    std::vector<TString> const& Sources() const { return sourceNames; }
+
+    // relative uncertainties of nJets jets at their corrected pt, written to
+    // up[iJet*NSources()+iSource] and down[...]; jets outside the eta bins get 0
+    void Evaluate(unsigned nJets, const float *pt, const float *eta, float *up, float *down) const;
+
+    // largest |table - reader| of one source over nPoints random jets; the
+    // reader must be built from the same file and section. Above kTolerance
+    // the table should not be used
+    double Validate(JetCorrectionUncertainty &reader, unsigned iSource, unsigned nPoints=10000) const;
+
+    static constexpr double kTolerance = 1e-6; //!< absolute, the uncertainties are O(1%)
+
+private:
+    struct EtaBin {
+      float lo, hi;
+      unsigned first, n;  //!< pt nodes [first,first+n)
+    };
+    struct Section {
+      std::vector<float> etaLo, etaHi;
+      std::vector<std::vector<float>> pt, up, down; //!< per record
+    };
+
+    bool ReadSections(TString path, std::vector<TString> const& sources, std::vector<Section> &sections) const;
+    int FindEtaBin(float eta) const;
+
+    std::vector<TString> sourceNames;
+    unsigned nSources=0;
+    std::vector<EtaBin> etaBins;    //!< sorted, not overlapping
+    std::vector<float> ptNodes;     //!< [node]
+    std::vector<float> upValues;    //!< [node*nSources+iSource]
+    std::vector<float> downValues;  //!< [node*nSources+iSource]
+};
+
+#endif
@@ -5,15 +5,22 @@
 #include "PandaCore/Tools/interface/DataTools.h"
 #include <map>
 #include <string>
+#include <vector>
 #include "TString.h"
 #include "PandaTree/Objects/interface/Jet.h"
 #include "PandaTree/Objects/interface/Met.h"
 #include "CondFormats/JetMETObjects/interface/JetCorrectorParameters.h"
 #include "CondFormats/JetMETObjects/interface/FactorizedJetCorrector.h"
+#include "JECEngine.h"
 
 /**
- * \brief Corrects a jet collection and optionally propagates to Met 
+ * \brief Corrects a jet collection and optionally propagates to Met
  *
+ * Jets are corrected from their rawPt. The output either goes to a
+ * collection the caller owns and reuses, or back into the input
+ * collection, so no event allocates. The Met is shifted by the change of
+ * every jet's pt (type-1). The corrector for data is looked up once per
+ * run.
  */
 class JetCorrector
 {
@@ -21,20 +28,54 @@ public:
 	JetCorrector();
 	~JetCorrector();
 
+	// fills outjets_ (cleared first) with the corrected injets_; if rawmet_ is given,
+	// outmet_ gets rawmet_ shifted by the difference of raw and corrected jets
+	void RunCorrection(bool isData, float rho, panda::JetCollection const& injets_, panda::JetCollection &outjets_,
+	                   panda::Met const* rawmet_=0, panda::Met *outmet_=0, int runNumber=0);
+	// corrects jets_ in place; met_ is shifted by the difference of old and new jets
+	void CorrectInPlace(bool isData, float rho, panda::JetCollection &jets_, panda::Met *met_=0, int runNumber=0);
+
+	// as above, into a collection and Met owned by the JetCorrector, which
+	// GetCorrectedJets/GetCorrectedMet return; they are reused by the next call
 	void RunCorrection(bool isData, float rho, panda::JetCollection *injets_, panda::Met *rawmet_=0, int runNumber = 0);
 	panda::JetCollection *GetCorrectedJets();
 	panda::Met *GetCorrectedMet();
 
 	void SetMCCorrector(TString fpath);
 	void SetDataCorrector(TString fpath, TString iov = "all");
+	// use an engine loaded elsewhere; it is not deleted here
+	void SetMCCorrector(JECEngine const* engine);
+	void SetDataCorrector(JECEngine const* engine, TString iov = "all");
+
+	bool validate = false; // compare the JECEngine to FactorizedJetCorrector when it is loaded
 
 private:
-		FactorizedJetCorrector *mMCJetCorrector;	 
+		// loads the engine, and the CMSSW corrector if the engine fails or to validate it
+		void LoadCorrector(TString fpath, JECEngine const*&engine, FactorizedJetCorrector *&corrector);
+		// picks the engine or corrector for this event; false if there is none
+		bool SelectCorrector(bool isData, int runNumber);
+		// fills mFactors for all jets
+		void ComputeFactors(float rho, panda::JetCollection const& jets);
+
+		FactorizedJetCorrector *mMCJetCorrector = 0;
 		std::map<TString,FactorizedJetCorrector *> mDataJetCorrectors;	// map from era to corrector
+		JECEngine const* mMCEngine = 0;
+		std::map<TString,JECEngine const*> mDataEngines;	// map from era to engine; 0 => use the corrector
+		std::vector<JECEngine*> mOwnedEngines;	// the ones loaded here
+
+		// selection of the last event, reused while the run does not change
+		bool mSelected = false;
+		bool mSelectedData = false;
+		int mSelectedRun = 0;
+		JECEngine const* mEngine = 0;
+		FactorizedJetCorrector *mCorrector = 0;
+
+		// per-jet scratch, kept between calls
+		std::vector<float> mPt, mEta, mPhi, mE, mArea, mFactors;
 
 		panda::JetCollection *outjets = 0;
 		panda::Met *outmet = 0;
 
-		EraHandler *era = 0;	
+		EraHandler *era = 0;
 };
 #endif
@@ -0,0 +1,51 @@
+#ifndef ModuleProfiler_h
+#define ModuleProfiler_h
+
+// STL
+#include "vector"
+#include <chrono>
+
+// ROOT
+#include <TString.h>
+
+/////////////////////////////////////////////////////////////////////////////
+// ModuleProfiler: wall time spent in each step of the event loop.
+// The event loop calls Lap(i) after step i, which charges the time since
+// the previous lap to that step. Steps are the module plan, preceded by
+// reading the input. Only a clock read and a few adds happen per lap, so
+// this can stay on in production jobs.
+class ModuleProfiler {
+public :
+    ModuleProfiler(std::vector<TString> steps_);
+    ~ModuleProfiler() { }
+
+    void StartEvent() { ++nEvents; last = Clock::now(); }
+    void Skip() { last = Clock::now(); } //!< drop the time since the last lap
+    void Lap(unsigned iS) {
+      auto now = Clock::now();
+      Record(iS, std::chrono::duration<double>(now-last).count());
+      last = now;
+    }
+
+    void Add(const ModuleProfiler &other);             //!< merge another thread's profile
+    void WriteJSON(TString fpath, double wallTime) const; //!< sidecar for offline comparisons
+
+    static const unsigned kRead = 0; //!< step for panda::Event::getEntry
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    void Record(unsigned iS, double dt);
+
+    // time distributions are binned in log10(t/s)
+    static constexpr double histMin = -7, histMax = 1;
+    static const unsigned histBins = 64;
+
+    std::vector<TString> steps;
+    std::vector<unsigned long> calls;
+    std::vector<double> totals;
+    std::vector<std::vector<unsigned long>> hists;
+    unsigned long nEvents = 0;
+    Clock::time_point last;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef PFCandCache_h
+#define PFCandCache_h
+
+// STL
+#include <vector>
+
+#include "PandaTree/Objects/interface/Event.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// PFCandCache: the event's PF candidates unpacked once into contiguous
+// arrays (structure of arrays), so that the modules that loop over all of
+// them do not each go through the panda accessors and build their own
+// TLorentzVectors or pointer copies. Entry i is event.pfCandidates[i].
+// Everything is kept in double, as the panda accessors return it, so the
+// reclustering and the jet inputs see the same numbers as before. The
+// puppi-weighted four-momenta are only computed if somebody asks.
+class PFCandCache {
+public :
+    PFCandCache() { }
+    ~PFCandCache() { }
+
+    void Clear();
+    void Build(panda::PFCandCollection const& cands);
+    bool built() const { return isBuilt; }
+    unsigned size() const { return pt.size(); }
+    // entry of a Ref into the collection the cache was built from, -1 if the
+    // Ref is null or its index is out of range
+    int Index(panda::Ref<panda::PFCand> const& ref) const;
+
+    // one entry per candidate
+    std::vector<double> px, py, pz, e;
+    std::vector<double> pt, eta, phi, et;
+    std::vector<double> puppiW;
+    std::vector<int> charge, pdgId;
+
+    // puppiW-scaled px, py, pz, e, pt; filled on the first call
+    void BuildPuppi();
+    std::vector<double> pxW, pyW, pzW, eW, ptW;
+
+    // sums over all candidates, written so that the compiler can vectorize them
+    double SumEt() const;
+    double SumPuppiEt() const;
+
+private:
+    bool isBuilt=false, isPuppiBuilt=false;
+};
+
+#endif
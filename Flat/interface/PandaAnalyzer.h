@@ -6,6 +6,7 @@
 #include "map"
 #include <string>
 #include <cmath>
+#include <atomic>
 
 // ROOT
 #include <TTree.h>
@@ -17,7 +18,10 @@
 #include <TLorentzVector.h>
 
 #include "AnalyzerUtilities.h"
+#include "CorrectionBundle.h"
+#include "BTagSFTable.h"
 #include "GeneralTree.h"
+#include "EventContext.h"
 
 // btag
 #include "CondFormats/BTauObjects/interface/BTagEntry.h"
@@ -29,11 +33,16 @@
 #include "CondFormats/JetMETObjects/interface/JetCorrectorParameters.h"
 #include "CondFormats/JetMETObjects/interface/FactorizedJetCorrector.h"
 #include "CondFormats/JetMETObjects/interface/JetCorrectionUncertainty.h"
+#include "JECEngine.h"
+#include "JESSourceTable.h"
+#include "JERSmearer.h"
+#include "CounterRNG.h"
 #include "PandaAnalysis/Utilities/interface/RoccoR.h"
 #include "PandaAnalysis/Utilities/interface/CSVHelper.h"
 
 // TMVA
 #include "TMVA/Reader.h"
+#include "BDTEngine.h"
 
 /////////////////////////////////////////////////////////////////////////////
 // some misc definitions
@@ -82,7 +91,6 @@ public :
     ~PandaAnalyzer();
     int Init(TTree *tree, TH1D *hweights, TTree *weightNames=0);
     void SetOutputFile(TString fOutName);
-    void ResetBranches();
     void Run();
     void Terminate();
     void SetDataDir(const char *s);
@@ -99,6 +107,21 @@ public :
     bool isData=false;              // to do gen matching, etc
     int firstEvent=-1;
     int lastEvent=-1;               // max events to process; -1=>all
+    int nThreads=1;                 // >1 => split the entry range over worker threads
+    bool keepOrder=false;           // threaded mode: output entries keep the input order
+    unsigned int chunkSize=5000;    // threaded mode: entries handed to a worker at a time
+    bool profile=false;             // write per-module timing next to the output file
+    unsigned int checkpointEvents=0;// AutoSave the output every N entries; 0=>off
+    double checkpointSeconds=0;     // AutoSave the output every T seconds; 0=>off
+    bool resume=false;              // continue a partial output from its last checkpoint
+    TString correctionBundle="";    // read the binned corrections from here, if valid
+    TString rochesterCache="";      // binary copy of the Rochester tables; rewritten if missing or stale
+    bool validateBTagTables=false;  // compare the tabulated b-tag SFs to the CMSSW readers at load
+    bool validateBDTs=false;        // compare BDTEngine to TMVA::Reader at load
+    bool validateJEC=false;         // compare JECEngine (and JESSourceTable) to the CMSSW tools at load
+    bool validateRecluster=false;   // with reclusterCone, also run the full reclustering and compare per event
+    unsigned int rngSeed=3393;      // seed of the CounterRNG streams used for smearing
+    bool WriteCorrectionBundle(TString path); // call after SetDataDir
 
 private:
     enum CorrectionType { //!< enum listing relevant corrections applied to MC
@@ -172,119 +195,173 @@ private:
             double eff, sf, sfup, sfdown;
     };
 
+    // fj1 substructure from one reclustering, so the full and cone-local
+    // results can be compared
+    struct ReclusterVars {
+      int nConst=0, nSDConst=0;
+      float eFrac100=0, sdEFrac100=0;
+    };
+
 
     //////////////////////////////////////////////////////////////////////////////////////
 
     bool PassGoodLumis(int run, int lumi);
-    bool PassPreselection();
+    bool PassPreselection(EventContext &ctx);
+    bool ProcessEvent(EventContext &ctx, unsigned int iE);
+    void SelectJetCollections(EventContext &ctx);
+    void LoadBTagReaders(EventContext &ctx);
+    void LoadBTagTables();
+    void LoadBJetRegression(EventContext &ctx, TString dirPath);
+    void LoadJES(EventContext &ctx, TString dirPath);
+    JERSmearer *LoadJERSmearer(TString sfPath, TString resPath); // 0 if the files cannot be read
+    void LoadJESSources(EventContext &ctx, TString dirPath);
+    // threaded running: every thread gets its own EventContext
+    // and shares the read-only configuration held here
+    void RunThreaded(unsigned int nZero, unsigned int nEvents);
+    EventContext *BuildContext(int iW);
+    void RunChunk(EventContext &ctx, unsigned int iC, unsigned int first, unsigned int last,
+                  std::atomic<unsigned int> &nProcessed);
+    void TerminateContext(EventContext *ctx);
+    // checkpointing: the last entry safely in the output is kept in a sidecar
+    // file next to it, so an interrupted job can be resumed from there
+    TString CheckpointPath(TString fOutName) const;
+    long ReadCheckpoint(TString fOutName, long &nWritten) const; //!< nWritten: output entries at the checkpoint
+    TString CheckpointInput() const; //!< name of the input file, as recorded in the sidecar
+    void WriteCheckpoint(unsigned int iE);
     void OpenCorrection(CorrectionType,TString,TString,int);
+    TString CorrectionKey() const;
     double GetCorr(CorrectionType ct,double x, double y=0);
+    double GetCorr(EventContext &ctx, CorrectionType ct, double x); //!< TF1 corrections, from the context's clones
+    void CloneTF1s(EventContext &ctx, TString suffix);
     double GetError(CorrectionType ct,double x, double y=0);
-    void RegisterTriggers(); 
-    void GetMETSignificance(); 
+    void RegisterTriggers(EventContext &ctx); 
+    void GetMETSignificance(EventContext &ctx); 
+
+    // the modules run on each event are registered once in Init, together with
+    // the per-event products they read and fill. BuildPlan orders them so that
+    // every producer runs before its consumers and cuts run as early as possible
+    struct Module {
+      TString name;
+      void (PandaAnalyzer::*fill)(EventContext&);  //!< module that fills the event, or
+      bool (PandaAnalyzer::*cut)(EventContext&);   //!< module that can reject the event
+      std::vector<TString> inputs, outputs;
+    };
+    void RegisterModules();
+    void AddModule(TString name, void (PandaAnalyzer::*fill)(EventContext&), bool enabled,
+                   std::vector<TString> inputs, std::vector<TString> outputs);
+    void AddCut(TString name, bool (PandaAnalyzer::*cut)(EventContext&), bool enabled,
+                std::vector<TString> inputs);
+    bool BuildPlan();
+    ModuleProfiler *BuildProfiler();
 
     // these are functions used for analysis-specific tasks inside Run.
     // ideally the return type is void (e.g. they are stateful functions),
     // but that is not always possible (e.g. RecoilPresel)
-    void CalcBJetSFs(BTagType bt, int flavor, double eta, double pt, 
+    // all per-event state lives in the EventContext that is passed along
+    void CalcBJetSFs(EventContext &ctx, BTagType bt, int flavor, double eta, double pt, 
                      double eff, double uncFactor, double &sf, double &sfUp, double &sfDown);
-    void ComplicatedLeptons();
-    void EvalBTagSF(std::vector<btagcand> &cands, std::vector<double> &sfs,
-                    GeneralTree::BTagShift shift,GeneralTree::BTagJet jettype, bool do2=false);
-    void FatjetBasics();
-    void FatjetMatching();
-    void FatjetRecluster();
-    void GenJetsNu();
-    void GenStudyEWK();
-    float GetMSDCorr(Float_t puppipt, Float_t puppieta); // @bmaier: please refactor this
-    void HeavyFlavorCounting();
-    void IsoJet(panda::Jet&);
-    void JetBRegressionInfo(panda::Jet&);
-    void JetBasics();
-    void JetBtagSFs();
-    void JetCMVAWeights();
-    void JetHbbBasics(panda::Jet&);
-    void JetHbbReco();
-    void JetVBFBasics(panda::Jet&);
-    void JetVBFSystem();
-    void JetVaryJES(panda::Jet&);
-    void LeptonSFs();
-    void PhotonSFs();
-    void Photons();
-    void QCDUncs();
-    void Recoil();
-    bool RecoilPresel();
-    void SaveGenLeptons();
-    void SetupJES();
-    void SignalInfo();
-    void SignalReweights();
-    void SimpleLeptons();
-    void Taus();
-    void TopPTReweight();
-    void TriggerEffs();
-    void VJetsReweight();
+    void ComplicatedLeptons(EventContext &ctx);
+    void EvalBTagSF(EventContext &ctx, std::vector<btagcand> &cands, 
+                    GeneralTree::BTagJet jettype, bool do2=false);
+    void EventBasics(EventContext &ctx);
+    void FatjetBasics(EventContext &ctx);
+    void FatjetMatching(EventContext &ctx);
+    void FatjetRecluster(EventContext &ctx);
+    bool ReclusterFj1(EventContext &ctx, bool inCone, ReclusterVars &vars); //!< false if no jet matches fj1
+    void GenJetsNu(EventContext &ctx);
+    void GenStudyEWK(EventContext &ctx);
+    float GetMSDCorr(EventContext &ctx, Float_t puppipt, Float_t puppieta); // @bmaier: please refactor this
+    void HeavyFlavorCounting(EventContext &ctx);
+    void IsoJet(EventContext &ctx, panda::Jet&);
+    void JetBRegressionInfo(EventContext &ctx, panda::Jet&);
+    void JetBasics(EventContext &ctx);
+    void JetBtagSFs(EventContext &ctx);
+    void JetCMVAWeights(EventContext &ctx);
+    void JetCorrection(EventContext &ctx);
+    void JetHbbBasics(EventContext &ctx, panda::Jet&);
+    void JetHbbReco(EventContext &ctx);
+    void JetVBFBasics(EventContext &ctx, panda::Jet&);
+    void JetVBFSystem(EventContext &ctx);
+    void JetVaryJES(EventContext &ctx, panda::Jet&);
+    void JetVaryJESSources(EventContext &ctx);
+    void EvaluateJESSources(EventContext &ctx, unsigned nJets, const float *pt, const float *eta,
+                            float *up, float *down); //!< table, or the context's readers
+    void LeptonSFs(EventContext &ctx);
+    void METBasics(EventContext &ctx);
+    void PhotonSFs(EventContext &ctx);
+    void Photons(EventContext &ctx);
+    void QCDUncs(EventContext &ctx);
+    CounterRNG::Stream RandomStream(EventContext const& ctx, unsigned object, CounterRNG::Purpose purpose) const;
+    void Recoil(EventContext &ctx);
+    bool RecoilPresel(EventContext &ctx);
+    void SaveGenLeptons(EventContext &ctx);
+    void SetupJES(EventContext &ctx);
+    void SignalInfo(EventContext &ctx);
+    void SignalReweights(EventContext &ctx);
+    void SimpleLeptons(EventContext &ctx);
+    void Taus(EventContext &ctx);
+    void TopPTReweight(EventContext &ctx);
+    void TriggerEffs(EventContext &ctx);
+    void VJetsReweight(EventContext &ctx);
     double WeightEWKCorr(float pt, int type);
     double WeightZHEWKCorr(float baseCorr);
     // templated function needs to be defined here, ugh
-    template <typename T> void MatchGenJets(T& genJets) {
-      unsigned N = cleanedJets.size();
+    template <typename T> void MatchGenJets(EventContext &ctx, T& genJets) {
+      unsigned N = ctx.cleanedJets.size();
       for (unsigned i = 0; i != N; ++i) {
-        panda::Jet *reco = cleanedJets.at(i);
+        panda::Jet *reco = ctx.cleanedJets.at(i);
         for (auto &gen : genJets) {
           if (DeltaR2(gen.eta(), gen.phi(), reco->eta(), reco->phi()) < 0.09) {
-            gt->jetGenPt[i] = gen.pt();
-            gt->jetGenFlavor[i] = gen.pdgid;
+            ctx.gt->jetGenPt[i] = gen.pt();
+            ctx.gt->jetGenFlavor[i] = gen.pdgid;
             break;
           }
         }
       }
-      tr->TriggerEvent("match gen jets");
+      ctx.tr->TriggerEvent("match gen jets");
     }
 
     //////////////////////////////////////////////////////////////////////////////////////
 
     int DEBUG = 0; //!< debug verbosity level
     Analysis *analysis = 0; //!< configure what to run
-    TimeReporter *tr = 0; //!< profile time usage
     float FATJETMATCHDR2 = 2.25;
 
     //////////////////////////////////////////////////////////////////////////////////////
 
     // stuff for matching objects
-    std::map<panda::GenParticle const*,float> genObjects; 
-        //!< particles we want to match the jets to, and the 'size' of the daughters
-    panda::GenParticle const* MatchToGen(double eta, double phi, double r2, int pdgid=0);   
+    panda::GenParticle const* MatchToGen(EventContext &ctx, double eta, double phi, double r2, int pdgid=0);   
         //!< private function to match a jet; returns NULL if not found
     std::map<int,std::vector<LumiRange>> goodLumis;
-    std::vector<panda::Particle*> matchPhos, matchEles, matchLeps;
     
     // fastjet reclustering
     fastjet::JetDefinition *jetDef=0;
     fastjet::contrib::SoftDrop *softDrop=0;
-    fastjet::AreaDefinition *areaDef=0;
-    fastjet::GhostedAreaSpec *activeArea=0;
     fastjet::JetDefinition *jetDefGen=0;
+    // explicit ghosts of the area-aware reclusterings, drawn once in Init and
+    // sorted in rapidity; read-only afterwards and shared by all contexts.
+    // ReclusterFj1 uses all of them, or in cone mode the ones in the cone, so
+    // both modes see the same ghosts
+    VPseudoJet ghosts;
+    double ghostArea=0;
+    void ConeGhosts(fastjet::PseudoJet const& axis, double cone, VPseudoJet &out) const;
 
     //////////////////////////////////////////////////////////////////////////////////////
 
     // CMSSW-provided utilities
+    // the readers themselves are stateful, so each EventContext holds its own
     BTagCalibration *btagCalib=0;
     BTagCalibration *sj_btagCalib=0;
-    std::vector<BTagCalibrationReader*> btagReaders = std::vector<BTagCalibrationReader*>(bN,0); 
-        //!< maps BTagType to a reader 
-    std::map<TString,JetCorrectionUncertainty*> ak8UncReader; //!< calculate JES unc on the fly
-    JERReader *ak8JERReader{0}; //!< fatjet jet energy resolution reader
-    std::map<TString,JetCorrectionUncertainty*> ak4UncReader; //!< calculate JES unc on the fly
-    std::map<TString,FactorizedJetCorrector*> ak4ScaleReader; //!< calculate JES on the fly
-    JERReader *ak4JERReader{0}; //!< fatjet jet energy resolution reader
+    std::vector<BTagSFTable*> btagTables; //!< tabulated readers, maps BTagType to a table; shared, 0 => use the reader
+    BDTEngine *bjetregEngine=0; //!< b-jet energy regression; shared, the TMVA reader is only a fallback
+    std::map<TString,JECEngine*> ak4JECEngines; //!< AK4 JEC, keyed as ak4ScaleReader; shared, 0 => use the reader
+    JESSourceTable *ak4JESSources=0; //!< AK4 JES uncertainties of GeneralTree::jesSources; shared, 0 => use the readers
+    JERSmearer *ak8JERSmearer=0; //!< fatjet JER smearing; shared, 0 => use ak8JERReader
+    JERSmearer *ak4JERSmearer=0; //!< subjet JER smearing; shared, 0 => use ak4JERReader
     EraHandler eras = EraHandler(2016); //!< determining data-taking era, to be used for era-dependent JEC
-    JetCorrectionUncertainty *uncReader=0;           
-    JetCorrectionUncertainty *uncReaderAK4=0;        
-    FactorizedJetCorrector *scaleReaderAK4=0;        
     Binner btagpt = Binner({});
     Binner btageta = Binner({});
     std::vector<std::vector<double>> lfeff, ceff, beff;
-    TMVA::Reader *bjetreg_reader = new TMVA::Reader("!Color:!Silent");
 
     //////////////////////////////////////////////////////////////////////////////////////
 
@@ -292,13 +369,15 @@ private:
     std::vector<TFile*> fCorrs = std::vector<TFile*>(cN,0); //!< files containing corrections
     std::vector<THCorr1*> h1Corrs = std::vector<THCorr1*>(cN,0); //!< histograms for binned corrections
     std::vector<THCorr2*> h2Corrs = std::vector<THCorr2*>(cN,0); //!< histograms for binned corrections
-    std::vector<TF1Corr*> f1Corrs = std::vector<TF1Corr*>(cN,0); //!< TF1s for continuous corrections
+    std::vector<TF1Corr*> f1Corrs = std::vector<TF1Corr*>(cN,0); //!< TF1s for continuous corrections; only cloned, see CloneTF1s
+    std::vector<CorrTable*> tCorrs = std::vector<CorrTable*>(cN,0); //!< flat copies of h1Corrs and h2Corrs used by GetCorr
+    std::vector<TString> corrSources;   //!< files the binned corrections were read from
+    bool corrsFromBundle=false;         //!< binned corrections came from correctionBundle
     TFile *MSDcorr=0;
-    TF1* puppisd_corrGEN=0;
-    TF1* puppisd_corrRECO_cen=0;
-    TF1* puppisd_corrRECO_for=0;
+    TF1Corr *puppisd_corrGEN=0; //!< as f1Corrs, evaluated through the EventContext clones
+    TF1Corr *puppisd_corrRECO_cen=0;
+    TF1Corr *puppisd_corrRECO_for=0;
     RoccoR *rochesterCorrection=0;
-    TRandom3 rng;
     CSVHelper *csvReweighter=0, *cmvaReweighter=0;
 
     //////////////////////////////////////////////////////////////////////////////////////
@@ -310,42 +389,18 @@ private:
     TH1F *hDTotalMCWeight=0;
     TTree *tIn=0;    // input tree to read
     unsigned int preselBits=0;
-    panda::Event event;
-
-    //////////////////////////////////////////////////////////////////////////////////////
-
-    // configuration read from output tree
-    std::vector<int> ibetas;
-    std::vector<int> Ns; 
-    std::vector<int> orders;
+    EventContext *context=0; //!< event state for single-threaded running; reads tIn, fills gt
+    panda::utils::BranchList readlist; //!< input branches, kept to configure other contexts
+    std::vector<TString> preselList;   //!< subset of readlist needed by the preselection
+    TString dataDir;                   //!< kept to build per-context readers
+    std::vector<Module> modules;       //!< enabled modules, in execution order
 
     //////////////////////////////////////////////////////////////////////////////////////
 
     // any extra signal weights we want
-    // stuff that gets passed between modules
     std::vector<TriggerHandler> triggerHandlers = std::vector<TriggerHandler>(kNTrig);
-    std::vector<panda::Lepton*> looseLeps, tightLeps;
-    std::vector<panda::Photon*> loosePhos;
-    TLorentzVector vPFMET, vPuppiMET;
-    TVector2 vMETNoMu;
-    TLorentzVector vpfUW, vpfUZ, vpfUA, vpfU;
-    TLorentzVector vpuppiUW, vpuppiUZ, vpuppiUA, vpuppiU;
-    panda::FatJet *fj1 = 0;
-    std::vector<panda::Jet*> cleanedJets, isoJets, btaggedJets, centralJets;
-    std::vector<int> btagindices;
-    TLorentzVector vJet, vBarrelJets;
-    panda::FatJetCollection *fatjets = 0;
-    panda::JetCollection *jets = 0;
-    panda::Jet *jot1 = 0, *jot2 = 0;
-    panda::Jet *jotUp1 = 0, *jotUp2 = 0;
-    panda::Jet *jotDown1 = 0, *jotDown2 = 0;
-    panda::Jet *jetUp1 = 0, *jetUp2 = 0;
-    panda::Jet *jetDown1 = 0, *jetDown2 = 0;
-    std::vector<panda::GenJet> genJetsNu;
     float genBosonPtMin, genBosonPtMax;
-    int looseLep1PdgId, looseLep2PdgId;
     std::vector<TString> wIDs;
-    float *bjetreg_vars = 0;
 
     float jetPtThreshold=30;
     
@@ -13,10 +13,10 @@
 #include <TMath.h>
 #include <TH1D.h>
 #include <TH2F.h>
-#include <TLorentzVector.h>
 
 #include "AnalyzerUtilities.h"
 #include "GeneralLeptonicTree.h"
+#include "FourVector.h"
 
 // btag
 #include "CondFormats/BTauObjects/interface/BTagEntry.h"
@@ -150,8 +150,8 @@ private:
     bool PassPreselection();
     void CalcBJetSFs(BTagType bt, int flavor, double eta, double pt, 
                          double eff, double uncFactor, double &sf, double &sfUp, double &sfDown);
-    void EvalBTagSF(std::vector<btagcand> &cands, std::vector<double> &sfs,
-                    GeneralLeptonicTree::BTagShift shift,GeneralLeptonicTree::BTagJet jettype, bool do2=false);
+    void EvalBTagSF(std::vector<btagcand> &cands, 
+                    GeneralLeptonicTree::BTagJet jettype, bool do2=false);
     void OpenCorrection(CorrectionType,TString,TString,int);
     double GetCorr(CorrectionType ct,double x, double y=0);
     double GetError(CorrectionType ct,double x, double y=0);
@@ -17,6 +17,7 @@
 
 #include "AnalyzerUtilities.h"
 #include "TagTree.h"
+#include "GenDecayGraph.h"
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -61,7 +62,7 @@ private:
     bool PassPreselection();
     void OpenCorrection(CorrectionType,TString,TString,int);
     double GetCorr(CorrectionType ct,double x, double y=0);
-    bool CheckParton(panda::GenParticle*,double&);
+    bool CheckParton(unsigned,double&); // by index into event.genParticles
     panda::FatJet *Match(panda::GenParticle*,double);
 
     int DEBUG = 0; //!< debug verbosity level
@@ -82,11 +83,9 @@ private:
 
     // objects to read from the tree
     panda::Event event;
+    std::vector<TBranch*> preselBranches; // read ahead of the full event to preselect
+    GenDecayGraph genGraph; // parent/daughter links of event.genParticles
 
-    // configuration read from output tree
-    std::vector<int> ibetas;
-    std::vector<int> Ns; 
-    std::vector<int> orders;
 
 
 };
@@ -30,6 +30,13 @@ class TagTree : public genericTree {
         }
       };
 
+      // fj1ECFNs is a flat array, ecfIndex(order,N,ibeta) is the slot of one ECF
+      static constexpr int nECFOrders=3, nECFNs=4, nECFBetas=4;
+      static constexpr int nECF=nECFOrders*nECFNs*nECFBetas;
+      static constexpr int ecfIndex(int order, int N, int ibeta) {
+        return ((order-1)*nECFNs + (N-1))*nECFBetas + ibeta;
+      }
+
         
     private:
         std::vector<double> betas = {0.5, 1.0, 2.0, 4.0};
@@ -60,7 +67,7 @@ class TagTree : public genericTree {
         
 
 //STARTCUSTOMDEF
-      std::map<ECFParams,float> fj1ECFNs;
+      float fj1ECFNs[nECF];
 //ENDCUSTOMDEF
     int runNumber = -1;
     int lumiNumber = -1;
@@ -11,7 +11,11 @@ def _dump(a):
     for k in dir(a):
         if k[0] == '_':
             continue
-        PInfo('PandaAnalysis.Flat.analysis','    %20s = %s'%(k, 'True' if bool(getattr(a, k)) else 'False'))
+        v = getattr(a, k)
+        if type(v) == float:
+            PInfo('PandaAnalysis.Flat.analysis','    %20s = %g'%(k, v))
+        else:
+            PInfo('PandaAnalysis.Flat.analysis','    %20s = %s'%(k, 'True' if bool(v) else 'False'))
 
 
 
@@ -21,7 +25,10 @@ def _analysis(name, verbose, **kwargs):
         if not hasattr(a, k):
             PError('PandaAnalysis.Flat.analysis','Could not set property %s'%k)
             return None 
-        setattr(a, k, bool(v))
+        if type(getattr(a, k)) == float:
+            setattr(a, k, float(v))
+        else:
+            setattr(a, k, bool(v))
     setattr(a, 'dump', lambda : _dump(a))
     if verbose:
         a.dump()
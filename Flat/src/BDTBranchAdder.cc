@@ -0,0 +1,95 @@
+#include "../interface/BDTBranchAdder.h"
+#include "PandaCore/Tools/interface/Common.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TBranch.h"
+#include "TTreeFormula.h"
+#include <algorithm>
+
+bool BDTBranchAdder::BookMVA(TString branchName_, TString weightsPath)
+{
+  branchName = branchName_;
+  booked = false;
+  if (!engine.Load(weightsPath))
+    return false;
+  if (engine.NVar()!=formulae.size()) {
+    PError("BDTBranchAdder::BookMVA",
+           TString::Format("BDT has %u inputs, but %u were added",engine.NVar(),(unsigned)formulae.size()));
+    return false;
+  }
+  // the inputs are matched by position, so a different name means the
+  // formulae are in the wrong order or are the wrong ones
+  for (unsigned iV=0; iV!=names.size(); ++iV) {
+    if (names[iV]!=engine.Variables()[iV]) {
+      PError("BDTBranchAdder::BookMVA",
+             TString::Format("Input %u is %s, but was trained as %s",
+                             iV,names[iV].Data(),engine.Variables()[iV].Data()));
+      return false;
+    }
+  }
+  booked = true;
+  return true;
+}
+
+
+bool BDTBranchAdder::RunFile(TString fpath)
+{
+  if (!booked) {
+    PError("BDTBranchAdder::RunFile","No BDT booked");
+    return false;
+  }
+  TFile *fIn = TFile::Open(fpath,"UPDATE");
+  TTree *t = fIn ? (TTree*)fIn->Get(treename) : 0;
+  if (!t) {
+    PError("BDTBranchAdder::RunFile","Could not read "+treename+" from "+fpath);
+    delete fIn;
+    return false;
+  }
+
+  std::vector<TTreeFormula*> inputs;
+  for (unsigned iV=0; iV!=formulae.size(); ++iV)
+    inputs.push_back(new TTreeFormula(TString::Format("bdt_in%u",iV),formulae[iV],t));
+  TTreeFormula *fpresel = (presel!="") ? new TTreeFormula("bdt_presel",presel,t) : 0;
+
+  float val = defaultValue;
+  TBranch *b = t->Branch(branchName,&val,branchName+"/F");
+
+  unsigned nVar = formulae.size();
+  unsigned nEntries = t->GetEntries(), iE=0;
+  ProgressReporter pr("BDTBranchAdder::RunFile",&iE,&nEntries,10);
+  std::vector<float> rows(blockSize*nVar);
+  std::vector<double> responses(blockSize);
+  std::vector<bool> pass(blockSize);
+  for (unsigned iStart=0; iStart<nEntries; iStart+=blockSize) {
+    unsigned nBlock = std::min(blockSize,nEntries-iStart);
+    unsigned nPass=0;
+    for (unsigned iB=0; iB!=nBlock; ++iB) {
+      iE = iStart+iB;
+      pr.Report();
+      t->LoadTree(iE);
+      pass[iB] = !fpresel || (fpresel->GetNdata()>0 && fpresel->EvalInstance()!=0);
+      if (!pass[iB])
+        continue;
+      float *row = rows.data()+(nPass++)*nVar;
+      for (unsigned iV=0; iV!=nVar; ++iV) {
+        inputs[iV]->GetNdata();
+        row[iV] = inputs[iV]->EvalInstance();
+      }
+    }
+    engine.Evaluate(rows.data(),nPass,responses.data());
+    unsigned iP=0;
+    for (unsigned iB=0; iB!=nBlock; ++iB) {
+      val = pass[iB] ? responses[iP++] : defaultValue;
+      b->Fill();
+    }
+  }
+
+  fIn->cd();
+  t->Write("",TObject::kOverwrite);
+  for (auto *f : inputs)
+    delete f;
+  delete fpresel;
+  fIn->Close();
+  delete fIn;
+  return true;
+}
@@ -0,0 +1,254 @@
+#include "../interface/BDTEngine.h"
+#include "PandaCore/Tools/interface/Common.h"
+#include "TRandom3.h"
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+namespace {
+  TString Attr(TXMLEngine &xml, XMLNodePointer_t node, const char *name) {
+    const char *a = xml.GetAttr(node,name);
+    return a ? TString(a) : TString("");
+  }
+
+  XMLNodePointer_t Child(TXMLEngine &xml, XMLNodePointer_t node, const char *name) {
+    for (XMLNodePointer_t c = xml.GetChild(node); c; c = xml.GetNext(c)) {
+      if (TString(xml.GetNodeName(c))==name)
+        return c;
+    }
+    return 0;
+  }
+}
+
+
+int BDTEngine::ReadNode(TXMLEngine &xml, XMLNodePointer_t xmlNode, LeafValue leafValue)
+{
+  if (Attr(xml,xmlNode,"NCoef")!="" && Attr(xml,xmlNode,"NCoef").Atoi()!=0) {
+    PError("BDTEngine::ReadNode","Fisher cuts are not supported");
+    return -1;
+  }
+
+  unsigned idx = nodes.size();
+  nodes.push_back(Node());
+  Node node;
+  node.var = -1;
+  node.cut = Attr(xml,xmlNode,"Cut").Atof();
+  node.cutType = Attr(xml,xmlNode,"cType").Atoi()==1;
+  node.left = node.right = 0;
+  switch (leafValue) {
+    case kResponse:
+      node.value = Attr(xml,xmlNode,"res").Atof(); break;
+    case kNodeType:
+      node.value = Attr(xml,xmlNode,"nType").Atoi(); break;
+    case kPurity:
+      node.value = Attr(xml,xmlNode,"purity").Atof(); break;
+  }
+
+  int left=-1, right=-1;
+  for (XMLNodePointer_t c = xml.GetChild(xmlNode); c; c = xml.GetNext(c)) {
+    if (TString(xml.GetNodeName(c))!="Node")
+      continue;
+    int child = ReadNode(xml,c,leafValue);
+    if (child<0)
+      return -1;
+    if (Attr(xml,c,"pos")=="l")
+      left = child;
+    else
+      right = child;
+  }
+  if (left>=0 || right>=0) {
+    if (left<0 || right<0) {
+      PError("BDTEngine::ReadNode","Found a node with only one daughter");
+      return -1;
+    }
+    node.var = Attr(xml,xmlNode,"IVar").Atoi();
+    if (node.var<0 || node.var>=(int)variables.size()) {
+      PError("BDTEngine::ReadNode",TString::Format("Bad variable index %i",node.var));
+      return -1;
+    }
+    node.left = left;
+    node.right = right;
+  }
+  nodes[idx] = node;
+  return idx;
+}
+
+
+bool BDTEngine::Load(TString weightsPath)
+{
+  nodes.clear(); forest.clear(); boostWeights.clear();
+  variables.clear(); varMin.clear(); varMax.clear();
+
+  TXMLEngine xml;
+  XMLDocPointer_t doc = xml.ParseFile(weightsPath.Data());
+  if (!doc) {
+    PError("BDTEngine::Load","Could not parse "+weightsPath);
+    return false;
+  }
+  XMLNodePointer_t top = xml.DocGetRootElement(doc);
+
+  TString reason;
+  do {
+    if (!Attr(xml,top,"Method").BeginsWith("BDT")) {
+      reason = "not a BDT";
+      break;
+    }
+
+    TString boostType = "AdaBoost";
+    bool useYesNoLeaf = true;
+    if (XMLNodePointer_t options = Child(xml,top,"Options")) {
+      for (XMLNodePointer_t o = xml.GetChild(options); o; o = xml.GetNext(o)) {
+        TString name = Attr(xml,o,"name");
+        TString content = xml.GetNodeContent(o) ? xml.GetNodeContent(o) : "";
+        content = content.Strip(TString::kBoth);
+        if (name=="BoostType")
+          boostType = content;
+        else if (name=="UseYesNoLeaf")
+          useYesNoLeaf = !(content=="False" || content=="false" || content=="F" || content=="0");
+      }
+    }
+
+    if (XMLNodePointer_t vars = Child(xml,top,"Variables")) {
+      for (XMLNodePointer_t v = xml.GetChild(vars); v; v = xml.GetNext(v)) {
+        variables.push_back(Attr(xml,v,"Expression"));
+        varMin.push_back(Attr(xml,v,"Min").Atof());
+        varMax.push_back(Attr(xml,v,"Max").Atof());
+      }
+    }
+    if (variables.size()==0) {
+      reason = "no input variables";
+      break;
+    }
+
+    XMLNodePointer_t transforms = Child(xml,top,"Transformations");
+    if (transforms && Attr(xml,transforms,"NTransformations").Atoi()!=0) {
+      reason = "input transformations are not supported";
+      break;
+    }
+
+    XMLNodePointer_t weights = Child(xml,top,"Weights");
+    if (!weights) {
+      reason = "no Weights";
+      break;
+    }
+    regression = Attr(xml,weights,"AnalysisType").Atoi()==1;
+
+    LeafValue leafValue;
+    if (boostType=="Grad") {
+      combination = kSum;
+      leafValue = kResponse;
+    } else if (regression) {
+      if (boostType=="AdaBoostR2") {
+        reason = "AdaBoostR2 regression is not supported";
+        break;
+      }
+      combination = kWeightedMean;
+      leafValue = kResponse;
+    } else {
+      combination = kWeightedMean;
+      leafValue = useYesNoLeaf ? kNodeType : kPurity;
+    }
+
+    for (XMLNodePointer_t t = xml.GetChild(weights); t; t = xml.GetNext(t)) {
+      if (TString(xml.GetNodeName(t))!="BinaryTree")
+        continue;
+      XMLNodePointer_t rootNode = Child(xml,t,"Node");
+      int iRoot = rootNode ? ReadNode(xml,rootNode,leafValue) : -1;
+      if (iRoot<0) {
+        reason = TString::Format("could not read tree %u",(unsigned)forest.size());
+        break;
+      }
+      forest.push_back(iRoot);
+      boostWeights.push_back(Attr(xml,t,"boostWeight").Atof());
+    }
+  } while (false);
+
+  xml.FreeDoc(doc);
+
+  if (reason=="" && forest.size()==0)
+    reason = "no trees";
+  if (reason!="") {
+    PError("BDTEngine::Load","Cannot use "+weightsPath+": "+reason);
+    nodes.clear(); forest.clear(); boostWeights.clear();
+    return false;
+  }
+
+  // a Grad regression stores its initial estimate as the first boost weight
+  offset = (combination==kSum && regression) ? boostWeights[0] : 0;
+  sumBoostWeights = 0;
+  for (double w : boostWeights)
+    sumBoostWeights += w;
+
+  PInfo("BDTEngine::Load",
+        TString::Format("Loaded %u trees, %u nodes, %u variables from ",
+                        (unsigned)forest.size(),(unsigned)nodes.size(),(unsigned)variables.size())
+        +weightsPath);
+  return true;
+}
+
+
+void BDTEngine::Evaluate(const float *x, unsigned nRows, double *out) const
+{
+  unsigned nVar = variables.size();
+  std::fill(out,out+nRows,0.);
+
+  // trees outside, rows inside: every tree is walked for all rows while it is hot
+  const Node *base = nodes.data();
+  for (unsigned iT=0; iT!=forest.size(); ++iT) {
+    double w = (combination==kSum) ? 1 : boostWeights[iT];
+    for (unsigned iR=0; iR!=nRows; ++iR) {
+      const float *row = x+iR*nVar;
+      const Node *n = base+forest[iT];
+      while (n->var>=0) {
+        bool right = (row[n->var]>=n->cut)==n->cutType;
+        n = base+(right ? n->right : n->left);
+      }
+      out[iR] += w*n->value;
+    }
+  }
+
+  for (unsigned iR=0; iR!=nRows; ++iR) {
+    if (combination==kSum) {
+      if (regression)
+        out[iR] += offset;
+      else
+        out[iR] = 2.0/(1.0+std::exp(-2.0*out[iR]))-1.0;
+    } else {
+      out[iR] = (sumBoostWeights>1e-16) ? out[iR]/sumBoostWeights : 0;
+    }
+  }
+}
+
+
+double BDTEngine::Evaluate(const float *x) const
+{
+  double out=0;
+  Evaluate(x,1,&out);
+  return out;
+}
+
+
+double BDTEngine::Validate(TMVA::Reader &reader, float *readerVars, TString method,
+                           unsigned nPoints) const
+{
+  unsigned nVar = variables.size();
+  TRandom3 rng(1234);
+  double maxDiff = 0;
+  std::vector<float> x(nVar);
+  for (unsigned iP=0; iP!=nPoints; ++iP) {
+    for (unsigned iV=0; iV!=nVar; ++iV) {
+      x[iV] = varMin[iV] + rng.Rndm()*(varMax[iV]-varMin[iV]);
+      readerVars[iV] = x[iV];
+    }
+    double ref = regression ? reader.EvaluateRegression(method)[0] : reader.EvaluateMVA(method);
+    maxDiff = std::max(maxDiff,std::fabs(Evaluate(x.data())-ref)/std::max(std::fabs(ref),1.));
+  }
+  if (maxDiff>kTolerance)
+    PError("BDTEngine::Validate",
+           TString::Format("%s: max relative |engine-reader| = %.3g over %u points, above %.0e",
+                           method.Data(),maxDiff,nPoints,kTolerance));
+  else
+    PInfo("BDTEngine::Validate",
+          TString::Format("%s: max relative |engine-reader| = %.3g over %u points",method.Data(),maxDiff,nPoints));
+  return maxDiff;
+}
@@ -0,0 +1,173 @@
+#include "../interface/BTagSFTable.h"
+#include "PandaCore/Tools/interface/Common.h"
+#include <algorithm>
+#include <cmath>
+
+void BTagSFTable::Load(BTagCalibration const& calib, BTagCalibrationReader const& reader,
+                       BTagEntry::OperatingPoint op, BTagEntry::JetFlavor jf, std::string measurement)
+{
+  Flavor &fl = flavors[jf];
+  fl = Flavor();
+
+  std::vector<BTagEntry> entries;
+  for (auto sys : {"central","up","down"}) {
+    auto const& sysEntries = calib.getEntries(BTagEntry::Parameters(op,measurement,sys,jf));
+    entries.insert(entries.end(),sysEntries.begin(),sysEntries.end());
+  }
+  if (entries.size()==0) {
+    PError("BTagSFTable::Load",
+           TString::Format("No entries for flavor %i, measurement %s",(int)jf,measurement.c_str()));
+    return;
+  }
+
+  // same convention as the reader: |eta| if no bin reaches negative eta
+  fl.absEta = true;
+  std::vector<double> etaEdges;
+  for (auto &e : entries) {
+    if (e.params.etaMin<0)
+      fl.absEta = false;
+    etaEdges.push_back(e.params.etaMin);
+    etaEdges.push_back(e.params.etaMax);
+  }
+  std::sort(etaEdges.begin(),etaEdges.end());
+  etaEdges.erase(std::unique(etaEdges.begin(),etaEdges.end()),etaEdges.end());
+
+  for (unsigned iEta=0; iEta+1<etaEdges.size(); ++iEta) {
+    double etaMid = 0.5*(etaEdges[iEta]+etaEdges[iEta+1]);
+    auto bounds = reader.min_max_pt(jf,etaMid);
+    if (bounds.first<0)
+      continue; // no payload here, the reader returns 0
+
+    EtaBin eb;
+    eb.lo = etaEdges[iEta];
+    eb.hi = etaEdges[iEta+1];
+    eb.ptMin = bounds.first;
+    eb.ptMax = bounds.second;
+    for (auto &e : entries) {
+      if (e.params.etaMin<=etaMid && etaMid<e.params.etaMax) {
+        eb.ptEdges.push_back(std::max<double>(eb.ptMin,std::min<double>(eb.ptMax,e.params.ptMin)));
+        eb.ptEdges.push_back(std::max<double>(eb.ptMin,std::min<double>(eb.ptMax,e.params.ptMax)));
+      }
+    }
+    std::sort(eb.ptEdges.begin(),eb.ptEdges.end());
+    eb.ptEdges.erase(std::unique(eb.ptEdges.begin(),eb.ptEdges.end()),eb.ptEdges.end());
+
+    // the reader's pt bins are (ptMin,ptMax], so the first node of each
+    // bin is sampled just above its lower edge
+    for (unsigned iPt=0; iPt+1<eb.ptEdges.size(); ++iPt) {
+      PtBin pb;
+      pb.lo = eb.ptEdges[iPt];
+      pb.hi = eb.ptEdges[iPt+1];
+      pb.n = std::max(2,std::min(2001,(int)std::ceil((pb.hi-pb.lo)/ptStep)+1));
+      pb.invStep = (pb.n-1)/(pb.hi-pb.lo);
+      pb.first = fl.nodes.size();
+      for (unsigned iN=0; iN!=pb.n; ++iN) {
+        double pt = (iN==0) ? pb.lo+0.0001 : pb.lo+iN/pb.invStep;
+        Node node;
+        node.sf   = reader.eval_auto_bounds("central",jf,etaMid,pt);
+        node.up   = reader.eval_auto_bounds("up",jf,etaMid,pt);
+        node.down = reader.eval_auto_bounds("down",jf,etaMid,pt);
+        fl.nodes.push_back(node);
+      }
+      eb.ptBins.push_back(pb);
+    }
+    if (eb.ptBins.size()>0)
+      fl.etaBins.push_back(eb);
+  }
+
+  fl.loaded = true;
+}
+
+
+BTagSFTable::Node BTagSFTable::Interpolate(Flavor const& fl, EtaBin const& eb, double pt) const
+{
+  int iB = (std::lower_bound(eb.ptEdges.begin(),eb.ptEdges.end(),pt) - eb.ptEdges.begin()) - 1;
+  iB = std::max(0,std::min((int)eb.ptBins.size()-1,iB));
+  PtBin const& pb = eb.ptBins[iB];
+
+  double t = std::max(0.,(pt-pb.lo)*pb.invStep);
+  unsigned iN = std::min((unsigned)t,pb.n-2);
+  double f = std::min(1.,t-iN);
+  Node const& a = fl.nodes[pb.first+iN];
+  Node const& b = fl.nodes[pb.first+iN+1];
+  Node n;
+  n.sf   = a.sf   + f*(b.sf-a.sf);
+  n.up   = a.up   + f*(b.up-a.up);
+  n.down = a.down + f*(b.down-a.down);
+  return n;
+}
+
+
+void BTagSFTable::Eval(BTagEntry::JetFlavor jf, double eta, double pt,
+                       double &sf, double &sfUp, double &sfDown) const
+{
+  sf = 0; sfUp = 0; sfDown = 0;
+  Flavor const& fl = flavors[jf];
+  if (fl.absEta && eta<0)
+    eta = -eta;
+
+  // the reader's eta bins are [etaMin,etaMax]; on a shared edge the lower
+  // bin is taken, as the reader does for payloads in increasing eta
+  for (auto &eb : fl.etaBins) {
+    if (eta<eb.lo || eta>eb.hi)
+      continue;
+
+    bool outOfBounds = false;
+    if (pt<=eb.ptMin) {
+      pt = eb.ptMin+0.0001;
+      outOfBounds = true;
+    } else if (pt>eb.ptMax) {
+      pt = eb.ptMax-0.0001;
+      outOfBounds = true;
+    }
+
+    Node n = Interpolate(fl,eb,pt);
+    sf = n.sf;
+    sfUp = n.up;
+    sfDown = n.down;
+    if (outOfBounds) {
+      sfUp = sf + 2*(sfUp-sf);
+      sfDown = sf + 2*(sfDown-sf);
+    }
+    return;
+  }
+}
+
+
+double BTagSFTable::Validate(BTagCalibrationReader const& reader, unsigned nEta, unsigned nPt) const
+{
+  double maxDiff = 0;
+  for (int jf=BTagEntry::FLAV_B; jf<=BTagEntry::FLAV_UDSG; ++jf) {
+    if (!flavors[jf].loaded)
+      continue;
+    // a uniform grid, plus the bin edges, where the two disagree most easily
+    std::vector<double> etas;
+    for (unsigned iEta=0; iEta!=nEta; ++iEta)
+      etas.push_back(-2.5 + 5.*(iEta+0.5)/nEta);
+    for (auto &eb : flavors[jf].etaBins) {
+      etas.push_back(eb.lo);
+      etas.push_back(eb.hi);
+    }
+    double flavorDiff = 0;
+    for (double eta : etas) {
+      for (unsigned iPt=0; iPt!=nPt; ++iPt) {
+        double pt = 10 * std::pow(150.,(iPt+0.5)/nPt); // 10 GeV to 1.5 TeV
+        double sf, sfUp, sfDown;
+        Eval((BTagEntry::JetFlavor)jf,eta,pt,sf,sfUp,sfDown);
+        double ref     = reader.eval_auto_bounds("central",(BTagEntry::JetFlavor)jf,eta,pt);
+        double refUp   = reader.eval_auto_bounds("up",(BTagEntry::JetFlavor)jf,eta,pt);
+        double refDown = reader.eval_auto_bounds("down",(BTagEntry::JetFlavor)jf,eta,pt);
+        flavorDiff = std::max(flavorDiff,std::fabs(sf-ref));
+        flavorDiff = std::max(flavorDiff,std::fabs(sfUp-refUp));
+        flavorDiff = std::max(flavorDiff,std::fabs(sfDown-refDown));
+      }
+    }
+    PInfo("BTagSFTable::Validate",
+          TString::Format("flavor %i: max |table-reader| = %.3g",jf,flavorDiff));
+    maxDiff = std::max(maxDiff,flavorDiff);
+  }
+  if (maxDiff>tolerance)
+    PError("BTagSFTable::Validate",
+           TString::Format("max |table-reader| = %.3g is above the tolerance of %.3g",maxDiff,tolerance));
+  return maxDiff;
+}
@@ -0,0 +1,321 @@
+#include "../interface/CorrectionBundle.h"
+#include "PandaCore/Tools/interface/Common.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+  const char kMagic[8] = {'P','C','O','R','B','N','D','L'};
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t payloadSize;
+    uint64_t checksum;
+  };
+
+  // 64-bit FNV-1a over the payload
+  uint64_t Checksum(const char *data, uint64_t n) {
+    uint64_t h = 14695981039346656037ULL;
+    for (uint64_t i=0; i!=n; ++i) {
+      h ^= (unsigned char)data[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  template <typename T>
+  void Put(std::vector<char> &buf, T const& x) {
+    const char *c = reinterpret_cast<const char*>(&x);
+    buf.insert(buf.end(),c,c+sizeof(T));
+  }
+
+  void PutString(std::vector<char> &buf, TString const& s) {
+    Put<uint32_t>(buf,s.Length());
+    buf.insert(buf.end(),s.Data(),s.Data()+s.Length());
+  }
+
+  template <typename T>
+  bool Get(const char *&p, const char *end, T &x) {
+    if (end-p<(long)sizeof(T))
+      return false;
+    memcpy(&x,p,sizeof(T));
+    p += sizeof(T);
+    return true;
+  }
+
+  bool GetString(const char *&p, const char *end, TString &s) {
+    uint32_t n=0;
+    if (!Get(p,end,n) || end-p<(long)n)
+      return false;
+    s = TString(p,n);
+    p += n;
+    return true;
+  }
+
+  // size and FNV-1a checksum of a file's contents
+  bool Digest(TString const& path, int64_t &size, uint64_t &checksum) {
+    FILE *f = fopen(path.Data(),"rb");
+    if (!f)
+      return false;
+    size = 0;
+    checksum = 14695981039346656037ULL;
+    char buf[1<<16];
+    size_t n;
+    while ((n=fread(buf,1,sizeof(buf),f))>0) {
+      for (size_t i=0; i!=n; ++i) {
+        checksum ^= (unsigned char)buf[i];
+        checksum *= 1099511628211ULL;
+      }
+      size += n;
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+  }
+
+  bool Stat(TString const& path, int64_t &size, int64_t &mtime) {
+    struct stat st;
+    if (stat(path.Data(),&st)!=0)
+      return false;
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+  }
+
+  // sources under dataDir are stored relative to it
+  TString Relative(TString const& source, TString const& dataDir) {
+    if (dataDir!="" && source.BeginsWith(dataDir))
+      return source(dataDir.Length(),source.Length()-dataDir.Length());
+    return source;
+  }
+
+  TString Resolve(TString const& source, TString const& dataDir) {
+    return source.BeginsWith("/") ? source : dataDir+source;
+  }
+}
+
+
+void CorrectionBundle::WriteAxis(std::vector<char> &buf, CorrAxis const& axis)
+{
+  Put<int32_t>(buf,axis.nBins);
+  Put<uint8_t>(buf,axis.uniform);
+  Put(buf,axis.lo);
+  Put(buf,axis.hi);
+  Put(buf,axis.loCenter);
+  Put(buf,axis.hiCenter);
+  for (double e : axis.edges)
+    Put(buf,e);
+}
+
+
+bool CorrectionBundle::ReadAxis(const char *&p, const char *end, CorrAxis &axis)
+{
+  int32_t nBins=0;
+  uint8_t uniform=0;
+  if (!(Get(p,end,nBins) && nBins>0 && Get(p,end,uniform) &&
+        Get(p,end,axis.lo) && Get(p,end,axis.hi) &&
+        Get(p,end,axis.loCenter) && Get(p,end,axis.hiCenter)))
+    return false;
+  axis.nBins = nBins;
+  axis.uniform = uniform;
+  axis.edges.resize(nBins+1);
+  for (auto &e : axis.edges) {
+    if (!Get(p,end,e))
+      return false;
+  }
+  return true;
+}
+
+
+bool CorrectionBundle::Write(TString path, TString configKey, TString dataDir, std::vector<TString> const& sources,
+                             std::vector<CorrTable*> const& tables)
+{
+  std::vector<char> payload;
+  PutString(payload,configKey);
+
+  Put<uint32_t>(payload,sources.size());
+  for (auto &source : sources) {
+    int64_t size=0, mtime=0;
+    uint64_t sum=0;
+    if (!Stat(source,size,mtime) || !Digest(source,size,sum)) {
+      PError("CorrectionBundle::Write","Could not read "+source);
+      return false;
+    }
+    PutString(payload,Relative(source,dataDir));
+    Put(payload,size);
+    Put(payload,mtime);
+    Put(payload,sum);
+  }
+
+  uint32_t nTables=0;
+  for (auto *t : tables)
+    if (t)
+      ++nTables;
+  Put(payload,nTables);
+  for (unsigned ct=0; ct!=tables.size(); ++ct) {
+    CorrTable *t = tables[ct];
+    if (!t)
+      continue;
+    Put<uint32_t>(payload,ct);
+    Put<int32_t>(payload,t->dim);
+    WriteAxis(payload,t->xaxis);
+    WriteAxis(payload,t->yaxis);
+    for (auto &bin : t->bins) {
+      Put(payload,bin.val);
+      Put(payload,bin.err);
+    }
+  }
+
+  Header header;
+  memcpy(header.magic,kMagic,sizeof(kMagic));
+  header.version = version;
+  header.reserved = 0;
+  header.payloadSize = payload.size();
+  header.checksum = Checksum(payload.data(),payload.size());
+
+  // write to a temporary and rename, so readers never see a partial bundle
+  TString tmpPath = path+".tmp";
+  FILE *fBundle = fopen(tmpPath.Data(),"wb");
+  if (!fBundle) {
+    PError("CorrectionBundle::Write","Could not open "+tmpPath);
+    return false;
+  }
+  bool ok = (fwrite(&header,sizeof(header),1,fBundle)==1) &&
+            (fwrite(payload.data(),1,payload.size(),fBundle)==payload.size());
+  ok = (fclose(fBundle)==0) && ok;
+  if (!ok || rename(tmpPath.Data(),path.Data())!=0) {
+    PError("CorrectionBundle::Write","Could not write "+path);
+    unlink(tmpPath.Data());
+    return false;
+  }
+
+  PInfo("CorrectionBundle::Write",
+        TString::Format("Wrote %u tables from %u files to ",nTables,(unsigned)sources.size())+path);
+  return true;
+}
+
+
+bool CorrectionBundle::Read(TString path, TString configKey, TString dataDir, std::vector<CorrTable*> &tables)
+{
+  int fd = open(path.Data(),O_RDONLY);
+  if (fd<0) {
+    PInfo("CorrectionBundle::Read","No bundle at "+path);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd,&st)!=0 || st.st_size<(off_t)sizeof(Header)) {
+    PError("CorrectionBundle::Read","Bundle "+path+" is truncated");
+    close(fd);
+    return false;
+  }
+  void *mapped = mmap(0,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if (mapped==MAP_FAILED) {
+    PError("CorrectionBundle::Read","Could not map "+path);
+    return false;
+  }
+
+  const char *data = static_cast<const char*>(mapped);
+  std::vector<CorrTable*> loaded;
+  TString reason;
+  do {
+    Header header;
+    memcpy(&header,data,sizeof(header));
+    if (memcmp(header.magic,kMagic,sizeof(kMagic))!=0) {
+      reason = "not a correction bundle";
+      break;
+    }
+    if (header.version!=version) {
+      reason = TString::Format("version %u, expected %u",header.version,version);
+      break;
+    }
+    const char *p = data+sizeof(Header), *end = data+st.st_size;
+    if ((uint64_t)(end-p)!=header.payloadSize ||
+        Checksum(p,header.payloadSize)!=header.checksum) {
+      reason = "checksum mismatch";
+      break;
+    }
+
+    TString key;
+    if (!GetString(p,end,key) || key!=configKey) {
+      reason = "made for configuration "+key+", expected "+configKey;
+      break;
+    }
+
+    uint32_t nSources=0;
+    if (!Get(p,end,nSources)) {
+      reason = "corrupt source list";
+      break;
+    }
+    // a source with the recorded size and mtime is taken as unchanged; only
+    // one whose mtime moved (e.g. a fresh copy on the grid) is hashed
+    for (uint32_t iS=0; iS!=nSources && reason==""; ++iS) {
+      TString source;
+      int64_t size=0, mtime=0, curSize=-1, curMtime=0;
+      uint64_t sum=0, curSum=0;
+      if (!(GetString(p,end,source) && Get(p,end,size) && Get(p,end,mtime) && Get(p,end,sum))) {
+        reason = "corrupt source list";
+        break;
+      }
+      TString resolved = Resolve(source,dataDir);
+      bool same = Stat(resolved,curSize,curMtime) && curSize==size &&
+                  (curMtime==mtime || (Digest(resolved,curSize,curSum) && curSize==size && curSum==sum));
+      if (!same)
+        reason = resolved+" differs from the file the bundle was made from";
+    }
+    if (reason!="")
+      break;
+
+    uint32_t nTables=0;
+    if (!Get(p,end,nTables)) {
+      reason = "corrupt table list";
+      break;
+    }
+    loaded = std::vector<CorrTable*>(tables.size(),0);
+    for (uint32_t iT=0; iT!=nTables; ++iT) {
+      uint32_t ct=0;
+      int32_t dim=0;
+      CorrTable *t = new CorrTable();
+      bool ok = Get(p,end,ct) && ct<tables.size() && !loaded[ct] &&
+                Get(p,end,dim) && ReadAxis(p,end,t->xaxis) && ReadAxis(p,end,t->yaxis);
+      if (ok) {
+        t->dim = dim;
+        t->bins.resize(t->xaxis.nBins*t->yaxis.nBins);
+        for (auto &bin : t->bins) {
+          if (!(Get(p,end,bin.val) && Get(p,end,bin.err))) {
+            ok = false;
+            break;
+          }
+        }
+      }
+      if (!ok) {
+        delete t;
+        reason = "corrupt table";
+        break;
+      }
+      loaded[ct] = t;
+    }
+  } while (false);
+
+  munmap(mapped,st.st_size);
+
+  if (reason!="") {
+    PError("CorrectionBundle::Read","Ignoring "+path+": "+reason);
+    for (auto *t : loaded)
+      delete t;
+    return false;
+  }
+
+  for (unsigned ct=0; ct!=tables.size(); ++ct) {
+    if (loaded[ct]) {
+      delete tables[ct];
+      tables[ct] = loaded[ct];
+    }
+  }
+  return true;
+}
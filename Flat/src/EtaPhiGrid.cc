@@ -0,0 +1,91 @@
+#include "../interface/EtaPhiGrid.h"
+#include "PandaCore/Tools/interface/Common.h"
+#include "TMath.h"
+#include <algorithm>
+#include <cmath>
+
+EtaPhiGrid::EtaPhiGrid(double cellSize_, double etaMax_):
+  cellSize(cellSize_),
+  etaMax(etaMax_)
+{
+  nEta = std::max(1,(int)std::ceil(2*etaMax/cellSize));
+  nPhi = std::max(1,(int)std::floor(TMath::TwoPi()/cellSize));
+  offsets.assign(nEta*nPhi+1,0);
+}
+
+
+void EtaPhiGrid::Clear()
+{
+  staged.clear();
+  items.clear();
+  std::fill(offsets.begin(),offsets.end(),0);
+}
+
+
+int EtaPhiGrid::EtaCell(double eta) const
+{
+  int iEta = (int)std::floor((eta+etaMax)/cellSize);
+  return std::max(0,std::min(nEta-1,iEta));
+}
+
+
+int EtaPhiGrid::PhiCell(double phi) const
+{
+  // phi cells cover [0,2pi) and are slightly wider than cellSize
+  double phi02pi = phi - TMath::TwoPi()*std::floor(phi/TMath::TwoPi());
+  int iPhi = (int)(phi02pi*nPhi/TMath::TwoPi());
+  return std::min(nPhi-1,iPhi);
+}
+
+
+void EtaPhiGrid::Add(unsigned idx, double eta, double phi)
+{
+  staged.push_back({idx,(float)eta,(float)phi});
+}
+
+
+void EtaPhiGrid::Finalize()
+{
+  // counting sort into cells; a stable pass keeps the indices ordered within a cell
+  std::fill(offsets.begin(),offsets.end(),0);
+  for (auto &item : staged)
+    offsets[EtaCell(item.eta)*nPhi+PhiCell(item.phi)+1]++;
+  for (unsigned iC=1; iC!=offsets.size(); ++iC)
+    offsets[iC] += offsets[iC-1];
+  items.resize(staged.size());
+  std::vector<unsigned> fill(offsets.begin(),offsets.end()-1);
+  for (auto &item : staged)
+    items[fill[EtaCell(item.eta)*nPhi+PhiCell(item.phi)]++] = item;
+  staged.clear();
+}
+
+
+void EtaPhiGrid::Query(double eta, double phi, double dr2, std::vector<unsigned> &out) const
+{
+  out.clear();
+  if (items.size()==0)
+    return;
+
+  double dr = std::sqrt(dr2);
+  int etaLo = EtaCell(eta-dr), etaHi = EtaCell(eta+dr);
+  // phi cells are at least cellSize wide, so this many neighbours on each side suffice
+  int dPhi = (int)std::ceil(dr/cellSize);
+  int phiCenter = PhiCell(phi);
+  int phiLo = phiCenter-dPhi, phiHi = phiCenter+dPhi;
+  if (phiHi-phiLo+1>=nPhi) {
+    phiLo = 0;
+    phiHi = nPhi-1;
+  }
+
+  for (int iEta=etaLo; iEta<=etaHi; ++iEta) {
+    for (int iPhi=phiLo; iPhi<=phiHi; ++iPhi) {
+      int cell = iEta*nPhi + ((iPhi%nPhi)+nPhi)%nPhi;
+      for (unsigned iI=offsets[cell]; iI!=offsets[cell+1]; ++iI) {
+        Item const& item = items[iI];
+        if (DeltaR2(eta,phi,item.eta,item.phi)<dr2)
+          out.push_back(item.idx);
+      }
+    }
+  }
+  std::sort(out.begin(),out.end());
+}
@@ -0,0 +1,95 @@
+#include "../interface/EventContext.h"
+
+EventContext::~EventContext()
+{
+  for (auto *reader : btagReaders)
+    delete reader;
+
+  for (auto& iter : ak8UncReader)
+    delete iter.second;
+
+  delete ak8JERReader;
+
+  for (auto& iter : ak4UncReader)
+    delete iter.second;
+
+  for (auto& iter : ak4ScaleReader) {
+    delete iter.second;
+  }
+
+  for (auto *reader : jesSourceReaders)
+    delete reader;
+
+  delete ak4JERReader;
+  delete jetCorrector;
+
+  delete bjetreg_reader;
+  delete[] bjetreg_vars;
+
+  for (auto *f : f1Corrs)
+    delete f;
+  delete puppisd_corrGEN;
+  delete puppisd_corrRECO_cen;
+  delete puppisd_corrRECO_for;
+
+  delete profiler;
+}
+
+
+void EventContext::Reset()
+{
+  genObjects.clear();
+  genGrid.Clear();
+  finalGrid.Clear();
+  partonGrid.Clear();
+  genJetGrid.Clear();
+  genGraph.Clear();
+  matchPhos.clear();
+  matchEles.clear();
+  matchLeps.clear();
+  looseLeps.clear();
+  tightLeps.clear();
+  loosePhos.clear();
+  cleanedJets.clear();
+  isoJets.clear();
+  btaggedJets.clear();
+  centralJets.clear();
+  jesSourceJets.clear();
+  btagindices.clear();
+  genJetsNu.clear();
+  pfCands.Clear();
+  fj1 = 0;
+  for (FourVector *v_ : {&vPFMET, &vPuppiMET, &vpfUW, &vpfUZ, &vpfUA, &vpfU,
+                             &vpuppiUW, &vpuppiUZ, &vpuppiUA, &vpuppiU,
+                             &vJet, &vBarrelJets})
+  {
+    v_->SetPtEtaPhiM(0,0,0,0);
+  }
+  vMETNoMu.SetMagPhi(0,0);
+  gt->Reset();
+}
+
+
+void EventContext::BuildGenIndex()
+{
+  unsigned nG = event.genParticles.size();
+  for (unsigned iG=0; iG!=nG; ++iG) {
+    auto &gen = event.genParticles[iG];
+    genGrid.Add(iG,gen.eta(),gen.phi());
+    if (gen.finalState)
+      finalGrid.Add(iG,gen.eta(),gen.phi());
+    int apdgid = abs(gen.pdgid);
+    if ((apdgid>0 && apdgid<=5) || apdgid==21)
+      partonGrid.Add(iG,gen.eta(),gen.phi());
+  }
+  genGrid.Finalize();
+  finalGrid.Finalize();
+  partonGrid.Finalize();
+
+  unsigned nJ = event.ak4GenJets.size();
+  for (unsigned iJ=0; iJ!=nJ; ++iJ)
+    genJetGrid.Add(iJ,event.ak4GenJets[iJ].eta(),event.ak4GenJets[iJ].phi());
+  genJetGrid.Finalize();
+
+  genGraph.Build(event.genParticles);
+}
@@ -0,0 +1,225 @@
+#include "../interface/EventGenerator.h"
+#include "PandaCore/Tools/interface/Common.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1D.h"
+#include "TMath.h"
+#include "TVector2.h"
+
+using namespace panda;
+
+EventGenerator::EventGenerator(unsigned seed):
+  rng(seed)
+{ }
+
+
+int EventGenerator::Generate(TString outPath, unsigned nEvents)
+{
+  TFile *fOut = TFile::Open(outPath,"RECREATE");
+  if (!fOut || fOut->IsZombie()) {
+    PError("EventGenerator::Generate","Could not open "+outPath);
+    return 1;
+  }
+  TTree *tOut = new TTree("events","events");
+  TH1D *hSumW = new TH1D("hSumW","hSumW",1,0,2);
+
+  panda::Event event;
+  event.book(*tOut);
+
+  unsigned iE=0;
+  ProgressReporter pr("EventGenerator::Generate",&iE,&nEvents,10);
+  for (iE=0; iE!=nEvents; ++iE) {
+    pr.Report();
+    FillEvent(event,iE);
+    event.fill(*tOut);
+    hSumW->Fill(1,event.weight);
+  }
+
+  fOut->WriteTObject(tOut,"events");
+  fOut->WriteTObject(hSumW,"hSumW");
+  fOut->Close();
+
+  PInfo("EventGenerator::Generate",TString::Format("Wrote %u events to ",nEvents)+outPath);
+  return 0;
+}
+
+
+void EventGenerator::FillEvent(panda::Event &event, unsigned iE)
+{
+  event.runNumber = 1;
+  event.lumiNumber = 1 + iE/1000;
+  event.eventNumber = iE + 1;
+  event.isData = false;
+  event.weight = (rng.Uniform()<0.9) ? 1 : -1;
+  event.npv = rng.Poisson(20);
+  event.npvTrue = event.npv;
+  event.rho = rng.Uniform(5,30);
+
+  // MET and recoil
+  double metPt = FallingPt(20,metScale), metPhi = rng.Uniform(-TMath::Pi(),TMath::Pi());
+  event.pfMet.pt = metPt;
+  event.pfMet.phi = metPhi;
+  event.pfMet.ptCorrUp = metPt*1.03;
+  event.pfMet.ptCorrDown = metPt*0.97;
+  event.pfMet.sumETRaw = rng.Uniform(500,2500);
+  event.puppiMet.pt = metPt*rng.Gaus(1,0.1);
+  event.puppiMet.phi = metPhi;
+  event.rawMet.pt = metPt*0.9;
+  event.rawMet.phi = metPhi;
+  event.caloMet.pt = metPt*rng.Gaus(1,0.2);
+  event.caloMet.phi = metPhi;
+  event.trkMet.pt = metPt*rng.Gaus(0.7,0.2);
+  event.trkMet.phi = metPhi;
+  event.recoil.max = metPt;
+
+  axisEta.clear();
+  axisPhi.clear();
+
+  // AK4 jets
+  event.chsAK4Jets.clear();
+  unsigned nJ = rng.Poisson(nJets);
+  for (unsigned iJ=0; iJ!=nJ; ++iJ) {
+    auto &jet = event.chsAK4Jets.create_back();
+    double pt = FallingPt(15,60), eta = rng.Uniform(-4.7,4.7), phi = rng.Uniform(-TMath::Pi(),TMath::Pi());
+    jet.setPtEtaPhiM(pt,eta,phi,rng.Uniform(2,20));
+    jet.rawPt = pt*0.95;
+    jet.ptCorrUp = pt*1.03;
+    jet.ptCorrDown = pt*0.97;
+    jet.loose = rng.Uniform()<0.95;
+    jet.monojet = jet.loose && rng.Uniform()<0.9;
+    jet.csv = rng.Uniform();
+    jet.cmva = rng.Uniform(-1,1);
+    jet.qgl = rng.Uniform();
+    jet.chf = rng.Uniform(0,0.7);
+    jet.nhf = rng.Uniform(0,1-jet.chf);
+    jet.cef = rng.Uniform(0,0.3);
+    jet.nef = rng.Uniform(0,0.3);
+    axisEta.push_back(eta);
+    axisPhi.push_back(phi);
+  }
+
+  // fatjets
+  panda::FatJetCollection *fatjets = 0;
+  if (ak8)
+    fatjets = puppi ? &event.puppiAK8Jets : &event.chsAK8Jets;
+  else
+    fatjets = puppi ? &event.puppiCA15Jets : &event.chsCA15Jets;
+  fatjets->clear();
+  unsigned nFJ = rng.Poisson(nFatjets);
+  for (unsigned iJ=0; iJ!=nFJ; ++iJ) {
+    auto &fj = fatjets->create_back();
+    double pt = FallingPt(180,150), eta = rng.Uniform(-2.4,2.4), phi = rng.Uniform(-TMath::Pi(),TMath::Pi());
+    double mSD = rng.Uniform(10,250);
+    fj.setPtEtaPhiM(pt,eta,phi,mSD*1.1);
+    fj.rawPt = pt*0.95;
+    fj.ptCorrUp = pt*1.03;
+    fj.ptCorrDown = pt*0.97;
+    fj.loose = true;
+    fj.monojet = rng.Uniform()<0.9;
+    fj.mSD = mSD;
+    fj.tau1 = rng.Uniform(0.1,0.5);
+    fj.tau2 = fj.tau1*rng.Uniform(0.2,1);
+    fj.tau3 = fj.tau2*rng.Uniform(0.2,1);
+    fj.tau1SD = fj.tau1*0.9;
+    fj.tau2SD = fj.tau2*0.9;
+    fj.tau3SD = fj.tau3*0.9;
+    fj.double_sub = rng.Uniform(-1,1);
+    fj.htt_mass = rng.Uniform(0,250);
+    fj.htt_frec = rng.Uniform();
+    axisEta.push_back(eta);
+    axisPhi.push_back(phi);
+  }
+
+  // leptons, photons, taus
+  event.electrons.clear();
+  unsigned nEle = rng.Poisson(nElectrons);
+  for (unsigned iL=0; iL!=nEle; ++iL) {
+    auto &ele = event.electrons.create_back();
+    double pt = FallingPt(10,30);
+    ele.setPtEtaPhiM(pt,rng.Uniform(-2.5,2.5),rng.Uniform(-TMath::Pi(),TMath::Pi()),511e-6);
+    ele.smearedPt = pt;
+    ele.charge = (rng.Uniform()<0.5) ? -1 : 1;
+    ele.veto = true;
+    ele.loose = rng.Uniform()<0.9;
+    ele.medium = ele.loose && rng.Uniform()<0.9;
+    ele.tight = ele.medium && rng.Uniform()<0.9;
+    ele.hltsafe = ele.tight;
+    ele.dxy = rng.Gaus(0,0.01);
+    ele.dz = rng.Gaus(0,0.02);
+  }
+
+  event.muons.clear();
+  unsigned nMu = rng.Poisson(nMuons);
+  for (unsigned iL=0; iL!=nMu; ++iL) {
+    auto &mu = event.muons.create_back();
+    double pt = FallingPt(10,30);
+    mu.setPtEtaPhiM(pt,rng.Uniform(-2.4,2.4),rng.Uniform(-TMath::Pi(),TMath::Pi()),0.106);
+    mu.charge = (rng.Uniform()<0.5) ? -1 : 1;
+    mu.loose = true;
+    mu.medium = rng.Uniform()<0.9;
+    mu.tight = mu.medium && rng.Uniform()<0.9;
+    mu.combIso = pt*rng.Uniform(0,0.3);
+    mu.dxy = rng.Gaus(0,0.01);
+    mu.dz = rng.Gaus(0,0.02);
+  }
+
+  event.photons.clear();
+  unsigned nPho = rng.Poisson(nPhotons);
+  for (unsigned iP=0; iP!=nPho; ++iP) {
+    auto &pho = event.photons.create_back();
+    pho.setPtEtaPhiM(FallingPt(15,50),rng.Uniform(-2.5,2.5),rng.Uniform(-TMath::Pi(),TMath::Pi()),0);
+    pho.loose = true;
+    pho.medium = rng.Uniform()<0.8;
+    pho.csafeVeto = true;
+  }
+
+  event.taus.clear();
+  unsigned nTau = rng.Poisson(nTaus);
+  for (unsigned iT=0; iT!=nTau; ++iT) {
+    auto &tau = event.taus.create_back();
+    tau.setPtEtaPhiM(FallingPt(18,30),rng.Uniform(-2.3,2.3),rng.Uniform(-TMath::Pi(),TMath::Pi()),1.777);
+    tau.decayMode = true;
+    tau.decayModeNew = true;
+    tau.looseIsoMVA = rng.Uniform()<0.7;
+    tau.looseIsoMVAOld = tau.looseIsoMVA;
+  }
+
+  // PF candidates: a falling spectrum over the whole detector,
+  // plus collimated sprays around the jet axes
+  event.pfCandidates.clear();
+  unsigned nPF = rng.Poisson(nPFCands);
+  for (unsigned iP=0; iP!=nPF; ++iP) {
+    auto &cand = event.pfCandidates.create_back();
+    double eta, phi;
+    if (axisEta.size()>0 && rng.Uniform()<fracPFInJets) {
+      unsigned iA = rng.Integer(axisEta.size());
+      eta = axisEta[iA] + rng.Gaus(0,0.3);
+      phi = TVector2::Phi_mpi_pi(axisPhi[iA] + rng.Gaus(0,0.3));
+    } else {
+      eta = rng.Uniform(-4.7,4.7);
+      phi = rng.Uniform(-TMath::Pi(),TMath::Pi());
+    }
+    cand.setPtEtaPhiM(FallingPt(0.5,3),eta,phi,0.14);
+    double w = rng.Uniform();
+    cand.setPuppiW(w,w);
+  }
+
+  // gen particles, no decay chains
+  event.genParticles.clear();
+  static const int pdgids[] = {1,2,3,4,5,21,11,13,15,22,6,23,24,25};
+  unsigned nGen = rng.Poisson(nGenParticles);
+  for (unsigned iG=0; iG!=nGen; ++iG) {
+    auto &gen = event.genParticles.create_back();
+    int pdgid = pdgids[rng.Integer(sizeof(pdgids)/sizeof(int))];
+    gen.pdgid = (rng.Uniform()<0.5) ? -pdgid : pdgid;
+    gen.setPtEtaPhiM(FallingPt(1,40),rng.Uniform(-5,5),rng.Uniform(-TMath::Pi(),TMath::Pi()),0);
+    gen.statusFlags = 0x7fff;
+  }
+
+  event.ak4GenJets.clear();
+  for (unsigned iA=0; iA!=axisEta.size(); ++iA) {
+    auto &gen = event.ak4GenJets.create_back();
+    gen.setPtEtaPhiM(FallingPt(15,60),axisEta[iA],axisPhi[iA],5);
+    gen.pdgid = 0;
+  }
+}
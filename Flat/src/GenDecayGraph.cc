@@ -0,0 +1,126 @@
+#include "../interface/GenDecayGraph.h"
+
+void GenDecayGraph::Clear()
+{
+  pdgids.clear();
+  parents.clear();
+  offsets.clear();
+  children.clear();
+  lastCopies.clear();
+  firstCopies.clear();
+  memoAncestor = -1;
+}
+
+
+int GenDecayGraph::Index(panda::Ref<panda::GenParticle> const& ref) const
+{
+  if (!ref.isValid())
+    return -1;
+  long idx = ref.idx();
+  return (idx>=0 && idx<(long)parents.size()) ? idx : -1;
+}
+
+
+void GenDecayGraph::Build(panda::GenParticleCollection const& gens)
+{
+  Clear();
+  unsigned nG = gens.size();
+  if (nG==0)
+    return;
+
+  pdgids.resize(nG);
+  parents.assign(nG,-1);
+  for (unsigned iG=0; iG!=nG; ++iG) {
+    auto &gen = gens[iG];
+    pdgids[iG] = gen.pdgid;
+    parents[iG] = Index(gen.parent);
+  }
+
+  // counting sort of the parent links; filling in index order keeps each list sorted
+  offsets.assign(nG+1,0);
+  for (int parent : parents)
+    if (parent>=0)
+      offsets[parent+1]++;
+  for (unsigned iG=0; iG!=nG; ++iG)
+    offsets[iG+1] += offsets[iG];
+  children.resize(offsets[nG]);
+  std::vector<unsigned> fill(offsets.begin(),offsets.end()-1);
+  for (unsigned iG=0; iG!=nG; ++iG)
+    if (parents[iG]>=0)
+      children[fill[parents[iG]]++] = iG;
+
+  // copy chains: down through the first daughter with the same pdgid, up through
+  // parents with the same pdgid. Each chain is walked once; the step limit only
+  // protects against a malformed (cyclic) history.
+  lastCopies.assign(nG,-1);
+  firstCopies.assign(nG,-1);
+  std::vector<unsigned> chain;
+  for (unsigned iG=0; iG!=nG; ++iG) {
+    if (lastCopies[iG]<0) {
+      chain.clear();
+      int j = iG;
+      while (lastCopies[j]<0 && chain.size()<nG) {
+        chain.push_back(j);
+        int next = -1;
+        for (unsigned iD=offsets[j]; iD!=offsets[j+1]; ++iD) {
+          if (pdgids[children[iD]]==pdgids[j]) {
+            next = children[iD];
+            break;
+          }
+        }
+        if (next<0)
+          break;
+        j = next;
+      }
+      int last = (lastCopies[j]<0) ? j : lastCopies[j];
+      for (unsigned k : chain)
+        lastCopies[k] = last;
+    }
+    if (firstCopies[iG]<0) {
+      chain.clear();
+      int j = iG;
+      while (firstCopies[j]<0 && chain.size()<nG) {
+        chain.push_back(j);
+        int parent = parents[j];
+        if (parent<0 || pdgids[parent]!=pdgids[j])
+          break;
+        j = parent;
+      }
+      int firstCopy = (firstCopies[j]<0) ? j : firstCopies[j];
+      for (unsigned k : chain)
+        firstCopies[k] = firstCopy;
+    }
+  }
+}
+
+
+bool GenDecayGraph::IsDescendantOf(unsigned i, unsigned ancestor) const
+{
+  if (memoAncestor!=(int)ancestor) {
+    memoAncestor = ancestor;
+    memo.assign(parents.size(),0);
+  }
+  if (memo[i]!=0)
+    return memo[i]==1;
+
+  // walk up until the answer is known, then record it for the whole path
+  path.clear();
+  char answer = 2;
+  int j = parents[i];
+  while (j>=0 && path.size()<parents.size()) {
+    if ((unsigned)j==ancestor) {
+      answer = 1;
+      break;
+    }
+    if (memo[j]!=0) {
+      answer = memo[j];
+      break;
+    }
+    path.push_back(j);
+    j = parents[j];
+  }
+  memo[i] = answer;
+  for (unsigned k : path)
+    memo[k] = answer;
+  return answer==1;
+}
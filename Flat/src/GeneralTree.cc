@@ -1,9 +1,20 @@
 #include "../interface/GeneralTree.h"
+#include <algorithm>
 #include <iostream>
 
 #define NJET 20
 #define NSUBJET 2
 
+// the independent sources of the Summer16 UncertaintySources files
+const char *const GeneralTree::jesSources[GeneralTree::nJESSources] = {
+  "AbsoluteStat", "AbsoluteScale", "AbsoluteMPFBias", "Fragmentation",
+  "SinglePionECAL", "SinglePionHCAL", "FlavorQCD", "TimePtEta",
+  "RelativeJEREC1", "RelativeJEREC2", "RelativeJERHF",
+  "RelativePtBB", "RelativePtEC1", "RelativePtEC2", "RelativePtHF",
+  "RelativeFSR", "RelativeStatFSR", "RelativeStatEC", "RelativeStatHF",
+  "PileUpDataMC", "PileUpPtRef", "PileUpPtBB", "PileUpPtEC1", "PileUpPtEC2", "PileUpPtHF"
+};
+
 GeneralTree::GeneralTree() {
 //STARTCUSTOMCONST
   for (unsigned iS=0; iS!=6; ++iS) {
@@ -18,10 +29,13 @@ GeneralTree::GeneralTree() {
         p.N = N;
         p.order = order;
         ecfParams.push_back(p);
-        fj1ECFNs[p] = -1;
       }
     }
   }
+  std::fill(fj1ECFNs,fj1ECFNs+nECF,-1);
+  for (float *a : {jot1PtJESUp, jot1PtJESDown, jot12MassJESUp, jot12MassJESDown,
+                   pfUmagJESUp, pfUmagJESDown, fj1PtJESUp_sj, fj1PtJESDown_sj})
+    std::fill(a,a+nJESSources,-1);
 
   for (unsigned iShift=0; iShift!=bNShift; ++iShift) {
     for (unsigned iJet=0; iJet!=bNJet; ++iJet) {
@@ -87,9 +101,10 @@ void GeneralTree::Reset() {
     scale[iS] = 1;
   }
 
-  for (auto p : ecfParams) { 
-    fj1ECFNs[p] = -1;
-  }
+  std::fill(fj1ECFNs,fj1ECFNs+nECF,-1);
+  for (float *a : {jot1PtJESUp, jot1PtJESDown, jot12MassJESUp, jot12MassJESDown,
+                   pfUmagJESUp, pfUmagJESDown, fj1PtJESUp_sj, fj1PtJESDown_sj})
+    std::fill(a,a+nJESSources,-1);
 
   for (auto p : btagParams) { 
     sf_btags[p] = 1;
@@ -631,7 +646,7 @@ void GeneralTree::WriteTree(TTree *t) {
 
   for (auto p : ecfParams) { 
     TString ecfn(makeECFString(p));
-    Book("fj1"+ecfn,&(fj1ECFNs[p]),"fj1"+ecfn+"/F");
+    Book("fj1"+ecfn,&(fj1ECFNs[ecfIndex(p.order,p.N,p.ibeta)]),"fj1"+ecfn+"/F");
   }
 
   for (auto p : btagParams) {
@@ -785,6 +800,19 @@ void GeneralTree::WriteTree(TTree *t) {
       Book(csvWeightString, &(sf_csvWeights[shift]), csvWeightString+"/F");
     }
   }
+  if (varyJESSources) {
+    TString dim = TString::Format("[%i]/F",nJESSources);
+    Book("jot1PtJESUp",jot1PtJESUp,"jot1PtJESUp"+dim);
+    Book("jot1PtJESDown",jot1PtJESDown,"jot1PtJESDown"+dim);
+    Book("jot12MassJESUp",jot12MassJESUp,"jot12MassJESUp"+dim);
+    Book("jot12MassJESDown",jot12MassJESDown,"jot12MassJESDown"+dim);
+    Book("pfUmagJESUp",pfUmagJESUp,"pfUmagJESUp"+dim);
+    Book("pfUmagJESDown",pfUmagJESDown,"pfUmagJESDown"+dim);
+    if (fatjet) {
+      Book("fj1PtJESUp_sj",fj1PtJESUp_sj,"fj1PtJESUp_sj"+dim);
+      Book("fj1PtJESDown_sj",fj1PtJESDown_sj,"fj1PtJESDown_sj"+dim);
+    }
+  }
 //ENDCUSTOMWRITE
     Book("trkmetphi",&trkmetphi,"trkmetphi/F");
     Book("whichRecoil",&whichRecoil,"whichRecoil/I");
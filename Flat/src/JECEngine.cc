@@ -0,0 +1,529 @@
+#include "../interface/JECEngine.h"
+#include "PandaCore/Tools/interface/Common.h"
+#include "TRandom3.h"
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+
+namespace {
+  std::vector<std::string> Tokens(std::string const& line) {
+    std::vector<std::string> tokens;
+    std::istringstream ss(line);
+    std::string t;
+    while (ss >> t)
+      tokens.push_back(t);
+    return tokens;
+  }
+
+  // as JetCorrectorParameters: parsed as double, stored as float
+  float ToFloat(std::string const& t) {
+    return strtod(t.c_str(),0);
+  }
+
+  int VarIndex(std::string const& name) {
+    static const char *names[] = {"JetEta","JetPt","JetPhi","JetE","JetA","Rho","JetEMF"};
+    for (int i=0; i!=7; ++i) {
+      if (name==names[i])
+        return i;
+    }
+    return -1;
+  }
+
+  // reorders the records of a flat [record*stride+i] array
+  template <typename T>
+  void Permute(std::vector<T> &v, std::vector<unsigned> const& order, unsigned stride) {
+    std::vector<T> out;
+    out.reserve(v.size());
+    for (unsigned iR : order) {
+      for (unsigned i=0; i!=stride; ++i)
+        out.push_back(v[iR*stride+i]);
+    }
+    v.swap(out);
+  }
+}
+
+
+bool JECEngine::LoadLevel(TString path, Level &level)
+{
+  std::ifstream fin(path.Data());
+  if (!fin.good()) {
+    PError("JECEngine::LoadLevel","Could not open "+path);
+    return false;
+  }
+
+  std::string line, formula;
+  unsigned nBin=0, nPar=0;
+  bool hasDefinition = false;
+  while (std::getline(fin,line)) {
+    std::vector<std::string> tokens = Tokens(line);
+    if (tokens.size()==0 || tokens[0][0]=='#')
+      continue;
+    if (tokens[0][0]=='[') {
+      PError("JECEngine::LoadLevel","Files with sections are not supported: "+path);
+      return false;
+    }
+
+    if (!hasDefinition) {
+      if (tokens[0][0]!='{') {
+        PError("JECEngine::LoadLevel","No definition line in "+path);
+        return false;
+      }
+      std::string def = line.substr(line.find('{')+1);
+      def = def.substr(0,def.rfind('}'));
+      tokens = Tokens(def);
+      nBin = tokens.size()>0 ? atoi(tokens[0].c_str()) : 0;
+      nPar = tokens.size()>nBin+1 ? atoi(tokens[nBin+1].c_str()) : 0;
+      if (nBin<1 || nBin>3 || nPar>4 || tokens.size()<nBin+nPar+5) {
+        PError("JECEngine::LoadLevel","Cannot read the definition line of "+path);
+        return false;
+      }
+      for (unsigned i=0; i!=nBin+nPar; ++i) {
+        int var = VarIndex(tokens[i<nBin ? i+1 : i+2]);
+        if (var<0) {
+          PError("JECEngine::LoadLevel",
+                 TString("Unsupported variable ")+tokens[i<nBin ? i+1 : i+2].c_str()+" in "+path);
+          return false;
+        }
+        if (i<nBin)
+          level.binVars.push_back(var);
+        else
+          level.parVars.push_back(var);
+      }
+      formula = tokens[nBin+nPar+2];
+      if (tokens[nBin+nPar+3]!="Correction") {
+        PError("JECEngine::LoadLevel","Only Correction levels are supported: "+path);
+        return false;
+      }
+      level.name = tokens[nBin+nPar+4].c_str();
+      hasDefinition = true;
+      continue;
+    }
+
+    // xMin xMax (per bin variable) nValues yMin yMax (per parameter variable) p0 p1 ...
+    if (tokens.size()<2*nBin+1 || (unsigned)atoi(tokens[2*nBin].c_str())!=tokens.size()-2*nBin-1
+        || tokens.size()<2*nBin+1+2*nPar) {
+      PError("JECEngine::LoadLevel","Malformed record in "+path+": "+line.c_str());
+      return false;
+    }
+    unsigned nParams = tokens.size()-2*nBin-1-2*nPar;
+    if (level.nRecords==0) {
+      level.nParams = nParams;
+    } else if (nParams!=level.nParams) {
+      PError("JECEngine::LoadLevel","Records with different numbers of parameters in "+path);
+      return false;
+    }
+    for (unsigned i=0; i!=nBin; ++i) {
+      level.binMin.push_back(ToFloat(tokens[2*i]));
+      level.binMax.push_back(ToFloat(tokens[2*i+1]));
+    }
+    unsigned first = 2*nBin+1;
+    for (unsigned i=0; i!=nPar; ++i) {
+      level.parMin.push_back(ToFloat(tokens[first+2*i]));
+      level.parMax.push_back(ToFloat(tokens[first+2*i+1]));
+    }
+    for (unsigned k=0; k!=nParams; ++k)
+      level.params.push_back(ToFloat(tokens[first+2*nPar+k]));
+    ++(level.nRecords);
+  }
+
+  if (!hasDefinition || level.nRecords==0) {
+    PError("JECEngine::LoadLevel","No records in "+path);
+    return false;
+  }
+
+  if (!Compile(formula,level.program)) {
+    PError("JECEngine::LoadLevel",TString("Cannot compile ")+formula.c_str()+" in "+path);
+    return false;
+  }
+  int depth=0, maxDepth=0;
+  for (auto &op : level.program) {
+    if ((op.code==kX && op.arg>=(int)nPar) || (op.code==kParam && op.arg>=(int)level.nParams)) {
+      PError("JECEngine::LoadLevel",TString("Formula ")+formula.c_str()+" uses undefined inputs in "+path);
+      return false;
+    }
+    if (op.code<=kParam)
+      ++depth;
+    else if (op.code<=kMin)
+      --depth;
+    maxDepth = std::max(depth,maxDepth);
+  }
+  if (depth!=1 || maxDepth>(int)kMaxStack) {
+    PError("JECEngine::LoadLevel",TString("Formula ")+formula.c_str()+" is too deep in "+path);
+    return false;
+  }
+
+  // JetCorrectorParameters sorts its records by the lower edge of the first bin
+  // variable, and binIndex returns the first match in that order, which decides
+  // between overlapping bins. Ties keep the file order
+  std::vector<unsigned> order(level.nRecords);
+  for (unsigned iR=0; iR!=level.nRecords; ++iR)
+    order[iR] = iR;
+  std::stable_sort(order.begin(),order.end(),
+                   [&level,nBin](unsigned a, unsigned b) { return level.binMin[a*nBin]<level.binMin[b*nBin]; });
+  Permute(level.binMin,order,nBin);
+  Permute(level.binMax,order,nBin);
+  Permute(level.parMin,order,nPar);
+  Permute(level.parMax,order,nPar);
+  Permute(level.params,order,level.nParams);
+
+  if (nBin==1) {
+    level.disjoint = true;
+    for (unsigned iR=1; iR<level.nRecords; ++iR) {
+      if (level.binMax[iR-1]>level.binMin[iR])
+        level.disjoint = false;
+    }
+  }
+  return true;
+}
+
+
+bool JECEngine::Load(std::vector<TString> const& paths)
+{
+  levels.clear();
+  for (auto &path : paths) {
+    levels.emplace_back();
+    if (!LoadLevel(path,levels.back())) {
+      levels.clear();
+      return false;
+    }
+  }
+  unsigned nRecords = 0;
+  for (auto &level : levels)
+    nRecords += level.nRecords;
+  PInfo("JECEngine::Load",TString::Format("Loaded %u levels with %u bins",(unsigned)levels.size(),nRecords));
+  return loaded();
+}
+
+
+int JECEngine::FindBin(Level const& level, const float *x) const
+{
+  if (level.disjoint) {
+    // last record starting at or below x, if x is also below its end
+    auto it = std::upper_bound(level.binMin.begin(),level.binMin.end(),x[0]);
+    if (it==level.binMin.begin())
+      return -1;
+    unsigned iR = (it-level.binMin.begin())-1;
+    return (x[0]<level.binMax[iR]) ? (int)iR : -1;
+  }
+  // first matching record in the sorted order, as JetCorrectorParameters::binIndex
+  unsigned nBin = level.binVars.size();
+  for (unsigned iR=0; iR!=level.nRecords; ++iR) {
+    bool inside = true;
+    for (unsigned i=0; i!=nBin; ++i) {
+      if (!(x[i]>=level.binMin[iR*nBin+i] && x[i]<level.binMax[iR*nBin+i]))
+        inside = false;
+    }
+    if (inside)
+      return iR;
+  }
+  return -1;
+}
+
+
+bool JECEngine::Compile(std::string const& formula, std::vector<Op> &prog) const
+{
+  prog.clear();
+  const char *s = formula.c_str();
+  return ParseSum(s,prog) && *s==0;
+}
+
+
+bool JECEngine::ParseSum(const char *&s, std::vector<Op> &prog) const
+{
+  if (!ParseProduct(s,prog))
+    return false;
+  while (*s=='+' || *s=='-') {
+    OpCode code = (*s=='+') ? kAdd : kSub;
+    ++s;
+    if (!ParseProduct(s,prog))
+      return false;
+    prog.push_back({code,0,0});
+  }
+  return true;
+}
+
+
+bool JECEngine::ParseProduct(const char *&s, std::vector<Op> &prog) const
+{
+  if (!ParseUnary(s,prog))
+    return false;
+  while (*s=='*' || *s=='/') {
+    OpCode code = (*s=='*') ? kMul : kDiv;
+    ++s;
+    if (!ParseUnary(s,prog))
+      return false;
+    prog.push_back({code,0,0});
+  }
+  return true;
+}
+
+
+bool JECEngine::ParseUnary(const char *&s, std::vector<Op> &prog) const
+{
+  if (*s=='-' || *s=='+') {
+    bool neg = (*s=='-');
+    ++s;
+    if (!ParseUnary(s,prog))
+      return false;
+    if (neg)
+      prog.push_back({kNeg,0,0});
+    return true;
+  }
+  if (!ParsePrimary(s,prog))
+    return false;
+  if (*s=='^') {
+    ++s;
+    if (!ParseUnary(s,prog))
+      return false;
+    prog.push_back({kPow,0,0});
+  }
+  return true;
+}
+
+
+bool JECEngine::ParsePrimary(const char *&s, std::vector<Op> &prog) const
+{
+  if (*s=='(') {
+    ++s;
+    if (!ParseSum(s,prog) || *s!=')')
+      return false;
+    ++s;
+    return true;
+  }
+
+  if (*s=='[') {
+    char *end;
+    long idx = strtol(s+1,&end,10);
+    if (end==s+1 || *end!=']' || idx<0)
+      return false;
+    s = end+1;
+    prog.push_back({kParam,(int)idx,0});
+    return true;
+  }
+
+  if (isdigit(*s) || *s=='.') {
+    char *end;
+    double value = strtod(s,&end);
+    if (end==s)
+      return false;
+    s = end;
+    prog.push_back({kConst,0,value});
+    return true;
+  }
+
+  std::string name;
+  while (isalnum(*s) || *s=='_' || *s==':')
+    name += *(s++);
+  if (name.size()==0)
+    return false;
+
+  if (*s!='(') {
+    static const std::string vars = "xyzt";
+    if (name.size()!=1 || vars.find(name)==std::string::npos)
+      return false;
+    prog.push_back({kX,(int)vars.find(name),0});
+    return true;
+  }
+
+  for (std::string prefix : {"TMath::","std::"}) {
+    if (name.compare(0,prefix.size(),prefix)==0)
+      name = name.substr(prefix.size());
+  }
+  std::transform(name.begin(),name.end(),name.begin(),::tolower);
+  OpCode code;
+  unsigned nArgs = 1;
+  if (name=="exp") code = kExp;
+  else if (name=="log") code = kLog;
+  else if (name=="log10") code = kLog10;
+  else if (name=="sqrt") code = kSqrt;
+  else if (name=="abs" || name=="fabs") code = kAbs;
+  else if (name=="erf") code = kErf;
+  else if (name=="pow" || name=="power") { code = kPow; nArgs = 2; }
+  else if (name=="max") { code = kMax; nArgs = 2; }
+  else if (name=="min") { code = kMin; nArgs = 2; }
+  else return false;
+
+  ++s;
+  for (unsigned iA=0; iA!=nArgs; ++iA) {
+    if (!ParseSum(s,prog))
+      return false;
+    if (*s!=(iA+1==nArgs ? ')' : ','))
+      return false;
+    ++s;
+  }
+  prog.push_back({code,0,0});
+  return true;
+}
+
+
+void JECEngine::CorrectBlock(unsigned n, float vars[][kBlock], float *factor) const
+{
+  int bins[kBlock];
+  double x[4][kBlock];
+  double stack[kMaxStack][kBlock];
+
+  for (unsigned i=0; i!=n; ++i)
+    factor[i] = 1;
+
+  for (auto &level : levels) {
+    unsigned nBin = level.binVars.size(), nPar = level.parVars.size();
+    for (unsigned i=0; i!=n; ++i) {
+      float xBin[3];
+      for (unsigned j=0; j!=nBin; ++j)
+        xBin[j] = vars[level.binVars[j]][i];
+      bins[i] = FindBin(level,xBin);
+      unsigned iR = std::max(bins[i],0); // jets outside all bins are evaluated, then ignored
+      for (unsigned j=0; j!=nPar; ++j) {
+        float y = vars[level.parVars[j]][i];
+        float lo = level.parMin[iR*nPar+j], hi = level.parMax[iR*nPar+j];
+        x[j][i] = (y<lo) ? lo : ((y>hi) ? hi : y);
+      }
+    }
+
+    // one instruction at a time over all jets of the block
+    unsigned sp = 0;
+    for (auto &op : level.program) {
+      double *top = stack[sp], *a = sp>1 ? stack[sp-2] : 0, *b = sp>0 ? stack[sp-1] : 0;
+      switch (op.code) {
+        case kConst:
+          for (unsigned i=0; i!=n; ++i) top[i] = op.value;
+          ++sp; break;
+        case kX:
+          for (unsigned i=0; i!=n; ++i) top[i] = x[op.arg][i];
+          ++sp; break;
+        case kParam:
+          for (unsigned i=0; i!=n; ++i) top[i] = level.params[std::max(bins[i],0)*level.nParams+op.arg];
+          ++sp; break;
+        case kAdd:
+          for (unsigned i=0; i!=n; ++i) a[i] = a[i]+b[i];
+          --sp; break;
+        case kSub:
+          for (unsigned i=0; i!=n; ++i) a[i] = a[i]-b[i];
+          --sp; break;
+        case kMul:
+          for (unsigned i=0; i!=n; ++i) a[i] = a[i]*b[i];
+          --sp; break;
+        case kDiv:
+          for (unsigned i=0; i!=n; ++i) a[i] = a[i]/b[i];
+          --sp; break;
+        case kPow:
+          for (unsigned i=0; i!=n; ++i) a[i] = std::pow(a[i],b[i]);
+          --sp; break;
+        case kMax:
+          for (unsigned i=0; i!=n; ++i) a[i] = std::max(a[i],b[i]);
+          --sp; break;
+        case kMin:
+          for (unsigned i=0; i!=n; ++i) a[i] = std::min(a[i],b[i]);
+          --sp; break;
+        case kNeg:
+          for (unsigned i=0; i!=n; ++i) b[i] = -b[i];
+          break;
+        case kExp:
+          for (unsigned i=0; i!=n; ++i) b[i] = std::exp(b[i]);
+          break;
+        case kLog:
+          for (unsigned i=0; i!=n; ++i) b[i] = std::log(b[i]);
+          break;
+        case kLog10:
+          for (unsigned i=0; i!=n; ++i) b[i] = std::log10(b[i]);
+          break;
+        case kSqrt:
+          for (unsigned i=0; i!=n; ++i) b[i] = std::sqrt(b[i]);
+          break;
+        case kAbs:
+          for (unsigned i=0; i!=n; ++i) b[i] = std::fabs(b[i]);
+          break;
+        case kErf:
+          for (unsigned i=0; i!=n; ++i) b[i] = std::erf(b[i]);
+          break;
+      }
+    }
+
+    // as FactorizedJetCorrector: float scale, and the next level sees pt and E
+    // scaled by it in float
+    for (unsigned i=0; i!=n; ++i) {
+      float scale = (bins[i]<0) ? 1 : (float)stack[0][i];
+      factor[i] *= scale;
+      vars[kJetPt][i] *= scale;
+      vars[kJetE][i] *= scale;
+    }
+  }
+}
+
+
+void JECEngine::Correct(unsigned nJets, const float *pt, const float *eta, const float *phi,
+                        const float *e, const float *area, float rho, float *factor) const
+{
+  float vars[kNVar][kBlock];
+  for (unsigned first=0; first<nJets; first+=kBlock) {
+    unsigned n = (nJets-first<kBlock) ? nJets-first : kBlock;
+    for (unsigned i=0; i!=n; ++i) {
+      unsigned iJ = first+i;
+      vars[kJetEta][i] = eta[iJ];
+      vars[kJetPt][i] = pt[iJ];
+      vars[kJetPhi][i] = phi[iJ];
+      vars[kJetE][i] = e[iJ];
+      vars[kJetA][i] = area[iJ];
+      vars[kRho][i] = rho;
+      vars[kJetEMF][i] = -99;
+    }
+    CorrectBlock(n,vars,factor+first);
+  }
+}
+
+
+float JECEngine::Correct(float pt, float eta, float phi, float e, float area, float rho) const
+{
+  float factor=1;
+  Correct(1,&pt,&eta,&phi,&e,&area,rho,&factor);
+  return factor;
+}
+
+
+double JECEngine::Validate(FactorizedJetCorrector &corrector, unsigned nPoints) const
+{
+  // random events of nPerEvent jets, corrected with one call each
+  const unsigned nPerEvent = 16;
+  TRandom3 rng(1234);
+  std::vector<float> pt(nPoints), eta(nPoints), phi(nPoints), e(nPoints), area(nPoints);
+  std::vector<float> rhos(nPoints), factor(nPoints);
+  for (unsigned iP=0; iP!=nPoints; ++iP) {
+    pt[iP] = std::exp(rng.Uniform(std::log(5.),std::log(5000.)));
+    eta[iP] = rng.Uniform(-5.4,5.4);
+    phi[iP] = rng.Uniform(-M_PI,M_PI);
+    double m = rng.Uniform(0,0.2)*pt[iP];
+    double p = pt[iP]*std::cosh(eta[iP]);
+    e[iP] = std::sqrt(p*p+m*m);
+    area[iP] = rng.Uniform(0.2,0.8);
+    rhos[iP] = (iP%nPerEvent==0) ? rng.Uniform(0,60) : rhos[iP-1];
+  }
+  for (unsigned first=0; first<nPoints; first+=nPerEvent) {
+    unsigned n = std::min(nPerEvent,nPoints-first);
+    Correct(n,&pt[first],&eta[first],&phi[first],&e[first],&area[first],rhos[first],&factor[first]);
+  }
+
+  double maxDiff = 0;
+  for (unsigned iP=0; iP!=nPoints; ++iP) {
+    corrector.setJetPt(pt[iP]);
+    corrector.setJetEta(eta[iP]);
+    corrector.setJetPhi(phi[iP]);
+    corrector.setJetE(e[iP]);
+    corrector.setRho(rhos[iP]);
+    corrector.setJetA(area[iP]);
+    corrector.setJetEMF(-99);
+    double ref = corrector.getCorrection();
+    double diff = std::fabs(factor[iP]-ref)/std::max(std::fabs(ref),1e-9);
+    maxDiff = std::max(maxDiff,diff);
+  }
+  if (maxDiff>kTolerance)
+    PError("JECEngine::Validate",
+           TString::Format("max relative |engine-corrector| = %.3g over %u jets, above %.0e",
+                           maxDiff,nPoints,kTolerance));
+  else
+    PInfo("JECEngine::Validate",
+          TString::Format("max relative |engine-corrector| = %.3g over %u jets",maxDiff,nPoints));
+  return maxDiff;
+}
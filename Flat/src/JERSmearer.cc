@@ -0,0 +1,168 @@
+#include "../interface/JERSmearer.h"
+#include "PandaCore/Tools/interface/Common.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+namespace {
+  std::vector<std::string> Tokens(std::string const& line) {
+    std::vector<std::string> tokens;
+    std::istringstream ss(line);
+    std::string t;
+    while (ss >> t)
+      tokens.push_back(t);
+    return tokens;
+  }
+
+  // as JetResolutionObject: parsed as double, stored as float
+  float ToFloat(std::string const& s) {
+    return std::strtod(s.c_str(),0);
+  }
+}
+
+
+bool JERSmearer::ReadResolution(TString path)
+{
+  std::ifstream fin(path.Data());
+  if (!fin.good()) {
+    PError("JERSmearer::ReadResolution","Could not open "+path);
+    return false;
+  }
+
+  bool defined = false;
+  std::string line;
+  while (std::getline(fin,line)) {
+    std::vector<std::string> tokens = Tokens(line);
+    if (tokens.size()==0 || tokens[0][0]=='#')
+      continue;
+
+    if (tokens[0][0]=='{') {
+      // {2 JetEta Rho 1 JetPt sqrt(...) Resolution}
+      if (tokens.size()<7 || tokens[0]!="{2" || tokens[1]!="JetEta" || tokens[2]!="Rho"
+          || tokens[3]!="1" || tokens[4]!="JetPt"
+          || tokens[5]!="sqrt([0]*abs([0])/(x*x)+[1]*[1]*pow(x,[3])+[2]*[2])") {
+        PError("JERSmearer::ReadResolution","Unsupported definition line in "+path+": "+line.c_str());
+        return false;
+      }
+      defined = true;
+      continue;
+    }
+    if (!defined) {
+      PError("JERSmearer::ReadResolution","No definition line in "+path);
+      return false;
+    }
+
+    // etaMin etaMax rhoMin rhoMax 6 ptMin ptMax p0 p1 p2 p3
+    if (tokens.size()!=11 || atoi(tokens[4].c_str())!=6) {
+      PError("JERSmearer::ReadResolution","Malformed record in "+path+": "+line.c_str());
+      return false;
+    }
+    ResRecord r;
+    r.etaMin = ToFloat(tokens[0]); r.etaMax = ToFloat(tokens[1]);
+    r.rhoMin = ToFloat(tokens[2]); r.rhoMax = ToFloat(tokens[3]);
+    r.ptMin = ToFloat(tokens[5]); r.ptMax = ToFloat(tokens[6]);
+    for (unsigned iP=0; iP!=4; ++iP)
+      r.par[iP] = ToFloat(tokens[7+iP]);
+    resRecords.push_back(r);
+  }
+  return resRecords.size()>0;
+}
+
+
+bool JERSmearer::ReadScaleFactors(TString path)
+{
+  std::ifstream fin(path.Data());
+  if (!fin.good()) {
+    PError("JERSmearer::ReadScaleFactors","Could not open "+path);
+    return false;
+  }
+
+  bool defined = false;
+  std::string line;
+  while (std::getline(fin,line)) {
+    std::vector<std::string> tokens = Tokens(line);
+    if (tokens.size()==0 || tokens[0][0]=='#')
+      continue;
+
+    if (tokens[0][0]=='{') {
+      // {1 JetEta 0 None ScaleFactor}
+      if (tokens.size()<3 || tokens[0]!="{1" || tokens[1]!="JetEta" || tokens[2]!="0") {
+        PError("JERSmearer::ReadScaleFactors","Unsupported definition line in "+path+": "+line.c_str());
+        return false;
+      }
+      defined = true;
+      continue;
+    }
+    if (!defined) {
+      PError("JERSmearer::ReadScaleFactors","No definition line in "+path);
+      return false;
+    }
+
+    // etaMin etaMax 3 nominal down up
+    if (tokens.size()!=6 || atoi(tokens[2].c_str())!=3) {
+      PError("JERSmearer::ReadScaleFactors","Malformed record in "+path+": "+line.c_str());
+      return false;
+    }
+    SFRecord r;
+    r.etaMin = ToFloat(tokens[0]); r.etaMax = ToFloat(tokens[1]);
+    r.sf = ToFloat(tokens[3]); r.sfDown = ToFloat(tokens[4]); r.sfUp = ToFloat(tokens[5]);
+    sfRecords.push_back(r);
+  }
+  return sfRecords.size()>0;
+}
+
+
+bool JERSmearer::Load(TString sfPath, TString resPath)
+{
+  resRecords.clear(); sfRecords.clear();
+  if (!ReadResolution(resPath) || !ReadScaleFactors(sfPath)) {
+    resRecords.clear(); sfRecords.clear();
+    return false;
+  }
+  PInfo("JERSmearer::Load",
+        TString::Format("Loaded %u resolution and %u scale factor records from ",
+                        (unsigned)resRecords.size(),(unsigned)sfRecords.size())+resPath);
+  return true;
+}
+
+
+double JERSmearer::Resolution(double pt, double eta, double rho) const
+{
+  for (auto const& r : resRecords) {
+    if (eta<r.etaMin || eta>r.etaMax || rho<r.rhoMin || rho>r.rhoMax)
+      continue;
+    double x = std::min(std::max(pt,(double)r.ptMin),(double)r.ptMax);
+    double res = std::sqrt(r.par[0]*std::fabs(r.par[0])/(x*x)
+                           + r.par[1]*r.par[1]*std::pow(x,r.par[3])
+                           + r.par[2]*r.par[2]);
+    return (float)res;
+  }
+  return 0;
+}
+
+
+void JERSmearer::ScaleFactors(double eta, double &sf, double &sfUp, double &sfDown) const
+{
+  sf = 1; sfUp = 1; sfDown = 1;
+  for (auto const& r : sfRecords) {
+    if (eta<r.etaMin || eta>r.etaMax)
+      continue;
+    sf = r.sf; sfUp = r.sfUp; sfDown = r.sfDown;
+    return;
+  }
+}
+
+
+void JERSmearer::GetStochasticSmear(double pt, double eta, double rho, double gaus,
+                                    double &smear, double &smearUp, double &smearDown) const
+{
+  double sf, sfUp, sfDown;
+  ScaleFactors(eta,sf,sfUp,sfDown);
+  double shift = gaus * Resolution(pt,eta,rho);
+  smear     = 1 + shift * std::sqrt(std::max(sf*sf-1,0.));
+  smearUp   = 1 + shift * std::sqrt(std::max(sfUp*sfUp-1,0.));
+  smearDown = 1 + shift * std::sqrt(std::max(sfDown*sfDown-1,0.));
+}
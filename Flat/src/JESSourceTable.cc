@@ -0,0 +1,265 @@
+#include "../interface/JESSourceTable.h"
+#include "PandaCore/Tools/interface/Common.h"
+#include "TRandom3.h"
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+namespace {
+  std::vector<std::string> Tokens(std::string const& line) {
+    std::vector<std::string> tokens;
+    std::istringstream ss(line);
+    std::string t;
+    while (ss >> t)
+      tokens.push_back(t);
+    return tokens;
+  }
+
+  // as JetCorrectorParameters: parsed as double, stored as float
+  float ToFloat(std::string const& s) {
+    return std::strtod(s.c_str(),0);
+  }
+}
+
+
+bool JESSourceTable::ReadSections(TString path, std::vector<TString> const& sources,
+                                  std::vector<Section> &sections) const
+{
+  std::ifstream fin(path.Data());
+  if (!fin.good()) {
+    PError("JESSourceTable::ReadSections","Could not open "+path);
+    return false;
+  }
+
+  sections.assign(sources.size(),Section());
+  std::vector<bool> found(sources.size(),false);
+  int current = -1;
+  std::string line;
+  while (std::getline(fin,line)) {
+    std::vector<std::string> tokens = Tokens(line);
+    if (tokens.size()==0 || tokens[0][0]=='#')
+      continue;
+
+    if (tokens[0][0]=='[') {
+      std::string name = line.substr(line.find('[')+1);
+      name = name.substr(0,name.find(']'));
+      current = -1;
+      for (unsigned iS=0; iS!=sources.size(); ++iS) {
+        if (sources[iS]==name.c_str()) {
+          current = iS;
+          found[iS] = true;
+          break;
+        }
+      }
+      continue;
+    }
+    if (current<0)
+      continue;
+
+    if (tokens[0][0]=='{') {
+      // {1 JetEta 1 JetPt "" Correction JECSource}
+      if (tokens.size()<4 || tokens[0]!="{1" || tokens[1]!="JetEta" || tokens[2]!="1" || tokens[3]!="JetPt") {
+        PError("JESSourceTable::ReadSections","Unsupported definition line in "+path+": "+line.c_str());
+        return false;
+      }
+      continue;
+    }
+
+    // etaMin etaMax nValues (pt up down)...
+    unsigned nValues = tokens.size()>2 ? atoi(tokens[2].c_str()) : 0;
+    if (nValues==0 || nValues!=tokens.size()-3 || nValues%3!=0) {
+      PError("JESSourceTable::ReadSections","Malformed record in "+path+": "+line.c_str());
+      return false;
+    }
+    Section &sec = sections[current];
+    sec.etaLo.push_back(ToFloat(tokens[0]));
+    sec.etaHi.push_back(ToFloat(tokens[1]));
+    sec.pt.emplace_back(); sec.up.emplace_back(); sec.down.emplace_back();
+    for (unsigned i=3; i<tokens.size(); i+=3) {
+      sec.pt.back().push_back(ToFloat(tokens[i]));
+      sec.up.back().push_back(ToFloat(tokens[i+1]));
+      sec.down.back().push_back(ToFloat(tokens[i+2]));
+    }
+  }
+
+  for (unsigned iS=0; iS!=sources.size(); ++iS) {
+    if (!found[iS] || sections[iS].etaLo.size()==0) {
+      PError("JESSourceTable::ReadSections","No source "+sources[iS]+" in "+path);
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool JESSourceTable::Load(TString path, std::vector<TString> const& sources)
+{
+  nSources = 0;
+  sourceNames.clear(); etaBins.clear();
+  ptNodes.clear(); upValues.clear(); downValues.clear();
+
+  std::vector<Section> sections;
+  if (sources.size()==0 || !ReadSections(path,sources,sections))
+    return false;
+
+  // records of each source in eta order
+  auto etaOrder = [](Section const& sec) {
+    std::vector<unsigned> order(sec.etaLo.size());
+    for (unsigned iR=0; iR!=order.size(); ++iR)
+      order[iR] = iR;
+    std::stable_sort(order.begin(),order.end(),
+                     [&sec](unsigned a, unsigned b) { return sec.etaLo[a]<sec.etaLo[b]; });
+    return order;
+  };
+
+  // the grid is taken from the first source
+  Section const& ref = sections[0];
+  unsigned nRecords = ref.etaLo.size();
+  std::vector<unsigned> order = etaOrder(ref);
+  for (unsigned iR=0; iR!=nRecords; ++iR) {
+    unsigned r = order[iR];
+    std::vector<float> const& pt = ref.pt[r];
+    if (iR>0 && ref.etaLo[r]<etaBins.back().hi) {
+      PError("JESSourceTable::Load","Overlapping eta bins in "+path);
+      return false;
+    }
+    for (unsigned i=1; i<pt.size(); ++i) {
+      if (!(pt[i]>pt[i-1])) {
+        PError("JESSourceTable::Load","pt nodes are not increasing in "+path);
+        return false;
+      }
+    }
+    EtaBin eb;
+    eb.lo = ref.etaLo[r]; eb.hi = ref.etaHi[r];
+    eb.first = ptNodes.size(); eb.n = pt.size();
+    etaBins.push_back(eb);
+    ptNodes.insert(ptNodes.end(),pt.begin(),pt.end());
+  }
+
+  unsigned nS = sources.size();
+  upValues.assign(ptNodes.size()*nS,0);
+  downValues.assign(ptNodes.size()*nS,0);
+  for (unsigned iS=0; iS!=nS; ++iS) {
+    Section const& sec = sections[iS];
+    if (sec.etaLo.size()!=nRecords) {
+      PError("JESSourceTable::Load","Source "+sources[iS]+" has different eta bins in "+path);
+      return false;
+    }
+    order = etaOrder(sec);
+    for (unsigned iR=0; iR!=nRecords; ++iR) {
+      unsigned r = order[iR];
+      EtaBin const& eb = etaBins[iR];
+      if (sec.etaLo[r]!=eb.lo || sec.etaHi[r]!=eb.hi || sec.pt[r].size()!=eb.n
+          || !std::equal(sec.pt[r].begin(),sec.pt[r].end(),ptNodes.begin()+eb.first)) {
+        PError("JESSourceTable::Load","Source "+sources[iS]+" has a different grid in "+path);
+        return false;
+      }
+      for (unsigned i=0; i!=eb.n; ++i) {
+        upValues[(eb.first+i)*nS+iS] = sec.up[r][i];
+        downValues[(eb.first+i)*nS+iS] = sec.down[r][i];
+      }
+    }
+  }
+
+  sourceNames = sources;
+  nSources = nS;
+  PInfo("JESSourceTable::Load",
+        TString::Format("Loaded %u sources on %u eta bins and %u pt nodes from ",
+                        nSources,nRecords,(unsigned)ptNodes.size())+path);
+  return true;
+}
+
+
+int JESSourceTable::FindEtaBin(float eta) const
+{
+  // first bin with lo>eta, then step back: the bins do not overlap
+  auto it = std::upper_bound(etaBins.begin(),etaBins.end(),eta,
+                             [](float x, EtaBin const& eb) { return x<eb.lo; });
+  if (it==etaBins.begin())
+    return -1;
+  --it;
+  return (eta<it->hi) ? it-etaBins.begin() : -1;
+}
+
+
+void JESSourceTable::Evaluate(unsigned nJets, const float *pt, const float *eta,
+                              float *up, float *down) const
+{
+  const unsigned nS = nSources;
+  for (unsigned iJ=0; iJ!=nJets; ++iJ) {
+    float *jetUp = up+iJ*nS, *jetDown = down+iJ*nS;
+    int iEta = FindEtaBin(eta[iJ]);
+    if (iEta<0) {
+      std::fill(jetUp,jetUp+nS,0);
+      std::fill(jetDown,jetDown+nS,0);
+      continue;
+    }
+
+    EtaBin const& eb = etaBins[iEta];
+    const float *x = &ptNodes[eb.first];
+    float y = pt[iJ];
+    unsigned node;
+    if (y<=x[0]) {
+      node = eb.first;
+    } else if (y>=x[eb.n-1]) {
+      node = eb.first+eb.n-1;
+    } else {
+      // x[i] <= y < x[i+1]
+      unsigned i = std::upper_bound(x,x+eb.n,y)-x-1;
+      float x0 = x[i], x1 = x[i+1];
+      const float *u0 = &upValues[(eb.first+i)*nS], *u1 = u0+nS;
+      const float *d0 = &downValues[(eb.first+i)*nS], *d1 = d0+nS;
+      for (unsigned iS=0; iS!=nS; ++iS) {
+        float a = (u1[iS]-u0[iS])/(x1-x0);
+        float b = (u0[iS]*x1-u1[iS]*x0)/(x1-x0);
+        jetUp[iS] = a*y+b;
+      }
+      for (unsigned iS=0; iS!=nS; ++iS) {
+        float a = (d1[iS]-d0[iS])/(x1-x0);
+        float b = (d0[iS]*x1-d1[iS]*x0)/(x1-x0);
+        jetDown[iS] = a*y+b;
+      }
+      continue;
+    }
+    std::copy(&upValues[node*nS],&upValues[node*nS]+nS,jetUp);
+    std::copy(&downValues[node*nS],&downValues[node*nS]+nS,jetDown);
+  }
+}
+
+
+double JESSourceTable::Validate(JetCorrectionUncertainty &reader, unsigned iSource, unsigned nPoints) const
+{
+  if (iSource>=nSources)
+    return -1;
+  TRandom3 rng(1234);
+  std::vector<float> pt(nPoints), eta(nPoints), up(nPoints*nSources), down(nPoints*nSources);
+  for (unsigned iP=0; iP!=nPoints; ++iP) {
+    pt[iP] = std::exp(rng.Uniform(std::log(5.),std::log(5000.)));
+    eta[iP] = rng.Uniform(etaBins.front().lo,etaBins.back().hi);
+  }
+  Evaluate(nPoints,pt.data(),eta.data(),up.data(),down.data());
+
+  double maxDiff = 0;
+  for (unsigned iP=0; iP!=nPoints; ++iP) {
+    if (FindEtaBin(eta[iP])<0)
+      continue; // the reader complains about these
+    for (bool isUp : {true,false}) {
+      reader.setJetEta(eta[iP]);
+      reader.setJetPt(pt[iP]);
+      double ref = reader.getUncertainty(isUp);
+      double val = isUp ? up[iP*nSources+iSource] : down[iP*nSources+iSource];
+      maxDiff = std::max(maxDiff,std::fabs(val-ref));
+    }
+  }
+  if (maxDiff>kTolerance)
+    PError("JESSourceTable::Validate",
+           TString::Format("%s: max |table-reader| = %.3g over %u jets, above %.0e",
+                           sourceNames[iSource].Data(),maxDiff,nPoints,kTolerance));
+  else
+    PInfo("JESSourceTable::Validate",
+          TString::Format("%s: max |table-reader| = %.3g over %u jets",
+                          sourceNames[iSource].Data(),maxDiff,nPoints));
+  return maxDiff;
+}
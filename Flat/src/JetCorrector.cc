@@ -1,8 +1,8 @@
 #include "../interface/JetCorrector.h"
-#include "TLorentzVector.h"
+#include "../interface/FourVector.h"
 
-JetCorrector::JetCorrector() 
-{ 
+JetCorrector::JetCorrector()
+{
 	era = new EraHandler(2016);
 }
 
@@ -10,110 +10,236 @@ JetCorrector::JetCorrector()
 JetCorrector::~JetCorrector()
 {
 	delete era;
-//	delete outjets;
-//	delete outmet;
+	delete outjets;
+	delete outmet;
 	delete mMCJetCorrector;
 	for (auto& iter : mDataJetCorrectors)
 		delete iter.second;
+	for (auto *engine : mOwnedEngines)
+		delete engine;
 }
 
-void JetCorrector::SetMCCorrector(TString fpath)
+void JetCorrector::LoadCorrector(TString fpath, JECEngine const*&engine, FactorizedJetCorrector *&corrector)
 {
-	delete mMCJetCorrector;
 	std::vector<TString> levels = {"L1FastJet","L2Relative","L3Absolute","L2L3Residual"};
+	std::vector<TString> paths;
+	for (auto &level : levels)
+		paths.push_back(TString::Format(fpath,level.Data()));
+
+	JECEngine *newEngine = new JECEngine();
+	if (newEngine->Load(paths)) {
+		mOwnedEngines.push_back(newEngine);
+	} else {
+		PError("JetCorrector::LoadCorrector","Falling back to FactorizedJetCorrector");
+		delete newEngine;
+		newEngine = 0;
+	}
+	engine = newEngine;
+
+	delete corrector;
+	corrector = 0;
+	if (engine && !validate)
+		return;
 	std::vector<JetCorrectorParameters> params;
-	for (auto &level : levels) {
+	for (auto &path : paths) {
 		params.push_back(
 				JetCorrectorParameters(
-					TString::Format(fpath,level.Data()).Data()
+					path.Data()
 					)
 				);
 	}
-	mMCJetCorrector = new FactorizedJetCorrector(params);
+	corrector = new FactorizedJetCorrector(params);
+	if (engine) {
+		if (engine->Validate(*corrector)>JECEngine::kTolerance) {
+			PError("JetCorrector::LoadCorrector","Falling back to FactorizedJetCorrector");
+			mOwnedEngines.pop_back();
+			delete newEngine;
+			engine = 0;
+		} else {
+			delete corrector;
+			corrector = 0;
+		}
+	}
+}
+
+void JetCorrector::SetMCCorrector(TString fpath)
+{
+	LoadCorrector(fpath,mMCEngine,mMCJetCorrector);
+	mSelected = false;
 }
 
 void JetCorrector::SetDataCorrector(TString fpath, TString iov)
 {
-	std::vector<TString> levels = {"L1FastJet","L2Relative","L3Absolute","L2L3Residual"};
-	std::vector<JetCorrectorParameters> params;
-	for (auto &level : levels) {
-		params.push_back(
-				JetCorrectorParameters(
-					TString::Format(fpath,level.Data()).Data()
-					)
-				);
-	}
-	mDataJetCorrectors[iov] = new FactorizedJetCorrector(params);
+	LoadCorrector(fpath,mDataEngines[iov],mDataJetCorrectors[iov]);
+	mSelected = false;
 }
 
-void JetCorrector::RunCorrection(bool isData, float rho, panda::JetCollection *injets_, panda::Met *rawmet_, int runNumber)
+void JetCorrector::SetMCCorrector(JECEngine const* engine)
 {
-	FactorizedJetCorrector *corrector=0;
+	mMCEngine = engine;
+	delete mMCJetCorrector;
+	mMCJetCorrector = 0;
+	mSelected = false;
+}
+
+void JetCorrector::SetDataCorrector(JECEngine const* engine, TString iov)
+{
+	mDataEngines[iov] = engine;
+	delete mDataJetCorrectors[iov];
+	mDataJetCorrectors[iov] = 0;
+	mSelected = false;
+}
+
+bool JetCorrector::SelectCorrector(bool isData, int runNumber)
+{
+	if (mSelected && mSelectedData==isData && (!isData || mSelectedRun==runNumber))
+		return mEngine!=0 || mCorrector!=0;
+
+	mEngine = 0;
+	mCorrector = 0;
 	if (isData) {
-		if (mDataJetCorrectors.find("all") != mDataJetCorrectors.end()) {
+		if (mDataEngines.find("all") != mDataEngines.end()) {
 			// we have an era-independent corrector. use it
-			corrector = mDataJetCorrectors["all"];
+			mCorrector = mDataJetCorrectors["all"];
+			mEngine = mDataEngines["all"];
 		} else {
 			TString thisEra = era->getEra(runNumber);
-			TString thisEraGroup;
-			for (auto &iter : mDataJetCorrectors) {
+			for (auto &iter : mDataEngines) {
 				if (iter.first.Contains(thisEra)) {
-					thisEraGroup = iter.first;
-					corrector = iter.second;
+					mCorrector = mDataJetCorrectors[iter.first];
+					mEngine = iter.second;
 					break;
 				}
 			}
 		}
 	} else {
-		corrector = mMCJetCorrector;
+		mCorrector = mMCJetCorrector;
+		mEngine = mMCEngine;
 	}
-	if (corrector==0) {
-		PError("JetCorrector::RunCorrection",
+	mSelected = true;
+	mSelectedData = isData;
+	mSelectedRun = runNumber;
+
+	if (mCorrector==0 && mEngine==0) {
+		PError("JetCorrector::SelectCorrector",
 				TString::Format("Could not determine data era for run %i",runNumber)
 				);
-		assert(corrector!=0);
+		return false;
 	}
+	return true;
+}
 
-	TLorentzVector v_outmet;
-	if (rawmet_) {
-		v_outmet.SetPtEtaPhiM(rawmet_->pt,0,rawmet_->phi,0);
-		outmet = new panda::Met();
+void JetCorrector::ComputeFactors(float rho, panda::JetCollection const& jets)
+{
+	unsigned nJ = jets.size();
+	mPt.resize(nJ); mEta.resize(nJ); mPhi.resize(nJ);
+	mE.resize(nJ); mArea.resize(nJ); mFactors.resize(nJ);
+	for (unsigned iJ=0; iJ!=nJ; ++iJ) {
+		auto &j = jets.at(iJ);
+		mPt[iJ] = j.rawPt;
+		mEta[iJ] = j.eta();
+		mPhi[iJ] = j.phi();
+		mE[iJ] = FourVector::PtEtaPhiM(j.rawPt,j.eta(),j.phi(),j.m()).E();
+		mArea[iJ] = j.area;
 	}
 
-	outjets = new panda::JetCollection();
-
-	TLorentzVector v_j_in, v_j_out;
-	for (auto &j_in : *injets_) {
-		double jecFactor = 1;
-		v_j_in.SetPtEtaPhiM(j_in.rawPt,j_in.eta(),j_in.phi(),j_in.m());
-		if (fabs(j_in.eta())<5.191) {
-			corrector->setJetPt(j_in.rawPt);
-			corrector->setJetEta(j_in.eta());
-			corrector->setJetPhi(j_in.phi());
-			corrector->setJetE(v_j_in.E());
-			corrector->setRho(rho);
-			corrector->setJetA(j_in.area);
-			corrector->setJetEMF(-99);
-			jecFactor = corrector->getCorrection();
+	// with the engine, the whole collection is corrected in one call
+	if (mEngine)
+		mEngine->Correct(nJ,mPt.data(),mEta.data(),mPhi.data(),mE.data(),mArea.data(),rho,mFactors.data());
+	for (unsigned iJ=0; iJ!=nJ; ++iJ) {
+		if (fabs(mEta[iJ])>=5.191) {
+			mFactors[iJ] = 1;
+		} else if (!mEngine) {
+			mCorrector->setJetPt(mPt[iJ]);
+			mCorrector->setJetEta(mEta[iJ]);
+			mCorrector->setJetPhi(mPhi[iJ]);
+			mCorrector->setJetE(mE[iJ]);
+			mCorrector->setRho(rho);
+			mCorrector->setJetA(mArea[iJ]);
+			mCorrector->setJetEMF(-99);
+			mFactors[iJ] = mCorrector->getCorrection();
 		}
-		v_j_out.SetPtEtaPhiM(jecFactor*j_in.rawPt,j_in.eta(),j_in.phi(),j_in.m());
-		
-		panda::Jet &j_out = outjets->create_back();
+	}
+}
+
+void JetCorrector::RunCorrection(bool isData, float rho, panda::JetCollection const& injets_, panda::JetCollection &outjets_,
+                                 panda::Met const* rawmet_, panda::Met *outmet_, int runNumber)
+{
+	if (!SelectCorrector(isData,runNumber))
+		assert(mCorrector!=0 || mEngine!=0);
+	ComputeFactors(rho,injets_);
+
+	double metPx=0, metPy=0;
+	if (rawmet_) {
+		FourVector v = FourVector::PtEtaPhiM(rawmet_->pt,0,rawmet_->phi,0);
+		metPx = v.Px(); metPy = v.Py();
+	}
+
+	outjets_.clear();
+	unsigned iJ = 0;
+	for (auto &j_in : injets_) {
+		double jecFactor = mFactors[iJ];
+		panda::Jet &j_out = outjets_.create_back();
 		j_out.setPtEtaPhiM(jecFactor*j_in.rawPt,j_in.eta(),j_in.phi(),j_in.m());
 		j_out.rawPt = j_in.rawPt;
 
 		if (rawmet_) {
-			TLorentzVector v_diff = v_j_in - v_j_out;
-			v_outmet += v_diff;
+			double ptIn = fabs(j_in.rawPt), ptOut = fabs(jecFactor*j_in.rawPt);
+			double cosPhi = cos(j_in.phi()), sinPhi = sin(j_in.phi());
+			metPx += ptIn*cosPhi - ptOut*cosPhi;
+			metPy += ptIn*sinPhi - ptOut*sinPhi;
 		}
+		++iJ;
 	}
 
-	if (rawmet_) {
-		outmet->pt = v_outmet.Pt();
-		outmet->phi = v_outmet.Phi();
+	if (rawmet_ && outmet_) {
+		FourVector v(metPx,metPy,0,0);
+		outmet_->pt = v.Pt();
+		outmet_->phi = v.Phi();
 	}
 }
 
-panda::JetCollection *JetCorrector::GetCorrectedJets() { return outjets; outjets = 0; }
+void JetCorrector::CorrectInPlace(bool isData, float rho, panda::JetCollection &jets_, panda::Met *met_, int runNumber)
+{
+	if (!SelectCorrector(isData,runNumber))
+		assert(mCorrector!=0 || mEngine!=0);
+	ComputeFactors(rho,jets_);
+
+	double metPx=0, metPy=0;
+	if (met_) {
+		FourVector v = FourVector::PtEtaPhiM(met_->pt,0,met_->phi,0);
+		metPx = v.Px(); metPy = v.Py();
+	}
+
+	unsigned iJ = 0;
+	for (auto &jet : jets_) {
+		double jecFactor = mFactors[iJ];
+		double ptOld = fabs(jet.pt()), ptNew = jecFactor*jet.rawPt;
+		if (met_) {
+			double cosPhi = cos(jet.phi()), sinPhi = sin(jet.phi());
+			metPx += ptOld*cosPhi - fabs(ptNew)*cosPhi;
+			metPy += ptOld*sinPhi - fabs(ptNew)*sinPhi;
+		}
+		jet.setPtEtaPhiM(ptNew,jet.eta(),jet.phi(),jet.m());
+		++iJ;
+	}
+
+	if (met_) {
+		FourVector v(metPx,metPy,0,0);
+		met_->pt = v.Pt();
+		met_->phi = v.Phi();
+	}
+}
+
+void JetCorrector::RunCorrection(bool isData, float rho, panda::JetCollection *injets_, panda::Met *rawmet_, int runNumber)
+{
+	if (!outjets)
+		outjets = new panda::JetCollection();
+	if (rawmet_ && !outmet)
+		outmet = new panda::Met();
+	RunCorrection(isData,rho,*injets_,*outjets,rawmet_,rawmet_ ? outmet : 0,runNumber);
+}
+
+panda::JetCollection *JetCorrector::GetCorrectedJets() { return outjets; }
 
-panda::Met *JetCorrector::GetCorrectedMet() { return outmet; outmet = 0; }
+panda::Met *JetCorrector::GetCorrectedMet() { return outmet; }
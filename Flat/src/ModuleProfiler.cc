@@ -0,0 +1,81 @@
+#include "../interface/ModuleProfiler.h"
+#include "PandaCore/Tools/interface/Common.h"
+#include <cmath>
+#include <cstdio>
+
+constexpr double ModuleProfiler::histMin;
+constexpr double ModuleProfiler::histMax;
+const unsigned ModuleProfiler::histBins;
+const unsigned ModuleProfiler::kRead;
+
+ModuleProfiler::ModuleProfiler(std::vector<TString> steps_):
+  steps(steps_),
+  calls(steps_.size(),0),
+  totals(steps_.size(),0),
+  hists(steps_.size(),std::vector<unsigned long>(histBins,0))
+{
+  last = Clock::now();
+}
+
+
+void ModuleProfiler::Record(unsigned iS, double dt)
+{
+  calls[iS]++;
+  totals[iS] += dt;
+  int bin = (dt>0) ? std::floor((std::log10(dt)-histMin)*histBins/(histMax-histMin)) : 0;
+  if (bin<0)
+    bin = 0;
+  else if (bin>=(int)histBins)
+    bin = histBins-1;
+  hists[iS][bin]++;
+}
+
+
+void ModuleProfiler::Add(const ModuleProfiler &other)
+{
+  if (other.steps.size()!=steps.size()) {
+    PError("ModuleProfiler::Add","Cannot merge profiles of different module plans!");
+    return;
+  }
+  nEvents += other.nEvents;
+  for (unsigned iS=0; iS!=steps.size(); ++iS) {
+    calls[iS] += other.calls[iS];
+    totals[iS] += other.totals[iS];
+    for (unsigned iB=0; iB!=histBins; ++iB)
+      hists[iS][iB] += other.hists[iS][iB];
+  }
+}
+
+
+void ModuleProfiler::WriteJSON(TString fpath, double wallTime) const
+{
+  FILE *fJSON = fopen(fpath.Data(),"w");
+  if (!fJSON) {
+    PError("ModuleProfiler::WriteJSON","Could not open "+fpath);
+    return;
+  }
+
+  double readTime = totals[kRead], computeTime = 0;
+  for (unsigned iS=kRead+1; iS!=steps.size(); ++iS)
+    computeTime += totals[iS];
+
+  fprintf(fJSON,"{\n");
+  fprintf(fJSON,"  \"events\": %lu,\n",nEvents);
+  fprintf(fJSON,"  \"wall_s\": %.6g,\n",wallTime);
+  fprintf(fJSON,"  \"events_per_s\": %.6g,\n",(wallTime>0) ? nEvents/wallTime : 0.);
+  fprintf(fJSON,"  \"getentry_s\": %.6g,\n",readTime);
+  fprintf(fJSON,"  \"compute_s\": %.6g,\n",computeTime);
+  fprintf(fJSON,"  \"hist_log10_s\": {\"min\": %g, \"max\": %g, \"bins\": %u},\n",
+          histMin,histMax,histBins);
+  fprintf(fJSON,"  \"steps\": [\n");
+  for (unsigned iS=0; iS!=steps.size(); ++iS) {
+    fprintf(fJSON,"    {\"name\": \"%s\", \"calls\": %lu, \"total_s\": %.6g, \"mean_s\": %.6g, \"hist\": [",
+            steps[iS].Data(),calls[iS],totals[iS],(calls[iS]>0) ? totals[iS]/calls[iS] : 0.);
+    for (unsigned iB=0; iB!=histBins; ++iB)
+      fprintf(fJSON,(iB==0) ? "%lu" : ",%lu",hists[iS][iB]);
+    fprintf(fJSON,(iS+1==steps.size()) ? "]}\n" : "]},\n");
+  }
+  fprintf(fJSON,"  ]\n");
+  fprintf(fJSON,"}\n");
+  fclose(fJSON);
+}
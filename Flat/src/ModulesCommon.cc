@@ -10,12 +10,12 @@ using namespace panda;
 using namespace std;
 
 
-void PandaAnalyzer::RegisterTriggers() 
+void PandaAnalyzer::RegisterTriggers(EventContext &ctx) 
 {
   for (auto &th : triggerHandlers) {
     unsigned N = th.paths.size();
     for (unsigned i = 0; i != N; i++) {
-      unsigned panda_idx = event.registerTrigger(th.paths.at(i));
+      unsigned panda_idx = ctx.event.registerTrigger(th.paths.at(i));
       th.indices[i] = panda_idx;
       if (DEBUG) PDebug("PandaAnalyzer::RegisterTriggers",
         Form("Got index %d for trigger path %s", panda_idx, th.paths.at(i).Data())
@@ -24,40 +24,102 @@ void PandaAnalyzer::RegisterTriggers()
   }
 }
 
-bool PandaAnalyzer::RecoilPresel() 
+bool PandaAnalyzer::RecoilPresel(EventContext &ctx) 
 {
     if ( (preselBits&kMonotop) || (preselBits&kMonohiggs) || 
          (preselBits&kMonojet) || (preselBits&kRecoil) ) 
     {
-       if (event.recoil.max<175)
+       if (ctx.event.recoil.max<175)
          return false;
     } 
     return true;
 }
 
-void PandaAnalyzer::TriggerEffs()
+CounterRNG::Stream PandaAnalyzer::RandomStream(EventContext const& ctx, unsigned object,
+                                               CounterRNG::Purpose purpose) const
+{
+  // a function of the event and the object only, whichever job or thread runs it
+  return CounterRNG(rngSeed).Get(ctx.event.runNumber,ctx.event.lumiNumber,ctx.event.eventNumber,
+                                 object,purpose);
+}
+
+void PandaAnalyzer::EventBasics(EventContext &ctx)
+{
+  ctx.gt->mcWeight = ctx.event.weight;
+  ctx.gt->runNumber = ctx.event.runNumber;
+  ctx.gt->lumiNumber = ctx.event.lumiNumber;
+  ctx.gt->eventNumber = ctx.event.eventNumber;
+  ctx.gt->npv = ctx.event.npv;
+  ctx.gt->pu = ctx.event.npvTrue;
+  ctx.gt->metFilter = (ctx.event.metFilters.pass()) ? 1 : 0;
+  ctx.gt->metFilter = (ctx.gt->metFilter==1 && !ctx.event.metFilters.badPFMuons) ? 1 : 0;
+  ctx.gt->metFilter = (ctx.gt->metFilter==1 && !ctx.event.metFilters.badChargedHadrons) ? 1 : 0;
+  if (isData) {
+    // save triggers
+    for (unsigned iT = 0; iT != kNTrig; ++iT) {
+      auto &th = triggerHandlers.at(iT);
+      for (auto iP : th.indices) {
+        if (ctx.event.triggerFired(iP)) {
+            ctx.gt->trigger |= (1 << iT);
+            break;
+        }
+      }
+    }
+  } else { // !isData
+    ctx.gt->sf_npv = GetCorr(cNPV,ctx.gt->npv);
+    ctx.gt->sf_pu = GetCorr(cPU,ctx.gt->pu);
+    ctx.gt->sf_puUp = GetCorr(cPUUp,ctx.gt->pu);
+    ctx.gt->sf_puDown = GetCorr(cPUDown,ctx.gt->pu);
+  }
+
+  ctx.tr->TriggerEvent("initialize");
+}
+
+void PandaAnalyzer::METBasics(EventContext &ctx)
+{
+  ctx.gt->pfmetRaw = ctx.event.rawMet.pt;
+  ctx.gt->pfmet = ctx.event.pfMet.pt;
+  ctx.gt->pfmetphi = ctx.event.pfMet.phi;
+  ctx.gt->calomet = ctx.event.caloMet.pt;
+  ctx.gt->sumETRaw = ctx.event.pfMet.sumETRaw;
+  ctx.gt->puppimet = ctx.event.puppiMet.pt;
+  ctx.gt->puppimetphi = ctx.event.puppiMet.phi;
+  ctx.gt->trkmet = ctx.event.trkMet.pt;
+  ctx.gt->trkmetphi = ctx.event.trkMet.phi;
+  ctx.vPFMET.SetPtEtaPhiM(ctx.gt->pfmet,0,ctx.gt->pfmetphi,0);
+  ctx.vPuppiMET.SetPtEtaPhiM(ctx.gt->puppimet,0,ctx.gt->puppimetphi,0);
+  ctx.vMETNoMu.SetMagPhi(ctx.gt->pfmet,ctx.gt->pfmetphi); //       for trigger eff
+  if (analysis->varyJES) {
+    ctx.gt->pfmetUp = ctx.event.pfMet.ptCorrUp;
+    ctx.gt->pfmetDown = ctx.event.pfMet.ptCorrDown;
+  }
+
+  ctx.tr->TriggerEvent("met");
+}
+
+void PandaAnalyzer::TriggerEffs(EventContext &ctx)
 {
 
     // trigger efficiencies
-    gt->sf_metTrig = GetCorr(cTrigMET,gt->pfmetnomu);
-    gt->sf_metTrigZmm = GetCorr(cTrigMETZmm,gt->pfmetnomu);
+    ctx.gt->sf_metTrig = GetCorr(cTrigMET,ctx.gt->pfmetnomu);
+    ctx.gt->sf_metTrigZmm = GetCorr(cTrigMETZmm,ctx.gt->pfmetnomu);
 
-    if (gt->nLooseElectron>0) {
+    if (ctx.gt->nLooseElectron>0) {
       panda::Electron *ele1=0, *ele2=0;
-      if (gt->nLooseLep>0) ele1 = dynamic_cast<panda::Electron*>(looseLeps[0]);
-      if (gt->nLooseLep>1) ele2 = dynamic_cast<panda::Electron*>(looseLeps[1]);
+      if (ctx.gt->nLooseLep>0) ele1 = dynamic_cast<panda::Electron*>(ctx.looseLeps[0]);
+      if (ctx.gt->nLooseLep>1) ele2 = dynamic_cast<panda::Electron*>(ctx.looseLeps[1]);
       float eff1=0, eff2=0;
       if (ele1 && ele1->tight) {
         eff1 = GetCorr(cTrigEle, ele1->eta(), ele1->pt());
         if (ele2 && ele2->tight)
           eff2 = GetCorr(cTrigEle, ele2->eta(), ele2->pt());
-        gt->sf_eleTrig = 1 - (1-eff1)*(1-eff2);
+        ctx.gt->sf_eleTrig = 1 - (1-eff1)*(1-eff2);
       }
     } // done with ele trig SF
-    if (gt->nLooseMuon>0) {
+    if (ctx.gt->nLooseMuon>0) {
       panda::Muon *mu1=0, *mu2=0;
-      if (gt->nLooseLep>0) mu1 = dynamic_cast<panda::Muon*>(looseLeps[0]);
-      if (gt->nLooseLep>1) mu2 = dynamic_cast<panda::Muon*>(looseLeps[1]);
+      if (ctx.gt->nLooseLep>0) mu1 = dynamic_cast<panda::Muon*>(ctx.looseLeps[0]);
+      if (ctx.gt->nLooseLep>1) mu2 = dynamic_cast<panda::Muon*>(ctx.looseLeps[1]);
       float eff1=0, eff2=0;
       if (mu1 && mu1->tight) {
 	eff1 = GetCorr(
@@ -71,94 +133,94 @@ void PandaAnalyzer::TriggerEffs()
 			 fabs(mu2->eta()),
 			 TMath::Max((float)26.,TMath::Min((float)499.99,(float)mu2->pt()))
 			 );
-	gt->sf_muTrig = 1 - (1-eff1)*(1-eff2);
+	ctx.gt->sf_muTrig = 1 - (1-eff1)*(1-eff2);
       }
     } // done with mu trig SF
 
-    if (gt->nLoosePhoton>0 && gt->loosePho1IsTight)
-      gt->sf_phoTrig = GetCorr(cTrigPho,gt->loosePho1Pt);
+    if (ctx.gt->nLoosePhoton>0 && ctx.gt->loosePho1IsTight)
+      ctx.gt->sf_phoTrig = GetCorr(cTrigPho,ctx.gt->loosePho1Pt);
 
     if (analysis->vbf) {
-      gt->sf_metTrigVBF = GetCorr(cVBF_TrigMET,gt->barrelHTMiss);
-      gt->sf_metTrigZmmVBF = GetCorr(cVBF_TrigMETZmm,gt->barrelHTMiss);
+      ctx.gt->sf_metTrigVBF = GetCorr(ctx,cVBF_TrigMET,ctx.gt->barrelHTMiss);
+      ctx.gt->sf_metTrigZmmVBF = GetCorr(ctx,cVBF_TrigMETZmm,ctx.gt->barrelHTMiss);
     }
-    tr->TriggerEvent("triggers");
+    ctx.tr->TriggerEvent("triggers");
 }
 
-void PandaAnalyzer::Recoil()
+void PandaAnalyzer::Recoil(EventContext &ctx)
 {
-    TLorentzVector vpfUp; vpfUp.SetPtEtaPhiM(gt->pfmetUp,0,gt->pfmetphi,0);
-    TLorentzVector vpfDown; vpfDown.SetPtEtaPhiM(gt->pfmetDown,0,gt->pfmetphi,0);
-    TLorentzVector vpfUWUp, vpfUWDown;
-    TLorentzVector vObj1, vObj2;
-    gt->whichRecoil = 0; // -1=photon, 0=MET, 1,2=nLep
-    if (gt->nLooseLep>0) {
-      panda::Lepton *lep1 = looseLeps.at(0);
+    FourVector vpfUp; vpfUp.SetPtEtaPhiM(ctx.gt->pfmetUp,0,ctx.gt->pfmetphi,0);
+    FourVector vpfDown; vpfDown.SetPtEtaPhiM(ctx.gt->pfmetDown,0,ctx.gt->pfmetphi,0);
+    FourVector vpfUWUp, vpfUWDown;
+    FourVector vObj1, vObj2;
+    ctx.gt->whichRecoil = 0; // -1=photon, 0=MET, 1,2=nLep
+    if (ctx.gt->nLooseLep>0) {
+      panda::Lepton *lep1 = ctx.looseLeps.at(0);
       vObj1.SetPtEtaPhiM(lep1->pt(),lep1->eta(),lep1->phi(),lep1->m());
 
       // one lep => W
-      vpuppiUW = vPuppiMET+vObj1; gt->puppiUWmag=vpuppiUW.Pt(); gt->puppiUWphi=vpuppiUW.Phi();
-      vpfUW = vPFMET+vObj1; gt->pfUWmag=vpfUW.Pt(); gt->pfUWphi=vpfUW.Phi();
+      ctx.vpuppiUW = ctx.vPuppiMET+vObj1; ctx.gt->puppiUWmag=ctx.vpuppiUW.Pt(); ctx.gt->puppiUWphi=ctx.vpuppiUW.Phi();
+      ctx.vpfUW = ctx.vPFMET+vObj1; ctx.gt->pfUWmag=ctx.vpfUW.Pt(); ctx.gt->pfUWphi=ctx.vpfUW.Phi();
       
       if (analysis->varyJES) {
-        vpfUWUp = vpfUp+vObj1; gt->pfUWmagUp = vpfUWUp.Pt();
-        vpfUWDown = vpfDown+vObj1; gt->pfUWmagDown = vpfUWDown.Pt();
+        vpfUWUp = vpfUp+vObj1; ctx.gt->pfUWmagUp = vpfUWUp.Pt();
+        vpfUWDown = vpfDown+vObj1; ctx.gt->pfUWmagDown = vpfUWDown.Pt();
       }
 
-      if (gt->nLooseLep>1 && looseLep1PdgId+looseLep2PdgId==0) {
+      if (ctx.gt->nLooseLep>1 && ctx.looseLep1PdgId+ctx.looseLep2PdgId==0) {
         // two OS lep => Z
-        panda::Lepton *lep2 = looseLeps.at(1);
+        panda::Lepton *lep2 = ctx.looseLeps.at(1);
         vObj2.SetPtEtaPhiM(lep2->pt(),lep2->eta(),lep2->phi(),lep2->m());
 
-        vpuppiUZ=vpuppiUW+vObj2; gt->puppiUZmag=vpuppiUZ.Pt(); gt->puppiUZphi=vpuppiUZ.Phi();
-        vpfUZ=vpfUW+vObj2; gt->pfUZmag=vpfUZ.Pt(); gt->pfUZphi=vpfUZ.Phi();
+        ctx.vpuppiUZ=ctx.vpuppiUW+vObj2; ctx.gt->puppiUZmag=ctx.vpuppiUZ.Pt(); ctx.gt->puppiUZphi=ctx.vpuppiUZ.Phi();
+        ctx.vpfUZ=ctx.vpfUW+vObj2; ctx.gt->pfUZmag=ctx.vpfUZ.Pt(); ctx.gt->pfUZphi=ctx.vpfUZ.Phi();
 
         if (analysis->varyJES) {
-          TLorentzVector vpfUZUp = vpfUWUp+vObj2; gt->pfUZmagUp = vpfUZUp.Pt();
-          TLorentzVector vpfUZDown = vpfUWDown+vObj2; gt->pfUZmagDown = vpfUZDown.Pt();
+          FourVector vpfUZUp = vpfUWUp+vObj2; ctx.gt->pfUZmagUp = vpfUZUp.Pt();
+          FourVector vpfUZDown = vpfUWDown+vObj2; ctx.gt->pfUZmagDown = vpfUZDown.Pt();
         }
 
-        vpuppiU = vpuppiUZ; vpfU = vpfUZ;
-        gt->whichRecoil = 2;
+        ctx.vpuppiU = ctx.vpuppiUZ; ctx.vpfU = ctx.vpfUZ;
+        ctx.gt->whichRecoil = 2;
       } else {
-        vpuppiU = vpuppiUW; vpfU = vpfUW;
-        gt->whichRecoil = 1;
+        ctx.vpuppiU = ctx.vpuppiUW; ctx.vpfU = ctx.vpfUW;
+        ctx.gt->whichRecoil = 1;
       }
     }
-    if (gt->nLoosePhoton>0) {
-      panda::Photon *pho = loosePhos.at(0);
+    if (ctx.gt->nLoosePhoton>0) {
+      panda::Photon *pho = ctx.loosePhos.at(0);
       vObj1.SetPtEtaPhiM(pho->pt(),pho->eta(),pho->phi(),0.);
 
-      vpuppiUA=vPuppiMET+vObj1; gt->puppiUAmag=vpuppiUA.Pt(); gt->puppiUAphi=vpuppiUA.Phi();
-      vpfUA=vPFMET+vObj1; gt->pfUAmag=vpfUA.Pt(); gt->pfUAphi=vpfUA.Phi();
+      ctx.vpuppiUA=ctx.vPuppiMET+vObj1; ctx.gt->puppiUAmag=ctx.vpuppiUA.Pt(); ctx.gt->puppiUAphi=ctx.vpuppiUA.Phi();
+      ctx.vpfUA=ctx.vPFMET+vObj1; ctx.gt->pfUAmag=ctx.vpfUA.Pt(); ctx.gt->pfUAphi=ctx.vpfUA.Phi();
 
       if (analysis->varyJES) {
-        TLorentzVector vpfUAUp = vpfUp+vObj1; gt->pfUAmagUp = vpfUAUp.Pt();
-        TLorentzVector vpfUADown = vpfDown+vObj1; gt->pfUAmagDown = vpfUADown.Pt();
+        FourVector vpfUAUp = vpfUp+vObj1; ctx.gt->pfUAmagUp = vpfUAUp.Pt();
+        FourVector vpfUADown = vpfDown+vObj1; ctx.gt->pfUAmagDown = vpfUADown.Pt();
       }
 
-      if (gt->nLooseLep==0) {
-        vpuppiU = vpuppiUA; vpfU = vpfUA;
-        gt->whichRecoil = -1;
+      if (ctx.gt->nLooseLep==0) {
+        ctx.vpuppiU = ctx.vpuppiUA; ctx.vpfU = ctx.vpfUA;
+        ctx.gt->whichRecoil = -1;
       }
     }
-    if (gt->nLooseLep==0 && gt->nLoosePhoton==0) {
-      vpuppiU = vPuppiMET;
-      vpfU = vPFMET;
-      gt->whichRecoil = 0;
+    if (ctx.gt->nLooseLep==0 && ctx.gt->nLoosePhoton==0) {
+      ctx.vpuppiU = ctx.vPuppiMET;
+      ctx.vpfU = ctx.vPFMET;
+      ctx.gt->whichRecoil = 0;
     }
-    gt->puppiUmag = vpuppiU.Pt();
-    gt->puppiUphi = vpuppiU.Phi();
-    gt->pfUmag = vpfU.Pt();
-    gt->pfUphi = vpfU.Phi();
+    ctx.gt->puppiUmag = ctx.vpuppiU.Pt();
+    ctx.gt->puppiUphi = ctx.vpuppiU.Phi();
+    ctx.gt->pfUmag = ctx.vpfU.Pt();
+    ctx.gt->pfUphi = ctx.vpfU.Phi();
 
-    tr->TriggerEvent("recoils");
+    ctx.tr->TriggerEvent("recoils");
 }
 
-void PandaAnalyzer::HeavyFlavorCounting() 
+void PandaAnalyzer::HeavyFlavorCounting(EventContext &ctx) 
 {
   // For now, simple B and C counting
-  for (auto& gen : event.genParticles) {
+  for (auto& gen : ctx.event.genParticles) {
     float pt = gen.pt();
     int pdgid = gen.pdgid;
     if (gen.parent.isValid() && gen.parent->pdgid==gen.pdgid)
@@ -168,28 +230,22 @@ void PandaAnalyzer::HeavyFlavorCounting()
     if (apdgid!=5 && apdgid!=4) 
       continue;
     if (gen.pt()>5) {
-      gt->nHF++;
+      ctx.gt->nHF++;
       if (apdgid==5)
-        gt->nB++;
+        ctx.gt->nB++;
     }
   }
 }
 
-void PandaAnalyzer::GetMETSignificance()
+void PandaAnalyzer::GetMETSignificance(EventContext &ctx)
 {
-  float pfEt = 0;
-  float puppiEt = 0;
-
-  TLorentzVector pfcand(0,0,0,0);
-  for (auto& pfCand : event.pfCandidates){
-    pfcand.SetPtEtaPhiM(pfCand.pt(),pfCand.eta(),pfCand.phi(),pfCand.m());
-    puppiEt += pfcand.Et()*pfCand.puppiW();
-    pfEt += pfcand.Et();
-  }
+  PFCandCache const& cands(ctx.PFCands());
+  float pfEt = cands.SumEt();
+  float puppiEt = cands.SumPuppiEt();
 
-  gt->pfmetsig = event.pfMet.pt/sqrt(pfEt);
-  gt->puppimetsig = event.puppiMet.pt/sqrt(puppiEt);
+  ctx.gt->pfmetsig = ctx.event.pfMet.pt/sqrt(pfEt);
+  ctx.gt->puppimetsig = ctx.event.puppiMet.pt/sqrt(puppiEt);
 
-  tr->TriggerEvent("MET significance");
+  ctx.tr->TriggerEvent("MET significance");
 }
 
@@ -3,6 +3,7 @@
 #include "TMath.h"
 #include <algorithm>
 #include <vector>
+#include <memory>
 
 #define EGMSCALE 1
 
@@ -10,31 +11,31 @@ using namespace panda;
 using namespace std;
 
 
-float PandaAnalyzer::GetMSDCorr(Float_t puppipt, Float_t puppieta) 
+float PandaAnalyzer::GetMSDCorr(EventContext &ctx, Float_t puppipt, Float_t puppieta) 
 {
 
   float genCorr  = 1.;
   float recoCorr = 1.;
   float totalWeight = 1.;
 
-  genCorr = puppisd_corrGEN->Eval( puppipt );
+  genCorr = ctx.puppisd_corrGEN->Eval( puppipt );
   if( fabs(puppieta) <= 1.3 ){
-    recoCorr = puppisd_corrRECO_cen->Eval( puppipt );
+    recoCorr = ctx.puppisd_corrRECO_cen->Eval( puppipt );
   }
   else{
-    recoCorr = puppisd_corrRECO_for->Eval( puppipt );
+    recoCorr = ctx.puppisd_corrRECO_for->Eval( puppipt );
   }
   totalWeight = genCorr * recoCorr;
 
   return totalWeight;
 }
 
-void PandaAnalyzer::FatjetBasics() 
+void PandaAnalyzer::FatjetBasics(EventContext &ctx) 
 {
-  fj1=0;
-  gt->nFatjet=0;
+  ctx.fj1=0;
+  ctx.gt->nFatjet=0;
   int fatjet_counter=-1;
-  for (auto& fj : *fatjets) {
+  for (auto& fj : *ctx.fatjets) {
     ++fatjet_counter;
     float pt = fj.pt();
     float rawpt = fj.rawPt;
@@ -48,119 +49,163 @@ void PandaAnalyzer::FatjetBasics()
       continue;
 
     float phi = fj.phi();
-    if (IsMatched(&matchLeps,FATJETMATCHDR2,eta,phi) || IsMatched(&matchPhos,FATJETMATCHDR2,eta,phi)) {
+    if (IsMatched(&ctx.matchLeps,FATJETMATCHDR2,eta,phi) || IsMatched(&ctx.matchPhos,FATJETMATCHDR2,eta,phi)) {
       continue;
     }
 
-    gt->nFatjet++;
-    if (gt->nFatjet==1) {
-      fj1 = &fj;
+    ctx.gt->nFatjet++;
+    if (ctx.gt->nFatjet==1) {
+      ctx.fj1 = &fj;
       if (fatjet_counter==0)
-        gt->fj1IsClean = 1;
+        ctx.gt->fj1IsClean = 1;
       else
-        gt->fj1IsClean = 0;
-      gt->fj1Pt = pt;
-      gt->fj1Eta = eta;
-      gt->fj1Phi = phi;
-      gt->fj1M = mass;
-      gt->fj1MSD = fj.mSD;
-      gt->fj1RawPt = rawpt;
+        ctx.gt->fj1IsClean = 0;
+      ctx.gt->fj1Pt = pt;
+      ctx.gt->fj1Eta = eta;
+      ctx.gt->fj1Phi = phi;
+      ctx.gt->fj1M = mass;
+      ctx.gt->fj1MSD = fj.mSD;
+      ctx.gt->fj1RawPt = rawpt;
 
       // do a bit of jet energy scaling
       if (analysis->varyJES) {
-        double scaleUnc = (fj.ptCorrUp - gt->fj1Pt) / gt->fj1Pt; 
-        gt->fj1PtScaleUp   = gt->fj1Pt  * (1 + 2*scaleUnc);
-        gt->fj1PtScaleDown  = gt->fj1Pt  * (1 - 2*scaleUnc);
-        gt->fj1MSDScaleUp  = gt->fj1MSD * (1 + 2*scaleUnc);
-        gt->fj1MSDScaleDown = gt->fj1MSD * (1 - 2*scaleUnc);
+        double scaleUnc = (fj.ptCorrUp - ctx.gt->fj1Pt) / ctx.gt->fj1Pt; 
+        ctx.gt->fj1PtScaleUp   = ctx.gt->fj1Pt  * (1 + 2*scaleUnc);
+        ctx.gt->fj1PtScaleDown  = ctx.gt->fj1Pt  * (1 - 2*scaleUnc);
+        ctx.gt->fj1MSDScaleUp  = ctx.gt->fj1MSD * (1 + 2*scaleUnc);
+        ctx.gt->fj1MSDScaleDown = ctx.gt->fj1MSD * (1 - 2*scaleUnc);
 
         // do some jet energy smearing
         if (isData) {
-          gt->fj1PtSmeared = gt->fj1Pt;
-          gt->fj1PtSmearedUp = gt->fj1Pt;
-          gt->fj1PtSmearedDown = gt->fj1Pt;
-          gt->fj1MSDSmeared = gt->fj1MSD;
-          gt->fj1MSDSmearedUp = gt->fj1MSD;
-          gt->fj1MSDSmearedDown = gt->fj1MSD;
+          ctx.gt->fj1PtSmeared = ctx.gt->fj1Pt;
+          ctx.gt->fj1PtSmearedUp = ctx.gt->fj1Pt;
+          ctx.gt->fj1PtSmearedDown = ctx.gt->fj1Pt;
+          ctx.gt->fj1MSDSmeared = ctx.gt->fj1MSD;
+          ctx.gt->fj1MSDSmearedUp = ctx.gt->fj1MSD;
+          ctx.gt->fj1MSDSmearedDown = ctx.gt->fj1MSD;
         } else {
           double smear=1, smearUp=1, smearDown=1;
-          ak8JERReader->getStochasticSmear(pt,eta,event.rho,smear,smearUp,smearDown);
+          if (ak8JERSmearer) {
+            double gaus = RandomStream(ctx,fatjet_counter,CounterRNG::kFatjetJER).Gaus();
+            ak8JERSmearer->GetStochasticSmear(pt,eta,ctx.event.rho,gaus,smear,smearUp,smearDown);
+          } else {
+            ctx.ak8JERReader->getStochasticSmear(pt,eta,ctx.event.rho,smear,smearUp,smearDown);
+          }
 
-          gt->fj1PtSmeared = smear*gt->fj1Pt;
-          gt->fj1PtSmearedUp = smearUp*gt->fj1Pt;
-          gt->fj1PtSmearedDown = smearDown*gt->fj1Pt;
+          ctx.gt->fj1PtSmeared = smear*ctx.gt->fj1Pt;
+          ctx.gt->fj1PtSmearedUp = smearUp*ctx.gt->fj1Pt;
+          ctx.gt->fj1PtSmearedDown = smearDown*ctx.gt->fj1Pt;
 
-          gt->fj1MSDSmeared = smear*gt->fj1MSD;
-          gt->fj1MSDSmearedUp = smearUp*gt->fj1MSD;
-          gt->fj1MSDSmearedDown = smearDown*gt->fj1MSD;
+          ctx.gt->fj1MSDSmeared = smear*ctx.gt->fj1MSD;
+          ctx.gt->fj1MSDSmearedUp = smearUp*ctx.gt->fj1MSD;
+          ctx.gt->fj1MSDSmearedDown = smearDown*ctx.gt->fj1MSD;
         }
 
         // now have to do this mess with the subjets...
-        TLorentzVector sjSum, sjSumUp, sjSumDown, sjSumSmear;
-        for (unsigned int iSJ=0; iSJ!=fj.subjets.size(); ++iSJ) {
+        FourVector sjSum, sjSumUp, sjSumDown, sjSumSmear;
+        unsigned nSJ = fj.subjets.size();
+        std::vector<float> sjFactors(nSJ,1);
+        std::vector<FourVector> sjCorr(nSJ);
+        if (ctx.jecEngineAK4) {
+          // all subjets in one call
+          std::vector<float> sjPt(nSJ), sjEta(nSJ), sjPhi(nSJ), sjE(nSJ), sjArea(nSJ,0);
+          for (unsigned int iSJ=0; iSJ!=nSJ; ++iSJ) {
+            auto& subjet = fj.subjets.objAt(iSJ);
+            sjPt[iSJ] = subjet.pt();
+            sjEta[iSJ] = subjet.eta();
+            sjPhi[iSJ] = subjet.phi();
+            sjE[iSJ] = subjet.e();
+          }
+          ctx.jecEngineAK4->Correct(nSJ,sjPt.data(),sjEta.data(),sjPhi.data(),sjE.data(),sjArea.data(),
+                                    ctx.event.rho,sjFactors.data());
+        }
+        for (unsigned int iSJ=0; iSJ!=nSJ; ++iSJ) {
           auto& subjet = fj.subjets.objAt(iSJ);
           // now correct...
           double factor=1;
-          if (fabs(subjet.eta())<5.191) {
-            scaleReaderAK4->setJetPt(subjet.pt());
-            scaleReaderAK4->setJetEta(subjet.eta());
-            scaleReaderAK4->setJetPhi(subjet.phi());
-            scaleReaderAK4->setJetE(subjet.e());
-            scaleReaderAK4->setRho(event.rho);
-            scaleReaderAK4->setJetA(0);
-            scaleReaderAK4->setJetEMF(-99.0);
-            factor = scaleReaderAK4->getCorrection();
+          if (fabs(subjet.eta())<5.191 && ctx.jecEngineAK4) {
+            factor = sjFactors[iSJ];
+          } else if (fabs(subjet.eta())<5.191) {
+            ctx.scaleReaderAK4->setJetPt(subjet.pt());
+            ctx.scaleReaderAK4->setJetEta(subjet.eta());
+            ctx.scaleReaderAK4->setJetPhi(subjet.phi());
+            ctx.scaleReaderAK4->setJetE(subjet.e());
+            ctx.scaleReaderAK4->setRho(ctx.event.rho);
+            ctx.scaleReaderAK4->setJetA(0);
+            ctx.scaleReaderAK4->setJetEMF(-99.0);
+            factor = ctx.scaleReaderAK4->getCorrection();
           }
-          TLorentzVector vCorr = factor * subjet.p4();
+          FourVector vCorr = factor * FourVector::PtEtaPhiM(subjet.pt(),subjet.eta(),subjet.phi(),subjet.m());
           sjSum += vCorr;
+          sjCorr[iSJ] = vCorr;
           double corr_pt = vCorr.Pt();
 
           // now vary
-          uncReaderAK4->setJetEta(subjet.eta()); uncReaderAK4->setJetPt(corr_pt);
-          double scaleUnc = uncReaderAK4->getUncertainty(true);
+          ctx.uncReaderAK4->setJetEta(subjet.eta()); ctx.uncReaderAK4->setJetPt(corr_pt);
+          double scaleUnc = ctx.uncReaderAK4->getUncertainty(true);
           sjSumUp += (1 + 2*scaleUnc) * vCorr;
           sjSumDown += (1 - 2*scaleUnc) * vCorr;
 
           // now smear...
           double smear=1, smearUp=1, smearDown=1;
-          ak4JERReader->getStochasticSmear(corr_pt,subjet.eta(),event.rho,smear,smearUp,smearDown);
+          if (ak4JERSmearer) {
+            double gaus = RandomStream(ctx,fatjet_counter<<8|iSJ,CounterRNG::kSubjetJER).Gaus();
+            ak4JERSmearer->GetStochasticSmear(corr_pt,subjet.eta(),ctx.event.rho,gaus,smear,smearUp,smearDown);
+          } else {
+            ctx.ak4JERReader->getStochasticSmear(corr_pt,subjet.eta(),ctx.event.rho,smear,smearUp,smearDown);
+          }
           sjSumSmear += smear * vCorr;
         }
-        gt->fj1PtScaleUp_sj = gt->fj1Pt * (sjSumUp.Pt()/sjSum.Pt());
-        gt->fj1PtScaleDown_sj = gt->fj1Pt * (sjSumDown.Pt()/sjSum.Pt());
-        gt->fj1PtSmeared_sj = gt->fj1Pt * (sjSumSmear.Pt()/sjSum.Pt());
-        gt->fj1MSDScaleUp_sj = gt->fj1MSD * (sjSumUp.Pt()/sjSum.Pt());
-        gt->fj1MSDScaleDown_sj = gt->fj1MSD * (sjSumDown.Pt()/sjSum.Pt());
-        gt->fj1MSDSmeared_sj = gt->fj1MSD * (sjSumSmear.Pt()/sjSum.Pt());
+        if (analysis->varyJESSources) {
+          // every source of all subjets in one call, varied like the total above
+          const unsigned nS = GeneralTree::nJESSources;
+          std::vector<float> sjCorrPt(nSJ), sjEta(nSJ), up(nSJ*nS), down(nSJ*nS);
+          for (unsigned int iSJ=0; iSJ!=nSJ; ++iSJ) {
+            sjCorrPt[iSJ] = sjCorr[iSJ].Pt();
+            sjEta[iSJ] = fj.subjets.objAt(iSJ).eta();
+          }
+          EvaluateJESSources(ctx,nSJ,sjCorrPt.data(),sjEta.data(),up.data(),down.data());
+          for (unsigned iS=0; iS!=nS; ++iS) {
+            FourVector sjSumSourceUp, sjSumSourceDown;
+            for (unsigned int iSJ=0; iSJ!=nSJ; ++iSJ) {
+              sjSumSourceUp += (1 + 2*up[iSJ*nS+iS]) * sjCorr[iSJ];
+              sjSumSourceDown += (1 - 2*down[iSJ*nS+iS]) * sjCorr[iSJ];
+            }
+            ctx.gt->fj1PtJESUp_sj[iS] = ctx.gt->fj1Pt * (sjSumSourceUp.Pt()/sjSum.Pt());
+            ctx.gt->fj1PtJESDown_sj[iS] = ctx.gt->fj1Pt * (sjSumSourceDown.Pt()/sjSum.Pt());
+          }
+        }
+        ctx.gt->fj1PtScaleUp_sj = ctx.gt->fj1Pt * (sjSumUp.Pt()/sjSum.Pt());
+        ctx.gt->fj1PtScaleDown_sj = ctx.gt->fj1Pt * (sjSumDown.Pt()/sjSum.Pt());
+        ctx.gt->fj1PtSmeared_sj = ctx.gt->fj1Pt * (sjSumSmear.Pt()/sjSum.Pt());
+        ctx.gt->fj1MSDScaleUp_sj = ctx.gt->fj1MSD * (sjSumUp.Pt()/sjSum.Pt());
+        ctx.gt->fj1MSDScaleDown_sj = ctx.gt->fj1MSD * (sjSumDown.Pt()/sjSum.Pt());
+        ctx.gt->fj1MSDSmeared_sj = ctx.gt->fj1MSD * (sjSumSmear.Pt()/sjSum.Pt());
       }
 
       if (analysis->monoh) {
         // mSD correction
         float corrweight=1.;
-        corrweight = GetMSDCorr(pt,eta);
-        gt->fj1MSD_corr = corrweight*gt->fj1MSD;
+        corrweight = GetMSDCorr(ctx,pt,eta);
+        ctx.gt->fj1MSD_corr = corrweight*ctx.gt->fj1MSD;
       }
 
       // now we do substructure
-      gt->fj1Tau32 = clean(fj.tau3/fj.tau2);
-      gt->fj1Tau32SD = clean(fj.tau3SD/fj.tau2SD);
-      gt->fj1Tau21 = clean(fj.tau2/fj.tau1);
-      gt->fj1Tau21SD = clean(fj.tau2SD/fj.tau1SD);
-
-      for (auto ibeta : ibetas) {
-        for (auto N : Ns) {
-          for (auto order : orders) {
-            GeneralTree::ECFParams p;
-            p.order = order; p.N = N; p.ibeta = ibeta;
-            if (gt->fj1IsClean || true)
-              gt->fj1ECFNs[p] = fj.get_ecf(order,N,ibeta);
-            else
-              gt->fj1ECFNs[p] = fj.get_ecf(order,N,ibeta);
-          }
+      ctx.gt->fj1Tau32 = clean(fj.tau3/fj.tau2);
+      ctx.gt->fj1Tau32SD = clean(fj.tau3SD/fj.tau2SD);
+      ctx.gt->fj1Tau21 = clean(fj.tau2/fj.tau1);
+      ctx.gt->fj1Tau21SD = clean(fj.tau2SD/fj.tau1SD);
+
+      // same (order,N,ibeta) order as GeneralTree::ecfIndex, so the array is filled front to back
+      float *ecfn = ctx.gt->fj1ECFNs;
+      for (int order=1; order<=GeneralTree::nECFOrders; ++order) {
+        for (int N=1; N<=GeneralTree::nECFNs; ++N) {
+          for (int ibeta=0; ibeta!=GeneralTree::nECFBetas; ++ibeta)
+            *(ecfn++) = fj.get_ecf(order,N,ibeta);
         }
       } //loop over betas
-      gt->fj1HTTMass = fj.htt_mass;
-      gt->fj1HTTFRec = fj.htt_frec;
+      ctx.gt->fj1HTTMass = fj.htt_mass;
+      ctx.gt->fj1HTTFRec = fj.htt_frec;
 
       std::vector<panda::MicroJet const*> subjets;
       for (unsigned iS(0); iS != fj.subjets.size(); ++iS)
@@ -172,78 +217,136 @@ void PandaAnalyzer::FatjetBasics()
 
       std::sort(subjets.begin(),subjets.end(),csvsort);
       if (subjets.size()>0) {
-        gt->fj1MaxCSV = subjets.at(0)->csv;
-        gt->fj1MinCSV = subjets.back()->csv;
+        ctx.gt->fj1MaxCSV = subjets.at(0)->csv;
+        ctx.gt->fj1MinCSV = subjets.back()->csv;
         if (subjets.size()>1) {
-          gt->fj1SubMaxCSV = subjets.at(1)->csv;
+          ctx.gt->fj1SubMaxCSV = subjets.at(1)->csv;
         }
       }
 
       if (analysis->monoh) {
-        gt->fj1DoubleCSV = fj.double_sub;
+        ctx.gt->fj1DoubleCSV = fj.double_sub;
         for (unsigned int iSJ=0; iSJ!=fj.subjets.size(); ++iSJ) {
           auto& subjet = fj.subjets.objAt(iSJ);
-          gt->fj1sjPt[iSJ]=subjet.pt();
-          gt->fj1sjEta[iSJ]=subjet.eta();
-          gt->fj1sjPhi[iSJ]=subjet.phi();
-          gt->fj1sjM[iSJ]=subjet.m();
-          gt->fj1sjCSV[iSJ]=subjet.csv;
-          gt->fj1sjQGL[iSJ]=subjet.qgl;
+          ctx.gt->fj1sjPt[iSJ]=subjet.pt();
+          ctx.gt->fj1sjEta[iSJ]=subjet.eta();
+          ctx.gt->fj1sjPhi[iSJ]=subjet.phi();
+          ctx.gt->fj1sjM[iSJ]=subjet.m();
+          ctx.gt->fj1sjCSV[iSJ]=subjet.csv;
+          ctx.gt->fj1sjQGL[iSJ]=subjet.qgl;
         }
       }
     }
   }
-  tr->TriggerSubEvent("fatjet basics");
+  ctx.tr->TriggerEvent("fatjet");
 }
 
-void PandaAnalyzer::FatjetRecluster() 
+void PandaAnalyzer::ConeGhosts(fastjet::PseudoJet const& axis, double cone, VPseudoJet &out) const
 {
-  if (fj1) {
-    VPseudoJet particles = ConvertPFCands(event.pfCandidates,analysis->puppi_jets,0);
-    fastjet::ClusterSequenceArea seq(particles,*jetDef,*areaDef);
-    VPseudoJet allJets(seq.inclusive_jets(0.));
-    fastjet::PseudoJet *pj1=0;
-    double minDR2 = 999;
-    for (auto &jet : allJets) {
-      double dr2 = DeltaR2(jet.eta(),jet.phi_std(),fj1->eta(),fj1->phi());
-      if (dr2<minDR2) {
-        minDR2 = dr2;
-        pj1 = &jet;
-      }
+  // the template is sorted in rapidity, so only the band around the axis is scanned
+  auto byRap = [](fastjet::PseudoJet const& g, double y) { return g.rap()<y; };
+  auto first = std::lower_bound(ghosts.begin(),ghosts.end(),axis.rap()-cone,byRap);
+  double cone2 = cone*cone, yMax = axis.rap()+cone;
+  for (auto g=first; g!=ghosts.end() && g->rap()<=yMax; ++g) {
+    if (g->squared_distance(axis)<cone2)
+      out.push_back(*g);
+  }
+}
+
+bool PandaAnalyzer::ReclusterFj1(EventContext &ctx, bool inCone, ReclusterVars &vars)
+{
+  VPseudoJet particles = ConvertPFCands(ctx.PFCands(),analysis->puppi_jets,0);
+  std::unique_ptr<fastjet::ClusterSequence> seq;
+  // both modes cluster with explicit ghosts from the template drawn in Init,
+  // as ClusterSequenceArea does with active_area_explicit_ghosts after
+  // drawing its own, so areas are computed the same way in both
+  if (inCone) {
+    // only the neighbourhood of fj1 matters, so keep the candidates and the
+    // ghosts in the cone
+    fastjet::PseudoJet axis(ctx.fj1->px(),ctx.fj1->py(),ctx.fj1->pz(),ctx.fj1->e());
+    double cone2 = analysis->reclusterCone*analysis->reclusterCone;
+    auto outside = [&axis,cone2](fastjet::PseudoJet const& p) { return p.squared_distance(axis)>=cone2; };
+    particles.erase(std::remove_if(particles.begin(),particles.end(),outside),particles.end());
+    VPseudoJet coneGhosts;
+    ConeGhosts(axis,analysis->reclusterCone,coneGhosts);
+    seq.reset(new fastjet::ClusterSequenceActiveAreaExplicitGhosts(particles,*jetDef,coneGhosts,ghostArea));
+  } else {
+    seq.reset(new fastjet::ClusterSequenceActiveAreaExplicitGhosts(particles,*jetDef,ghosts,ghostArea));
+  }
+  VPseudoJet allJets(seq->inclusive_jets(0.));
+  fastjet::PseudoJet *pj1=0;
+  double minDR2 = 999;
+  for (auto &jet : allJets) {
+    double dr2 = DeltaR2(jet.eta(),jet.phi_std(),ctx.fj1->eta(),ctx.fj1->phi());
+    if (dr2<minDR2) {
+      minDR2 = dr2;
+      pj1 = &jet;
     }
-    if (pj1) {
-      VPseudoJet constituents = fastjet::sorted_by_pt(pj1->constituents());
-
-      gt->fj1NConst = constituents.size();
-      double eTot=0, eTrunc=0;
-      for (unsigned iC=0; iC!=gt->fj1NConst; ++iC) {
-        double e = constituents.at(iC).E();
-        eTot += e;
-        if (iC<100)
-          eTrunc += e;
-      }
-      gt->fj1EFrac100 = eTrunc/eTot;
-
-
-      fastjet::PseudoJet sdJet = (*softDrop)(*pj1);
-      VPseudoJet sdConstituents = fastjet::sorted_by_pt(sdJet.constituents());
-      gt->fj1NSDConst = sdConstituents.size();
-      eTot=0; eTrunc=0;
-      for (unsigned iC=0; iC!=gt->fj1NSDConst; ++iC) {
-        double e = sdConstituents.at(iC).E();
-        eTot += e;
-        if (iC<100)
-          eTrunc += e;
-      }
-      gt->fj1SDEFrac100 = eTrunc/eTot;
+  }
+  if (!pj1)
+    return false;
+
+  VPseudoJet constituents = fastjet::sorted_by_pt(pj1->constituents());
+  vars.nConst = constituents.size();
+  double eTot=0, eTrunc=0;
+  for (int iC=0; iC!=vars.nConst; ++iC) {
+    double e = constituents.at(iC).E();
+    eTot += e;
+    if (iC<100)
+      eTrunc += e;
+  }
+  vars.eFrac100 = eTrunc/eTot;
+
+  fastjet::PseudoJet sdJet = (*softDrop)(*pj1);
+  VPseudoJet sdConstituents = fastjet::sorted_by_pt(sdJet.constituents());
+  vars.nSDConst = sdConstituents.size();
+  eTot=0; eTrunc=0;
+  for (int iC=0; iC!=vars.nSDConst; ++iC) {
+    double e = sdConstituents.at(iC).E();
+    eTot += e;
+    if (iC<100)
+      eTrunc += e;
+  }
+  vars.sdEFrac100 = eTrunc/eTot;
+  return true;
+}
 
+void PandaAnalyzer::FatjetRecluster(EventContext &ctx) 
+{
+  if (ctx.fj1) {
+    bool inCone = analysis->reclusterCone>0;
+    bool validate = inCone && validateRecluster;
+
+    ReclusterVars vars;
+    bool found = ReclusterFj1(ctx,inCone,vars);
+    if (found) {
+      ctx.gt->fj1NConst = vars.nConst;
+      ctx.gt->fj1EFrac100 = vars.eFrac100;
+      ctx.gt->fj1NSDConst = vars.nSDConst;
+      ctx.gt->fj1SDEFrac100 = vars.sdEFrac100;
     }
-    tr->TriggerSubEvent("fatjet reclustering");
+
+    if (validate) {
+      ReclusterVars full;
+      bool foundFull = ReclusterFj1(ctx,false,full);
+      ++ctx.nReclusterChecked;
+      if (found!=foundFull || vars.nConst!=full.nConst || vars.nSDConst!=full.nSDConst ||
+          vars.eFrac100!=full.eFrac100 || vars.sdEFrac100!=full.sdEFrac100) {
+        ++ctx.nReclusterDiffer;
+        PError("PandaAnalyzer::FatjetRecluster",
+               TString::Format("Event %llu: cone NConst=%i NSDConst=%i EFrac100=%g SDEFrac100=%g, "
+                               "full NConst=%i NSDConst=%i EFrac100=%g SDEFrac100=%g",
+                               (unsigned long long)ctx.event.eventNumber,
+                               vars.nConst,vars.nSDConst,vars.eFrac100,vars.sdEFrac100,
+                               full.nConst,full.nSDConst,full.eFrac100,full.sdEFrac100));
+      }
+    }
+    ctx.tr->TriggerEvent("fatjet reclustering");
   }
 
 }
 
-void PandaAnalyzer::FatjetMatching() 
+void PandaAnalyzer::FatjetMatching(EventContext &ctx) 
 {
   // identify interesting gen particles for fatjet matching
   unsigned int pdgidTarget=0;
@@ -267,113 +370,93 @@ void PandaAnalyzer::FatjetMatching()
 
     std::vector<int> targets;
 
-    int nGen = event.genParticles.size();
+    int nGen = ctx.event.genParticles.size();
     for (int iG=0; iG!=nGen; ++iG) {
-      auto& part(event.genParticles.at(iG));
+      auto& part(ctx.event.genParticles.at(iG));
       int pdgid = part.pdgid;
       unsigned int abspdgid = abs(pdgid);
       if (abspdgid == pdgidTarget)
         targets.push_back(iG);
     } //looking for targets
 
+    GenDecayGraph const& graph(ctx.genGraph);
     for (int iG : targets) {
-      auto& part(event.genParticles.at(iG));
+      auto& part(ctx.event.genParticles.at(iG));
 
       // check there is no further copy:
-      bool isLastCopy=true;
-      for (int jG : targets) {
-        if (event.genParticles.at(jG).parent.get() == &part) {
-          isLastCopy=false;
-          break;
-        }
-      }
-      if (!isLastCopy)
+      if (!graph.IsLastCopy(iG))
         continue;
 
       // (a) check it is a hadronic decay and if so, (b) calculate the size
       if (analysis->processType==kTop||analysis->processType==kTT) {
 
-        // first look for a W whose parent is the top at iG, or a W further down the chain
-        panda::GenParticle const* lastW(0);
-        for (int jG=0; jG!=nGen; ++jG) {
-          GenParticle const& partW(event.genParticles.at(jG));
-          if (TMath::Abs(partW.pdgid)==24 && partW.pdgid*part.pdgid>0) {
+        // first look for a W whose parent is the top at iG, then go down to its last copy
+        int iW=-1;
+        for (unsigned jG : graph.Daughters(iG)) {
+          int pdgidW = ctx.event.genParticles.at(jG).pdgid;
+          if (TMath::Abs(pdgidW)==24 && pdgidW*part.pdgid>0) {
             // it's a W and has the same sign as the top
-            if (!lastW && partW.parent.get() == &part) {
-              lastW = &partW;
-            } else if (lastW && partW.parent.get() == lastW) {
-              lastW = &partW;
-            }
+            iW = graph.LastCopy(jG);
+            break;
           }
         } // looking for W
-        if (!lastW) {// ???
+        if (iW<0) {// ???
           continue;
         }
-        auto& partW(*lastW);
+        auto& partW(ctx.event.genParticles.at(iW));
 
         // now look for b or W->qq
         int iB=-1, iQ1=-1, iQ2=-1;
         double size=0, sizeW=0;
-        for (int jG=0; jG!=nGen; ++jG) {
-          auto& partQ(event.genParticles.at(jG));
-          int pdgidQ = partQ.pdgid;
-          unsigned int abspdgidQ = TMath::Abs(pdgidQ);
-          if (abspdgidQ>5)
-            continue;
-          if (abspdgidQ==5 && iB<0 && partQ.parent.get() == &part) {
+        for (unsigned jG : graph.Daughters(iG)) {
+          auto& partQ(ctx.event.genParticles.at(jG));
+          if (TMath::Abs(partQ.pdgid)==5) {
             // only keep first copy
             iB = jG;
             size = TMath::Max(DeltaR2(part.eta(),part.phi(),partQ.eta(),partQ.phi()),size);
-          } else if (abspdgidQ<5 && partQ.parent.get() == &partW) {
-            if (iQ1<0) {
-              iQ1 = jG;
-              size = TMath::Max(DeltaR2(part.eta(),part.phi(),partQ.eta(),partQ.phi()),
-                  size);
-              sizeW = TMath::Max(DeltaR2(partW.eta(),partW.phi(),partQ.eta(),partQ.phi()),
-                  sizeW);
-            } else if (iQ2<0) {
-              iQ2 = jG;
-              size = TMath::Max(DeltaR2(part.eta(),part.phi(),partQ.eta(),partQ.phi()),
-                  size);
-              sizeW = TMath::Max(DeltaR2(partW.eta(),partW.phi(),partQ.eta(),partQ.phi()),
-                  sizeW);
-            }
+            break;
           }
-          if (iB>=0 && iQ1>=0 && iQ2>=0)
+        }
+        for (unsigned jG : graph.Daughters(iW)) {
+          auto& partQ(ctx.event.genParticles.at(jG));
+          if (TMath::Abs(partQ.pdgid)>=5)
+            continue;
+          if (iQ1<0)
+            iQ1 = jG;
+          else
+            iQ2 = jG;
+          size = TMath::Max(DeltaR2(part.eta(),part.phi(),partQ.eta(),partQ.phi()),
+              size);
+          sizeW = TMath::Max(DeltaR2(partW.eta(),partW.phi(),partQ.eta(),partQ.phi()),
+              sizeW);
+          if (iQ2>=0)
             break;
         } // looking for quarks
 
 
         bool isHadronic = (iB>=0 && iQ1>=0 && iQ2>=0); // all 3 quarks were found
         if (isHadronic)
-          genObjects[&part] = size;
+          ctx.genObjects[&part] = size;
 
         bool isHadronicW = (iQ1>=0 && iQ2>=0);
         if (isHadronicW)
-          genObjects[&partW] = sizeW;
+          ctx.genObjects[&partW] = sizeW;
 
       } else { // these are W,Z,H - 2 prong decays
 
         int iQ1=-1, iQ2=-1;
         double size=0;
-        for (int jG=0; jG!=nGen; ++jG) {
-          auto& partQ(event.genParticles.at(jG));
-          int pdgidQ = partQ.pdgid;
-          unsigned int abspdgidQ = TMath::Abs(pdgidQ);
-          if (abspdgidQ>5)
+        for (unsigned jG : graph.Daughters(iG)) {
+          auto& partQ(ctx.event.genParticles.at(jG));
+          if (TMath::Abs(partQ.pdgid)>5)
             continue;
-          if (partQ.parent.get() == &part) {
-            if (iQ1<0) {
-              iQ1=jG;
-              size = TMath::Max(DeltaR2(part.eta(),part.phi(),partQ.eta(),partQ.phi()),
-                  size);
-            } else if (iQ2<0) {
-              iQ2=jG;
-              size = TMath::Max(DeltaR2(part.eta(),part.phi(),partQ.eta(),partQ.phi()),
-                  size);
-            }
-          }
-          if (iQ1>=0 && iQ2>=0)
+          if (iQ1<0)
+            iQ1 = jG;
+          else
+            iQ2 = jG;
+          size = TMath::Max(DeltaR2(part.eta(),part.phi(),partQ.eta(),partQ.phi()),
+              size);
+          if (iQ2>=0)
             break;
         } // looking for quarks
 
@@ -381,32 +464,32 @@ void PandaAnalyzer::FatjetMatching()
 
         // add to collection
         if (isHadronic)
-          genObjects[&part] = size;
+          ctx.genObjects[&part] = size;
       }
 
     } // loop over targets
   } // process is interesting
 
-  tr->TriggerEvent("gen matching");
+  ctx.tr->TriggerEvent("gen matching");
 
-  if (!isData && gt->nFatjet>0) {
+  if (!isData && ctx.gt->nFatjet>0) {
     // first see if jet is matched
-    auto* matched = MatchToGen(fj1->eta(),fj1->phi(),1.5,pdgidTarget);
+    auto* matched = MatchToGen(ctx, ctx.fj1->eta(),ctx.fj1->phi(),1.5,pdgidTarget);
     if (matched!=NULL) {
-      gt->fj1IsMatched = 1;
-      gt->fj1GenPt = matched->pt();
-      gt->fj1GenSize = genObjects[matched];
+      ctx.gt->fj1IsMatched = 1;
+      ctx.gt->fj1GenPt = matched->pt();
+      ctx.gt->fj1GenSize = ctx.genObjects[matched];
     } else {
-      gt->fj1IsMatched = 0;
+      ctx.gt->fj1IsMatched = 0;
     }
     if (pdgidTarget==6) { // matched to top; try for W
-      auto* matchedW = MatchToGen(fj1->eta(),fj1->phi(),1.5,24);
+      auto* matchedW = MatchToGen(ctx, ctx.fj1->eta(),ctx.fj1->phi(),1.5,24);
       if (matchedW!=NULL) {
-        gt->fj1IsWMatched = 1;
-        gt->fj1GenWPt = matchedW->pt();
-        gt->fj1GenWSize = genObjects[matchedW];
+        ctx.gt->fj1IsWMatched = 1;
+        ctx.gt->fj1GenWPt = matchedW->pt();
+        ctx.gt->fj1GenWSize = ctx.genObjects[matchedW];
       } else {
-        gt->fj1IsWMatched = 0;
+        ctx.gt->fj1IsWMatched = 0;
       }
     }
 
@@ -415,13 +498,15 @@ void PandaAnalyzer::FatjetMatching()
     int has_gluon_splitting=0;
     panda::GenParticle const* first_b_mo(0);
     // now get the highest pT gen particle inside the jet cone
-    for (auto& gen : event.genParticles) {
+    vector<unsigned> inCone;
+    ctx.genGrid.Query(ctx.fj1->eta(),ctx.fj1->phi(),FATJETMATCHDR2,inCone);
+    for (unsigned iG : inCone) {
+      auto& gen = ctx.event.genParticles[iG];
       float pt = gen.pt();
       int pdgid = gen.pdgid;
-      if (pt>(gt->fj1HighestPtGenPt)
-          && DeltaR2(gen.eta(),gen.phi(),fj1->eta(),fj1->phi())<FATJETMATCHDR2) {
-        gt->fj1HighestPtGenPt = pt;
-        gt->fj1HighestPtGen = pdgid;
+      if (pt>(ctx.gt->fj1HighestPtGenPt)) {
+        ctx.gt->fj1HighestPtGenPt = pt;
+        ctx.gt->fj1HighestPtGen = pdgid;
       }
 
       if (gen.parent.isValid() && gen.parent->pdgid==gen.pdgid)
@@ -432,49 +517,41 @@ void PandaAnalyzer::FatjetMatching()
       if (apdgid!=5 && apdgid!=4) 
         continue;
 
-      if (DeltaR2(gen.eta(),gen.phi(),fj1->eta(),fj1->phi())<FATJETMATCHDR2) {
-        gt->fj1NHF++;
-        if (apdgid==5) {
-          if (gen.parent.isValid() && gen.parent->pdgid==21 && gen.parent->pt()>20) {
-            if (!found_b_from_g) {
-              found_b_from_g=true;
-              first_b_mo=gen.parent.get();
-              bs_inside_cone+=1;
-            } else if (gen.parent.get()==first_b_mo) {
-              bs_inside_cone+=1;
-              has_gluon_splitting=1;
-            } else {
-              bs_inside_cone+=1;
-            }
+      ctx.gt->fj1NHF++;
+      if (apdgid==5) {
+        if (gen.parent.isValid() && gen.parent->pdgid==21 && gen.parent->pt()>20) {
+          if (!found_b_from_g) {
+            found_b_from_g=true;
+            first_b_mo=gen.parent.get();
+            bs_inside_cone+=1;
+          } else if (gen.parent.get()==first_b_mo) {
+            bs_inside_cone+=1;
+            has_gluon_splitting=1;
           } else {
             bs_inside_cone+=1;
           }
+        } else {
+          bs_inside_cone+=1;
         }
       }
     }
 
-    gt->fj1Nbs=bs_inside_cone;
-    gt->fj1gbb=has_gluon_splitting;
+    ctx.gt->fj1Nbs=bs_inside_cone;
+    ctx.gt->fj1gbb=has_gluon_splitting;
 
     // now get the subjet btag SFs
     vector<btagcand> sj_btagcands;
-    vector<double> sj_sf_cent, sj_sf_bUp, sj_sf_bDown, sj_sf_mUp, sj_sf_mDown;
-    unsigned int nSJ = fj1->subjets.size();
+    vector<unsigned> partons;
+    unsigned int nSJ = ctx.fj1->subjets.size();
     for (unsigned int iSJ=0; iSJ!=nSJ; ++iSJ) {
-      auto& subjet = fj1->subjets.objAt(iSJ);
+      auto& subjet = ctx.fj1->subjets.objAt(iSJ);
       int flavor=0;
-      for (auto& gen : event.genParticles) {
-        int apdgid = abs(gen.pdgid);
-        if (apdgid==0 || (apdgid>5 && apdgid!=21)) // light quark or gluon
-          continue;
-        double dr2 = DeltaR2(subjet.eta(),subjet.phi(),gen.eta(),gen.phi());
-        if (dr2<0.09) {
-          if (apdgid==4 || apdgid==5) {
-            flavor=apdgid;
-            break;
-          } else {
-            flavor=0;
-          }
+      ctx.partonGrid.Query(subjet.eta(),subjet.phi(),0.09,partons);
+      for (unsigned iG : partons) {
+        int apdgid = abs(ctx.event.genParticles[iG].pdgid);
+        if (apdgid==4 || apdgid==5) {
+          flavor=apdgid;
+          break;
         }
       } // finding the subjet flavor
 
@@ -491,27 +568,15 @@ void PandaAnalyzer::FatjetMatching()
       } else {
         eff = lfeff[bineta][binpt];
       }
-      CalcBJetSFs(bSubJetL,flavor,eta,pt,eff,btagUncFactor,sf,sfUp,sfDown);
+      CalcBJetSFs(ctx, bSubJetL,flavor,eta,pt,eff,btagUncFactor,sf,sfUp,sfDown);
       sj_btagcands.push_back(btagcand(iSJ,flavor,eff,sf,sfUp,sfDown));
-      sj_sf_cent.push_back(sf);
-      if (flavor>0) {
-        sj_sf_bUp.push_back(sfUp); sj_sf_bDown.push_back(sfDown);
-        sj_sf_mUp.push_back(sf); sj_sf_mDown.push_back(sf);
-      } else {
-        sj_sf_bUp.push_back(sf); sj_sf_bDown.push_back(sf);
-        sj_sf_mUp.push_back(sfUp); sj_sf_mDown.push_back(sfDown);
-      }
 
     } // loop over subjets
 
-    EvalBTagSF(sj_btagcands,sj_sf_cent,GeneralTree::bCent,GeneralTree::bSubJet);
-    EvalBTagSF(sj_btagcands,sj_sf_bUp,GeneralTree::bBUp,GeneralTree::bSubJet);
-    EvalBTagSF(sj_btagcands,sj_sf_bDown,GeneralTree::bBDown,GeneralTree::bSubJet);
-    EvalBTagSF(sj_btagcands,sj_sf_mUp,GeneralTree::bMUp,GeneralTree::bSubJet);
-    EvalBTagSF(sj_btagcands,sj_sf_mDown,GeneralTree::bMDown,GeneralTree::bSubJet);
+    EvalBTagSF(ctx, sj_btagcands,GeneralTree::bSubJet);
 
   }
 
-  tr->TriggerEvent("fatjet gen-matching");
+  ctx.tr->TriggerEvent("fatjet gen-matching");
 }
 
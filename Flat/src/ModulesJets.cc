@@ -10,49 +10,62 @@ using namespace panda;
 using namespace std;
 
 
-void PandaAnalyzer::SetupJES()
+void PandaAnalyzer::SetupJES(EventContext &ctx)
 {
-  if (uncReader==0) {
+  if (ctx.uncReader==0) {
     if (isData) {
-      TString thisEra = eras.getEra(gt->runNumber);
-      for (auto &iter : ak8UncReader) {
+      TString thisEra = eras.getEra(ctx.gt->runNumber);
+      for (auto &iter : ctx.ak8UncReader) {
         if (! iter.first.Contains("data"))
           continue;
         if (iter.first.Contains(thisEra)) {
-          uncReader = iter.second;
-          uncReaderAK4 = ak4UncReader[iter.first];
-          scaleReaderAK4 = ak4ScaleReader[iter.first];
+          ctx.uncReader = iter.second;
+          ctx.uncReaderAK4 = ctx.ak4UncReader[iter.first];
+          ctx.scaleReaderAK4 = ctx.ak4ScaleReader[iter.first];
+          ctx.jecEngineAK4 = ak4JECEngines[iter.first];
           break;
         }
       }
     } else {
-      uncReader = ak8UncReader["MC"];
-      uncReaderAK4 = ak4UncReader["MC"];
-      scaleReaderAK4 = ak4ScaleReader["MC"];
+      ctx.uncReader = ctx.ak8UncReader["MC"];
+      ctx.uncReaderAK4 = ctx.ak4UncReader["MC"];
+      ctx.scaleReaderAK4 = ctx.ak4ScaleReader["MC"];
+      ctx.jecEngineAK4 = ak4JECEngines["MC"];
     }
   }
 }
 
-void PandaAnalyzer::JetBasics() 
+void PandaAnalyzer::JetCorrection(EventContext &ctx)
 {
-  gt->barrelJet12Pt = 0;
-  gt->barrelHT = 0;
+  // only with Analysis::reapplyJEC, as it changes the jets and the puppi MET
+  // of the output: the jets are re-corrected from rawPt, the MET follows the
+  // change of their pt, and the collection is sorted by the new pt again
+  ctx.jetCorrector->CorrectInPlace(isData,ctx.event.rho,*ctx.jets,&ctx.event.puppiMet,ctx.gt->runNumber);
+  ctx.jets->sort(panda::Particle::PtGreater);
+
+  ctx.tr->TriggerEvent("jet correction");
+}
+
+void PandaAnalyzer::JetBasics(EventContext &ctx) 
+{
+  ctx.gt->barrelJet12Pt = 0;
+  ctx.gt->barrelHT = 0;
   unsigned nBarrelJets = 0;
   panda::Jet *jet1=0, *jet2=0;
-  jot1=0; jot2=0;
-  jotUp1=0; jotUp2=0;
-  jotDown1=0; jotDown2=0;
-  jetUp1=0; jetUp2=0;
-  jetDown1=0; jetDown2=0;
-  gt->dphipuppimet=999; gt->dphipfmet=999;
-  gt->dphipuppiUW=999; gt->dphipfUW=999;
-  gt->dphipuppiUZ=999; gt->dphipfUZ=999;
-  gt->dphipuppiUA=999; gt->dphipfUA=999;
+  ctx.jot1=0; ctx.jot2=0;
+  ctx.jotUp1=0; ctx.jotUp2=0;
+  ctx.jotDown1=0; ctx.jotDown2=0;
+  ctx.jetUp1=0; ctx.jetUp2=0;
+  ctx.jetDown1=0; ctx.jetDown2=0;
+  ctx.gt->dphipuppimet=999; ctx.gt->dphipfmet=999;
+  ctx.gt->dphipuppiUW=999; ctx.gt->dphipfUW=999;
+  ctx.gt->dphipuppiUZ=999; ctx.gt->dphipfUZ=999;
+  ctx.gt->dphipuppiUA=999; ctx.gt->dphipfUA=999;
   float maxJetEta = (analysis->vbf) ? 4.7 : 4.5;
   unsigned nJetDPhi = (analysis->vbf) ? 4 : 5;
 
-  gt->badECALFilter = 1;
-  for (auto& jet : *jets) {
+  ctx.gt->badECALFilter = 1;
+  for (auto& jet : *ctx.jets) {
 
     // only do eta-phi checks here
     if (abs(jet.eta()) > maxJetEta)
@@ -61,339 +74,433 @@ void PandaAnalyzer::JetBasics()
     // For VBF we require nTightLep>0, but in monotop looseLep1IsTight
     // No good reason to do that, should switch to former
     // Should update jet cleaning accordingly (just check all loose objects)
-    if (IsMatched(&matchLeps,0.16,jet.eta(),jet.phi()) ||
-        IsMatched(&matchPhos,0.16,jet.eta(),jet.phi()))
+    if (IsMatched(&ctx.matchLeps,0.16,jet.eta(),jet.phi()) ||
+        IsMatched(&ctx.matchPhos,0.16,jet.eta(),jet.phi()))
       continue;
     if (analysis->vbf && !jet.loose)
       continue;
 
     if (analysis->vbf && jet.pt()>20 && fabs(jet.eta())<2.4 && jet.csv>0.8484) {
-      ++(gt->jetNMBtags);
+      ++(ctx.gt->jetNMBtags);
     }
 
     if (jet.pt()>jetPtThreshold) { // nominal jets
-      cleanedJets.push_back(&jet);
-      if (cleanedJets.size()<3) {
+      ctx.cleanedJets.push_back(&jet);
+      if (ctx.cleanedJets.size()<3) {
         bool isBad = GetCorr(cBadECALJets,jet.eta(),jet.phi()) > 0;
         if (isBad)
-          gt->badECALFilter = 0;
+          ctx.gt->badECALFilter = 0;
       }
 
       float csv = (fabs(jet.eta())<2.5) ? jet.csv : -1;
       float cmva = (fabs(jet.eta())<2.5) ? jet.cmva : -1;
       if (fabs(jet.eta())<2.4) {
-        centralJets.push_back(&jet);
-        if (centralJets.size()==1) {
+        ctx.centralJets.push_back(&jet);
+        if (ctx.centralJets.size()==1) {
           jet1 = &jet;
-          gt->jet1Pt = jet.pt();
-          gt->jet1Eta = jet.eta();
-          gt->jet1Phi = jet.phi();
-          gt->jet1CSV = csv;
-          gt->jet1CMVA = cmva;
-          gt->jet1IsTight = jet.monojet ? 1 : 0;
-        } else if (centralJets.size()==2) {
+          ctx.gt->jet1Pt = jet.pt();
+          ctx.gt->jet1Eta = jet.eta();
+          ctx.gt->jet1Phi = jet.phi();
+          ctx.gt->jet1CSV = csv;
+          ctx.gt->jet1CMVA = cmva;
+          ctx.gt->jet1IsTight = jet.monojet ? 1 : 0;
+        } else if (ctx.centralJets.size()==2) {
           jet2 = &jet;
-          gt->jet2Pt = jet.pt();
-          gt->jet2Eta = jet.eta();
-          gt->jet2Phi = jet.phi();
-          gt->jet2CSV = csv;
-          gt->jet2CMVA = cmva;
+          ctx.gt->jet2Pt = jet.pt();
+          ctx.gt->jet2Eta = jet.eta();
+          ctx.gt->jet2Phi = jet.phi();
+          ctx.gt->jet2CSV = csv;
+          ctx.gt->jet2CMVA = cmva;
         }
       }
 
-      vJet.SetPtEtaPhiM(jet.pt(),jet.eta(),jet.phi(),jet.m());
+      ctx.vJet.SetPtEtaPhiM(jet.pt(),jet.eta(),jet.phi(),jet.m());
 
       if (analysis->vbf)
-        JetVBFBasics(jet);
+        JetVBFBasics(ctx, jet);
 
       if (analysis->monoh || analysis->hbb) {
-        JetHbbBasics(jet);
+        JetHbbBasics(ctx, jet);
         if (analysis->bjetRegression)
-          JetBRegressionInfo(jet);
+          JetBRegressionInfo(ctx, jet);
       }
 
       // compute dphi wrt mets
-      if (cleanedJets.size() <= nJetDPhi) {
-        gt->dphipuppimet = std::min(fabs(vJet.DeltaPhi(vPuppiMET)),(double)gt->dphipuppimet);
-        gt->dphipfmet = std::min(fabs(vJet.DeltaPhi(vPFMET)),(double)gt->dphipfmet);
+      if (ctx.cleanedJets.size() <= nJetDPhi) {
+        ctx.gt->dphipuppimet = std::min(fabs(ctx.vJet.DeltaPhi(ctx.vPuppiMET)),(double)ctx.gt->dphipuppimet);
+        ctx.gt->dphipfmet = std::min(fabs(ctx.vJet.DeltaPhi(ctx.vPFMET)),(double)ctx.gt->dphipfmet);
         if (analysis->recoil) {
-          gt->dphipuppiUA = std::min(fabs(vJet.DeltaPhi(vpuppiUA)),(double)gt->dphipuppiUA);
-          gt->dphipuppiUW = std::min(fabs(vJet.DeltaPhi(vpuppiUW)),(double)gt->dphipuppiUW);
-          gt->dphipuppiUZ = std::min(fabs(vJet.DeltaPhi(vpuppiUZ)),(double)gt->dphipuppiUZ);
-          gt->dphipfUA = std::min(fabs(vJet.DeltaPhi(vpfUA)),(double)gt->dphipfUA);
-          gt->dphipfUW = std::min(fabs(vJet.DeltaPhi(vpfUW)),(double)gt->dphipfUW);
-          gt->dphipfUZ = std::min(fabs(vJet.DeltaPhi(vpfUZ)),(double)gt->dphipfUZ);
+          ctx.gt->dphipuppiUA = std::min(fabs(ctx.vJet.DeltaPhi(ctx.vpuppiUA)),(double)ctx.gt->dphipuppiUA);
+          ctx.gt->dphipuppiUW = std::min(fabs(ctx.vJet.DeltaPhi(ctx.vpuppiUW)),(double)ctx.gt->dphipuppiUW);
+          ctx.gt->dphipuppiUZ = std::min(fabs(ctx.vJet.DeltaPhi(ctx.vpuppiUZ)),(double)ctx.gt->dphipuppiUZ);
+          ctx.gt->dphipfUA = std::min(fabs(ctx.vJet.DeltaPhi(ctx.vpfUA)),(double)ctx.gt->dphipfUA);
+          ctx.gt->dphipfUW = std::min(fabs(ctx.vJet.DeltaPhi(ctx.vpfUW)),(double)ctx.gt->dphipfUW);
+          ctx.gt->dphipfUZ = std::min(fabs(ctx.vJet.DeltaPhi(ctx.vpfUZ)),(double)ctx.gt->dphipfUZ);
         }
       }
       // btags
       if (csv>0.5426) {
-        ++(gt->jetNBtags);
+        ++(ctx.gt->jetNBtags);
         if (analysis->monoh || analysis->hbb) {
-          btaggedJets.push_back(&jet);
-          btagindices.push_back(cleanedJets.size()-1);
+          ctx.btaggedJets.push_back(&jet);
+          ctx.btagindices.push_back(ctx.cleanedJets.size()-1);
         }
         if (!analysis->vbf && csv>0.8484) 
-          ++(gt->jetNMBtags);
+          ++(ctx.gt->jetNMBtags);
       }
     }
 
     if (analysis->varyJES)
-      JetVaryJES(jet);
+      JetVaryJES(ctx, jet);
+    if (analysis->varyJESSources)
+      ctx.jesSourceJets.push_back(&jet);
 
   } // VJet loop
-  gt->barrelHTMiss = vBarrelJets.Pt();
+  ctx.gt->barrelHTMiss = ctx.vBarrelJets.Pt();
 
-  switch (gt->whichRecoil) {
+  switch (ctx.gt->whichRecoil) {
     case 0: // MET
-      gt->dphipuppiU = gt->dphipuppimet;
-      gt->dphipfU = gt->dphipfmet;
+      ctx.gt->dphipuppiU = ctx.gt->dphipuppimet;
+      ctx.gt->dphipfU = ctx.gt->dphipfmet;
       break;
     case -1: // photon
-      gt->dphipuppiU = gt->dphipuppiUA;
-      gt->dphipfU = gt->dphipfUA;
+      ctx.gt->dphipuppiU = ctx.gt->dphipuppiUA;
+      ctx.gt->dphipfU = ctx.gt->dphipfUA;
       break;
     case 1:
-      gt->dphipuppiU = gt->dphipuppiUW;
-      gt->dphipfU = gt->dphipfUW;
+      ctx.gt->dphipuppiU = ctx.gt->dphipuppiUW;
+      ctx.gt->dphipfU = ctx.gt->dphipfUW;
       break;
     case 2:
-      gt->dphipuppiU = gt->dphipuppiUZ;
-      gt->dphipfU = gt->dphipfUZ;
+      ctx.gt->dphipuppiU = ctx.gt->dphipuppiUZ;
+      ctx.gt->dphipfU = ctx.gt->dphipfUZ;
       break;
     default: // impossible
       break;
   }
 
-  gt->nJet = centralJets.size();
-  gt->nJot = cleanedJets.size();
+  ctx.gt->nJet = ctx.centralJets.size();
+  ctx.gt->nJot = ctx.cleanedJets.size();
 
   if (analysis->vbf) {
-    JetVBFSystem();
+    JetVBFSystem(ctx);
   }
 
-  tr->TriggerEvent("jets");
+  ctx.tr->TriggerEvent("jets");
 
 }
 
-void PandaAnalyzer::JetHbbBasics(panda::Jet& jet)
+void PandaAnalyzer::JetHbbBasics(EventContext &ctx, panda::Jet& jet)
 {
   float csv = (fabs(jet.eta())<2.5) ? jet.csv : -1;
   float cmva = (fabs(jet.eta())<2.5) ? jet.cmva : -1;
-  unsigned N = cleanedJets.size()-1;
-  gt->jetPt[N]=jet.pt();
-  gt->jetEta[N]=jet.eta();
-  gt->jetPhi[N]=jet.phi();
-  gt->jetE[N]=jet.e();
-  gt->jetCSV[N]=csv;
-  gt->jetCMVA[N]=cmva;
-  gt->jetQGL[N]=jet.qgl;
-
-  tr->TriggerSubEvent("H->bb jet");
+  unsigned N = ctx.cleanedJets.size()-1;
+  ctx.gt->jetPt[N]=jet.pt();
+  ctx.gt->jetEta[N]=jet.eta();
+  ctx.gt->jetPhi[N]=jet.phi();
+  ctx.gt->jetE[N]=jet.e();
+  ctx.gt->jetCSV[N]=csv;
+  ctx.gt->jetCMVA[N]=cmva;
+  ctx.gt->jetQGL[N]=jet.qgl;
+
+  ctx.tr->TriggerSubEvent("H->bb jet");
 }
 
-void PandaAnalyzer::JetBRegressionInfo(panda::Jet& jet)
+void PandaAnalyzer::JetBRegressionInfo(EventContext &ctx, panda::Jet& jet)
 {
-  unsigned N = cleanedJets.size()-1;
-  gt->jetEMFrac[N] = jet.cef + jet.nef;
-  gt->jetHadFrac[N] = jet.chf + jet.nhf;
-  gt->jetLeadingLepPt[N] = 0;
-  gt->jetLeadingTrkPt[N] = 0;
-  gt->jetNLep[N] = 0;
+  unsigned N = ctx.cleanedJets.size()-1;
+  ctx.gt->jetEMFrac[N] = jet.cef + jet.nef;
+  ctx.gt->jetHadFrac[N] = jet.chf + jet.nhf;
+  ctx.gt->jetLeadingLepPt[N] = 0;
+  ctx.gt->jetLeadingTrkPt[N] = 0;
+  ctx.gt->jetNLep[N] = 0;
+  PFCandCache const& cands(ctx.PFCands());
+  TVector3 jetP3(jet.p4().Vect());
   for (const panda::Ref<panda::PFCand> &c_iter : jet.constituents) {
     if (!c_iter.isValid())
       continue;
-    auto *pf = c_iter.get();
-    if (pf->q() != 0) {
-      float pt = pf->pt();
-      gt->jetLeadingTrkPt[N] = max(pt, gt->jetLeadingTrkPt[N]);
-      unsigned pdgid = abs(pf->pdgId());
-      if (pdgid == 11 || pdgid == 13) {
-        gt->jetNLep[N]++;
-        if (pt > gt->jetLeadingLepPt[N]) {
-          gt->jetLeadingLepPt[N] = pt;
-          gt->jetLeadingLepPtRel[N] = pf->p4().Perp(jet.p4().Vect());
-          gt->jetLeadingLepDeltaR[N] = sqrt(DeltaR2(pf->eta(), pf->phi(), jet.eta(), jet.phi()));
-        }
+    int iC = cands.Index(c_iter);
+    if (iC<0) {
+      PError("PandaAnalyzer::JetBRegressionInfo",
+             TString::Format("Constituent index %i is outside the %u PF candidates",(int)c_iter.idx(),cands.size()));
+      continue;
+    }
+    if (cands.charge[iC] == 0)
+      continue;
+    float pt = cands.pt[iC];
+    ctx.gt->jetLeadingTrkPt[N] = max(pt, ctx.gt->jetLeadingTrkPt[N]);
+    unsigned pdgid = abs(cands.pdgId[iC]);
+    if (pdgid == 11 || pdgid == 13) {
+      ctx.gt->jetNLep[N]++;
+      if (pt > ctx.gt->jetLeadingLepPt[N]) {
+        ctx.gt->jetLeadingLepPt[N] = pt;
+        ctx.gt->jetLeadingLepPtRel[N] = TVector3(cands.px[iC],cands.py[iC],cands.pz[iC]).Perp(jetP3);
+        ctx.gt->jetLeadingLepDeltaR[N] = sqrt(DeltaR2(cands.eta[iC], cands.phi[iC], jet.eta(), jet.phi()));
       }
     }
   }
 
   auto& vert = jet.secondaryVertex;
   if (vert.isValid()) {
-    gt->jetvtxPt[N] = vert->pt();
-    gt->jetvtxMass[N] = vert->m();
-    gt->jetvtx3Dval[N] = vert->vtx3DVal;
-    gt->jetvtx3Derr[N] = vert->vtx3DeVal;
-    gt->jetvtxNtrk[N] = vert->ntrk;
+    ctx.gt->jetvtxPt[N] = vert->pt();
+    ctx.gt->jetvtxMass[N] = vert->m();
+    ctx.gt->jetvtx3Dval[N] = vert->vtx3DVal;
+    ctx.gt->jetvtx3Derr[N] = vert->vtx3DeVal;
+    ctx.gt->jetvtxNtrk[N] = vert->ntrk;
   }
 
-  tr->TriggerSubEvent("b-jet reg info");
+  ctx.tr->TriggerSubEvent("b-jet reg info");
 }
 
-void PandaAnalyzer::JetVBFBasics(panda::Jet& jet)
+void PandaAnalyzer::JetVBFBasics(EventContext &ctx, panda::Jet& jet)
 {
-  if (cleanedJets.size()==1) {
-    jot1 = &jet;
-    gt->jot1Pt = jet.pt();
-    gt->jot1Eta = jet.eta();
-    gt->jot1Phi = jet.phi();
-    if (analysis->vbf && fabs(gt->jot1Eta)<2.4) { // if it's a central jet, must pass ID requirements
-      gt->jot1VBFID = jet.monojet ? 1 : 0;
+  if (ctx.cleanedJets.size()==1) {
+    ctx.jot1 = &jet;
+    ctx.gt->jot1Pt = jet.pt();
+    ctx.gt->jot1Eta = jet.eta();
+    ctx.gt->jot1Phi = jet.phi();
+    if (analysis->vbf && fabs(ctx.gt->jot1Eta)<2.4) { // if it's a central jet, must pass ID requirements
+      ctx.gt->jot1VBFID = jet.monojet ? 1 : 0;
     } else { // if leading jet is not central, leave the event be
-      gt->jot1VBFID = 1;
+      ctx.gt->jot1VBFID = 1;
     }
-  } else if (cleanedJets.size()==2) {
-    jot2 = &jet;
-    gt->jot2Pt = jet.pt();
-    gt->jot2Eta = jet.eta();
-    gt->jot2Phi = jet.phi();
+  } else if (ctx.cleanedJets.size()==2) {
+    ctx.jot2 = &jet;
+    ctx.gt->jot2Pt = jet.pt();
+    ctx.gt->jot2Eta = jet.eta();
+    ctx.gt->jot2Phi = jet.phi();
   }
 
   if (fabs(jet.eta())<3.0) {
-    gt->barrelHT += jet.pt();
-    vBarrelJets += vJet;
-    if (gt->barrelJet1Pt <= 0) {
-      gt->barrelJet1Pt = jet.pt();
-      gt->barrelJet1Eta = jet.eta();
+    ctx.gt->barrelHT += jet.pt();
+    ctx.vBarrelJets += ctx.vJet;
+    if (ctx.gt->barrelJet1Pt <= 0) {
+      ctx.gt->barrelJet1Pt = jet.pt();
+      ctx.gt->barrelJet1Eta = jet.eta();
     }
   }
-  tr->TriggerSubEvent("VBF jet");
+  ctx.tr->TriggerSubEvent("VBF jet");
 
 }
 
-void PandaAnalyzer::IsoJet(panda::Jet& jet) 
+void PandaAnalyzer::IsoJet(EventContext &ctx, panda::Jet& jet) 
 {
   float maxIsoEta = (analysis->monoh) ? 4.5 : 2.5;
-  bool isIsoJet = ( (gt->nFatjet==0) || 
+  bool isIsoJet = ( (ctx.gt->nFatjet==0) || 
       (fabs(jet.eta())<maxIsoEta 
-       && DeltaR2(gt->fj1Eta,gt->fj1Phi,jet.eta(),jet.phi())>FATJETMATCHDR2) ); 
+       && DeltaR2(ctx.gt->fj1Eta,ctx.gt->fj1Phi,jet.eta(),jet.phi())>FATJETMATCHDR2) ); 
 
   if (isIsoJet) {
-    isoJets.push_back(&jet);
+    ctx.isoJets.push_back(&jet);
     float csv = (fabs(jet.eta())<2.5) ? jet.csv : -1;
     if (csv>0.5426)
-      ++gt->isojetNBtags;
-    if (isoJets.size()==1) {
-      gt->isojet1Pt = jet.pt();
-      gt->isojet1CSV = jet.csv;
-    } else if (isoJets.size()==2) {
-      gt->isojet2Pt = jet.pt();
-      gt->isojet2CSV = jet.csv;
+      ++ctx.gt->isojetNBtags;
+    if (ctx.isoJets.size()==1) {
+      ctx.gt->isojet1Pt = jet.pt();
+      ctx.gt->isojet1CSV = jet.csv;
+    } else if (ctx.isoJets.size()==2) {
+      ctx.gt->isojet2Pt = jet.pt();
+      ctx.gt->isojet2CSV = jet.csv;
     }
     if (analysis->monoh)
-      gt->jetIso[cleanedJets.size()-1]=1;
+      ctx.gt->jetIso[ctx.cleanedJets.size()-1]=1;
   } else {
     if (analysis->monoh)
-      gt->jetIso[cleanedJets.size()-1]=0;
+      ctx.gt->jetIso[ctx.cleanedJets.size()-1]=0;
   }
-  tr->TriggerSubEvent("iso jets");
+  ctx.tr->TriggerSubEvent("iso jets");
 }
 
-void PandaAnalyzer::JetVaryJES(panda::Jet& jet)
+void PandaAnalyzer::JetVaryJES(EventContext &ctx, panda::Jet& jet)
 {
   // do jes variation OUTSIDE of nominal jet check 
   if (jet.ptCorrUp>jetPtThreshold) { // Vary the pT up
     // forward and central jets:
-    if (jet.ptCorrUp > gt->jot1PtUp) {
-      if (jotUp1) {
-        jotUp2 = jotUp1;
-        gt->jot2PtUp = gt->jot1PtUp;
-        gt->jot2EtaUp = gt->jot1EtaUp;
+    if (jet.ptCorrUp > ctx.gt->jot1PtUp) {
+      if (ctx.jotUp1) {
+        ctx.jotUp2 = ctx.jotUp1;
+        ctx.gt->jot2PtUp = ctx.gt->jot1PtUp;
+        ctx.gt->jot2EtaUp = ctx.gt->jot1EtaUp;
       }
-      jotUp1 = &jet;
-      gt->jot1PtUp = jet.ptCorrUp;
-      gt->jot1EtaUp = jet.eta();
-    } else if (jet.ptCorrUp > gt->jot2PtUp) {
-      jotUp2 = &jet;
-      gt->jot2PtUp = jet.ptCorrUp;
-      gt->jot2EtaUp = jet.eta();
+      ctx.jotUp1 = &jet;
+      ctx.gt->jot1PtUp = jet.ptCorrUp;
+      ctx.gt->jot1EtaUp = jet.eta();
+    } else if (jet.ptCorrUp > ctx.gt->jot2PtUp) {
+      ctx.jotUp2 = &jet;
+      ctx.gt->jot2PtUp = jet.ptCorrUp;
+      ctx.gt->jot2EtaUp = jet.eta();
     }
     // central only jets:
     if (fabs(jet.eta()) < 2.4) {
-      if (jet.ptCorrUp > gt->jet1PtUp) {
-        if (jetUp1) {
-          jetUp2 = jetUp1;
-          gt->jet2PtUp = gt->jet1PtUp;
-          gt->jet2EtaUp = gt->jet1EtaUp;
+      if (jet.ptCorrUp > ctx.gt->jet1PtUp) {
+        if (ctx.jetUp1) {
+          ctx.jetUp2 = ctx.jetUp1;
+          ctx.gt->jet2PtUp = ctx.gt->jet1PtUp;
+          ctx.gt->jet2EtaUp = ctx.gt->jet1EtaUp;
         }
-        jetUp1 = &jet;
-        gt->jet1PtUp = jet.ptCorrUp;
-        gt->jet1EtaUp = jet.eta();
-      } else if (jet.ptCorrUp > gt->jet2PtUp) {
-        jetUp2 = &jet;
-        gt->jet2PtUp = jet.ptCorrUp;
-        gt->jet2EtaUp = jet.eta();
+        ctx.jetUp1 = &jet;
+        ctx.gt->jet1PtUp = jet.ptCorrUp;
+        ctx.gt->jet1EtaUp = jet.eta();
+      } else if (jet.ptCorrUp > ctx.gt->jet2PtUp) {
+        ctx.jetUp2 = &jet;
+        ctx.gt->jet2PtUp = jet.ptCorrUp;
+        ctx.gt->jet2EtaUp = jet.eta();
       }
     }
   }
   if (jet.ptCorrDown>jetPtThreshold) { // Vary the pT down:
     // forward and central jets:
-    if (jet.ptCorrDown > gt->jot1PtDown) {
-      if (jotDown1) {
-        jotDown2 = jotDown1;
-        gt->jot2PtDown = gt->jot1PtDown;
-        gt->jot2EtaDown = gt->jot1EtaDown;
+    if (jet.ptCorrDown > ctx.gt->jot1PtDown) {
+      if (ctx.jotDown1) {
+        ctx.jotDown2 = ctx.jotDown1;
+        ctx.gt->jot2PtDown = ctx.gt->jot1PtDown;
+        ctx.gt->jot2EtaDown = ctx.gt->jot1EtaDown;
       }
-      jotDown1 = &jet;
-      gt->jot1PtDown = jet.ptCorrDown;
-      gt->jot1EtaDown = jet.eta();
-    } else if (jet.ptCorrDown > gt->jot2PtDown) {
-      jotDown2 = &jet;
-      gt->jot2PtDown = jet.ptCorrDown;
-      gt->jot2EtaDown = jet.eta();
+      ctx.jotDown1 = &jet;
+      ctx.gt->jot1PtDown = jet.ptCorrDown;
+      ctx.gt->jot1EtaDown = jet.eta();
+    } else if (jet.ptCorrDown > ctx.gt->jot2PtDown) {
+      ctx.jotDown2 = &jet;
+      ctx.gt->jot2PtDown = jet.ptCorrDown;
+      ctx.gt->jot2EtaDown = jet.eta();
     }
     // central only jets:
     if (fabs(jet.eta()) < 2.4) {
-      if (jet.ptCorrDown > gt->jet1PtDown) {
-        if (jetDown1) {
-          jetDown2 = jetDown1;
-          gt->jet2PtDown = gt->jet1PtDown;
-          gt->jet2EtaDown = gt->jet1EtaDown;
+      if (jet.ptCorrDown > ctx.gt->jet1PtDown) {
+        if (ctx.jetDown1) {
+          ctx.jetDown2 = ctx.jetDown1;
+          ctx.gt->jet2PtDown = ctx.gt->jet1PtDown;
+          ctx.gt->jet2EtaDown = ctx.gt->jet1EtaDown;
         }
-        jetDown1 = &jet;
-        gt->jet1PtDown = jet.ptCorrDown;
-        gt->jet1EtaDown = jet.eta();
-      } else if (jet.ptCorrDown > gt->jet2PtDown) {
-        jetDown2 = &jet;
-        gt->jet2PtDown = jet.ptCorrDown;
-        gt->jet2EtaDown = jet.eta();
+        ctx.jetDown1 = &jet;
+        ctx.gt->jet1PtDown = jet.ptCorrDown;
+        ctx.gt->jet1EtaDown = jet.eta();
+      } else if (jet.ptCorrDown > ctx.gt->jet2PtDown) {
+        ctx.jetDown2 = &jet;
+        ctx.gt->jet2PtDown = jet.ptCorrDown;
+        ctx.gt->jet2EtaDown = jet.eta();
       }
     }
   }
-  tr->TriggerSubEvent("vary jet JES");
+  ctx.tr->TriggerSubEvent("vary jet JES");
 }
 
-void PandaAnalyzer::JetVBFSystem() 
+void PandaAnalyzer::EvaluateJESSources(EventContext &ctx, unsigned nJets, const float *pt, const float *eta,
+                                       float *up, float *down)
 {
-  if (gt->nJot>1 && analysis->vbf) {
-    TLorentzVector vj1, vj2;
-    vj1.SetPtEtaPhiM(jot1->pt(),jot1->eta(),jot1->phi(),jot1->m());
-    vj2.SetPtEtaPhiM(jot2->pt(),jot2->eta(),jot2->phi(),jot2->m());
-    gt->jot12Mass = (vj1+vj2).M();
-    gt->jot12DPhi = vj1.DeltaPhi(vj2);
-    gt->jot12DEta = fabs(jot1->eta()-jot2->eta());
-
-    if (analysis->varyJES && jotUp1 && jotUp2) {
-      vj1.SetPtEtaPhiM(jotUp1->ptCorrUp,jotUp1->eta(),jotUp1->phi(),jotUp1->m());
-      vj2.SetPtEtaPhiM(jotUp2->ptCorrUp,jotUp2->eta(),jotUp2->phi(),jotUp2->m());
-      gt->jot12MassUp = (vj1+vj2).M();
-      gt->jot12DPhiUp = vj1.DeltaPhi(vj2);
-      gt->jot12DEtaUp = fabs(jotUp1->eta()-jotUp2->eta());
+  if (ak4JESSources) {
+    ak4JESSources->Evaluate(nJets,pt,eta,up,down);
+    return;
+  }
+  // the table failed: one reader per source, same layout
+  const unsigned nS = ctx.jesSourceReaders.size();
+  for (unsigned iJ=0; iJ!=nJets; ++iJ) {
+    for (unsigned iS=0; iS!=nS; ++iS) {
+      JetCorrectionUncertainty *reader = ctx.jesSourceReaders[iS];
+      reader->setJetEta(eta[iJ]); reader->setJetPt(pt[iJ]);
+      up[iJ*nS+iS] = reader->getUncertainty(true);
+      reader->setJetEta(eta[iJ]); reader->setJetPt(pt[iJ]);
+      down[iJ*nS+iS] = reader->getUncertainty(false);
     }
+  }
+}
+
+void PandaAnalyzer::JetVaryJESSources(EventContext &ctx)
+{
+  // every source of every jet in one call
+  const unsigned nS = GeneralTree::nJESSources;
+  unsigned nJets = ctx.jesSourceJets.size();
+  std::vector<float> pt(nJets), eta(nJets), cosPhi(nJets), sinPhi(nJets);
+  std::vector<float> up(nJets*nS), down(nJets*nS);
+  for (unsigned iJ=0; iJ!=nJets; ++iJ) {
+    panda::Jet *jet = ctx.jesSourceJets[iJ];
+    pt[iJ] = jet->pt();
+    eta[iJ] = jet->eta();
+    cosPhi[iJ] = cos(jet->phi());
+    sinPhi[iJ] = sin(jet->phi());
+  }
+  EvaluateJESSources(ctx,nJets,pt.data(),eta.data(),up.data(),down.data());
+
+  // then per source and direction: the two leading jets as in JetVaryJES, and
+  // the recoil with the shifts of the jets above 15 GeV taken out, as in type-1 MET
+  FourVector vU = analysis->recoil ? ctx.vpfU : ctx.vPFMET;
+  for (unsigned iS=0; iS!=nS; ++iS) {
+    for (bool isUp : {true,false}) {
+      const float *unc = isUp ? up.data() : down.data();
+      float sign = isUp ? 1 : -1;
+      int iJ1=-1, iJ2=-1;
+      float pt1=-1, pt2=-1;
+      double dpx=0, dpy=0;
+      for (unsigned iJ=0; iJ!=nJets; ++iJ) {
+        float shift = sign*unc[iJ*nS+iS]*pt[iJ];
+        float ptVar = pt[iJ]+shift;
+        if (pt[iJ]>15) {
+          dpx += shift*cosPhi[iJ];
+          dpy += shift*sinPhi[iJ];
+        }
+        if (ptVar<=jetPtThreshold)
+          continue;
+        if (ptVar>pt1) {
+          iJ2 = iJ1; pt2 = pt1;
+          iJ1 = iJ; pt1 = ptVar;
+        } else if (ptVar>pt2) {
+          iJ2 = iJ; pt2 = ptVar;
+        }
+      }
 
-    if (analysis->varyJES && jotDown1 && jotDown2) {
-      vj1.SetPtEtaPhiM(jotDown1->ptCorrDown,jotDown1->eta(),jotDown1->phi(),jotDown1->m());
-      vj2.SetPtEtaPhiM(jotDown2->ptCorrDown,jotDown2->eta(),jotDown2->phi(),jotDown2->m());
-      gt->jot12MassDown = (vj1+vj2).M();
-      gt->jot12DPhiDown = vj1.DeltaPhi(vj2);
-      gt->jot12DEtaDown = fabs(jotDown1->eta()-jotDown2->eta());
+      float mass = -1;
+      if (iJ2>=0) {
+        panda::Jet *j1 = ctx.jesSourceJets[iJ1], *j2 = ctx.jesSourceJets[iJ2];
+        mass = (FourVector::PtEtaPhiM(pt1,j1->eta(),j1->phi(),j1->m()) +
+                FourVector::PtEtaPhiM(pt2,j2->eta(),j2->phi(),j2->m())).M();
+      }
+      float recoil = FourVector(vU.Px()-dpx,vU.Py()-dpy,0,0).Pt();
+      if (isUp) {
+        ctx.gt->jot1PtJESUp[iS] = pt1;
+        ctx.gt->jot12MassJESUp[iS] = mass;
+        ctx.gt->pfUmagJESUp[iS] = recoil;
+      } else {
+        ctx.gt->jot1PtJESDown[iS] = pt1;
+        ctx.gt->jot12MassJESDown[iS] = mass;
+        ctx.gt->pfUmagJESDown[iS] = recoil;
+      }
     }
   }
 
-  tr->TriggerSubEvent("VBF jet system");
+  ctx.tr->TriggerEvent("vary JES sources");
 }
 
-void PandaAnalyzer::JetHbbReco() 
+void PandaAnalyzer::JetVBFSystem(EventContext &ctx) 
+{
+  if (ctx.gt->nJot>1 && analysis->vbf) {
+    FourVector vj1, vj2;
+    vj1.SetPtEtaPhiM(ctx.jot1->pt(),ctx.jot1->eta(),ctx.jot1->phi(),ctx.jot1->m());
+    vj2.SetPtEtaPhiM(ctx.jot2->pt(),ctx.jot2->eta(),ctx.jot2->phi(),ctx.jot2->m());
+    ctx.gt->jot12Mass = (vj1+vj2).M();
+    ctx.gt->jot12DPhi = vj1.DeltaPhi(vj2);
+    ctx.gt->jot12DEta = fabs(ctx.jot1->eta()-ctx.jot2->eta());
+
+    if (analysis->varyJES && ctx.jotUp1 && ctx.jotUp2) {
+      vj1.SetPtEtaPhiM(ctx.jotUp1->ptCorrUp,ctx.jotUp1->eta(),ctx.jotUp1->phi(),ctx.jotUp1->m());
+      vj2.SetPtEtaPhiM(ctx.jotUp2->ptCorrUp,ctx.jotUp2->eta(),ctx.jotUp2->phi(),ctx.jotUp2->m());
+      ctx.gt->jot12MassUp = (vj1+vj2).M();
+      ctx.gt->jot12DPhiUp = vj1.DeltaPhi(vj2);
+      ctx.gt->jot12DEtaUp = fabs(ctx.jotUp1->eta()-ctx.jotUp2->eta());
+    }
+
+    if (analysis->varyJES && ctx.jotDown1 && ctx.jotDown2) {
+      vj1.SetPtEtaPhiM(ctx.jotDown1->ptCorrDown,ctx.jotDown1->eta(),ctx.jotDown1->phi(),ctx.jotDown1->m());
+      vj2.SetPtEtaPhiM(ctx.jotDown2->ptCorrDown,ctx.jotDown2->eta(),ctx.jotDown2->phi(),ctx.jotDown2->m());
+      ctx.gt->jot12MassDown = (vj1+vj2).M();
+      ctx.gt->jot12DPhiDown = vj1.DeltaPhi(vj2);
+      ctx.gt->jot12DEtaDown = fabs(ctx.jotDown1->eta()-ctx.jotDown2->eta());
+    }
+  }
+
+  ctx.tr->TriggerSubEvent("VBF jet system");
+}
+
+void PandaAnalyzer::JetHbbReco(EventContext &ctx) 
 {
   float tmp_hbbpt=-99;
   float tmp_hbbeta=-99;
@@ -401,8 +508,8 @@ void PandaAnalyzer::JetHbbReco()
   float tmp_hbbm=-99;
   int tmp_hbbjtidx1=-1;
   int tmp_hbbjtidx2=-1;
-  if (centralJets.size() > 1) {
-    vector<Jet*> btagSortedJets = centralJets;
+  if (ctx.centralJets.size() > 1) {
+    vector<Jet*> btagSortedJets = ctx.centralJets;
     sort(
       btagSortedJets.begin(),
       btagSortedJets.end(),
@@ -411,18 +518,18 @@ void PandaAnalyzer::JetHbbReco()
         [](panda::Jet *x, panda::Jet *y) -> bool { return x->csv  > y->csv ; }
     );
     map<Jet*, unsigned> order;
-    for (unsigned i = 0; i != cleanedJets.size(); ++i) 
-      order[cleanedJets[i]] = i;
+    for (unsigned i = 0; i != ctx.cleanedJets.size(); ++i) 
+      order[ctx.cleanedJets[i]] = i;
 
     panda::Jet *jet_1 = btagSortedJets.at(0);
-    TLorentzVector hbbdaughter1;
+    FourVector hbbdaughter1;
     hbbdaughter1.SetPtEtaPhiM(jet_1->pt(),jet_1->eta(),jet_1->phi(),jet_1->m());
 
     panda::Jet *jet_2 = btagSortedJets.at(1);
-    TLorentzVector hbbdaughter2;
+    FourVector hbbdaughter2;
     hbbdaughter2.SetPtEtaPhiM(jet_2->pt(),jet_2->eta(),jet_2->phi(),jet_2->m());
 
-    TLorentzVector hbbsystem = hbbdaughter1 + hbbdaughter2;
+    FourVector hbbsystem = hbbdaughter1 + hbbdaughter2;
 
     tmp_hbbpt = hbbsystem.Pt();
     tmp_hbbeta = hbbsystem.Eta();
@@ -432,73 +539,88 @@ void PandaAnalyzer::JetHbbReco()
     tmp_hbbjtidx2 = order[jet_2];
     
   }
-  gt->hbbpt = tmp_hbbpt;
-  gt->hbbeta = tmp_hbbeta;
-  gt->hbbphi = tmp_hbbphi;
-  gt->hbbm = tmp_hbbm;
-  gt->hbbjtidx[0] = tmp_hbbjtidx1;
-  gt->hbbjtidx[1] = tmp_hbbjtidx2;
+  ctx.gt->hbbpt = tmp_hbbpt;
+  ctx.gt->hbbeta = tmp_hbbeta;
+  ctx.gt->hbbphi = tmp_hbbphi;
+  ctx.gt->hbbm = tmp_hbbm;
+  ctx.gt->hbbjtidx[0] = tmp_hbbjtidx1;
+  ctx.gt->hbbjtidx[1] = tmp_hbbjtidx2;
 
   
-  if (analysis->bjetRegression && gt->hbbm>0.) {
-    TLorentzVector hbbdaughters_corr[2];
+  if (analysis->bjetRegression && ctx.gt->hbbm>0.) {
+    FourVector hbbdaughters_corr[2];
     
+    // inputs in the training order, one row per Higgs daughter
+    float bjetreg_inputs[2][10];
     for (unsigned i = 0; i<2; i++) {
-      bjetreg_vars[0] = gt->jetPt[gt->hbbjtidx[i]];
-      bjetreg_vars[1] = gt->nJot;
-      bjetreg_vars[2] = gt->jetEta[gt->hbbjtidx[i]];
-      bjetreg_vars[3] = gt->jetE[gt->hbbjtidx[i]];
-      bjetreg_vars[4] = gt->npv;
-      bjetreg_vars[5] = gt->jetLeadingTrkPt[gt->hbbjtidx[i]];
-      bjetreg_vars[6] = gt->jetLeadingLepPt[gt->hbbjtidx[i]];
-      bjetreg_vars[7] = gt->jetNLep[gt->hbbjtidx[i]];
-      bjetreg_vars[8] = gt->jetEMFrac[gt->hbbjtidx[i]];
-      bjetreg_vars[9] = gt->jetHadFrac[gt->hbbjtidx[i]];
-      
-      gt->jetRegFac[i] = (bjetreg_reader->EvaluateRegression("BDT method"))[0];
-      hbbdaughters_corr[i].SetPtEtaPhiE(gt->jetRegFac[i]*gt->jetPt[gt->hbbjtidx[i]],gt->jetEta[gt->hbbjtidx[i]],gt->jetPhi[gt->hbbjtidx[i]],gt->jetRegFac[i]*gt->jetE[gt->hbbjtidx[i]]);
+      int idx = ctx.gt->hbbjtidx[i];
+      float *row = bjetreg_inputs[i];
+      row[0] = ctx.gt->jetPt[idx];
+      row[1] = ctx.gt->nJot;
+      row[2] = ctx.gt->jetEta[idx];
+      row[3] = ctx.gt->jetE[idx];
+      row[4] = ctx.gt->npv;
+      row[5] = ctx.gt->jetLeadingTrkPt[idx];
+      row[6] = ctx.gt->jetLeadingLepPt[idx];
+      row[7] = ctx.gt->jetNLep[idx];
+      row[8] = ctx.gt->jetEMFrac[idx];
+      row[9] = ctx.gt->jetHadFrac[idx];
     }
 
-    TLorentzVector hbbsystem_corr = hbbdaughters_corr[0] + hbbdaughters_corr[1];
-    gt->hbbm_reg = hbbsystem_corr.M();
-    gt->hbbpt_reg = hbbsystem_corr.Pt();
+    double regFac[2];
+    if (bjetregEngine) {
+      bjetregEngine->Evaluate(bjetreg_inputs[0],2,regFac);
+    } else {
+      for (unsigned i = 0; i<2; i++) {
+        std::copy(bjetreg_inputs[i],bjetreg_inputs[i]+10,ctx.bjetreg_vars);
+        regFac[i] = (ctx.bjetreg_reader->EvaluateRegression("BDT method"))[0];
+      }
+    }
+
+    for (unsigned i = 0; i<2; i++) {
+      ctx.gt->jetRegFac[i] = regFac[i];
+      hbbdaughters_corr[i].SetPtEtaPhiE(ctx.gt->jetRegFac[i]*ctx.gt->jetPt[ctx.gt->hbbjtidx[i]],ctx.gt->jetEta[ctx.gt->hbbjtidx[i]],ctx.gt->jetPhi[ctx.gt->hbbjtidx[i]],ctx.gt->jetRegFac[i]*ctx.gt->jetE[ctx.gt->hbbjtidx[i]]);
+    }
+
+    FourVector hbbsystem_corr = hbbdaughters_corr[0] + hbbdaughters_corr[1];
+    ctx.gt->hbbm_reg = hbbsystem_corr.M();
+    ctx.gt->hbbpt_reg = hbbsystem_corr.Pt();
   }
   
-  tr->TriggerEvent("monohiggs");
+  ctx.tr->TriggerEvent("monohiggs");
 }
 
-void PandaAnalyzer::GenJetsNu()
+void PandaAnalyzer::GenJetsNu(EventContext &ctx)
 {
 
   std::vector<fastjet::PseudoJet> finalStates;
-  std::vector<panda::GenParticle*> bcs;
-  for (auto &p : event.genParticles) {
-    if (p.finalState && p.pt() > 0.001) {
+  for (auto &p : ctx.event.genParticles) {
+    if (p.finalState && p.pt() > 0.001)
       finalStates.emplace_back(p.px(), p.py(), p.pz(), p.e());
-      continue;
-    }
-    unsigned apdgid = abs(p.pdgid);
-    if (apdgid == 4 || apdgid == 5) {
-      bcs.push_back(&p);
-    }
   }
 
-  fastjet::ClusterSequenceArea seq(finalStates, *jetDefGen, *areaDef);
+  fastjet::ClusterSequenceActiveAreaExplicitGhosts seq(finalStates, *jetDefGen, ghosts, ghostArea);
   std::vector<fastjet::PseudoJet> allJets(seq.inclusive_jets(0.01));
 
-  genJetsNu.reserve(allJets.size());
+  ctx.genJetsNu.reserve(allJets.size());
+  std::vector<unsigned> partons;
   for (auto &pj : allJets) {
-    genJetsNu.emplace_back(panda::GenJet());
-    genJetsNu.back().setXYZE(pj.px(), pj.py(), pj.pz(), pj.e());
+    ctx.genJetsNu.emplace_back(panda::GenJet());
+    ctx.genJetsNu.back().setXYZE(pj.px(), pj.py(), pj.pz(), pj.e());
     int flavor = 0;
-    for (auto *bc : bcs) {
-      if (DeltaR2(pj.eta(), pj.phi(), bc->eta(), bc->phi()) < 0.09) {
-        flavor = abs(bc->pdgid);
+    ctx.partonGrid.Query(pj.eta(), pj.phi(), 0.09, partons);
+    for (unsigned iG : partons) {
+      auto &bc = ctx.event.genParticles[iG];
+      unsigned apdgid = abs(bc.pdgid);
+      if ((apdgid == 4 || apdgid == 5) && !(bc.finalState && bc.pt() > 0.001)) {
+        flavor = apdgid;
         break;
       }
     }
-    genJetsNu.back().pdgid = flavor;
+    ctx.genJetsNu.back().pdgid = flavor;
   }
-  tr->TriggerEvent("gen jets nu");
+  ctx.tr->TriggerEvent("gen jets nu");
+
+  MatchGenJets(ctx, ctx.genJetsNu);
 }
 
@@ -10,13 +10,13 @@ using namespace panda;
 using namespace std;
 
 
-void PandaAnalyzer::TopPTReweight()
+void PandaAnalyzer::TopPTReweight(EventContext &ctx)
 {
       if (analysis->processType != kTT)
         return;
 
-      gt->genWPlusPt = -1; gt->genWMinusPt = -1;
-      for (auto& gen : event.genParticles) {
+      ctx.gt->genWPlusPt = -1; ctx.gt->genWMinusPt = -1;
+      for (auto& gen : ctx.event.genParticles) {
         if (abs(gen.pdgid)!=24)
           continue;
         if (analysis->firstGen) {
@@ -24,20 +24,20 @@ void PandaAnalyzer::TopPTReweight()
             continue; // must be first copy
         }
         if (gen.pdgid>0) {
-         gt->genWPlusPt = gen.pt();
-         gt->genWPlusEta = gen.eta();
+         ctx.gt->genWPlusPt = gen.pt();
+         ctx.gt->genWPlusEta = gen.eta();
         } else {
-         gt->genWMinusPt = gen.pt();
-         gt->genWMinusEta = gen.eta();
+         ctx.gt->genWMinusPt = gen.pt();
+         ctx.gt->genWMinusEta = gen.eta();
         }
         if (analysis->firstGen) {
-          if (gt->genWPlusPt>0 && gt->genWMinusPt>0)
+          if (ctx.gt->genWPlusPt>0 && ctx.gt->genWMinusPt>0)
             break;
         }
       }
-      TLorentzVector vT,vTbar;
+      FourVector vT,vTbar;
       float pt_t=0, pt_tbar=0;
-      for (auto& gen : event.genParticles) {
+      for (auto& gen : ctx.event.genParticles) {
         if (abs(gen.pdgid)!=6)
           continue;
         if (analysis->firstGen) {
@@ -46,13 +46,13 @@ void PandaAnalyzer::TopPTReweight()
         }
         if (gen.pdgid>0) {
          pt_t = gen.pt();
-         gt->genTopPt = gen.pt();
-         gt->genTopEta = gen.eta();
+         ctx.gt->genTopPt = gen.pt();
+         ctx.gt->genTopEta = gen.eta();
          vT.SetPtEtaPhiM(gen.pt(),gen.eta(),gen.phi(),gen.m());
         } else {
          pt_tbar = gen.pt();
-         gt->genAntiTopPt = gen.pt();
-         gt->genAntiTopEta = gen.eta();
+         ctx.gt->genAntiTopPt = gen.pt();
+         ctx.gt->genAntiTopEta = gen.eta();
          vTbar.SetPtEtaPhiM(gen.pt(),gen.eta(),gen.phi(),gen.m());
         }
         if (analysis->firstGen) {
@@ -61,52 +61,48 @@ void PandaAnalyzer::TopPTReweight()
         }
       }
       if (pt_t>0 && pt_tbar>0) {
-        TLorentzVector vTT = vT+vTbar;
-        gt->genTTPt = vTT.Pt(); gt->genTTEta = vTT.Eta();
-        gt->sf_tt8TeV       = TMath::Sqrt(TMath::Exp(0.156-0.00137*TMath::Min((float)400.,pt_t)) *
+        FourVector vTT = vT+vTbar;
+        ctx.gt->genTTPt = vTT.Pt(); ctx.gt->genTTEta = vTT.Eta();
+        ctx.gt->sf_tt8TeV       = TMath::Sqrt(TMath::Exp(0.156-0.00137*TMath::Min((float)400.,pt_t)) *
                          TMath::Exp(0.156-0.00137*TMath::Min((float)400.,pt_tbar)));
-        gt->sf_tt           = TMath::Sqrt(TMath::Exp(0.0615-0.0005*TMath::Min((float)400.,pt_t)) *
+        ctx.gt->sf_tt           = TMath::Sqrt(TMath::Exp(0.0615-0.0005*TMath::Min((float)400.,pt_t)) *
                          TMath::Exp(0.0615-0.0005*TMath::Min((float)400.,pt_tbar)));
-        gt->sf_tt8TeV_ext   = TMath::Sqrt(TMath::Exp(0.156-0.00137*pt_t) *
+        ctx.gt->sf_tt8TeV_ext   = TMath::Sqrt(TMath::Exp(0.156-0.00137*pt_t) *
                          TMath::Exp(0.156-0.00137*pt_tbar));
-        gt->sf_tt_ext       = TMath::Sqrt(TMath::Exp(0.0615-0.0005*pt_t) *
+        ctx.gt->sf_tt_ext       = TMath::Sqrt(TMath::Exp(0.0615-0.0005*pt_t) *
                          TMath::Exp(0.0615-0.0005*pt_tbar));
-        gt->sf_tt8TeV_bound = TMath::Sqrt(((pt_t>400) ? 1 : TMath::Exp(0.156-0.00137*pt_t)) *
+        ctx.gt->sf_tt8TeV_bound = TMath::Sqrt(((pt_t>400) ? 1 : TMath::Exp(0.156-0.00137*pt_t)) *
                          ((pt_tbar>400) ? 1 : TMath::Exp(0.156-0.00137*pt_tbar)));
-        gt->sf_tt_bound     = TMath::Sqrt(((pt_t>400) ? 1 : TMath::Exp(0.0615-0.0005*pt_t)) *
+        ctx.gt->sf_tt_bound     = TMath::Sqrt(((pt_t>400) ? 1 : TMath::Exp(0.0615-0.0005*pt_t)) *
                          ((pt_tbar>400) ? 1 : TMath::Exp(0.0615-0.0005*pt_tbar)));
       }
 
       if (pt_t>0)
-        gt->sf_qcdTT *= TTNLOToNNLO(pt_t);
+        ctx.gt->sf_qcdTT *= TTNLOToNNLO(pt_t);
       if (pt_tbar>0) 
-        gt->sf_qcdTT *= TTNLOToNNLO(pt_tbar);
-      gt->sf_qcdTT = TMath::Sqrt(gt->sf_qcdTT);
+        ctx.gt->sf_qcdTT *= TTNLOToNNLO(pt_tbar);
+      ctx.gt->sf_qcdTT = TMath::Sqrt(ctx.gt->sf_qcdTT);
 
-    tr->TriggerEvent("tt SFs");
+    ctx.tr->TriggerEvent("tt SFs");
 }
 
-void PandaAnalyzer::VJetsReweight() 
+void PandaAnalyzer::VJetsReweight(EventContext &ctx) 
 {
       // calculate the mjj 
-      TLorentzVector vGenJet;
+      FourVector vGenJet;
       if (analysis->vbf) {
-        // first find high pT leptons
-        std::vector<GenParticle*> genLeptons;
-        for (auto &gp : event.genParticles) {
-          if (!gp.finalState)
-            continue;
-          unsigned id = abs(gp.pdgid);
-          if ((id == 11 || id == 13) &&
-              (gp.pt() > 20 && fabs(gp.eta()) < 4.7))
-            genLeptons.push_back(&gp);
-        }
+        // skip gen jets that overlap with high pT leptons
         unsigned nGenJet = 0;
-        TLorentzVector v;
-        for (auto &gj : event.ak4GenJets) {
+        FourVector v;
+        std::vector<unsigned> nearby;
+        for (auto &gj : ctx.event.ak4GenJets) {
           bool matchesLep = false;
-          for (auto *gl : genLeptons) {
-            if (DeltaR2(gj.eta(), gj.phi(), gl->eta(), gl->phi()) < 0.16) {
+          ctx.finalGrid.Query(gj.eta(), gj.phi(), 0.16, nearby);
+          for (unsigned iG : nearby) {
+            auto &gp = ctx.event.genParticles[iG];
+            unsigned id = abs(gp.pdgid);
+            if ((id == 11 || id == 13) &&
+                (gp.pt() > 20 && fabs(gp.eta()) < 4.7)) {
               matchesLep = true;
               break;
             }
@@ -115,8 +111,8 @@ void PandaAnalyzer::VJetsReweight()
             continue;
 
           v.SetPtEtaPhiM(gj.pt(), gj.eta(), gj.phi(), gj.m());
-          if (nGenJet == 0) { gt->genJet1Pt = gj.pt(); gt->genJet1Eta = gj.eta(); }
-          else if (nGenJet == 1) { gt->genJet2Pt = gj.pt(); gt->genJet2Eta = gj.eta(); }
+          if (nGenJet == 0) { ctx.gt->genJet1Pt = gj.pt(); ctx.gt->genJet1Eta = gj.eta(); }
+          else if (nGenJet == 1) { ctx.gt->genJet2Pt = gj.pt(); ctx.gt->genJet2Eta = gj.eta(); }
 
           vGenJet += v;
           nGenJet++;
@@ -124,7 +120,7 @@ void PandaAnalyzer::VJetsReweight()
             break;
         }
       }
-      gt->genMjj = vGenJet.M();
+      ctx.gt->genMjj = vGenJet.M();
 
       bool found = analysis->processType!=kA 
                    && analysis->processType!=kZ 
@@ -138,12 +134,12 @@ void PandaAnalyzer::VJetsReweight()
       if (analysis->processType==kZ || analysis->processType==kZEWK) target=23;
       if (analysis->processType==kA) target=22;
 
-      for (auto& gen : event.genParticles) {
+      for (auto& gen : ctx.event.genParticles) {
         if (found) break;
         int apdgid = abs(gen.pdgid);
         if (apdgid==target)     {
           bool foundChild = false;
-          for (auto& child : event.genParticles) {
+          for (auto& child : ctx.event.genParticles) {
             if (abs(child.pdgid) != target)
               continue;
             if (child.parent.isValid() && child.parent.get() == &(gen)) {
@@ -154,70 +150,70 @@ void PandaAnalyzer::VJetsReweight()
           if (foundChild)
             continue;
           if (analysis->processType==kZ) {
-            gt->trueGenBosonPt = gen.pt();
-            gt->genBosonMass = gen.m();
-            gt->genBosonEta = gen.eta();
-            gt->genBosonPt = bound(gen.pt(),genBosonPtMin,genBosonPtMax);
-            gt->sf_qcdV = GetCorr(cZNLO,gt->genBosonPt);
-            gt->sf_ewkV = GetCorr(cZEWK,gt->genBosonPt);
+            ctx.gt->trueGenBosonPt = gen.pt();
+            ctx.gt->genBosonMass = gen.m();
+            ctx.gt->genBosonEta = gen.eta();
+            ctx.gt->genBosonPt = bound(gen.pt(),genBosonPtMin,genBosonPtMax);
+            ctx.gt->sf_qcdV = GetCorr(cZNLO,ctx.gt->genBosonPt);
+            ctx.gt->sf_ewkV = GetCorr(cZEWK,ctx.gt->genBosonPt);
             if (analysis->vbf) {
-              gt->sf_qcdV_VBF = GetCorr(cVBF_ZNLO,gt->genBosonPt,gt->genMjj);
-              gt->sf_qcdV_VBF2l = GetCorr(cVBF_ZllNLO,gt->genBosonPt,gt->genMjj);
-              gt->sf_qcdV_VBFTight = GetCorr(cVBFTight_ZNLO,gt->genBosonPt);
-              gt->sf_qcdV_VBF2lTight = GetCorr(cVBFTight_ZllNLO,gt->genBosonPt);
+              ctx.gt->sf_qcdV_VBF = GetCorr(cVBF_ZNLO,ctx.gt->genBosonPt,ctx.gt->genMjj);
+              ctx.gt->sf_qcdV_VBF2l = GetCorr(cVBF_ZllNLO,ctx.gt->genBosonPt,ctx.gt->genMjj);
+              ctx.gt->sf_qcdV_VBFTight = GetCorr(cVBFTight_ZNLO,ctx.gt->genBosonPt);
+              ctx.gt->sf_qcdV_VBF2lTight = GetCorr(cVBFTight_ZllNLO,ctx.gt->genBosonPt);
             }
             found=true;
           } else if (analysis->processType==kW) {
-            gt->trueGenBosonPt = gen.pt();
-            gt->genBosonMass = gen.m();
-            gt->genBosonEta = gen.eta();
-            gt->genBosonPt = bound(gen.pt(),genBosonPtMin,genBosonPtMax);
-            gt->sf_qcdV = GetCorr(cWNLO,gt->genBosonPt);
-            gt->sf_ewkV = GetCorr(cWEWK,gt->genBosonPt);
+            ctx.gt->trueGenBosonPt = gen.pt();
+            ctx.gt->genBosonMass = gen.m();
+            ctx.gt->genBosonEta = gen.eta();
+            ctx.gt->genBosonPt = bound(gen.pt(),genBosonPtMin,genBosonPtMax);
+            ctx.gt->sf_qcdV = GetCorr(cWNLO,ctx.gt->genBosonPt);
+            ctx.gt->sf_ewkV = GetCorr(cWEWK,ctx.gt->genBosonPt);
             if (analysis->vbf) {
-              gt->sf_qcdV_VBF = GetCorr(cVBF_WNLO,gt->genBosonPt,gt->genMjj);
-              gt->sf_qcdV_VBFTight = GetCorr(cVBFTight_WNLO,gt->genBosonPt);
+              ctx.gt->sf_qcdV_VBF = GetCorr(cVBF_WNLO,ctx.gt->genBosonPt,ctx.gt->genMjj);
+              ctx.gt->sf_qcdV_VBFTight = GetCorr(cVBFTight_WNLO,ctx.gt->genBosonPt);
             }
             found=true;
           } else if (analysis->processType==kZEWK) {
-            gt->trueGenBosonPt = gen.pt();
-            gt->genBosonMass = gen.m();
-            gt->genBosonEta = gen.eta();
-            gt->genBosonPt = bound(gen.pt(),genBosonPtMin,genBosonPtMax);
+            ctx.gt->trueGenBosonPt = gen.pt();
+            ctx.gt->genBosonMass = gen.m();
+            ctx.gt->genBosonEta = gen.eta();
+            ctx.gt->genBosonPt = bound(gen.pt(),genBosonPtMin,genBosonPtMax);
             if (analysis->vbf) {
-              gt->sf_qcdV_VBF = GetCorr(cVBF_EWKZ,gt->genBosonPt,gt->genMjj);
-              gt->sf_qcdV_VBFTight = gt->sf_qcdV_VBF; // for consistency
+              ctx.gt->sf_qcdV_VBF = GetCorr(cVBF_EWKZ,ctx.gt->genBosonPt,ctx.gt->genMjj);
+              ctx.gt->sf_qcdV_VBFTight = ctx.gt->sf_qcdV_VBF; // for consistency
             }
           } else if (analysis->processType==kWEWK) {
-            gt->trueGenBosonPt = gen.pt();
-            gt->genBosonMass = gen.m();
-            gt->genBosonEta = gen.eta();
-            gt->genBosonPt = bound(gen.pt(),genBosonPtMin,genBosonPtMax);
+            ctx.gt->trueGenBosonPt = gen.pt();
+            ctx.gt->genBosonMass = gen.m();
+            ctx.gt->genBosonEta = gen.eta();
+            ctx.gt->genBosonPt = bound(gen.pt(),genBosonPtMin,genBosonPtMax);
             if (analysis->vbf) {
-              gt->sf_qcdV_VBF = GetCorr(cVBF_EWKW,gt->genBosonPt,gt->genMjj);
-              gt->sf_qcdV_VBFTight = gt->sf_qcdV_VBF; // for consistency
+              ctx.gt->sf_qcdV_VBF = GetCorr(cVBF_EWKW,ctx.gt->genBosonPt,ctx.gt->genMjj);
+              ctx.gt->sf_qcdV_VBFTight = ctx.gt->sf_qcdV_VBF; // for consistency
             }
           } else if (analysis->processType==kA) {
             // take the highest pT
-            if (gen.pt() > gt->trueGenBosonPt) {
-              gt->trueGenBosonPt = gen.pt();
-              gt->genBosonMass = gen.m();
-              gt->genBosonEta = gen.eta();
-              gt->genBosonPt = bound(gen.pt(),genBosonPtMin,genBosonPtMax);
-              gt->sf_qcdV = GetCorr(cANLO,gt->genBosonPt);
-              gt->sf_ewkV = GetCorr(cAEWK,gt->genBosonPt);
-              gt->sf_qcdV2j = GetCorr(cANLO2j,gt->genBosonPt);
+            if (gen.pt() > ctx.gt->trueGenBosonPt) {
+              ctx.gt->trueGenBosonPt = gen.pt();
+              ctx.gt->genBosonMass = gen.m();
+              ctx.gt->genBosonEta = gen.eta();
+              ctx.gt->genBosonPt = bound(gen.pt(),genBosonPtMin,genBosonPtMax);
+              ctx.gt->sf_qcdV = GetCorr(cANLO,ctx.gt->genBosonPt);
+              ctx.gt->sf_ewkV = GetCorr(cAEWK,ctx.gt->genBosonPt);
+              ctx.gt->sf_qcdV2j = GetCorr(cANLO2j,ctx.gt->genBosonPt);
             }
           }
         } // target matches
       } // gen particle loop ends
 
       //now for the cases where we did not find a gen boson
-      if (gt->genBosonPt < 0) {
+      if (ctx.gt->genBosonPt < 0) {
 
-        TLorentzVector vpt(0,0,0,0);
+        FourVector vpt(0,0,0,0);
 
-        for (auto& part : event.genParticles) {
+        for (auto& part : ctx.event.genParticles) {
           int pdgid = part.pdgid;
           unsigned int abspdgid = abs(pdgid);
 
@@ -230,64 +226,64 @@ void PandaAnalyzer::VJetsReweight()
 
             //ideally you want to have dressed leptons (lepton + photon), 
             //but we have in any ways have a photon veto in the analysis
-            if (IsMatched(&matchLeps,0.01,part.eta(),part.phi()))
-              vpt += part.p4();
+            if (IsMatched(&ctx.matchLeps,0.01,part.eta(),part.phi()))
+              vpt += FourVector::PtEtaPhiM(part.pt(),part.eta(),part.phi(),part.m());
           }
           
           if ((abspdgid == 12 || abspdgid == 14 || abspdgid == 16) && part.finalState==1) {
-            vpt += part.p4();
+            vpt += FourVector::PtEtaPhiM(part.pt(),part.eta(),part.phi(),part.m());
           }
         }
         
-        gt->genBosonPt = bound(vpt.Pt(),genBosonPtMin,genBosonPtMax);
-        gt->trueGenBosonPt = vpt.Pt();
-        gt->genBosonMass = vpt.M();
-        gt->genBosonEta = vpt.Eta();
+        ctx.gt->genBosonPt = bound(vpt.Pt(),genBosonPtMin,genBosonPtMax);
+        ctx.gt->trueGenBosonPt = vpt.Pt();
+        ctx.gt->genBosonMass = vpt.M();
+        ctx.gt->genBosonEta = vpt.Eta();
 
         if (analysis->processType==kZ) {
-          gt->sf_qcdV = GetCorr(cZNLO,gt->genBosonPt);
-          gt->sf_ewkV = GetCorr(cZEWK,gt->genBosonPt);
+          ctx.gt->sf_qcdV = GetCorr(cZNLO,ctx.gt->genBosonPt);
+          ctx.gt->sf_ewkV = GetCorr(cZEWK,ctx.gt->genBosonPt);
           if (analysis->vbf) {
-            gt->sf_qcdV_VBF = GetCorr(cVBF_ZNLO,gt->genBosonPt,gt->genMjj);
-            gt->sf_qcdV_VBF2l = GetCorr(cVBF_ZllNLO,gt->genBosonPt,gt->genMjj);
-            gt->sf_qcdV_VBFTight = GetCorr(cVBFTight_ZNLO,gt->genBosonPt);
-            gt->sf_qcdV_VBF2lTight = GetCorr(cVBFTight_ZllNLO,gt->genBosonPt);
+            ctx.gt->sf_qcdV_VBF = GetCorr(cVBF_ZNLO,ctx.gt->genBosonPt,ctx.gt->genMjj);
+            ctx.gt->sf_qcdV_VBF2l = GetCorr(cVBF_ZllNLO,ctx.gt->genBosonPt,ctx.gt->genMjj);
+            ctx.gt->sf_qcdV_VBFTight = GetCorr(cVBFTight_ZNLO,ctx.gt->genBosonPt);
+            ctx.gt->sf_qcdV_VBF2lTight = GetCorr(cVBFTight_ZllNLO,ctx.gt->genBosonPt);
           }
         } 
         else if (analysis->processType==kW) {
-          gt->sf_qcdV = GetCorr(cWNLO,gt->genBosonPt);
-          gt->sf_ewkV = GetCorr(cWEWK,gt->genBosonPt);
+          ctx.gt->sf_qcdV = GetCorr(cWNLO,ctx.gt->genBosonPt);
+          ctx.gt->sf_ewkV = GetCorr(cWEWK,ctx.gt->genBosonPt);
           if (analysis->vbf) {
-            gt->sf_qcdV_VBF = GetCorr(cVBF_WNLO,gt->genBosonPt,gt->genMjj);
-            gt->sf_qcdV_VBFTight = GetCorr(cVBFTight_WNLO,gt->genBosonPt);
+            ctx.gt->sf_qcdV_VBF = GetCorr(cVBF_WNLO,ctx.gt->genBosonPt,ctx.gt->genMjj);
+            ctx.gt->sf_qcdV_VBFTight = GetCorr(cVBFTight_WNLO,ctx.gt->genBosonPt);
           }
         } 
         else if (analysis->processType==kZEWK) {
           if (analysis->vbf) {
-            gt->sf_qcdV_VBF = GetCorr(cVBF_EWKZ,gt->genBosonPt,gt->genMjj);
-            gt->sf_qcdV_VBFTight = gt->sf_qcdV_VBF; // for consistency
+            ctx.gt->sf_qcdV_VBF = GetCorr(cVBF_EWKZ,ctx.gt->genBosonPt,ctx.gt->genMjj);
+            ctx.gt->sf_qcdV_VBFTight = ctx.gt->sf_qcdV_VBF; // for consistency
           }
         } 
         else if (analysis->processType==kWEWK) {
           if (analysis->vbf) {
-            gt->sf_qcdV_VBF = GetCorr(cVBF_EWKW,gt->genBosonPt,gt->genMjj);
-            gt->sf_qcdV_VBFTight = gt->sf_qcdV_VBF; // for consistency
+            ctx.gt->sf_qcdV_VBF = GetCorr(cVBF_EWKW,ctx.gt->genBosonPt,ctx.gt->genMjj);
+            ctx.gt->sf_qcdV_VBFTight = ctx.gt->sf_qcdV_VBF; // for consistency
           }
         }  
       }
 
-    tr->TriggerEvent("qcd/ewk SFs");
+    ctx.tr->TriggerEvent("qcd/ewk SFs");
 }
 
 
-void PandaAnalyzer::SignalInfo()
+void PandaAnalyzer::SignalInfo(EventContext &ctx)
 {
       if (analysis->processType != kSignal)
         return;
 
       bool found=false, foundbar=false;
-      TLorentzVector vMediator(0,0,0,0);
-      for (auto& gen : event.genParticles) {
+      FourVector vMediator(0,0,0,0);
+      for (auto& gen : ctx.event.genParticles) {
         if (found && foundbar)
           break;
         if (abs(gen.pdgid) != 18)
@@ -296,23 +292,23 @@ void PandaAnalyzer::SignalInfo()
           continue;
         if (gen.pdgid == 18 && !found) {
           found = true;
-          vMediator += gen.p4();
+          vMediator += FourVector::PtEtaPhiM(gen.pt(),gen.eta(),gen.phi(),gen.m());
         } else if (gen.pdgid == -18 && !foundbar) {
           foundbar = true;
-          vMediator += gen.p4();
+          vMediator += FourVector::PtEtaPhiM(gen.pt(),gen.eta(),gen.phi(),gen.m());
         }
       }
       if (found && foundbar) {
-        gt->trueGenBosonPt = vMediator.Pt();
-        gt->genBosonPt = bound(gt->trueGenBosonPt,175,1200);
+        ctx.gt->trueGenBosonPt = vMediator.Pt();
+        ctx.gt->genBosonPt = bound(ctx.gt->trueGenBosonPt,175,1200);
       }
 }
 
-void PandaAnalyzer::QCDUncs()
+void PandaAnalyzer::QCDUncs(EventContext &ctx)
 {
-      gt->pdfUp = 1 + event.genReweight.pdfDW;
-      gt->pdfDown = 1 - event.genReweight.pdfDW;
-      auto &genReweight = event.genReweight;
+      ctx.gt->pdfUp = 1 + ctx.event.genReweight.pdfDW;
+      ctx.gt->pdfDown = 1 - ctx.event.genReweight.pdfDW;
+      auto &genReweight = ctx.event.genReweight;
       for (unsigned iS=0; iS!=6; ++iS) {
         float s=1;
         switch (iS) {
@@ -331,19 +327,19 @@ void PandaAnalyzer::QCDUncs()
           default:
             break;
         }
-        gt->scale[iS] = s; 
-        gt->scaleUp = max(float(gt->scaleUp),float(s));
-        gt->scaleDown = min(float(gt->scaleDown),float(s));
+        ctx.gt->scale[iS] = s; 
+        ctx.gt->scaleUp = max(float(ctx.gt->scaleUp),float(s));
+        ctx.gt->scaleDown = min(float(ctx.gt->scaleDown),float(s));
       }
-      tr->TriggerEvent("qcd uncertainties");
+      ctx.tr->TriggerEvent("qcd uncertainties");
 }
 
-void PandaAnalyzer::SignalReweights()
+void PandaAnalyzer::SignalReweights(EventContext &ctx)
 {
       unsigned nW = wIDs.size();
       if (nW) {
         for (unsigned iW=0; iW!=nW; ++iW) {
-          gt->signal_weights[wIDs[iW]] = event.genReweight.genParam[iW];
+          ctx.gt->signal_weights[wIDs[iW]] = ctx.event.genReweight.genParam[iW];
         }
       }
 }
@@ -371,35 +367,35 @@ double PandaAnalyzer::WeightEWKCorr(float pt, int type) {
 double PandaAnalyzer::WeightZHEWKCorr(float baseCorr) {
   return (baseCorr+0.31+0.11)/((1-0.053)+0.31+0.11);
 }
-void PandaAnalyzer::GenStudyEWK() {
-  gt->genLep1Pt = 0;
-  gt->genLep1Eta = -1;
-  gt->genLep1Phi = -1;
-  gt->genLep1PdgId = 0;
-  gt->genLep2Pt = 0;
-  gt->genLep2Eta = -1;
-  gt->genLep2Phi = -1;
-  gt->genLep2PdgId = 0;
-  gt->looseGenLep1PdgId = 0;
-  gt->looseGenLep2PdgId = 0;
-  gt->looseGenLep3PdgId = 0;
-  gt->looseGenLep4PdgId = 0;
+void PandaAnalyzer::GenStudyEWK(EventContext &ctx) {
+  ctx.gt->genLep1Pt = 0;
+  ctx.gt->genLep1Eta = -1;
+  ctx.gt->genLep1Phi = -1;
+  ctx.gt->genLep1PdgId = 0;
+  ctx.gt->genLep2Pt = 0;
+  ctx.gt->genLep2Eta = -1;
+  ctx.gt->genLep2Phi = -1;
+  ctx.gt->genLep2PdgId = 0;
+  ctx.gt->looseGenLep1PdgId = 0;
+  ctx.gt->looseGenLep2PdgId = 0;
+  ctx.gt->looseGenLep3PdgId = 0;
+  ctx.gt->looseGenLep4PdgId = 0;
   if (isData) return;
-  TLorentzVector v1,v2,v3,v4;
-  if (gt->nLooseLep>=1) {
-    panda::Lepton *lep1=looseLeps[0];
+  FourVector v1,v2,v3,v4;
+  if (ctx.gt->nLooseLep>=1) {
+    panda::Lepton *lep1=ctx.looseLeps[0];
     v1.SetPtEtaPhiM(lep1->pt(),lep1->eta(),lep1->phi(),lep1->m());
   }
-  if (gt->nLooseLep>=2) {
-    panda::Lepton *lep2=looseLeps[1];
+  if (ctx.gt->nLooseLep>=2) {
+    panda::Lepton *lep2=ctx.looseLeps[1];
     v2.SetPtEtaPhiM(lep2->pt(),lep2->eta(),lep2->phi(),lep2->m());
   }
-  if (gt->nLooseLep>=3) {
-    panda::Lepton *lep3=looseLeps[2];
+  if (ctx.gt->nLooseLep>=3) {
+    panda::Lepton *lep3=ctx.looseLeps[2];
     v3.SetPtEtaPhiM(lep3->pt(),lep3->eta(),lep3->phi(),lep3->m());
   }
-  if (gt->nLooseLep>=4) {
-    panda::Lepton *lep4=looseLeps[3];
+  if (ctx.gt->nLooseLep>=4) {
+    panda::Lepton *lep4=ctx.looseLeps[3];
     v4.SetPtEtaPhiM(lep4->pt(),lep4->eta(),lep4->phi(),lep4->m());
   }
   // gen lepton matching
@@ -409,9 +405,9 @@ void PandaAnalyzer::GenStudyEWK() {
   std::vector<int> targetsTop;
   std::vector<int> targetsN;
 
-  int nGen = event.genParticles.size();
+  int nGen = ctx.event.genParticles.size();
   for (int iG=0; iG!=nGen; ++iG) {
-    auto& part(event.genParticles.at(iG));
+    auto& part(ctx.event.genParticles.at(iG));
     int pdgid = part.pdgid;
     unsigned int abspdgid = abs(pdgid);
     if ((abspdgid == 11 || abspdgid == 13) && (part.finalState) && 
@@ -434,13 +430,13 @@ void PandaAnalyzer::GenStudyEWK() {
 
   } //looking for targets
 
-  tr->TriggerSubEvent("check gen infos");
+  ctx.tr->TriggerSubEvent("check gen infos");
 
-  TLorentzVector rhoP4(0,0,0,0);
+  FourVector rhoP4(0,0,0,0);
   double bosonPtMin = 1000000000;
   for (int iG : targetsLepton) {
-    auto& part(event.genParticles.at(iG));
-    TLorentzVector dressedLepton;
+    auto& part(ctx.event.genParticles.at(iG));
+    FourVector dressedLepton;
     dressedLepton.SetPtEtaPhiM(part.pt(),part.eta(),part.phi(),part.m());
 
 //     // check there is no further copy:
@@ -455,7 +451,7 @@ void PandaAnalyzer::GenStudyEWK() {
   
     rhoP4 = rhoP4 + dressedLepton;
     for (int jG : targetsPhoton) {
-      auto& partj(event.genParticles.at(jG));
+      auto& partj(ctx.event.genParticles.at(jG));
 
 //       // check there is no further copy:
 //       bool isLastCopy=true;
@@ -468,71 +464,71 @@ void PandaAnalyzer::GenStudyEWK() {
 //       if (!isLastCopy)
 //         continue;
       if (DeltaR2(part.eta(),part.phi(),partj.eta(),partj.phi()) < 0.01) {
-        TLorentzVector photonV;
+        FourVector photonV;
         photonV.SetPtEtaPhiM(partj.pt(),partj.eta(),partj.phi(),partj.m());
         dressedLepton += photonV;
       }
     }
 
-    if (dressedLepton.Pt() > gt->genLep1Pt) {
-      gt->genLep2Pt    = gt->genLep1Pt; 
-      gt->genLep2Eta   = gt->genLep1Eta;
-      gt->genLep2Phi   = gt->genLep1Phi;
-      gt->genLep2PdgId = gt->genLep1PdgId; 
-      gt->genLep1Pt    = dressedLepton.Pt();
-      gt->genLep1Eta   = dressedLepton.Eta();
-      gt->genLep1Phi   = dressedLepton.Phi();
-      gt->genLep1PdgId = part.pdgid;
-    } else if (dressedLepton.Pt() > gt->genLep2Pt) {
-      gt->genLep2Pt    = dressedLepton.Pt();
-      gt->genLep2Eta   = dressedLepton.Eta();
-      gt->genLep2Phi   = dressedLepton.Phi();
-      gt->genLep2PdgId = part.pdgid; 
+    if (dressedLepton.Pt() > ctx.gt->genLep1Pt) {
+      ctx.gt->genLep2Pt    = ctx.gt->genLep1Pt; 
+      ctx.gt->genLep2Eta   = ctx.gt->genLep1Eta;
+      ctx.gt->genLep2Phi   = ctx.gt->genLep1Phi;
+      ctx.gt->genLep2PdgId = ctx.gt->genLep1PdgId; 
+      ctx.gt->genLep1Pt    = dressedLepton.Pt();
+      ctx.gt->genLep1Eta   = dressedLepton.Eta();
+      ctx.gt->genLep1Phi   = dressedLepton.Phi();
+      ctx.gt->genLep1PdgId = part.pdgid;
+    } else if (dressedLepton.Pt() > ctx.gt->genLep2Pt) {
+      ctx.gt->genLep2Pt    = dressedLepton.Pt();
+      ctx.gt->genLep2Eta   = dressedLepton.Eta();
+      ctx.gt->genLep2Phi   = dressedLepton.Phi();
+      ctx.gt->genLep2PdgId = part.pdgid; 
     }
     panda::Muon *mu; panda::Electron *ele;
     if (v1.Pt() > 0 && DeltaR2(part.eta(),part.phi(),v1.Eta(),v1.Phi()) < 0.01) {
       if (part.statusFlags == GenParticle::kIsTauDecayProduct || part.statusFlags == GenParticle::kIsPromptTauDecayProduct || 
-         part.statusFlags == GenParticle::kIsDirectTauDecayProduct || part.statusFlags == GenParticle::kIsDirectPromptTauDecayProduct) gt->looseGenLep1PdgId = 2;
-      else if (part.statusFlags == GenParticle::kIsPrompt) gt->looseGenLep1PdgId = 1;
-      if (part.pdgid != looseLep1PdgId) gt->looseGenLep1PdgId = -1 * gt->looseGenLep1PdgId;
+         part.statusFlags == GenParticle::kIsDirectTauDecayProduct || part.statusFlags == GenParticle::kIsDirectPromptTauDecayProduct) ctx.gt->looseGenLep1PdgId = 2;
+      else if (part.statusFlags == GenParticle::kIsPrompt) ctx.gt->looseGenLep1PdgId = 1;
+      if (part.pdgid != ctx.looseLep1PdgId) ctx.gt->looseGenLep1PdgId = -1 * ctx.gt->looseGenLep1PdgId;
     }
 
     if (v2.Pt() > 0 && DeltaR2(part.eta(),part.phi(),v2.Eta(),v2.Phi()) < 0.01) {
       if     (part.statusFlags == GenParticle::kIsTauDecayProduct || part.statusFlags == GenParticle::kIsPromptTauDecayProduct || 
-              part.statusFlags == GenParticle::kIsDirectTauDecayProduct || part.statusFlags == GenParticle::kIsDirectPromptTauDecayProduct) gt->looseGenLep2PdgId = 2;
-      else if (part.statusFlags == GenParticle::kIsPrompt) gt->looseGenLep2PdgId = 1;
-      if (part.pdgid != looseLep2PdgId) gt->looseGenLep2PdgId = -1 * gt->looseGenLep2PdgId;
+              part.statusFlags == GenParticle::kIsDirectTauDecayProduct || part.statusFlags == GenParticle::kIsDirectPromptTauDecayProduct) ctx.gt->looseGenLep2PdgId = 2;
+      else if (part.statusFlags == GenParticle::kIsPrompt) ctx.gt->looseGenLep2PdgId = 1;
+      if (part.pdgid != ctx.looseLep2PdgId) ctx.gt->looseGenLep2PdgId = -1 * ctx.gt->looseGenLep2PdgId;
     }
     if (v3.Pt() > 0 && DeltaR2(part.eta(),part.phi(),v3.Eta(),v3.Phi()) < 0.01) {
-      mu = dynamic_cast<panda::Muon*>(looseLeps[2]);
-      ele = dynamic_cast<panda::Electron*>(looseLeps[2]);
+      mu = dynamic_cast<panda::Muon*>(ctx.looseLeps[2]);
+      ele = dynamic_cast<panda::Electron*>(ctx.looseLeps[2]);
       int looseLep3PdgId = mu? mu->charge*-13 : (ele? ele->charge*-13 : 0);
       if     (part.statusFlags == GenParticle::kIsTauDecayProduct || part.statusFlags == GenParticle::kIsPromptTauDecayProduct || 
-              part.statusFlags == GenParticle::kIsDirectTauDecayProduct || part.statusFlags == GenParticle::kIsDirectPromptTauDecayProduct) gt->looseGenLep3PdgId = 2;
-      else if (part.statusFlags == GenParticle::kIsPrompt) gt->looseGenLep3PdgId = 1;
-      if (part.pdgid != looseLep3PdgId) gt->looseGenLep3PdgId = -1 * gt->looseGenLep3PdgId;
+              part.statusFlags == GenParticle::kIsDirectTauDecayProduct || part.statusFlags == GenParticle::kIsDirectPromptTauDecayProduct) ctx.gt->looseGenLep3PdgId = 2;
+      else if (part.statusFlags == GenParticle::kIsPrompt) ctx.gt->looseGenLep3PdgId = 1;
+      if (part.pdgid != looseLep3PdgId) ctx.gt->looseGenLep3PdgId = -1 * ctx.gt->looseGenLep3PdgId;
     }
     if (v4.Pt() > 0 && DeltaR2(part.eta(),part.phi(),v4.Eta(),v4.Phi()) < 0.01) {
-      mu = dynamic_cast<panda::Muon*>(looseLeps[3]);
-      ele = dynamic_cast<panda::Electron*>(looseLeps[3]);
+      mu = dynamic_cast<panda::Muon*>(ctx.looseLeps[3]);
+      ele = dynamic_cast<panda::Electron*>(ctx.looseLeps[3]);
       int looseLep4PdgId = mu? mu->charge*-13 : (ele? ele->charge*-13 : 0);
       if     (part.statusFlags == GenParticle::kIsTauDecayProduct || part.statusFlags == GenParticle::kIsPromptTauDecayProduct || 
-              part.statusFlags == GenParticle::kIsDirectTauDecayProduct || part.statusFlags == GenParticle::kIsDirectPromptTauDecayProduct) gt->looseGenLep4PdgId = 2;
-      else if (part.statusFlags == GenParticle::kIsPrompt) gt->looseGenLep4PdgId = 1;
-      if (part.pdgid != looseLep4PdgId) gt->looseGenLep4PdgId = -1 * gt->looseGenLep4PdgId;
+              part.statusFlags == GenParticle::kIsDirectTauDecayProduct || part.statusFlags == GenParticle::kIsDirectPromptTauDecayProduct) ctx.gt->looseGenLep4PdgId = 2;
+      else if (part.statusFlags == GenParticle::kIsPrompt) ctx.gt->looseGenLep4PdgId = 1;
+      if (part.pdgid != looseLep4PdgId) ctx.gt->looseGenLep4PdgId = -1 * ctx.gt->looseGenLep4PdgId;
     }
   }
   
-  tr->TriggerSubEvent("gen leptons 2");
+  ctx.tr->TriggerSubEvent("gen leptons 2");
 
   for (int iG : targetsN) {
-    auto& part(event.genParticles.at(iG));
-    TLorentzVector neutrino;
+    auto& part(ctx.event.genParticles.at(iG));
+    FourVector neutrino;
     neutrino.SetPtEtaPhiM(part.pt(),part.eta(),part.phi(),part.m());
     // check there is no further copy:
     bool isLastCopy=true;
     for (int kG : targetsN) {
-      if (event.genParticles.at(kG).parent.isValid() && event.genParticles.at(kG).parent.get() == &part) {
+      if (ctx.event.genParticles.at(kG).parent.isValid() && ctx.event.genParticles.at(kG).parent.get() == &part) {
         isLastCopy=false;
         break;
       }
@@ -542,21 +538,21 @@ void PandaAnalyzer::GenStudyEWK() {
     rhoP4 = rhoP4 + neutrino;
   }
 
-  tr->TriggerSubEvent("gen neutrinos");
+  ctx.tr->TriggerSubEvent("gen neutrinos");
 
-  TLorentzVector zBosons(0,0,0,0);
-  TLorentzVector wBosons(0,0,0,0);
+  FourVector zBosons(0,0,0,0);
+  FourVector wBosons(0,0,0,0);
   int nZBosons = 0; int nWBosons = 0;
   for (int iG : targetsV) {
-    auto& part(event.genParticles.at(iG));
-    TLorentzVector boson;
+    auto& part(ctx.event.genParticles.at(iG));
+    FourVector boson;
     boson.SetPtEtaPhiM(part.pt(),part.eta(),part.phi(),part.m());
 
     // check there is no further copy:
     bool isLastCopy=true;
     for (int kG : targetsV) {
-      if (event.genParticles.at(kG).parent.isValid() 
-          && event.genParticles.at(kG).parent.get() == &part) {
+      if (ctx.event.genParticles.at(kG).parent.isValid() 
+          && ctx.event.genParticles.at(kG).parent.get() == &part) {
         isLastCopy=false;
         break;
       }
@@ -575,33 +571,33 @@ void PandaAnalyzer::GenStudyEWK() {
     ZZCorr[0] = WeightEWKCorr(bosonPtMin,1);
     float GENmZZ = zBosons.M();
     ZZCorr[1] = GetCorr(cqqZZQcdCorr,2,GENmZZ); // final state = 2 is fixed
-    gt->sf_zz = ZZCorr[0]*ZZCorr[1];
-    if (rho <= 0.3) gt->sf_zzUnc = (1.0+TMath::Abs((ZZCorr[0]-1)*(15.99/9.89-1)));
-    else               gt->sf_zzUnc = (1.0+TMath::Abs((ZZCorr[0]-1)               ));
+    ctx.gt->sf_zz = ZZCorr[0]*ZZCorr[1];
+    if (rho <= 0.3) ctx.gt->sf_zzUnc = (1.0+TMath::Abs((ZZCorr[0]-1)*(15.99/9.89-1)));
+    else               ctx.gt->sf_zzUnc = (1.0+TMath::Abs((ZZCorr[0]-1)               ));
   } else {
-    gt->sf_zz    = 1.0;
-    gt->sf_zzUnc = 1.0;
+    ctx.gt->sf_zz    = 1.0;
+    ctx.gt->sf_zzUnc = 1.0;
   }
 
   if (nWBosons == 1 && nZBosons == 1) {
-    TLorentzVector WZBoson = wBosons + zBosons;
-    gt->sf_wz = GetCorr(cWZEwkCorr,WZBoson.M());
+    FourVector WZBoson = wBosons + zBosons;
+    ctx.gt->sf_wz = GetCorr(cWZEwkCorr,WZBoson.M());
   } else {
-    gt->sf_wz = 1.0;
+    ctx.gt->sf_wz = 1.0;
   }
   
   if (nZBosons == 1) {
-    gt->sf_zh     = WeightZHEWKCorr(GetCorr(cZHEwkCorr,bound(zBosons.Pt(),0,499.999)));
-    gt->sf_zhUp   = WeightZHEWKCorr(GetCorr(cZHEwkCorrUp,bound(zBosons.Pt(),0,499.999)));
-    gt->sf_zhDown = WeightZHEWKCorr(GetCorr(cZHEwkCorrDown,bound(zBosons.Pt(),0,499.999)));
+    ctx.gt->sf_zh     = WeightZHEWKCorr(GetCorr(cZHEwkCorr,bound(zBosons.Pt(),0,499.999)));
+    ctx.gt->sf_zhUp   = WeightZHEWKCorr(GetCorr(cZHEwkCorrUp,bound(zBosons.Pt(),0,499.999)));
+    ctx.gt->sf_zhDown = WeightZHEWKCorr(GetCorr(cZHEwkCorrDown,bound(zBosons.Pt(),0,499.999)));
   }
   else {
-    gt->sf_zh     = 1.0;
-    gt->sf_zhUp   = 1.0;
-    gt->sf_zhDown = 1.0;
+    ctx.gt->sf_zh     = 1.0;
+    ctx.gt->sf_zhUp   = 1.0;
+    ctx.gt->sf_zhDown = 1.0;
   }
 
-  tr->TriggerSubEvent("boson corrections");
+  ctx.tr->TriggerSubEvent("boson corrections");
 
-  tr->TriggerEvent("EWK gen study");
+  ctx.tr->TriggerEvent("EWK gen study");
 }
@@ -0,0 +1,118 @@
+#include "../interface/PFCandCache.h"
+#include <cmath>
+
+namespace {
+  // independent partial sums break the dependency chain of a serial
+  // sum, so the inner loop becomes one vector add without -ffast-math
+  const unsigned kLanes = 8;
+
+  double Sum(const double *x, unsigned n) {
+    double lanes[kLanes] = {0};
+    unsigned nBlock = n - n%kLanes;
+    for (unsigned i=0; i!=nBlock; i+=kLanes) {
+      for (unsigned j=0; j!=kLanes; ++j)
+        lanes[j] += x[i+j];
+    }
+    for (unsigned i=nBlock; i!=n; ++i)
+      lanes[0] += x[i];
+    double s = 0;
+    for (unsigned j=0; j!=kLanes; ++j)
+      s += lanes[j];
+    return s;
+  }
+
+  double SumProduct(const double *x, const double *y, unsigned n) {
+    double lanes[kLanes] = {0};
+    unsigned nBlock = n - n%kLanes;
+    for (unsigned i=0; i!=nBlock; i+=kLanes) {
+      for (unsigned j=0; j!=kLanes; ++j)
+        lanes[j] += x[i+j]*y[i+j];
+    }
+    for (unsigned i=nBlock; i!=n; ++i)
+      lanes[0] += x[i]*y[i];
+    double s = 0;
+    for (unsigned j=0; j!=kLanes; ++j)
+      s += lanes[j];
+    return s;
+  }
+}
+
+
+void PFCandCache::Clear()
+{
+  isBuilt = false;
+  isPuppiBuilt = false;
+  for (auto *v : {&px, &py, &pz, &e, &pt, &eta, &phi, &et, &puppiW,
+                  &pxW, &pyW, &pzW, &eW, &ptW})
+    v->clear();
+  charge.clear();
+  pdgId.clear();
+}
+
+
+int PFCandCache::Index(panda::Ref<panda::PFCand> const& ref) const
+{
+  if (!ref.isValid())
+    return -1;
+  long idx = ref.idx();
+  return (idx>=0 && idx<(long)size()) ? idx : -1;
+}
+
+
+void PFCandCache::Build(panda::PFCandCollection const& cands)
+{
+  Clear();
+  unsigned nC = cands.size();
+  for (auto *v : {&px, &py, &pz, &e, &pt, &eta, &phi, &et, &puppiW})
+    v->resize(nC);
+  charge.resize(nC);
+  pdgId.resize(nC);
+
+  for (unsigned iC=0; iC!=nC; ++iC) {
+    auto &cand = cands[iC];
+    double candPt = cand.pt(), candEta = cand.eta(), candE = cand.e();
+    px[iC] = cand.px();
+    py[iC] = cand.py();
+    pz[iC] = cand.pz();
+    e[iC] = candE;
+    pt[iC] = candPt;
+    eta[iC] = candEta;
+    phi[iC] = cand.phi();
+    et[iC] = (candPt>0) ? candE/std::cosh(candEta) : 0; // = E pt/|p|, as TLorentzVector::Et
+    puppiW[iC] = cand.puppiW();
+    charge[iC] = cand.q();
+    pdgId[iC] = cand.pdgId();
+  }
+  isBuilt = true;
+}
+
+
+void PFCandCache::BuildPuppi()
+{
+  if (isPuppiBuilt)
+    return;
+  unsigned nC = size();
+  for (auto *v : {&pxW, &pyW, &pzW, &eW, &ptW})
+    v->resize(nC);
+  for (unsigned iC=0; iC!=nC; ++iC) {
+    double w = puppiW[iC];
+    pxW[iC] = w*px[iC];
+    pyW[iC] = w*py[iC];
+    pzW[iC] = w*pz[iC];
+    eW[iC] = w*e[iC];
+    ptW[iC] = w*pt[iC];
+  }
+  isPuppiBuilt = true;
+}
+
+
+double PFCandCache::SumEt() const
+{
+  return Sum(et.data(),size());
+}
+
+
+double PFCandCache::SumPuppiEt() const
+{
+  return SumProduct(puppiW.data(),et.data(),size());
+}
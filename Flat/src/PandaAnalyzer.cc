@@ -2,8 +2,14 @@
 #include "TVector2.h"
 #include "TSystem.h"
 #include "TMath.h"
+#include "TROOT.h"
+#include "TChain.h"
+#include "TNamed.h"
 #include <algorithm>
 #include <vector>
+#include <thread>
+#include <chrono>
+#include <fstream>
 #include "PandaAnalysis/Utilities/src/RoccoR.cc"
 #include "PandaAnalysis/Utilities/src/CSVHelper.cc"
 
@@ -19,9 +25,8 @@ PandaAnalyzer::PandaAnalyzer(int debug_/*=0*/)
   if (DEBUG) PDebug("PandaAnalyzer::PandaAnalyzer","Calling constructor");
   gt = new GeneralTree();
   if (DEBUG) PDebug("PandaAnalyzer::PandaAnalyzer","Built GeneralTree");
-  ibetas = gt->get_ibetas();
-  Ns = gt->get_Ns();
-  orders = gt->get_orders();
+  context = new EventContext();
+  context->gt = gt;
   if (DEBUG) PDebug("PandaAnalyzer::PandaAnalyzer","Called constructor");
 }
 
@@ -32,41 +37,50 @@ PandaAnalyzer::~PandaAnalyzer()
 }
 
 
-void PandaAnalyzer::ResetBranches() 
-{
-  genObjects.clear();
-  matchPhos.clear();
-  matchEles.clear();
-  matchLeps.clear();
-  looseLeps.clear();
-  tightLeps.clear();
-  loosePhos.clear();
-  cleanedJets.clear();
-  isoJets.clear();
-  btaggedJets.clear();
-  centralJets.clear();
-  btagindices.clear();
-  genJetsNu.clear();
-  fj1 = 0;
-  for (TLorentzVector v_ : {vPFMET, vPuppiMET, vpfUW, vpfUZ, vpfUA, vpfU,
-                            vpuppiUW, vpuppiUZ, vpuppiUA, vpuppiU,
-                            vJet, vBarrelJets})
-  {
-    v_.SetPtEtaPhiM(0,0,0,0);
-  }
-  vMETNoMu.SetMagPhi(0,0);
-  gt->Reset();
-  if (DEBUG) PDebug("PandaAnalyzer::ResetBranches","Reset");
-}
-
-
 void PandaAnalyzer::SetOutputFile(TString fOutName) 
 {
-  fOut = new TFile(fOutName,"RECREATE");
-  fOut->cd();
-  tOut = new TTree("events","events");
-
-  fOut->WriteTObject(hDTotalMCWeight);    
+  // if resuming, reopen the partial output and continue after its last checkpoint
+  long nWritten = -1;
+  long lastEntry = resume ? ReadCheckpoint(fOutName,nWritten) : -1;
+  if (lastEntry>=0) {
+    fOut = new TFile(fOutName,"UPDATE");
+    tOut = fOut->IsZombie() ? 0 : (TTree*)fOut->Get("events");
+    if (!tOut) {
+      PError("PandaAnalyzer::SetOutputFile","Could not recover a tree from "+fOutName+", starting over");
+      delete fOut;
+      lastEntry = -1;
+    } else if (tOut->GetEntries()!=nWritten) {
+      // killed between the AutoSave and the sidecar: the tree holds entries
+      // past the checkpoint, which would be written a second time
+      PError("PandaAnalyzer::SetOutputFile",
+             TString::Format("%s has %lli entries, but the checkpoint was taken at %li; starting over",
+                             fOutName.Data(),tOut->GetEntries(),nWritten));
+      delete fOut;
+      tOut = 0;
+      lastEntry = -1;
+    }
+  }
+  if (lastEntry>=0) {
+    fOut->cd();
+    firstEvent = std::max(firstEvent,(int)lastEntry+1);
+    PInfo("PandaAnalyzer::SetOutputFile",
+          TString::Format("Resuming %s at entry %i with %lli entries already written",
+                          fOutName.Data(),firstEvent,tOut->GetEntries()));
+  } else {
+    fOut = new TFile(fOutName,"RECREATE");
+    fOut->cd();
+    tOut = new TTree("events","events");
+
+    fOut->WriteTObject(hDTotalMCWeight);    
+    if (analysis->varyJESSources) {
+      // the order of the *JESUp/*JESDown arrays
+      TString names;
+      for (int iS=0; iS!=GeneralTree::nJESSources; ++iS)
+        names += TString(iS ? "," : "")+GeneralTree::jesSources[iS];
+      TNamed jesSources("jesSources",names.Data());
+      fOut->WriteTObject(&jesSources);
+    }
+  }
 
   gt->monohiggs      = analysis->monoh;
   gt->vbf            = analysis->vbf;
@@ -75,6 +89,7 @@ void PandaAnalyzer::SetOutputFile(TString fOutName)
   gt->hfCounting     = analysis->hfCounting;
   gt->btagWeights    = analysis->btagWeights;
   gt->useCMVA        = analysis->useCMVA;
+  gt->varyJESSources = analysis->varyJESSources;
 
   // fill the signal weights
   for (auto& id : wIDs) 
@@ -95,15 +110,16 @@ int PandaAnalyzer::Init(TTree *t, TH1D *hweights, TTree *weightNames)
     return 0;
   }
   tIn = t;
+  context->tIn = t;
 
-  event.setStatus(*t, {"!*"}); // turn everything off first
+  context->event.setStatus(*t, {"!*"}); // turn everything off first
 
   TString jetname = (analysis->puppi_jets) ? "puppi" : "chs";
-  panda::utils::BranchList readlist({"runNumber", "lumiNumber", "eventNumber", "rho", 
-                                     "isData", "npv", "npvTrue", "weight", "chsAK4Jets", 
-                                     "electrons", "muons", "taus", "photons", 
-                                     "pfMet", "caloMet", "puppiMet", "rawMet", 
-                                     "recoil","metFilters","trkMet"});
+  readlist = panda::utils::BranchList({"runNumber", "lumiNumber", "eventNumber", "rho", 
+                                        "isData", "npv", "npvTrue", "weight", "chsAK4Jets", 
+                                        "electrons", "muons", "taus", "photons", 
+                                        "pfMet", "caloMet", "puppiMet", "rawMet", 
+                                        "recoil","metFilters","trkMet"});
   readlist.setVerbosity(0);
 
   if (analysis->ak8)
@@ -127,7 +143,15 @@ int PandaAnalyzer::Init(TTree *t, TH1D *hweights, TTree *weightNames)
   }
 
 
-  event.setAddress(*t, readlist); // pass the readlist so only the relevant branches are turned on
+  // objects the preselection cuts on, read before the rest of the event
+  preselList = {"recoil"};
+  if (isData) {
+    preselList.push_back("runNumber");
+    preselList.push_back("lumiNumber");
+  }
+
+  context->event.setAddress(*t, readlist); // pass the readlist so only the relevant branches are turned on
+  context->preselBranches = GetObjectBranches(t, preselList);
   if (DEBUG) PDebug("PandaAnalyzer::Init","Set addresses");
 
   hDTotalMCWeight = new TH1F("hDTotalMCWeight","hDTotalMCWeight",1,0,2);
@@ -173,10 +197,18 @@ int PandaAnalyzer::Init(TTree *t, TH1D *hweights, TTree *weightNames)
   
   if (analysis->recluster || analysis->reclusterGen) {
     int activeAreaRepeats = 1;
-    double ghostArea = 0.01;
+    double targetGhostArea = 0.01;
     double ghostEtaMax = 7.0;
-    activeArea = new fastjet::GhostedAreaSpec(ghostEtaMax,activeAreaRepeats,ghostArea);
-    areaDef = new fastjet::AreaDefinition(fastjet::active_area_explicit_ghosts,*activeArea);
+    // the generator behind GhostedAreaSpec is static and shared by all threads,
+    // so it is only used here, once, from a fixed state. The event loop never
+    // draws ghosts, which keeps areas independent of the event order and threads
+    fastjet::GhostedAreaSpec activeArea(ghostEtaMax,activeAreaRepeats,targetGhostArea);
+    activeArea.set_random_status({12345,67890});
+    ghosts.clear();
+    activeArea.add_ghosts(ghosts);
+    ghostArea = activeArea.actual_ghost_area();
+    std::stable_sort(ghosts.begin(),ghosts.end(),
+                     [](fastjet::PseudoJet const& a, fastjet::PseudoJet const& b) { return a.rap()<b.rap(); });
   }
 
   if (!analysis->fatjet && !analysis->ak8) {
@@ -187,6 +219,7 @@ int PandaAnalyzer::Init(TTree *t, TH1D *hweights, TTree *weightNames)
     double sdBeta = 1.;
     jetDef = new fastjet::JetDefinition(fastjet::cambridge_algorithm,radius);
     softDrop = new fastjet::contrib::SoftDrop(sdBeta,sdZcut,radius);
+
   } else { 
     std::vector<TString> droppable = {"fj1NConst","fj1NSDConst","fj1EFrac100","fj1SDEFrac100"};
     gt->RemoveBranches(droppable);
@@ -200,21 +233,191 @@ int PandaAnalyzer::Init(TTree *t, TH1D *hweights, TTree *weightNames)
   // Custom jet pt threshold
   if (analysis->hbb) jetPtThreshold=20;
 
+  RegisterModules();
+  if (!BuildPlan())
+    return 3;
+
   if (DEBUG) PDebug("PandaAnalyzer::Init","Finished configuration");
 
   return 0;
 }
 
 
-panda::GenParticle const *PandaAnalyzer::MatchToGen(double eta, double phi, double radius, int pdgid) 
+void PandaAnalyzer::RegisterModules()
+{
+  // modules run in the order they are registered here, unless a cut can be
+  // moved up or the inputs say otherwise. the names in the input/output lists
+  // are just labels for what gets passed between modules; a product that no
+  // enabled module fills is taken to be available from the start
+  bool reco = !analysis->genOnly;
+  bool mc = !isData;
+
+  modules.clear();
+  AddModule("EventBasics",         &PandaAnalyzer::EventBasics,         true,
+            {}, {"eventInfo"});
+  AddModule("SetupJES",            &PandaAnalyzer::SetupJES,            analysis->rerunJES,
+            {"eventInfo"}, {"jes"});
+  AddModule("JetCorrection",       &PandaAnalyzer::JetCorrection,       reco && analysis->rerunJES && analysis->reapplyJEC && analysis->puppi_jets,
+            {"eventInfo","jes"}, {"jes"});
+  AddModule("METBasics",           &PandaAnalyzer::METBasics,           true,
+            {"jes"}, {"met"});
+  AddModule("SimpleLeptons",       &PandaAnalyzer::SimpleLeptons,       reco && !analysis->complicatedLeptons,
+            {"met"}, {"leptons"});
+  AddModule("ComplicatedLeptons",  &PandaAnalyzer::ComplicatedLeptons,  reco && analysis->complicatedLeptons,
+            {"met"}, {"leptons"});
+  AddModule("Photons",             &PandaAnalyzer::Photons,             reco,
+            {}, {"photons"});
+  AddModule("Recoil",              &PandaAnalyzer::Recoil,              reco && analysis->recoil,
+            {"met","leptons","photons"}, {"recoil"});
+  AddModule("FatjetBasics",        &PandaAnalyzer::FatjetBasics,        reco && analysis->fatjet,
+            {"jes","leptons","photons"}, {"fatjet"});
+  AddModule("FatjetRecluster",     &PandaAnalyzer::FatjetRecluster,     reco && analysis->fatjet && analysis->recluster,
+            {"fatjet"}, {"fatjetRecluster"});
+  AddModule("JetBasics",           &PandaAnalyzer::JetBasics,           reco,
+            {"jes","met","leptons","photons","recoil","fatjet"}, {"jets"});
+  AddModule("JetVaryJESSources",   &PandaAnalyzer::JetVaryJESSources,   reco && analysis->varyJESSources,
+            {"jets","recoil","fatjet"}, {"jesSources"});
+  AddModule("JetHbbReco",          &PandaAnalyzer::JetHbbReco,          reco && analysis->monoh,
+            {"eventInfo","jets"}, {"hbb"});
+  AddModule("Taus",                &PandaAnalyzer::Taus,                reco,
+            {"leptons"}, {"taus"});
+  AddCut(   "RecoPreselection",    &PandaAnalyzer::PassPreselection,    reco,
+            {"eventInfo","met","leptons","recoil","fatjet","jets","hbb"});
+  AddModule("GetMETSignificance",  &PandaAnalyzer::GetMETSignificance,  reco && analysis->monoh,
+            {}, {"metSignificance"});
+  AddModule("FatjetMatching",      &PandaAnalyzer::FatjetMatching,      mc && reco && analysis->fatjet,
+            {"fatjet"}, {"fatjetGen"});
+  AddModule("JetBtagSFs",          &PandaAnalyzer::JetBtagSFs,          mc && reco && analysis->btagSFs,
+            {"jets"}, {"btagSFs"});
+  AddModule("JetCMVAWeights",      &PandaAnalyzer::JetCMVAWeights,      mc && reco && analysis->btagWeights,
+            {"jets"}, {"btagWeights"});
+  AddModule("TriggerEffs",         &PandaAnalyzer::TriggerEffs,         mc && reco,
+            {"leptons","photons","jets"}, {"triggerEffs"});
+  AddModule("GenStudyEWK",         &PandaAnalyzer::GenStudyEWK,         mc && analysis->complicatedLeptons,
+            {"leptons"}, {"genStudyEWK"});
+  AddModule("LeptonSFs",           &PandaAnalyzer::LeptonSFs,           mc && !analysis->complicatedLeptons,
+            {"eventInfo","leptons"}, {"leptonSFs"});
+  AddModule("PhotonSFs",           &PandaAnalyzer::PhotonSFs,           mc,
+            {"photons"}, {"photonSFs"});
+  AddModule("QCDUncs",             &PandaAnalyzer::QCDUncs,             mc,
+            {}, {"qcdUncs"});
+  AddModule("SignalReweights",     &PandaAnalyzer::SignalReweights,     mc,
+            {}, {"signalWeights"});
+  AddModule("SaveGenLeptons",      &PandaAnalyzer::SaveGenLeptons,      mc && analysis->vbf,
+            {}, {"genLeptons"});
+  AddModule("SignalInfo",          &PandaAnalyzer::SignalInfo,          mc,
+            {}, {"genBoson"});
+  AddModule("GenJetsNu",           &PandaAnalyzer::GenJetsNu,           mc && analysis->reclusterGen && analysis->monoh,
+            {"jets"}, {"genJetsNu"});
+  AddModule("HeavyFlavorCounting", &PandaAnalyzer::HeavyFlavorCounting, mc && analysis->hfCounting,
+            {}, {"heavyFlavor"});
+  AddModule("TopPTReweight",       &PandaAnalyzer::TopPTReweight,       mc,
+            {}, {"topPt"});
+  AddModule("VJetsReweight",       &PandaAnalyzer::VJetsReweight,       mc,
+            {"leptons"}, {"genBoson"});
+  AddCut(   "GenPreselection",     &PandaAnalyzer::PassPreselection,    !reco,
+            {"genBoson"});
+}
+
+
+ModuleProfiler *PandaAnalyzer::BuildProfiler()
+{
+  // one step for reading the event, then one per module in the plan
+  std::vector<TString> steps = {"getEntry"};
+  for (auto &m : modules)
+    steps.push_back(m.name);
+  return new ModuleProfiler(steps);
+}
+
+
+void PandaAnalyzer::AddModule(TString name, void (PandaAnalyzer::*fill)(EventContext&), bool enabled,
+                              std::vector<TString> inputs, std::vector<TString> outputs)
+{
+  if (!enabled)
+    return;
+  modules.push_back({name, fill, 0, inputs, outputs});
+}
+
+
+void PandaAnalyzer::AddCut(TString name, bool (PandaAnalyzer::*cut)(EventContext&), bool enabled,
+                           std::vector<TString> inputs)
+{
+  if (!enabled)
+    return;
+  modules.push_back({name, 0, cut, inputs, {}});
+}
+
+
+bool PandaAnalyzer::BuildPlan()
+{
+  unsigned nM = modules.size();
+
+  // a product may be filled by several modules, in which case all of them
+  // have to run before anything reads it
+  std::map<TString,std::vector<unsigned>> producers;
+  for (unsigned iM=0; iM!=nM; ++iM) {
+    for (auto &out : modules[iM].outputs)
+      producers[out].push_back(iM);
+  }
+
+  std::vector<std::vector<unsigned>> consumers(nM);
+  std::vector<unsigned> nWaiting(nM,0);
+  for (unsigned iM=0; iM!=nM; ++iM) {
+    for (auto &in : modules[iM].inputs) {
+      auto p = producers.find(in);
+      if (p==producers.end())
+        continue;
+      for (auto iP : p->second) {
+        if (iP==iM)
+          continue;
+        consumers[iP].push_back(iM);
+        nWaiting[iM]++;
+      }
+    }
+  }
+
+  std::vector<Module> plan;
+  std::vector<bool> scheduled(nM,false);
+  while (plan.size()!=nM) {
+    // a cut goes as soon as everything it reads is there,
+    // otherwise take the first module in registration order that is ready
+    int next = -1;
+    for (unsigned iM=0; iM!=nM; ++iM) {
+      if (scheduled[iM] || nWaiting[iM]>0)
+        continue;
+      if (modules[iM].cut) {
+        next = iM;
+        break;
+      }
+      if (next<0)
+        next = iM;
+    }
+    if (next<0) {
+      PError("PandaAnalyzer::BuildPlan","Modules have circular dependencies!");
+      return false;
+    }
+    scheduled[next] = true;
+    for (auto iC : consumers[next])
+      nWaiting[iC]--;
+    plan.push_back(modules[next]);
+    if (DEBUG) PDebug("PandaAnalyzer::BuildPlan",
+                      TString::Format("Step %u: %s",unsigned(plan.size()),modules[next].name.Data()));
+  }
+
+  modules = plan;
+  return true;
+}
+
+
+panda::GenParticle const *PandaAnalyzer::MatchToGen(EventContext &ctx, double eta, double phi, double radius, int pdgid) 
 {
   panda::GenParticle const* found=NULL;
   double r2 = radius*radius;
   pdgid = abs(pdgid);
 
   unsigned int counter=0;
-  for (map<panda::GenParticle const*,float>::iterator iG=genObjects.begin();
-      iG!=genObjects.end(); ++iG) {
+  for (map<panda::GenParticle const*,float>::iterator iG=ctx.genObjects.begin();
+      iG!=ctx.genObjects.end(); ++iG) {
     if (found!=NULL)
       break;
     if (pdgid!=0 && abs(iG->first->pdgid)!=pdgid)
@@ -229,7 +432,12 @@ panda::GenParticle const *PandaAnalyzer::MatchToGen(double eta, double phi, doub
 
 void PandaAnalyzer::Terminate() 
 {
-  fOut->WriteTObject(tOut);
+  if (validateRecluster && analysis->reclusterCone>0)
+    PInfo("PandaAnalyzer::Terminate",
+          TString::Format("Cone reclustering differed from the full reclustering in %u of %u events",
+                          context->nReclusterDiffer,context->nReclusterChecked));
+
+  fOut->WriteTObject(tOut,0,"Overwrite"); // replaces the AutoSaved cycle, if any
   fOut->Close();
 
   for (auto *f : fCorrs)
@@ -239,28 +447,34 @@ void PandaAnalyzer::Terminate()
     delete h;
   for (auto *h : h2Corrs)
     delete h;
+  // what SetDataDir and LoadJES check for 0 before loading is zeroed, so the
+  // analyzer can be set up and run again
+  for (auto *&t : tCorrs) {
+    delete t;
+    t = 0;
+  }
 
+  for (auto *t : btagTables)
+    delete t;
+  delete bjetregEngine;
+  bjetregEngine = 0;
+  for (auto& iter : ak4JECEngines)
+    delete iter.second;
+  ak4JECEngines.clear();
+  delete ak4JESSources;
+  ak4JESSources = 0;
+  delete ak8JERSmearer;
+  ak8JERSmearer = 0;
+  delete ak4JERSmearer;
+  ak4JERSmearer = 0;
+  delete rochesterCorrection;
+  rochesterCorrection = 0;
   delete btagCalib;
   delete sj_btagCalib;
-  for (auto *reader : btagReaders )
-    delete reader;
 
-  for (auto& iter : ak8UncReader)
-    delete iter.second;
-
-  delete ak8JERReader;
-
-  for (auto& iter : ak4UncReader)
-    delete iter.second;
+  delete context;
+  context = 0;
 
-  for (auto& iter : ak4ScaleReader) {
-    delete iter.second;
-  }
-
-  delete ak4JERReader;
-
-  delete activeArea;
-  delete areaDef;
   delete jetDef;
   delete jetDefGen;
   delete softDrop;
@@ -271,6 +485,12 @@ void PandaAnalyzer::Terminate()
 
 void PandaAnalyzer::OpenCorrection(CorrectionType ct, TString fpath, TString hname, int dim) 
 {
+  // binned corrections may already have been read from the bundle
+  if (dim<3) {
+    corrSources.push_back(fpath);
+    if (corrsFromBundle)
+      return;
+  }
   fCorrs[ct] = TFile::Open(fpath);
   if (dim==1) 
     h1Corrs[ct] = new THCorr1((TH1D*)fCorrs[ct]->Get(hname));
@@ -280,14 +500,26 @@ void PandaAnalyzer::OpenCorrection(CorrectionType ct, TString fpath, TString hna
     f1Corrs[ct] = new TF1Corr((TF1*)fCorrs[ct]->Get(hname));
 }
 
+TString PandaAnalyzer::CorrectionKey() const
+{
+  // everything in SetDataDir that changes which binned corrections are loaded
+  return TString::Format("leptonic%i_vbf%i",
+                         (int)analysis->complicatedLeptons,(int)analysis->vbf);
+}
+
+bool PandaAnalyzer::WriteCorrectionBundle(TString path)
+{
+  if (corrsFromBundle) {
+    PError("PandaAnalyzer::WriteCorrectionBundle","Corrections were read from a bundle, run SetDataDir without one");
+    return false;
+  }
+  return CorrectionBundle::Write(path,CorrectionKey(),dataDir,corrSources,tCorrs);
+}
+
 double PandaAnalyzer::GetCorr(CorrectionType ct, double x, double y) 
 {
-  if (h1Corrs[ct]!=0) {
-    return h1Corrs[ct]->Eval(x); 
-  } else if (h2Corrs[ct]!=0) {
-    return h2Corrs[ct]->Eval(x,y);
-  } else if (f1Corrs[ct]!=0) {
-    return f1Corrs[ct]->Eval(x);
+  if (tCorrs[ct]!=0) {
+    return tCorrs[ct]->Eval(x,y);
   } else {
     PError("PandaAnalyzer::GetCorr",
        TString::Format("No correction is defined for CorrectionType=%u",ct));
@@ -295,12 +527,37 @@ double PandaAnalyzer::GetCorr(CorrectionType ct, double x, double y)
   }
 }
 
+double PandaAnalyzer::GetCorr(EventContext &ctx, CorrectionType ct, double x)
+{
+  if (ct<ctx.f1Corrs.size() && ctx.f1Corrs[ct]!=0)
+    return ctx.f1Corrs[ct]->Eval(x);
+  return GetCorr(ct,x);
+}
+
+void PandaAnalyzer::CloneTF1s(EventContext &ctx, TString suffix)
+{
+  // TF1::Eval is not thread-safe, so every context evaluates its own copies.
+  // Contexts are built serially, so the cloning itself does not race
+  auto clone = [&suffix](TF1Corr *f) {
+    return f ? (TF1*)f->GetFunc()->Clone(TString(f->GetFunc()->GetName())+suffix) : (TF1*)0;
+  };
+  for (auto *f : ctx.f1Corrs)
+    delete f;
+  ctx.f1Corrs.assign(cN,0);
+  for (unsigned ct=0; ct!=cN; ++ct)
+    ctx.f1Corrs[ct] = clone(f1Corrs[ct]);
+  delete ctx.puppisd_corrGEN;
+  delete ctx.puppisd_corrRECO_cen;
+  delete ctx.puppisd_corrRECO_for;
+  ctx.puppisd_corrGEN = clone(puppisd_corrGEN);
+  ctx.puppisd_corrRECO_cen = clone(puppisd_corrRECO_cen);
+  ctx.puppisd_corrRECO_for = clone(puppisd_corrRECO_for);
+}
+
 double PandaAnalyzer::GetError(CorrectionType ct, double x, double y) 
 {
-  if (h1Corrs[ct]!=0) {
-    return h1Corrs[ct]->Error(x); 
-  } else if (h2Corrs[ct]!=0) {
-    return h2Corrs[ct]->Error(x,y);
+  if (tCorrs[ct]!=0) {
+    return tCorrs[ct]->Error(x,y);
   } else {
     PError("PandaAnalyzer::GetError",
        TString::Format("No correction is defined for CorrectionType=%u",ct));
@@ -312,9 +569,16 @@ void PandaAnalyzer::SetDataDir(const char *s)
 {
   TString dirPath(s);
   dirPath += "/";
+  dataDir = dirPath;
 
   if (DEBUG) PDebug("PandaAnalyzer::SetDataDir","Starting loading of data");
 
+  corrSources.clear();
+  corrsFromBundle = (correctionBundle!="") && 
+                    CorrectionBundle::Read(correctionBundle,CorrectionKey(),dirPath,tCorrs);
+  if (corrsFromBundle && DEBUG) 
+    PDebug("PandaAnalyzer::SetDataDir","Read binned corrections from "+correctionBundle);
+
   // pileup
   OpenCorrection(cNPV,dirPath+"moriond17/normalized_npv.root","data_npv_Wmn",1);
   OpenCorrection(cPU,dirPath+"moriond17/puWeights_80x_37ifb.root","puWeights",1);
@@ -370,32 +634,32 @@ void PandaAnalyzer::SetDataDir(const char *s)
   if (DEBUG) PDebug("PandaAnalyzer::SetDataDir","Loaded scale factors");
 
   // kfactors
-  TFile *fKFactor = 0;
-  if (analysis->vbf)
-    fKFactor = new TFile(dirPath+"vbf16/kqcd/kfactor_24bins.root"); 
-  else
-    fKFactor = new TFile(dirPath+"kfactors.root"); 
-  fCorrs[cZNLO] = fKFactor; // just for garbage collection
-
-  TH1D *hZLO    = (TH1D*)fKFactor->Get("ZJets_LO/inv_pt");
-  TH1D *hWLO    = (TH1D*)fKFactor->Get("WJets_LO/inv_pt");
-  TH1D *hALO    = (TH1D*)fKFactor->Get("GJets_LO/inv_pt_G");
-
-  h1Corrs[cZNLO] = new THCorr1((TH1D*)fKFactor->Get("ZJets_012j_NLO/nominal"));
-  h1Corrs[cWNLO] = new THCorr1((TH1D*)fKFactor->Get("WJets_012j_NLO/nominal"));
-  h1Corrs[cANLO] = new THCorr1((TH1D*)fKFactor->Get("GJets_1j_NLO/nominal_G"));
-
-  h1Corrs[cZEWK] = new THCorr1((TH1D*)fKFactor->Get("EWKcorr/Z"));
-  h1Corrs[cWEWK] = new THCorr1((TH1D*)fKFactor->Get("EWKcorr/W"));
-  h1Corrs[cAEWK] = new THCorr1((TH1D*)fKFactor->Get("EWKcorr/photon"));
-
-  h1Corrs[cZEWK]->GetHist()->Divide(h1Corrs[cZNLO]->GetHist());     
-  h1Corrs[cWEWK]->GetHist()->Divide(h1Corrs[cWNLO]->GetHist());     
-  h1Corrs[cAEWK]->GetHist()->Divide(h1Corrs[cANLO]->GetHist());
-
-  h1Corrs[cZNLO]->GetHist()->Divide(hZLO);    
-  h1Corrs[cWNLO]->GetHist()->Divide(hWLO);    
-  h1Corrs[cANLO]->GetHist()->Divide(hALO);
+  TString kFactorPath = dirPath + (analysis->vbf ? "vbf16/kqcd/kfactor_24bins.root" : "kfactors.root");
+  corrSources.push_back(kFactorPath);
+  if (!corrsFromBundle) {
+    TFile *fKFactor = new TFile(kFactorPath);
+    fCorrs[cZNLO] = fKFactor; // just for garbage collection
+
+    TH1D *hZLO    = (TH1D*)fKFactor->Get("ZJets_LO/inv_pt");
+    TH1D *hWLO    = (TH1D*)fKFactor->Get("WJets_LO/inv_pt");
+    TH1D *hALO    = (TH1D*)fKFactor->Get("GJets_LO/inv_pt_G");
+
+    h1Corrs[cZNLO] = new THCorr1((TH1D*)fKFactor->Get("ZJets_012j_NLO/nominal"));
+    h1Corrs[cWNLO] = new THCorr1((TH1D*)fKFactor->Get("WJets_012j_NLO/nominal"));
+    h1Corrs[cANLO] = new THCorr1((TH1D*)fKFactor->Get("GJets_1j_NLO/nominal_G"));
+
+    h1Corrs[cZEWK] = new THCorr1((TH1D*)fKFactor->Get("EWKcorr/Z"));
+    h1Corrs[cWEWK] = new THCorr1((TH1D*)fKFactor->Get("EWKcorr/W"));
+    h1Corrs[cAEWK] = new THCorr1((TH1D*)fKFactor->Get("EWKcorr/photon"));
+
+    h1Corrs[cZEWK]->GetHist()->Divide(h1Corrs[cZNLO]->GetHist());     
+    h1Corrs[cWEWK]->GetHist()->Divide(h1Corrs[cWNLO]->GetHist());     
+    h1Corrs[cAEWK]->GetHist()->Divide(h1Corrs[cANLO]->GetHist());
+
+    h1Corrs[cZNLO]->GetHist()->Divide(hZLO);    
+    h1Corrs[cWNLO]->GetHist()->Divide(hWLO);    
+    h1Corrs[cANLO]->GetHist()->Divide(hALO);
+  }
 
   OpenCorrection(cANLO2j,dirPath+"moriond17/histo_photons_2jet.root","Func",1);
 
@@ -454,21 +718,9 @@ void PandaAnalyzer::SetDataDir(const char *s)
   if (analysis->btagSFs) {
     // btag SFs
     btagCalib = new BTagCalibration("csvv2",(dirPath+"moriond17/CSVv2_Moriond17_B_H.csv").Data());
-    btagReaders[bJetL] = new BTagCalibrationReader(BTagEntry::OP_LOOSE,"central",{"up","down"});
-    btagReaders[bJetL]->load(*btagCalib,BTagEntry::FLAV_B,"comb");
-    btagReaders[bJetL]->load(*btagCalib,BTagEntry::FLAV_C,"comb");
-    btagReaders[bJetL]->load(*btagCalib,BTagEntry::FLAV_UDSG,"incl");
-
     sj_btagCalib = new BTagCalibration("csvv2",(dirPath+"moriond17/subjet_CSVv2_Moriond17_B_H.csv").Data());
-    btagReaders[bSubJetL] = new BTagCalibrationReader(BTagEntry::OP_LOOSE,"central",{"up","down"});
-    btagReaders[bSubJetL]->load(*sj_btagCalib,BTagEntry::FLAV_B,"lt");
-    btagReaders[bSubJetL]->load(*sj_btagCalib,BTagEntry::FLAV_C,"lt");
-    btagReaders[bSubJetL]->load(*sj_btagCalib,BTagEntry::FLAV_UDSG,"incl");
-
-    btagReaders[bJetM] = new BTagCalibrationReader(BTagEntry::OP_MEDIUM,"central",{"up","down"});
-    btagReaders[bJetM]->load(*btagCalib,BTagEntry::FLAV_B,"comb");
-    btagReaders[bJetM]->load(*btagCalib,BTagEntry::FLAV_C,"comb");
-    btagReaders[bJetM]->load(*btagCalib,BTagEntry::FLAV_UDSG,"incl");
+    LoadBTagReaders(*context);
+    LoadBTagTables();
 
     if (DEBUG) PDebug("PandaAnalyzer::SetDataDir","Loaded btag SFs");
   } 
@@ -480,95 +732,310 @@ void PandaAnalyzer::SetDataDir(const char *s)
   }
 
   // bjet regression
-  if (analysis->bjetRegression){
-    bjetreg_vars = new float[10];
-
-    bjetreg_reader->AddVariable("jetPt[hbbjtidx[0]]",&bjetreg_vars[0]);
-    bjetreg_reader->AddVariable("nJot",&bjetreg_vars[1]);
-    bjetreg_reader->AddVariable("jetEta[hbbjtidx[0]]",&bjetreg_vars[2]);
-    bjetreg_reader->AddVariable("jetE[hbbjtidx[0]]",&bjetreg_vars[3]);
-    bjetreg_reader->AddVariable("npv",&bjetreg_vars[4]);
-    bjetreg_reader->AddVariable("jetLeadingTrkPt[hbbjtidx[0]]",&bjetreg_vars[5]);
-    bjetreg_reader->AddVariable("jetLeadingLepPt[hbbjtidx[0]]",&bjetreg_vars[6]);
-    bjetreg_reader->AddVariable("jetNLep[hbbjtidx[0]]",&bjetreg_vars[7]);
-    bjetreg_reader->AddVariable("jetEMFrac[hbbjtidx[0]]",&bjetreg_vars[8]);
-    bjetreg_reader->AddVariable("jetHadFrac[hbbjtidx[0]]",&bjetreg_vars[9]);
-
-    bjetreg_reader->BookMVA( "BDT method", dirPath+"trainings/bjet_regression_v0.weights.xml" );    
-
-    if (DEBUG) PDebug("PandaAnalyzer::SetDataDir","Loaded bjet regression weights");
-  }
+  if (analysis->bjetRegression)
+    LoadBJetRegression(*context,dirPath);
 
 
   if (analysis->monoh) {
     // mSD corr
     MSDcorr = new TFile(dirPath+"/puppiCorr.root");
-    puppisd_corrGEN = (TF1*)MSDcorr->Get("puppiJECcorr_gen");;
-    puppisd_corrRECO_cen = (TF1*)MSDcorr->Get("puppiJECcorr_reco_0eta1v3");
-    puppisd_corrRECO_for = (TF1*)MSDcorr->Get("puppiJECcorr_reco_1v3eta2v5");
+    puppisd_corrGEN = new TF1Corr((TF1*)MSDcorr->Get("puppiJECcorr_gen"));
+    puppisd_corrRECO_cen = new TF1Corr((TF1*)MSDcorr->Get("puppiJECcorr_reco_0eta1v3"));
+    puppisd_corrRECO_for = new TF1Corr((TF1*)MSDcorr->Get("puppiJECcorr_reco_1v3eta2v5"));
 
     if (DEBUG) PDebug("PandaAnalyzer::SetDataDir","Loaded mSD correction");
   }
 
-  if (analysis->rerunJES) {
-    TString jecV = "V4", jecReco = "23Sep2016"; 
-    TString jecVFull = jecReco+jecV;
-    ak8UncReader["MC"] = new JetCorrectionUncertainty(
-       (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecVFull+"_MC_Uncertainty_AK8PFPuppi.txt").Data()
-      );
-    std::vector<TString> eraGroups = {"BCD","EF","G","H"};
-    for (auto e : eraGroups) {
-      ak8UncReader["data"+e] = new JetCorrectionUncertainty(
-         (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecReco+e+jecV+"_DATA_Uncertainty_AK8PFPuppi.txt").Data()
-        );
+  if (analysis->rerunJES)
+    LoadJES(*context,dirPath);
+  if (analysis->varyJESSources)
+    LoadJESSources(*context,dirPath);
+
+  // the binned corrections are final now: flatten them for GetCorr
+  for (unsigned ct=0; ct!=cN; ++ct) {
+    if (h1Corrs[ct]==0 && h2Corrs[ct]==0)
+      continue;
+    delete tCorrs[ct];
+    if (h1Corrs[ct]!=0)
+      tCorrs[ct] = new CorrTable(h1Corrs[ct]->GetHist());
+    else
+      tCorrs[ct] = new CorrTable(h2Corrs[ct]->GetHist());
+  }
+
+  CloneTF1s(*context,"_main");
+}
+
+
+void PandaAnalyzer::LoadBTagReaders(EventContext &ctx)
+{
+  // the calibrations are only read here, so contexts can share them
+  ctx.btagReaders = std::vector<BTagCalibrationReader*>(bN,0);
+  ctx.btagReaders[bJetL] = new BTagCalibrationReader(BTagEntry::OP_LOOSE,"central",{"up","down"});
+  ctx.btagReaders[bJetL]->load(*btagCalib,BTagEntry::FLAV_B,"comb");
+  ctx.btagReaders[bJetL]->load(*btagCalib,BTagEntry::FLAV_C,"comb");
+  ctx.btagReaders[bJetL]->load(*btagCalib,BTagEntry::FLAV_UDSG,"incl");
+
+  ctx.btagReaders[bSubJetL] = new BTagCalibrationReader(BTagEntry::OP_LOOSE,"central",{"up","down"});
+  ctx.btagReaders[bSubJetL]->load(*sj_btagCalib,BTagEntry::FLAV_B,"lt");
+  ctx.btagReaders[bSubJetL]->load(*sj_btagCalib,BTagEntry::FLAV_C,"lt");
+  ctx.btagReaders[bSubJetL]->load(*sj_btagCalib,BTagEntry::FLAV_UDSG,"incl");
+
+  ctx.btagReaders[bJetM] = new BTagCalibrationReader(BTagEntry::OP_MEDIUM,"central",{"up","down"});
+  ctx.btagReaders[bJetM]->load(*btagCalib,BTagEntry::FLAV_B,"comb");
+  ctx.btagReaders[bJetM]->load(*btagCalib,BTagEntry::FLAV_C,"comb");
+  ctx.btagReaders[bJetM]->load(*btagCalib,BTagEntry::FLAV_UDSG,"incl");
+}
+
+
+void PandaAnalyzer::LoadBTagTables()
+{
+  // tabulated once from the main context's readers; the tables are 
+  // read-only afterwards and shared by all contexts. A table that fails
+  // validation is dropped, and CalcBJetSFs uses the context's reader
+  btagTables = std::vector<BTagSFTable*>(bN,0);
+  auto load = [&](BTagType bt, BTagCalibration *calib, BTagEntry::OperatingPoint op, std::string hfMeasurement) {
+    BTagCalibrationReader *reader = context->btagReaders[bt];
+    btagTables[bt] = new BTagSFTable();
+    btagTables[bt]->Load(*calib,*reader,op,BTagEntry::FLAV_B,hfMeasurement);
+    btagTables[bt]->Load(*calib,*reader,op,BTagEntry::FLAV_C,hfMeasurement);
+    btagTables[bt]->Load(*calib,*reader,op,BTagEntry::FLAV_UDSG,"incl");
+    if (validateBTagTables) {
+      double maxDiff = btagTables[bt]->Validate(*reader);
+      PInfo("PandaAnalyzer::LoadBTagTables",
+            TString::Format("BTagType %i: max |table-reader| = %.3g",(int)bt,maxDiff));
+      if (maxDiff>btagTables[bt]->tolerance) {
+        PError("PandaAnalyzer::LoadBTagTables",
+               TString::Format("Falling back to BTagCalibrationReader for BTagType %i",(int)bt));
+        delete btagTables[bt];
+        btagTables[bt] = 0;
+      }
     }
+  };
+  load(bJetL,btagCalib,BTagEntry::OP_LOOSE,"comb");
+  load(bSubJetL,sj_btagCalib,BTagEntry::OP_LOOSE,"lt");
+  load(bJetM,btagCalib,BTagEntry::OP_MEDIUM,"comb");
+}
+
+
+void PandaAnalyzer::LoadBJetRegression(EventContext &ctx, TString dirPath)
+{
+  TString weightsPath = dirPath+"trainings/bjet_regression_v0.weights.xml";
+  // in the order JetHbbReco fills the inputs
+  static const std::vector<TString> inputs = {
+    "jetPt[hbbjtidx[0]]", "nJot", "jetEta[hbbjtidx[0]]", "jetE[hbbjtidx[0]]", "npv",
+    "jetLeadingTrkPt[hbbjtidx[0]]", "jetLeadingLepPt[hbbjtidx[0]]", "jetNLep[hbbjtidx[0]]",
+    "jetEMFrac[hbbjtidx[0]]", "jetHadFrac[hbbjtidx[0]]"
+  };
+
+  // the engine is stateless, so all contexts share the one made for the first.
+  // It reads its inputs by position, so they have to be the ones above, in order
+  if (!bjetregEngine) {
+    bjetregEngine = new BDTEngine();
+    bool ok = bjetregEngine->Load(weightsPath);
+    if (ok && bjetregEngine->Variables()!=inputs) {
+      PError("PandaAnalyzer::LoadBJetRegression","The inputs of "+weightsPath+" are not the expected ones");
+      ok = false;
+    }
+    if (!ok) {
+      PError("PandaAnalyzer::LoadBJetRegression","Falling back to TMVA::Reader");
+      delete bjetregEngine;
+      bjetregEngine = 0;
+    }
+  }
+  if (bjetregEngine && (!validateBDTs || &ctx!=context)) {
+    if (DEBUG) PDebug("PandaAnalyzer::LoadBJetRegression","Loaded bjet regression weights");
+    return;
+  }
+
+  ctx.bjetreg_reader = new TMVA::Reader("!Color:!Silent");
+  ctx.bjetreg_vars = new float[inputs.size()];
+  for (unsigned iV=0; iV!=inputs.size(); ++iV)
+    ctx.bjetreg_reader->AddVariable(inputs[iV],&ctx.bjetreg_vars[iV]);
+
+  ctx.bjetreg_reader->BookMVA( "BDT method", weightsPath );    
+
+  if (bjetregEngine) {
+    // only here for validation; the event loop uses the engine, unless it fails.
+    // Contexts built later see the 0 and book their own reader
+    if (bjetregEngine->Validate(*ctx.bjetreg_reader,ctx.bjetreg_vars,"BDT method")>BDTEngine::kTolerance) {
+      PError("PandaAnalyzer::LoadBJetRegression","Falling back to TMVA::Reader");
+      delete bjetregEngine;
+      bjetregEngine = 0;
+    } else {
+      delete ctx.bjetreg_reader;
+      delete[] ctx.bjetreg_vars;
+      ctx.bjetreg_reader = 0;
+      ctx.bjetreg_vars = 0;
+    }
+  }
+
+  if (DEBUG) PDebug("PandaAnalyzer::LoadBJetRegression","Loaded bjet regression weights");
+}
+
+
+JERSmearer *PandaAnalyzer::LoadJERSmearer(TString sfPath, TString resPath)
+{
+  JERSmearer *smearer = new JERSmearer();
+  if (!smearer->Load(sfPath,resPath)) {
+    PError("PandaAnalyzer::LoadJERSmearer","Falling back to JERReader, whose smearing depends on the event order");
+    delete smearer;
+    smearer = 0;
+  }
+  return smearer;
+}
+
 
-    ak8JERReader = new JERReader(dirPath+"/jec/25nsV10/Spring16_25nsV10_MC_SF_AK8PFPuppi.txt",
+void PandaAnalyzer::LoadJES(EventContext &ctx, TString dirPath)
+{
+  TString jecV = "V4", jecReco = "23Sep2016"; 
+  TString jecVFull = jecReco+jecV;
+  ctx.ak8UncReader["MC"] = new JetCorrectionUncertainty(
+     (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecVFull+"_MC_Uncertainty_AK8PFPuppi.txt").Data()
+    );
+  std::vector<TString> eraGroups = {"BCD","EF","G","H"};
+  for (auto e : eraGroups) {
+    ctx.ak8UncReader["data"+e] = new JetCorrectionUncertainty(
+       (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecReco+e+jecV+"_DATA_Uncertainty_AK8PFPuppi.txt").Data()
+      );
+  }
+
+  // the smearers take their draws from CounterRNG streams and are shared; the
+  // JERReader, with its own sequential generator, is only built if they fail
+  if (!ak8JERSmearer)
+    ak8JERSmearer = LoadJERSmearer(dirPath+"/jec/25nsV10/Spring16_25nsV10_MC_SF_AK8PFPuppi.txt",
+                                   dirPath+"/jec/25nsV10/Spring16_25nsV10_MC_PtResolution_AK8PFPuppi.txt");
+  if (!ak8JERSmearer)
+    ctx.ak8JERReader = new JERReader(dirPath+"/jec/25nsV10/Spring16_25nsV10_MC_SF_AK8PFPuppi.txt",
                                  dirPath+"/jec/25nsV10/Spring16_25nsV10_MC_PtResolution_AK8PFPuppi.txt");
 
 
-    ak4UncReader["MC"] = new JetCorrectionUncertainty(
-       (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecVFull+"_MC_Uncertainty_AK4PFPuppi.txt").Data()
+  ctx.ak4UncReader["MC"] = new JetCorrectionUncertainty(
+     (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecVFull+"_MC_Uncertainty_AK4PFPuppi.txt").Data()
+    );
+  for (auto e : eraGroups) {
+    ctx.ak4UncReader["data"+e] = new JetCorrectionUncertainty(
+       (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecReco+e+jecV+"_DATA_Uncertainty_AK4PFPuppi.txt").Data()
       );
-    for (auto e : eraGroups) {
-      ak4UncReader["data"+e] = new JetCorrectionUncertainty(
-         (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecReco+e+jecV+"_DATA_Uncertainty_AK4PFPuppi.txt").Data()
+  }
+
+  if (!ak4JERSmearer)
+    ak4JERSmearer = LoadJERSmearer(dirPath+"/jec/25nsV10/Spring16_25nsV10_MC_SF_AK4PFPuppi.txt",
+                                   dirPath+"/jec/25nsV10/Spring16_25nsV10_MC_PtResolution_AK4PFPuppi.txt");
+  if (!ak4JERSmearer)
+    ctx.ak4JERReader = new JERReader(dirPath+"/jec/25nsV10/Spring16_25nsV10_MC_SF_AK4PFPuppi.txt",
+                                 dirPath+"/jec/25nsV10/Spring16_25nsV10_MC_PtResolution_AK4PFPuppi.txt");
+
+  std::vector<TString> levels = {"L1FastJet","L2Relative","L3Absolute","L2L3Residual"};
+  std::map<TString,std::vector<TString>> ak4ScaleFiles;
+  for (auto &level : levels) {
+    ak4ScaleFiles["MC"].push_back(dirPath+"/jec/"+jecVFull+"/Summer16_"+jecVFull+"_MC_"+level+"_AK4PFPuppi.txt");
+    for (auto e : eraGroups)
+      ak4ScaleFiles["data"+e].push_back(
+        dirPath+"/jec/"+jecVFull+"/Summer16_"+jecReco+e+jecV+"_DATA_"+level+"_AK4PFPuppi.txt"
         );
+  }
+
+  // the engines are stateless, so all contexts share the ones made for the first.
+  // The CMSSW corrector is only built if the engine cannot read the files, or
+  // once to validate the engine
+  bool loadEngines = ak4JECEngines.size()==0;
+  for (auto &iter : ak4ScaleFiles) {
+    if (loadEngines) {
+      JECEngine *engine = new JECEngine();
+      if (!engine->Load(iter.second)) {
+        PError("PandaAnalyzer::LoadJES","Falling back to FactorizedJetCorrector for AK4 "+iter.first);
+        delete engine;
+        engine = 0;
+      }
+      ak4JECEngines[iter.first] = engine;
     }
+    JECEngine *engine = ak4JECEngines[iter.first];
+    if (engine && (!validateJEC || &ctx!=context))
+      continue;
 
-    ak4JERReader = new JERReader(dirPath+"/jec/25nsV10/Spring16_25nsV10_MC_SF_AK4PFPuppi.txt",
-                                 dirPath+"/jec/25nsV10/Spring16_25nsV10_MC_PtResolution_AK4PFPuppi.txt");
+    std::vector<JetCorrectorParameters> params;
+    for (auto &path : iter.second)
+      params.push_back(JetCorrectorParameters(path.Data()));
+    ctx.ak4ScaleReader[iter.first] = new FactorizedJetCorrector(params);
+    if (engine) {
+      if (engine->Validate(*ctx.ak4ScaleReader[iter.first])>JECEngine::kTolerance) {
+        // contexts built later see the 0 and make their own corrector
+        PError("PandaAnalyzer::LoadJES","Falling back to FactorizedJetCorrector for AK4 "+iter.first);
+        delete engine;
+        ak4JECEngines[iter.first] = 0;
+      } else {
+        delete ctx.ak4ScaleReader[iter.first];
+        ctx.ak4ScaleReader.erase(iter.first);
+      }
+    }
+    if (DEBUG>1) PDebug("PandaAnalyzer::LoadJES","Loaded JES for AK4 "+iter.first);
+  }
 
-    std::vector<JetCorrectorParameters> params = {
-      JetCorrectorParameters(
-        (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecVFull+"_MC_L1FastJet_AK4PFPuppi.txt").Data()),
-      JetCorrectorParameters(
-        (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecVFull+"_MC_L2Relative_AK4PFPuppi.txt").Data()),
-      JetCorrectorParameters(
-        (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecVFull+"_MC_L3Absolute_AK4PFPuppi.txt").Data()),
-      JetCorrectorParameters(
-        (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecVFull+"_MC_L2L3Residual_AK4PFPuppi.txt").Data())
-    };
-    ak4ScaleReader["MC"] = new FactorizedJetCorrector(params);
-    if (DEBUG>1) PDebug("PandaAnalyzer::SetDataDir","Loaded JES for AK4 MC");
+  if (analysis->reapplyJEC) {
+    // shares the engines; only an era whose engine failed gets its own corrector
+    ctx.jetCorrector = new JetCorrector();
+    TString ak4Format = dirPath+"/jec/"+jecVFull+"/Summer16_"+jecVFull+"_MC_%s_AK4PFPuppi.txt";
+    if (ak4JECEngines["MC"])
+      ctx.jetCorrector->SetMCCorrector(ak4JECEngines["MC"]);
+    else
+      ctx.jetCorrector->SetMCCorrector(ak4Format);
     for (auto e : eraGroups) {
-      params = {
-        JetCorrectorParameters(
-          (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecReco+e+jecV+"_DATA_L1FastJet_AK4PFPuppi.txt").Data()),
-        JetCorrectorParameters(
-          (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecReco+e+jecV+"_DATA_L2Relative_AK4PFPuppi.txt").Data()),
-        JetCorrectorParameters(
-          (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecReco+e+jecV+"_DATA_L3Absolute_AK4PFPuppi.txt").Data()),
-        JetCorrectorParameters(
-          (dirPath+"/jec/"+jecVFull+"/Summer16_"+jecReco+e+jecV+"_DATA_L2L3Residual_AK4PFPuppi.txt").Data())
-      };
-      ak4ScaleReader["data"+e] = new FactorizedJetCorrector(params);
-      if (DEBUG>1) PDebug("PandaAnalyzer::SetDataDir","Loaded JES for AK4 "+e);
+      ak4Format = dirPath+"/jec/"+jecVFull+"/Summer16_"+jecReco+e+jecV+"_DATA_%s_AK4PFPuppi.txt";
+      if (ak4JECEngines["data"+e])
+        ctx.jetCorrector->SetDataCorrector(ak4JECEngines["data"+e],e);
+      else
+        ctx.jetCorrector->SetDataCorrector(ak4Format,e);
     }
+  }
+
+  if (DEBUG) PDebug("PandaAnalyzer::LoadJES","Loaded JES/R");
+}
+
+
+void PandaAnalyzer::LoadJESSources(EventContext &ctx, TString dirPath)
+{
+  // there are no data versions of the source files, so MC and data share this
+  TString path = dirPath+"/jec/23Sep2016V4/Summer16_23Sep2016V4_MC_UncertaintySources_AK4PFPuppi.txt";
+  std::vector<TString> sources(GeneralTree::jesSources,GeneralTree::jesSources+GeneralTree::nJESSources);
+
+  // the table is stateless, so all contexts share the one made for the first.
+  // One JetCorrectionUncertainty per source is only built if the table cannot
+  // read the file, or once to validate the table
+  if (!ak4JESSources) {
+    ak4JESSources = new JESSourceTable();
+    if (!ak4JESSources->Load(path,sources)) {
+      PError("PandaAnalyzer::LoadJESSources","Falling back to JetCorrectionUncertainty for the JES sources");
+      delete ak4JESSources;
+      ak4JESSources = 0;
+    }
+  }
+  if (ak4JESSources && (!validateJEC || &ctx!=context)) {
+    if (DEBUG) PDebug("PandaAnalyzer::LoadJESSources","Loaded JES sources");
+    return;
+  }
 
-    if (DEBUG) PDebug("PandaAnalyzer::SetDataDir","Loaded JES/R");
+  for (auto &source : sources)
+    ctx.jesSourceReaders.push_back(new JetCorrectionUncertainty(JetCorrectorParameters(path.Data(),source.Data())));
+
+  if (ak4JESSources) {
+    // contexts built later see the 0 and make their own readers
+    bool ok = true;
+    for (unsigned iS=0; iS!=sources.size(); ++iS) {
+      if (ak4JESSources->Validate(*ctx.jesSourceReaders[iS],iS)>JESSourceTable::kTolerance)
+        ok = false;
+    }
+    if (!ok) {
+      PError("PandaAnalyzer::LoadJESSources","Falling back to JetCorrectionUncertainty for the JES sources");
+      delete ak4JESSources;
+      ak4JESSources = 0;
+    } else {
+      for (auto *reader : ctx.jesSourceReaders)
+        delete reader;
+      ctx.jesSourceReaders.clear();
+    }
   }
 
+  if (DEBUG) PDebug("PandaAnalyzer::LoadJESSources","Loaded JES sources");
 }
 
 
@@ -611,7 +1078,7 @@ bool PandaAnalyzer::PassGoodLumis(int run, int lumi)
 }
 
 
-bool PandaAnalyzer::PassPreselection() 
+bool PandaAnalyzer::PassPreselection(EventContext &ctx) 
 {
   // TODO: refactor this function
   // was originally written this way to handle more complex conditions
@@ -622,19 +1089,19 @@ bool PandaAnalyzer::PassPreselection()
   bool isGood=false;
 
   if (preselBits & kGenBosonPt) {
-    if (gt->trueGenBosonPt > 100)
+    if (ctx.gt->trueGenBosonPt > 100)
       isGood = true; 
   }
 
   if (preselBits & kFatjet) {
-    if (gt->fj1Pt>250)
+    if (ctx.gt->fj1Pt>250)
       isGood = true;
   }
 
-  float max_puppi = std::max({gt->puppimet, gt->puppiUZmag, gt->puppiUWmag, gt->puppiUAmag});
-  float max_pf = std::max({gt->pfmet, gt->pfUZmag, gt->pfUWmag, gt->pfUAmag});
-  float max_pfUp = std::max({gt->pfmetUp, gt->pfUZmagUp, gt->pfUWmagUp, gt->pfUAmagUp});
-  float max_pfDown = std::max({gt->pfmetDown, gt->pfUZmagDown, gt->pfUWmagDown, gt->pfUAmagDown});
+  float max_puppi = std::max({ctx.gt->puppimet, ctx.gt->puppiUZmag, ctx.gt->puppiUWmag, ctx.gt->puppiUAmag});
+  float max_pf = std::max({ctx.gt->pfmet, ctx.gt->pfUZmag, ctx.gt->pfUWmag, ctx.gt->pfUAmag});
+  float max_pfUp = std::max({ctx.gt->pfmetUp, ctx.gt->pfUZmagUp, ctx.gt->pfUWmagUp, ctx.gt->pfUAmagUp});
+  float max_pfDown = std::max({ctx.gt->pfmetDown, ctx.gt->pfUZmagDown, ctx.gt->pfUWmagDown, ctx.gt->pfUAmagDown});
 
   if (preselBits & kRecoil) {
     if ( max_pfDown>200 || max_pf>200 || max_pfUp>200 || max_puppi>200 ) {
@@ -642,12 +1109,12 @@ bool PandaAnalyzer::PassPreselection()
     }
   }
   if (preselBits & kRecoil50) {
-    if ( gt->pfmet>100 ) { // this will never cause any confusion, I'm sure
+    if ( ctx.gt->pfmet>100 ) { // this will never cause any confusion, I'm sure
       isGood = true;
     }
   }
   if (preselBits & kMonotop) {
-    if (gt->nFatjet>=1 && gt->fj1Pt>200) {
+    if (ctx.gt->nFatjet>=1 && ctx.gt->fj1Pt>200) {
       if ( max_pf>200 || max_puppi>200) {
         isGood = true;
       }
@@ -661,7 +1128,7 @@ bool PandaAnalyzer::PassPreselection()
     }
   }
   if (preselBits & kMonohiggs) {
-    if ((gt->nFatjet>=1 && gt->fj1Pt>200) || gt->hbbpt>150 ) {
+    if ((ctx.gt->nFatjet>=1 && ctx.gt->fj1Pt>200) || ctx.gt->hbbpt>150 ) {
       if ( max_pf>175 || max_puppi>175) {
         isGood = true;
       }
@@ -669,49 +1136,49 @@ bool PandaAnalyzer::PassPreselection()
   }
 
   if (preselBits & kVHBB) {
-    double bestMet = TMath::Max(TMath::Max(gt->pfmetUp, gt->pfmetDown), gt->pfmet);
-    double bestLeadingJet = TMath::Max(TMath::Max(gt->jet1PtUp, gt->jet1PtDown), gt->jet1Pt);
-    double bestSubLeadingJet = TMath::Max(TMath::Max(gt->jet2PtUp, gt->jet2PtDown), gt->jet2Pt);
+    double bestMet = TMath::Max(TMath::Max(ctx.gt->pfmetUp, ctx.gt->pfmetDown), ctx.gt->pfmet);
+    double bestLeadingJet = TMath::Max(TMath::Max(ctx.gt->jet1PtUp, ctx.gt->jet1PtDown), ctx.gt->jet1Pt);
+    double bestSubLeadingJet = TMath::Max(TMath::Max(ctx.gt->jet2PtUp, ctx.gt->jet2PtDown), ctx.gt->jet2Pt);
     // ZnnHbb
     if (
       bestMet>150 && 
       bestLeadingJet>50 && bestSubLeadingJet>25 &&
-      (gt->hbbpt>50 || (gt->nFatjet>0 && gt->fj1Pt>200))
+      (ctx.gt->hbbpt>50 || (ctx.gt->nFatjet>0 && ctx.gt->fj1Pt>200))
     ) isGood=true;
     // WlnHbb
     else if (
       bestLeadingJet>25 && bestSubLeadingJet>25 &&
       (
-       (gt->nTightElectron >0 && gt->electronPt[0]>25) ||
-       (gt->nTightMuon > 0 && gt->muonPt[0]>25)
+       (ctx.gt->nTightElectron >0 && ctx.gt->electronPt[0]>25) ||
+       (ctx.gt->nTightMuon > 0 && ctx.gt->muonPt[0]>25)
       ) &&
-      (gt->hbbpt>50 || (gt->nFatjet>0 && gt->fj1Pt>200))
+      (ctx.gt->hbbpt>50 || (ctx.gt->nFatjet>0 && ctx.gt->fj1Pt>200))
     ) isGood=true;
     // ZllHbb
     else if (
       bestLeadingJet>25 && bestSubLeadingJet>25 &&
       (
        (
-        gt->nTightElectron>0 && 
-        gt->nLooseElectron>1 &&
-        gt->electronPt[0]>25 && 
-        gt->electronPt[1]>20
+        ctx.gt->nTightElectron>0 && 
+        ctx.gt->nLooseElectron>1 &&
+        ctx.gt->electronPt[0]>25 && 
+        ctx.gt->electronPt[1]>20
        ) || (
-        gt->nTightMuon > 0 && 
-        gt->nLooseMuon>1 &&
-        gt->muonPt[0]>25 &&
-        gt->muonPt[1]>20 
+        ctx.gt->nTightMuon > 0 && 
+        ctx.gt->nLooseMuon>1 &&
+        ctx.gt->muonPt[0]>25 &&
+        ctx.gt->muonPt[1]>20 
        )
       ) &&
-      (gt->hbbpt>50 || (gt->nFatjet>0 && gt->fj1Pt>200))
+      (ctx.gt->hbbpt>50 || (ctx.gt->nFatjet>0 && ctx.gt->fj1Pt>200))
     ) isGood=true;
   }
   // anded with the rest
   if (preselBits & kPassTrig) {
-    isGood &= (!isData) || (gt->trigger != 0);
+    isGood &= (!isData) || (ctx.gt->trigger != 0);
   }
 
-  tr->TriggerEvent("presel");
+  ctx.tr->TriggerEvent("presel");
   
   return isGood;
 }
@@ -740,24 +1207,12 @@ void PandaAnalyzer::Run()
 
   // get bounds
   genBosonPtMin=150, genBosonPtMax=1000;
-  if (!isData && h1Corrs[cZNLO]) {
-    genBosonPtMin = h1Corrs[cZNLO]->GetHist()->GetBinCenter(1);
-    genBosonPtMax = h1Corrs[cZNLO]->GetHist()->GetBinCenter(h1Corrs[cZNLO]->GetHist()->GetNbinsX());
-  }
-
-  if (analysis->ak8) {
-    if (analysis->puppi_jets)
-      fatjets = &event.puppiAK8Jets;
-    else
-      fatjets = &event.chsAK8Jets;
-  } else if (analysis->fatjet) {
-    if (analysis->puppi_jets)
-      fatjets = &event.puppiCA15Jets;
-    else
-      fatjets = &event.chsCA15Jets;
+  if (!isData && tCorrs[cZNLO]) {
+    genBosonPtMin = tCorrs[cZNLO]->GetXaxis().loCenter;
+    genBosonPtMax = tCorrs[cZNLO]->GetXaxis().hiCenter;
   }
 
-  jets = &event.chsAK4Jets;
+  SelectJetCollections(*context);
 
   // these are bins of b-tagging eff in pT and eta, derived in 8024 TT MC
   // TODO: don't hardcode these 
@@ -775,11 +1230,17 @@ void PandaAnalyzer::Run()
   btagpt = Binner(vbtagpt);
   btageta = Binner(vbtageta);
   if (analysis->complicatedLeptons) {
-    if (DEBUG) PDebug("PandaAnalyzer::Run","Loading the Rochester corrections with random seed 3393");
+    if (DEBUG) PDebug("PandaAnalyzer::Run","Loading the Rochester corrections");
     // TO DO: Hard coded to 2016 rochester corrections for now, need to do this in a better way later
     TString dirPath1 = TString(gSystem->Getenv("CMSSW_BASE")) + "/src/";
-    rochesterCorrection = new RoccoR(Form("%sPandaAnalysis/data/rcdata.2016.v3",dirPath1.Data()));
-    rng=TRandom3(3393); //Dylan's b-day
+    TString rcDir = Form("%sPandaAnalysis/data/rcdata.2016.v3",dirPath1.Data());
+    if (!rochesterCorrection) {
+      // every member of the set shares one parsed table; the cache skips the parsing
+      if (rochesterCache!="")
+        rochesterCorrection = new RoccoR(rcDir.Data(),rochesterCache.Data());
+      else
+        rochesterCorrection = new RoccoR(rcDir.Data());
+    }
   }
 
 
@@ -889,7 +1350,7 @@ void PandaAnalyzer::Run()
       };
     triggerHandlers[kSingleMuTrig].addTriggers(paths);
     
-    RegisterTriggers();
+    RegisterTriggers(*context);
   }
 
   if (analysis->ak8)
@@ -897,206 +1358,365 @@ void PandaAnalyzer::Run()
 
   fOut->cd(); // to be absolutely sure
 
-  // set up reporters
-  unsigned int iE=0;
-  ProgressReporter pr("PandaAnalyzer::Run",&iE,&nEvents,10);
-  tr = new TimeReporter("PandaAnalyzer::Run",DEBUG+1);
+  if (profile)
+    context->profiler = BuildProfiler();
+  auto wallStart = std::chrono::steady_clock::now();
 
+  // checkpoints are only written from the serial loop: the threaded
+  // output is not assembled until all workers are done
+  bool checkpointing = (checkpointEvents>0 || checkpointSeconds>0);
+  if (nThreads>1 && (checkpointing || resume)) {
+    PError("PandaAnalyzer::Run","Checkpointing and resuming are not supported with threads, running serially");
+    nThreads = 1;
+  }
 
-  // EVENTLOOP --------------------------------------------------------------------------
-  for (iE=nZero; iE!=nEvents; ++iE) {
-    tr->Start();
-    pr.Report();
-    ResetBranches();
-    event.getEntry(*tIn,iE);
-
-
-    tr->TriggerEvent(TString::Format("GetEntry %u",iE));
-    if (DEBUG>2) {
-      PDebug("PandaAnalyzer::Run::Dump","");
-      event.print(std::cout, 2);
-      std::cout << std::endl;
-      PDebug("PandaAnalyzer::Run::Dump","");
-      event.photons.print(std::cout, 2);
-      std::cout << std::endl;
-      PDebug("PandaAnalyzer::Run::Dump","");
-      event.muons.print(std::cout, 2);
-      std::cout << std::endl;
-      PDebug("PandaAnalyzer::Run::Dump","");
-      event.electrons.print(std::cout, 2);
-      std::cout << std::endl;
-      PDebug("PandaAnalyzer::Run::Dump","");
-      event.chsAK4Jets.print(std::cout, 2);
-      std::cout << std::endl;
-      PDebug("PandaAnalyzer::Run::Dump","");
-      event.pfMet.print(std::cout, 2);
-      std::cout << std::endl;
-      PDebug("PandaAnalyzer::Run::Dump","");
-      event.metMuOnlyFix.print(std::cout, 2);
-      std::cout << std::endl;
-    }
+  if (nThreads>1) {
+    RunThreaded(nZero,nEvents);
+    if (DEBUG) { PDebug("PandaAnalyzer::Run","Done with threaded entry loop"); }
+  } else {
+    // set up reporters
+    unsigned int iE=0;
+    ProgressReporter pr("PandaAnalyzer::Run",&iE,&nEvents,10);
+    TimeReporter tr("PandaAnalyzer::Run",DEBUG+1);
+    context->tr = &tr;
+
+
+    unsigned int nSinceCheckpoint=0;
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+
+    // EVENTLOOP --------------------------------------------------------------------------
+    for (iE=nZero; iE<nEvents; ++iE) {
+      tr.Start();
+      pr.Report();
+      if (ProcessEvent(*context,iE))
+        gt->Fill();
+
+      if (checkpointing) {
+        ++nSinceCheckpoint;
+        auto now = std::chrono::steady_clock::now();
+        if ((checkpointEvents>0 && nSinceCheckpoint>=checkpointEvents) ||
+            (checkpointSeconds>0 && 
+             std::chrono::duration<double>(now-lastCheckpoint).count()>=checkpointSeconds)) {
+          WriteCheckpoint(iE);
+          nSinceCheckpoint = 0;
+          lastCheckpoint = now;
+        }
+      }
+    } // entry loop
 
-    if (!RecoilPresel())
-      continue;
+    if (checkpointing && nEvents>nZero)
+      WriteCheckpoint(nEvents-1);
 
-    // event info
-    gt->mcWeight = event.weight;
-    gt->runNumber = event.runNumber;
-    gt->lumiNumber = event.lumiNumber;
-    gt->eventNumber = event.eventNumber;
-    gt->npv = event.npv;
-    gt->pu = event.npvTrue;
-    gt->metFilter = (event.metFilters.pass()) ? 1 : 0;
-    gt->metFilter = (gt->metFilter==1 && !event.metFilters.badPFMuons) ? 1 : 0;
-    gt->metFilter = (gt->metFilter==1 && !event.metFilters.badChargedHadrons) ? 1 : 0;
-    if (isData) {
-      // check the json
-      if (!PassGoodLumis(gt->runNumber,gt->lumiNumber))
-        continue;
+    tr.Summary();
+    context->tr = 0;
 
-      // save triggers
-      for (unsigned iT = 0; iT != kNTrig; ++iT) {
-        auto &th = triggerHandlers.at(iT);
-        for (auto iP : th.indices) {
-          if (event.triggerFired(iP)) {
-              gt->trigger |= (1 << iT);
-              break;
-          }
-        }
-      }
-    } else { // !isData
-      gt->sf_npv = GetCorr(cNPV,gt->npv);
-      gt->sf_pu = GetCorr(cPU,gt->pu);
-      gt->sf_puUp = GetCorr(cPUUp,gt->pu);
-      gt->sf_puDown = GetCorr(cPUDown,gt->pu);
-    }
+    if (DEBUG) { PDebug("PandaAnalyzer::Run","Done with entry loop"); }
+  }
 
-    if (analysis->rerunJES)
-      SetupJES();
-
-    tr->TriggerEvent("initialize");
-
-    // met
-    gt->pfmetRaw = event.rawMet.pt;
-    gt->pfmet = event.pfMet.pt;
-    gt->pfmetphi = event.pfMet.phi;
-    gt->calomet = event.caloMet.pt;
-    gt->sumETRaw = event.pfMet.sumETRaw;
-    gt->puppimet = event.puppiMet.pt;
-    gt->puppimetphi = event.puppiMet.phi;
-    gt->trkmet = event.trkMet.pt;
-    gt->trkmetphi = event.trkMet.phi;
-    vPFMET.SetPtEtaPhiM(gt->pfmet,0,gt->pfmetphi,0);
-    vPuppiMET.SetPtEtaPhiM(gt->puppimet,0,gt->puppimetphi,0);
-    vMETNoMu.SetMagPhi(gt->pfmet,gt->pfmetphi); //       for trigger eff
-    if (analysis->varyJES) {
-      gt->pfmetUp = event.pfMet.ptCorrUp;
-      gt->pfmetDown = event.pfMet.ptCorrDown;
-    }
+  if (context->profiler) {
+    double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now()-wallStart).count();
+    TString profileName(fOut->GetName());
+    profileName.ReplaceAll(".root","_profile.json");
+    context->profiler->WriteJSON(profileName,wallTime);
+    if (DEBUG) PDebug("PandaAnalyzer::Run","Wrote module profile to "+profileName);
+  }
 
-    tr->TriggerEvent("met");
+} // Run()
 
-    if (!analysis->genOnly) {
-      // electrons and muons
-      if (analysis->complicatedLeptons) {
-        ComplicatedLeptons();
-      } else {
-        SimpleLeptons();
-      }
-      
-      // photons
-      Photons();
-
-      // recoil!
-      if (analysis->recoil)
-        Recoil();
-
-      // fatjets
-      if (analysis->fatjet) {
-        FatjetBasics();
-        if (analysis->recluster)
-          FatjetRecluster();
-        tr->TriggerEvent("fatjet");
-      }
 
-      // first identify interesting jets
-      JetBasics();
+bool PandaAnalyzer::ProcessEvent(EventContext &ctx, unsigned int iE) 
+{
+  ctx.Reset();
+  if (ctx.profiler) ctx.profiler->StartEvent();
+
+  // first read only what the preselection needs, and skip unpacking
+  // everything else for events that fail it
+  for (auto *b : ctx.preselBranches)
+    b->GetEntry(iE);
+  ctx.tr->TriggerEvent("GetEntry presel");
+
+  if (!RecoilPresel(ctx) ||
+      (isData && !PassGoodLumis(ctx.event.runNumber,ctx.event.lumiNumber))) { // check the json
+    if (ctx.profiler) ctx.profiler->Lap(ModuleProfiler::kRead);
+    return false;
+  }
 
-      if (analysis->monoh) {
-        // Higgs reconstruction for resolved analysis - highest pt pair of b jets
-        JetHbbReco();
-      }
+  ctx.event.getEntry(*(ctx.tIn),iE);
+  if (!isData)
+    ctx.BuildGenIndex();
+  if (ctx.profiler) ctx.profiler->Lap(ModuleProfiler::kRead);
+
+  ctx.tr->TriggerEvent("GetEntry");
+  if (DEBUG>2) {
+    PDebug("PandaAnalyzer::ProcessEvent::Dump","");
+    ctx.event.print(std::cout, 2);
+    std::cout << std::endl;
+    PDebug("PandaAnalyzer::ProcessEvent::Dump","");
+    ctx.event.photons.print(std::cout, 2);
+    std::cout << std::endl;
+    PDebug("PandaAnalyzer::ProcessEvent::Dump","");
+    ctx.event.muons.print(std::cout, 2);
+    std::cout << std::endl;
+    PDebug("PandaAnalyzer::ProcessEvent::Dump","");
+    ctx.event.electrons.print(std::cout, 2);
+    std::cout << std::endl;
+    PDebug("PandaAnalyzer::ProcessEvent::Dump","");
+    ctx.event.chsAK4Jets.print(std::cout, 2);
+    std::cout << std::endl;
+    PDebug("PandaAnalyzer::ProcessEvent::Dump","");
+    ctx.event.pfMet.print(std::cout, 2);
+    std::cout << std::endl;
+    PDebug("PandaAnalyzer::ProcessEvent::Dump","");
+    ctx.event.metMuOnlyFix.print(std::cout, 2);
+    std::cout << std::endl;
+  }
 
-      Taus();
-    }
+  // modules were planned in Init; disabled ones are not in the list at all
+  if (ctx.profiler) ctx.profiler->Skip();
+  unsigned nM = modules.size();
+  for (unsigned iM=0; iM!=nM; ++iM) {
+    auto &m = modules[iM];
+    bool pass = true;
+    if (m.cut)
+      pass = (this->*m.cut)(ctx);
+    else
+      (this->*m.fill)(ctx);
+    if (ctx.profiler) ctx.profiler->Lap(iM+1);
+    if (!pass)
+      return false;
+  }
 
-    if (!analysis->genOnly && !PassPreselection()) // only check reco presel here
-      continue;
+  return true;
+}
 
-    if (analysis->monoh && !analysis->genOnly)
-      GetMETSignificance();
 
-    if (!isData) {
-      if (!analysis->genOnly) {
-        if (analysis->fatjet)
-          FatjetMatching();
+void PandaAnalyzer::SelectJetCollections(EventContext &ctx)
+{
+  if (analysis->ak8) {
+    if (analysis->puppi_jets)
+      ctx.fatjets = &ctx.event.puppiAK8Jets;
+    else
+      ctx.fatjets = &ctx.event.chsAK8Jets;
+  } else if (analysis->fatjet) {
+    if (analysis->puppi_jets)
+      ctx.fatjets = &ctx.event.puppiCA15Jets;
+    else
+      ctx.fatjets = &ctx.event.chsCA15Jets;
+  }
 
-        if (analysis->btagSFs)
-          JetBtagSFs();
-        if (analysis->btagWeights)
-          JetCMVAWeights();
-        
-        TriggerEffs();
+  ctx.jets = &ctx.event.chsAK4Jets;
+}
 
-        if (analysis->complicatedLeptons) 
-          GenStudyEWK();
-        else
-          LeptonSFs();
 
-        PhotonSFs();
+// threaded running
+void PandaAnalyzer::RunThreaded(unsigned int nZero, unsigned int nEvents)
+{
+  ROOT::EnableThreadSafety();
+
+  unsigned int nChunks = (nEvents>nZero) ? (nEvents-nZero+chunkSize-1)/chunkSize : 0;
+  if (DEBUG) PDebug("PandaAnalyzer::RunThreaded",
+                    TString::Format("Splitting %u entries into %u chunks over %i threads",
+                                    nEvents-nZero,nChunks,nThreads));
+
+  // contexts are built serially: opening files and booking readers is not thread-safe
+  std::vector<EventContext*> contexts;
+  for (int iT=0; iT!=nThreads; ++iT)
+    contexts.push_back(BuildContext(iT));
+
+  std::atomic<unsigned int> nextChunk(0), nProcessed(0), nFinished(0);
+  std::vector<int> chunkOwner(nChunks,-1);
+  std::vector<std::thread> threads;
+  for (int iT=0; iT!=nThreads; ++iT) {
+    threads.emplace_back([&,iT]() {
+      EventContext &ctx = *(contexts[iT]);
+      for (unsigned int iC=nextChunk++; iC<nChunks; iC=nextChunk++) {
+        chunkOwner[iC] = iT;
+        unsigned int first = nZero + iC*chunkSize;
+        unsigned int last = std::min(first+chunkSize,nEvents);
+        RunChunk(ctx,iC,first,last,nProcessed);
       }
+      ++nFinished;
+    });
+  }
 
-      QCDUncs();
-      SignalReweights();
+  unsigned int iE=0, nTotal=nEvents-nZero;
+  ProgressReporter pr("PandaAnalyzer::Run",&iE,&nTotal,10);
+  while (nFinished<(unsigned int)nThreads) {
+    iE = nProcessed;
+    pr.Report();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  for (auto &t : threads)
+    t.join();
+
+  std::vector<TString> contextFiles;
+  for (auto *ctx : contexts) {
+    contextFiles.push_back(ctx->fOut->GetName());
+    if (context->profiler)
+      context->profiler->Add(*(ctx->profiler));
+    TerminateContext(ctx);
+  }
 
-      if (analysis->vbf)
-        SaveGenLeptons();
+  // stitch the per-thread outputs into tOut. with keepOrder, each chunk was
+  // written as its own tree and they are chained back in entry order
+  if (nChunks>0) {
+    TChain chain(tOut->GetName());
+    if (keepOrder) {
+      for (unsigned int iC=0; iC!=nChunks; ++iC)
+        chain.AddFile(contextFiles[chunkOwner[iC]],0,TString::Format("events_%u",iC));
+    } else {
+      for (auto &f : contextFiles)
+        chain.AddFile(f);
+    }
+    fOut->cd();
+    delete tOut;
+    tOut = chain.CloneTree(-1,"fast");
+  }
 
-      SignalInfo();
+  for (auto &f : contextFiles)
+    gSystem->Unlink(f);
+}
 
-      if (analysis->complicatedLeptons) 
-        GenStudyEWK();
-      else
-        LeptonSFs();
 
-      PhotonSFs();
+EventContext *PandaAnalyzer::BuildContext(int iW)
+{
+  EventContext *ctx = new EventContext();
 
-      QCDUncs();
-      SignalReweights();
+  // everything stateful gets its own copy, the rest of the analyzer is shared
+  if (analysis->btagSFs)
+    LoadBTagReaders(*ctx);
+  if (analysis->bjetRegression)
+    LoadBJetRegression(*ctx,dataDir);
+  if (analysis->rerunJES)
+    LoadJES(*ctx,dataDir);
+  if (analysis->varyJESSources)
+    LoadJESSources(*ctx,dataDir);
+  CloneTF1s(*ctx,TString::Format("_w%i",iW));
+
+  // every context reads the input through its own file handle
+  TFile *fIn = TFile::Open(tIn->GetCurrentFile()->GetName());
+  ctx->tIn = (TTree*)fIn->FindObjectAny(tIn->GetName());
+  ctx->event.setStatus(*(ctx->tIn), {"!*"});
+  ctx->event.setAddress(*(ctx->tIn), readlist);
+  ctx->preselBranches = GetObjectBranches(ctx->tIn, preselList);
+  SelectJetCollections(*ctx);
+  if (isData)
+    RegisterTriggers(*ctx);
+
+  // copying the tree carries over the flags and the dropped branches
+  ctx->gt = new GeneralTree();
+  *(ctx->gt) = *gt;
+  TString fOutName(fOut->GetName());
+  fOutName.ReplaceAll(".root",TString::Format("_thread%i.root",iW));
+  ctx->fOut = new TFile(fOutName,"RECREATE");
+  if (!keepOrder) {
+    ctx->tOut = new TTree(tOut->GetName(),tOut->GetTitle());
+    ctx->gt->WriteTree(ctx->tOut);
+  }
 
-      if (analysis->reclusterGen && analysis->monoh) {
-        GenJetsNu();
-        MatchGenJets(genJetsNu);
-      }
+  ctx->tr = new TimeReporter(TString::Format("PandaAnalyzer::Run[%i]",iW),DEBUG+1);
+  if (profile)
+    ctx->profiler = BuildProfiler();
 
-      if (analysis->hfCounting)
-        HeavyFlavorCounting();
+  if (DEBUG) PDebug("PandaAnalyzer::BuildContext","Built context writing to "+fOutName);
+  return ctx;
+}
 
-      TopPTReweight();
-      VJetsReweight();
-    }
 
-    
-    if (analysis->genOnly && !PassPreselection()) // only check gen presel here
-      continue;
+void PandaAnalyzer::RunChunk(EventContext &ctx, unsigned int iC, unsigned int first, 
+                             unsigned int last, std::atomic<unsigned int> &nProcessed)
+{
+  ctx.fOut->cd();
+  if (keepOrder) {
+    ctx.tOut = new TTree(TString::Format("events_%u",iC),"events");
+    ctx.gt->WriteTree(ctx.tOut);
+  }
 
-    gt->Fill();
+  for (unsigned int iE=first; iE!=last; ++iE) {
+    ctx.tr->Start();
+    if (ProcessEvent(ctx,iE))
+      ctx.gt->Fill();
+    ++nProcessed;
+  }
 
-  } // entry loop
+  if (keepOrder) {
+    ctx.fOut->WriteTObject(ctx.tOut);
+    delete ctx.tOut;
+    ctx.tOut = 0;
+  }
+}
 
-  tr->Summary();
 
-  if (DEBUG) { PDebug("PandaAnalyzer::Run","Done with entry loop"); }
+void PandaAnalyzer::TerminateContext(EventContext *ctx)
+{
+  ctx->tr->Summary();
+  context->nReclusterChecked += ctx->nReclusterChecked;
+  context->nReclusterDiffer += ctx->nReclusterDiffer;
+
+  if (ctx->tOut)
+    ctx->fOut->WriteTObject(ctx->tOut);
+  ctx->fOut->Close();
+  ctx->tIn->GetCurrentFile()->Close();
+
+  delete ctx->tr;
+  delete ctx->gt;
+  delete ctx;
+}
+
+
+TString PandaAnalyzer::CheckpointPath(TString fOutName) const
+{
+  fOutName.ReplaceAll(".root","_checkpoint.txt");
+  return fOutName;
+}
+
+
+TString PandaAnalyzer::CheckpointInput() const
+{
+  TFile *f = tIn ? tIn->GetCurrentFile() : 0;
+  return f ? TString(f->GetName()) : TString("");
+}
 
-} // Run()
 
+long PandaAnalyzer::ReadCheckpoint(TString fOutName, long &nWritten) const
+{
+  // the sidecar holds the last entry in the output, the number of output
+  // entries saved with it, and the name and size of the input it was made
+  // from, so a stale checkpoint is not applied to new inputs
+  if (!tIn) {
+    PError("PandaAnalyzer::ReadCheckpoint","Call Init before SetOutputFile to resume; starting over");
+    return -1;
+  }
+  std::ifstream fCheck(CheckpointPath(fOutName).Data());
+  long lastEntry=-1, nEntries=-1;
+  std::string inputName;
+  if (!(fCheck >> lastEntry >> nEntries >> nWritten) || !std::getline(fCheck >> std::ws,inputName)) {
+    PInfo("PandaAnalyzer::ReadCheckpoint","No checkpoint found for "+fOutName+", starting over");
+    return -1;
+  }
+  if (nEntries!=tIn->GetEntries() || CheckpointInput()!=inputName.c_str()) {
+    PError("PandaAnalyzer::ReadCheckpoint",
+           TString::Format("Checkpoint was made from %s with %li entries, but the input is %s with %lli; starting over",
+                           inputName.c_str(),nEntries,CheckpointInput().Data(),tIn->GetEntries()));
+    return -1;
+  }
+  return lastEntry;
+}
+
+
+void PandaAnalyzer::WriteCheckpoint(unsigned int iE)
+{
+  // AutoSave first, so the sidecar never points past what is on disk.
+  // the sidecar is written to a temporary and renamed into place, so a
+  // job killed in between leaves the previous checkpoint intact
+  tOut->AutoSave("SaveSelf");
+
+  TString checkPath = CheckpointPath(fOut->GetName());
+  TString tmpPath = checkPath+".tmp";
+  std::ofstream fCheck(tmpPath.Data());
+  fCheck << iE << " " << tIn->GetEntries() << " " << tOut->GetEntries() << " " << CheckpointInput() << std::endl;
+  fCheck.close();
+  gSystem->Rename(tmpPath,checkPath);
+
+  if (DEBUG) PDebug("PandaAnalyzer::WriteCheckpoint",TString::Format("Checkpointed at entry %u",iE));
+}
@@ -515,71 +515,24 @@ void PandaLeptonicAnalyzer::CalcBJetSFs(BTagType bt, int flavor,
   return;
 }
 
-void PandaLeptonicAnalyzer::EvalBTagSF(std::vector<btagcand> &cands, std::vector<double> &sfs,
-               GeneralLeptonicTree::BTagShift shift,GeneralLeptonicTree::BTagJet jettype, bool do2) 
+void PandaLeptonicAnalyzer::EvalBTagSF(std::vector<btagcand> &cands, 
+               GeneralLeptonicTree::BTagJet jettype, bool do2) 
 {
-  float sf0 = 1, sf1 = 1, sfGT0 = 1, sf2=1;
-  float prob_mc0=1, prob_data0=1;
-  float prob_mc1=0, prob_data1=0;
-  unsigned int nC = cands.size();
-
-  for (unsigned int iC=0; iC!=nC; ++iC) {
-    double sf_i = sfs[iC];
-    double eff_i = cands[iC].eff;
-    prob_mc0 *= (1-eff_i);
-    prob_data0 *= (1-sf_i*eff_i);
-    float tmp_mc1=1, tmp_data1=1;
-    for (unsigned int jC=0; jC!=nC; ++jC) {
-      if (iC==jC) continue;
-      double sf_j = sfs[jC];
-      double eff_j = cands[jC].eff;
-      tmp_mc1 *= (1-eff_j);
-      tmp_data1 *= (1-eff_j*sf_j);
-    }
-    prob_mc1 += eff_i * tmp_mc1;
-    prob_data1 += eff_i * sf_i * tmp_data1;
-  }
-  
-  if (nC>0) {
-    sf0 = prob_data0/prob_mc0;
-    sf1 = prob_data1/prob_mc1;
-    sfGT0 = (1-prob_data0)/(1-prob_mc0);
-  }
+  BTagWeightEngine engine;
+  for (auto &cand : cands)
+    engine.AddCand(cand.eff,cand.flav>0,cand.sf,cand.sfup,cand.sfdown);
 
   GeneralLeptonicTree::BTagParams p;
-  p.shift = shift;
   p.jet = jettype;
-  p.tag=GeneralLeptonicTree::b0; gt->sf_btags[p] = sf0;
-  p.tag=GeneralLeptonicTree::b1; gt->sf_btags[p] = sf1;
-  p.tag=GeneralLeptonicTree::bGT0; gt->sf_btags[p] = sfGT0;
-
-  if (do2) {
-    float prob_mc2=0, prob_data2=0;
-    unsigned int nC = cands.size();
-
-    for (unsigned int iC=0; iC!=nC; ++iC) {
-      double sf_i = sfs[iC], eff_i = cands[iC].eff;
-      for (unsigned int jC=iC+1; jC!=nC; ++jC) {
-        double sf_j = sfs[jC], eff_j = cands[jC].eff;
-        float tmp_mc2=1, tmp_data2=1;
-        for (unsigned int kC=0; kC!=nC; ++kC) {
-          if (kC==iC || kC==jC) continue;
-          double sf_k = sfs[kC], eff_k = cands[kC].eff;
-          tmp_mc2 *= (1-eff_k);
-          tmp_data2 *= (1-eff_k*sf_k);
-        }
-        prob_mc2 += eff_i * eff_j * tmp_mc2;
-        prob_data2 += eff_i * sf_i * eff_j * sf_j * tmp_data2;
-      }
+  for (unsigned iS=0; iS!=GeneralLeptonicTree::bNShift; ++iS) {
+    p.shift = (GeneralLeptonicTree::BTagShift)iS;
+    p.tag=GeneralLeptonicTree::b0; gt->sf_btags[p] = engine.SF(iS,0);
+    p.tag=GeneralLeptonicTree::b1; gt->sf_btags[p] = engine.SF(iS,1);
+    p.tag=GeneralLeptonicTree::bGT0; gt->sf_btags[p] = engine.SFGT0(iS);
+    if (do2) {
+      p.tag=GeneralLeptonicTree::b2; gt->sf_btags[p] = engine.SF(iS,2);
     }
-
-    if (nC>1) {
-      sf2 = prob_data2/prob_mc2;
-    }
-
-    p.tag=GeneralLeptonicTree::b2; gt->sf_btags[p] = sf2;
   }
-
 }
 
 void PandaLeptonicAnalyzer::RegisterTrigger(TString path, std::vector<unsigned> &idxs) {
@@ -887,7 +840,7 @@ void PandaLeptonicAnalyzer::Run() {
     gt->calometphi = event.caloMet.phi;
     gt->trkmet = event.trkMet.pt;
     gt->trkmetphi = event.trkMet.phi;
-    TLorentzVector vPFMET, vPuppiMET;
+    FourVector vPFMET, vPuppiMET;
     vPFMET.SetPtEtaPhiM(gt->pfmet,0,gt->pfmetphi,0);
     vPuppiMET.SetPtEtaPhiM(gt->puppimet,0,gt->puppimetphi,0);
     TVector2 vMETNoMu; vMETNoMu.SetMagPhi(gt->pfmet,gt->pfmetphi); //       for trigger eff
@@ -1135,7 +1088,7 @@ void PandaLeptonicAnalyzer::Run() {
     // first identify interesting jets
     vector<panda::Jet*> cleaned30Jets,cleaned20Jets;
     vector<int> btagindices;
-    TLorentzVector vJet;
+    FourVector vJet;
     panda::Jet *jet1=0, *jet2=0, *jet3=0, *jet4=0;
     panda::Jet *jetUp1=0, *jetUp2=0, *jetUp3=0, *jetUp4=0;
     panda::Jet *jetDown1=0, *jetDown2=0, *jetDown3=0, *jetDown4=0;
@@ -1334,7 +1287,7 @@ void PandaLeptonicAnalyzer::Run() {
     gt->looseGenLep2PdgId = 0;
     gt->looseGenLep3PdgId = 0;
     gt->looseGenLep4PdgId = 0;
-    TLorentzVector v1,v2,v3,v4;
+    FourVector v1,v2,v3,v4;
     if (gt->nLooseLep>=1) {
       panda::Lepton *lep1=looseLeps[0];
       v1.SetPtEtaPhiM(lep1->pt(),lep1->eta(),lep1->phi(),lep1->m());
@@ -1385,11 +1338,11 @@ void PandaLeptonicAnalyzer::Run() {
 
       } //looking for targets
 
-      TLorentzVector the_rhoP4(0,0,0,0);
+      FourVector the_rhoP4(0,0,0,0);
       double bosonPtMin = 1000000000;
       for (int iG : targetsLepton) {
         auto& part(event.genParticles.at(iG));
-        TLorentzVector dressedLepton;
+        FourVector dressedLepton;
         dressedLepton.SetPtEtaPhiM(part.pt(),part.eta(),part.phi(),part.m());
 
         // check there is no further copy:
@@ -1420,7 +1373,7 @@ void PandaLeptonicAnalyzer::Run() {
             continue;
 	  
 	  if(abs(partj.pdgid) == 22 && DeltaR2(part.eta(),part.phi(),partj.eta(),partj.phi()) < 0.1*0.1) {
-            TLorentzVector photonV;
+            FourVector photonV;
             photonV.SetPtEtaPhiM(partj.pt(),partj.eta(),partj.phi(),partj.m());
 	    dressedLepton += photonV;
 	  }
@@ -1475,11 +1428,11 @@ void PandaLeptonicAnalyzer::Run() {
       // Filling dilepton Pt at gen level
       if(gt->genLep1Pt > 25 && TMath::Abs(gt->genLep1Eta) < 2.5 && 
          gt->genLep2Pt > 25 && TMath::Abs(gt->genLep2Eta) < 2.5){
-        TLorentzVector genlep1;
+        FourVector genlep1;
         genlep1.SetPtEtaPhiM(gt->genLep1Pt,gt->genLep1Eta,gt->genLep1Phi,0.0);
-        TLorentzVector genlep2;
+        FourVector genlep2;
         genlep2.SetPtEtaPhiM(gt->genLep2Pt,gt->genLep2Eta,gt->genLep2Phi,0.0);
-	TLorentzVector dilep = genlep1 + genlep2;
+	FourVector dilep = genlep1 + genlep2;
 	if(TMath::Abs(dilep.M()-91.1876) < 15.0) {
           double ZGenPt  = dilep.Pt();
           double ZGenRap = TMath::Abs(dilep.Rapidity());
@@ -1534,7 +1487,7 @@ void PandaLeptonicAnalyzer::Run() {
 
       for (int iG : targetsN) {
         auto& part(event.genParticles.at(iG));
-        TLorentzVector neutrino;
+        FourVector neutrino;
         neutrino.SetPtEtaPhiM(part.pt(),part.eta(),part.phi(),part.m());
 
         // check there is no further copy:
@@ -1551,12 +1504,12 @@ void PandaLeptonicAnalyzer::Run() {
 	the_rhoP4 = the_rhoP4 + neutrino;
       }
 
-      TLorentzVector zBosons(0,0,0,0);
-      TLorentzVector wBosons(0,0,0,0);
+      FourVector zBosons(0,0,0,0);
+      FourVector wBosons(0,0,0,0);
       int nZBosons = 0; int nWBosons = 0;
       for (int iG : targetsV) {
         auto& part(event.genParticles.at(iG));
-        TLorentzVector boson;
+        FourVector boson;
         boson.SetPtEtaPhiM(part.pt(),part.eta(),part.phi(),part.m());
 
         // check there is no further copy:
@@ -1593,7 +1546,7 @@ void PandaLeptonicAnalyzer::Run() {
       }
 
       if(nWBosons == 1 && nZBosons == 1) {
-        TLorentzVector WZBoson = wBosons + zBosons;
+        FourVector WZBoson = wBosons + zBosons;
         gt->sf_wz = GetCorr(cWZEwkCorr,WZBoson.M());
       } else {
         gt->sf_wz = 1.0;
@@ -1611,7 +1564,7 @@ void PandaLeptonicAnalyzer::Run() {
       }
 
       // ttbar pT weight
-      TLorentzVector vT,vTbar;
+      FourVector vT,vTbar;
       float pt_t=0, pt_tbar=0;
       for (int iG : targetsTop) {
         auto& part(event.genParticles.at(iG));
@@ -1649,7 +1602,6 @@ void PandaLeptonicAnalyzer::Run() {
     if (!isData) {
       // now get the jet btag SFs
       vector<btagcand> btagcands;
-      vector<double> sf_cent, sf_bUp, sf_bDown, sf_mUp, sf_mDown;
       vector<double> sf_cent_alt, sf_bUp_alt, sf_bDown_alt, sf_mUp_alt, sf_mDown_alt;
 
       unsigned int nJ = cleaned30Jets.size();
@@ -1738,23 +1690,10 @@ void PandaLeptonicAnalyzer::Run() {
 
         CalcBJetSFs(bJetL,flavor,eta,pt,eff,btagUncFactor,sf,sfUp,sfDown);
         btagcands.push_back(btagcand(iJ,flavor,eff,sf,sfUp,sfDown));
-        sf_cent.push_back(sf);
-
-        if (flavor>0) {
-          sf_bUp.push_back(sfUp); sf_bDown.push_back(sfDown);
-          sf_mUp.push_back(sf); sf_mDown.push_back(sf);
-        } else {
-          sf_bUp.push_back(sf); sf_bDown.push_back(sf);
-          sf_mUp.push_back(sfUp); sf_mDown.push_back(sfDown);
-        }
 
       } // loop over jets
 
-      EvalBTagSF(btagcands,sf_cent,GeneralLeptonicTree::bCent,GeneralLeptonicTree::bJet);
-      EvalBTagSF(btagcands,sf_bUp,GeneralLeptonicTree::bBUp,GeneralLeptonicTree::bJet);
-      EvalBTagSF(btagcands,sf_bDown,GeneralLeptonicTree::bBDown,GeneralLeptonicTree::bJet);
-      EvalBTagSF(btagcands,sf_mUp,GeneralLeptonicTree::bMUp,GeneralLeptonicTree::bJet);
-      EvalBTagSF(btagcands,sf_mDown,GeneralLeptonicTree::bMDown,GeneralLeptonicTree::bJet);
+      EvalBTagSF(btagcands,GeneralLeptonicTree::bJet);
 
     }
 
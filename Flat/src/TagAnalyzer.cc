@@ -13,9 +13,6 @@ TagAnalyzer::TagAnalyzer(int debug_/*=0*/) {
   if (DEBUG) PDebug("TagAnalyzer::TagAnalyzer","Calling constructor");
   gt = new TagTree();
   if (DEBUG) PDebug("TagAnalyzer::TagAnalyzer","Built TagTree");
-  ibetas = gt->get_ibetas();
-  Ns = gt->get_Ns();
-  orders = gt->get_orders();
   if (DEBUG) PDebug("TagAnalyzer::TagAnalyzer","Called constructor");
 }
 
@@ -64,8 +61,12 @@ int TagAnalyzer::Init(TTree *t, TH1D *hweights)
   readlist += {jetname+"CA15Jets", "subjets", jetname+"CA15Subjets","Subjets"};
   
   readlist.push_back("genParticles");
+
+  // objects the preselection cuts on, read before the rest of the event
+  std::vector<TString> preselList = {"recoil"};
  
   event.setAddress(*t, readlist); // pass the readlist so only the relevant branches are turned on
+  preselBranches = GetObjectBranches(t, preselList);
  
   if (DEBUG) PDebug("TagAnalyzer::Init","Set addresses");
 
@@ -128,48 +129,34 @@ bool TagAnalyzer::PassPreselection() {
   return gt->partonPt > 250;
 }
 
-bool TagAnalyzer::CheckParton(panda::GenParticle *p, double &size) {
+bool TagAnalyzer::CheckParton(unsigned iP, double &size) {
+  panda::GenParticle *p = &event.genParticles[iP];
   if (processType == kTop) {
     if (abs(p->pdgid) != 6)
       return false; 
 
+    if (!genGraph.IsLastCopy(iP))
+      return false;
+
     panda::GenParticle *q1 = NULL, *q2 = NULL, *b = NULL;
-    bool notLastCopy = false;
-    for (auto &child : event.genParticles) {
-      unsigned apdgid = abs(child.pdgid);
-      if (apdgid == 6 && child.parent.isValid() && 
-          child.parent.get() ==  p) {
-        notLastCopy = true;
-        break;
-      }
-      if (apdgid > 5)
+    for (unsigned iD : genGraph.Daughters(iP)) {
+      if (abs(event.genParticles[iD].pdgid) == 5)
+        b = &event.genParticles[iD];
+    }
+    unsigned nG = genGraph.size();
+    for (unsigned iG=0; iG!=nG; ++iG) {
+      auto &child = event.genParticles[iG];
+      if (abs(child.pdgid) >= 5)
         continue;
-      if (apdgid == 5) {
-        if (child.parent.isValid() && child.parent.get() == p) {
-          b = &child; 
-        }
-      } else {
-        if (child.parent.isValid() && abs(child.parent->pdgid) == 24) {
-          bool foundTopParent = false; // go up the history, see if this W came from the top in question
-          auto *parent = child.parent.get(); // initialize to the W
-          while (parent->parent.isValid()) {
-            parent = parent->parent.get();
-            if (parent == p) {
-              foundTopParent = true; 
-              break;
-            }
-          }
-          if (foundTopParent) {
-            if (q1)
-              q2 = &child; 
-            else
-              q1 = &child;
-          }
-        }  
+      int iW = genGraph.Parent(iG);
+      // see if this W came from the top in question
+      if (iW >= 0 && abs(event.genParticles[iW].pdgid) == 24 && genGraph.IsDescendantOf(iW,iP)) {
+        if (q1)
+          q2 = &child; 
+        else
+          q1 = &child;
       }
     }
-    if (notLastCopy)
-      return false;
     if (!(b && q1 && q2))
       return false;
     size = DeltaR2(p->eta(),p->phi(),q1->eta(),q1->phi());
@@ -234,8 +221,15 @@ void TagAnalyzer::Run() {
   for (iE=nZero; iE!=nEvents; ++iE) {
     tr.Start();
     pr.Report();
-    event.getEntry(*tIn,iE);
 
+    // unpack the full event only if it passes the preselection
+    for (auto *b : preselBranches)
+      b->GetEntry(iE);
+    if (event.recoil.max<175) // no ECFs below this
+      continue;
+
+    event.getEntry(*tIn,iE);
+    genGraph.Build(event.genParticles);
 
     tr.TriggerEvent(TString::Format("GetEntry %u",iE));
     if (DEBUG>2) {
@@ -262,11 +256,10 @@ void TagAnalyzer::Run() {
       std::cout << std::endl;
     }
 
-    if (event.recoil.max<175) // no ECFs below this
-      continue;
-
     tr.TriggerEvent("initialize");
-    for (auto &gen : event.genParticles) {
+    unsigned nG = event.genParticles.size();
+    for (unsigned iG=0; iG!=nG; ++iG) {
+      auto &gen = event.genParticles[iG];
       ResetBranches();
       
       // event info
@@ -285,7 +278,7 @@ void TagAnalyzer::Run() {
       double size = -1;
       if (gen.pt() < 250)
         continue;
-      if (!CheckParton(&gen,size))
+      if (!CheckParton(iG,size))
         continue;
       gt->partonPt = gen.pt();
       gt->partonEta = gen.eta();
@@ -310,16 +303,12 @@ void TagAnalyzer::Run() {
         gt->fj1Tau21 = clean(fj.tau2/fj.tau1);
         gt->fj1Tau21SD = clean(fj.tau2SD/fj.tau1SD);
 
-        for (auto ibeta : ibetas) {
-          for (auto N : Ns) {
-            for (auto order : orders) {
-              TagTree::ECFParams p;
-              p.order = order; p.N = N; p.ibeta = ibeta;
-              if (gt->fj1IsClean || true)
-                gt->fj1ECFNs[p] = fj.get_ecf(order,N,ibeta);
-              else
-                gt->fj1ECFNs[p] = fj.get_ecf(order,N,ibeta);
-            }
+        // same (order,N,ibeta) order as TagTree::ecfIndex, so the array is filled front to back
+        float *ecfn = gt->fj1ECFNs;
+        for (int order=1; order<=TagTree::nECFOrders; ++order) {
+          for (int N=1; N<=TagTree::nECFNs; ++N) {
+            for (int ibeta=0; ibeta!=TagTree::nECFBetas; ++ibeta)
+              *(ecfn++) = fj.get_ecf(order,N,ibeta);
           }
         } //loop over betas
         gt->fj1HTTMass = fj.htt_mass;
@@ -1,4 +1,5 @@
 #include "../interface/TagTree.h"
+#include <algorithm>
 
 TagTree::TagTree() {
 //STARTCUSTOMCONST
@@ -11,10 +12,10 @@ TagTree::TagTree() {
         p.N = N;
         p.order = order;
         ecfParams.push_back(p);
-        fj1ECFNs[p] = -1;
       }
     }
   }
+  std::fill(fj1ECFNs,fj1ECFNs+nECF,-1);
 
 
 //ENDCUSTOMCONST
@@ -28,9 +29,7 @@ TagTree::~TagTree() {
 void TagTree::Reset() {
 //STARTCUSTOMRESET
 
-  for (auto p : ecfParams) { 
-    fj1ECFNs[p] = -1;
-  }
+  std::fill(fj1ECFNs,fj1ECFNs+nECF,-1);
 
 //ENDCUSTOMRESET
     runNumber = 0;
@@ -87,7 +86,7 @@ void TagTree::WriteTree(TTree *t) {
 
   for (auto p : ecfParams) { 
     TString ecfn(makeECFString(p));
-    Book("fj1"+ecfn,&(fj1ECFNs[p]),"fj1"+ecfn+"/F");
+    Book("fj1"+ecfn,&(fj1ECFNs[ecfIndex(p.order,p.N,p.ibeta)]),"fj1"+ecfn+"/F");
   }
 
 //ENDCUSTOMWRITE
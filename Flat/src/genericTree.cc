@@ -35,7 +35,12 @@ genericTree::Book(TString bname, void *address, TString leaf)
     }
   }
 
-  treePtr->Branch(bname,address,leaf);
+  // a tree reopened to resume a job already has its branches:
+  // point them at our members instead of booking duplicates
+  if (treePtr->GetBranch(bname))
+    treePtr->SetBranchAddress(bname,address);
+  else
+    treePtr->Branch(bname,address,leaf);
   return true;
 
 }
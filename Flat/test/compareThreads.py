@@ -0,0 +1,91 @@
+#!/usr/bin/env python
+
+# Runs PandaAnalyzer over the same input serially and with threads, with the
+# fatjet reclustering (jet areas from explicit ghosts) and the gen-jet
+# reclustering switched on, and checks that the two outputs are identical
+# entry by entry and branch by branch.
+#   python compareThreads.py input.root [nThreads] [nEvents]
+
+from sys import argv,exit
+from os import getenv
+
+torun = argv[1]
+nThreads = int(argv[2]) if len(argv)>2 else 4
+nEvents = int(argv[3]) if len(argv)>3 else 2000
+
+argv = []
+
+import ROOT as root
+from PandaCore.Tools.Load import *
+from PandaCore.Tools.Misc import PInfo, PError
+from PandaAnalysis.Flat.analysis import analysis
+
+Load('PandaAnalyzer')
+
+def run(threads, output):
+    a = analysis('compareThreads',
+                 fatjet = True,
+                 recluster = True,
+                 reclusterGen = True,
+                 btagSFs = True,
+                 bjetRegression = True)
+    skimmer = root.PandaAnalyzer(0)
+    skimmer.SetAnalysis(a)
+    skimmer.firstEvent = 0
+    skimmer.lastEvent = nEvents
+    skimmer.isData = False
+    skimmer.nThreads = threads
+    skimmer.keepOrder = True # compare entry by entry
+
+    fin = root.TFile.Open(torun)
+    tree = fin.FindObjectAny("events")
+    hweights = fin.FindObjectAny("hSumW")
+    weights = fin.FindObjectAny('weights')
+    if not weights:
+        weights = None
+
+    skimmer.SetDataDir(getenv('CMSSW_BASE')+'/src/PandaAnalysis/data/')
+    skimmer.Init(tree,hweights,weights)
+    skimmer.SetOutputFile(output)
+    skimmer.Run()
+    skimmer.Terminate()
+    fin.Close()
+
+def values(tree):
+    row = []
+    for leaf in tree.GetListOfLeaves():
+        for i in xrange(leaf.GetLen()):
+            row.append((leaf.GetName(),leaf.GetValue(i)))
+    return row
+
+run(1,'compareThreads_serial.root')
+run(nThreads,'compareThreads_threaded.root')
+
+fs = root.TFile.Open('compareThreads_serial.root')
+ft = root.TFile.Open('compareThreads_threaded.root')
+ts = fs.Get('events')
+tt = ft.Get('events')
+names = [l.GetName() for l in ts.GetListOfLeaves()]
+if names != [l.GetName() for l in tt.GetListOfLeaves()]:
+    PError('compareThreads','The outputs have different branches')
+    exit(1)
+if ts.GetEntries() != tt.GetEntries():
+    PError('compareThreads','%i serial entries, %i threaded'%(ts.GetEntries(),tt.GetEntries()))
+    exit(1)
+
+nDiffer = 0
+for iE in xrange(ts.GetEntries()):
+    ts.GetEntry(iE)
+    tt.GetEntry(iE)
+    vs = values(ts)
+    vt = values(tt)
+    if vs != vt:
+        nDiffer += 1
+        if nDiffer <= 10:
+            leaves = sorted(set(s[0] for s,t in zip(vs,vt) if s != t))
+            PError('compareThreads','Entry %i differs in %s'%(iE,', '.join(leaves[:10])))
+
+if nDiffer:
+    PError('compareThreads','%i of %i entries differ'%(nDiffer,ts.GetEntries()))
+    exit(1)
+PInfo('compareThreads','Serial and %i-thread outputs are identical over %i entries'%(nThreads,ts.GetEntries()))
@@ -130,20 +130,24 @@ def hadd(good_inputs):
 
 
 def add_bdt():
-    # now run the BDT
-    Load('TMVABranchAdder')
-    ba = root.TMVABranchAdder()
-    ba.treename = 'events'
-    ba.defaultValue = -1.2
-    ba.presel = 'fj1ECFN_2_4_20>0'
-    for v in tagcfg.variables:
-        ba.AddVariable(v[0],v[2])
-    for v in tagcfg.formulae:
-        ba.AddFormula(v[0],v[2])
-    for s in tagcfg.spectators:
-        ba.AddSpectator(s[0])
-    ba.BookMVA('top_ecf_bdt',data_dir+'/trainings/top_ecfbdt_v8_BDT.weights.xml')
-    ba.RunFile('output.root')
+    # now run the BDT; TMVABranchAdder is only needed if BDTEngine cannot read the training
+    for adder in ['BDTBranchAdder','TMVABranchAdder']:
+        if adder == 'TMVABranchAdder':
+            Load(adder)
+        ba = getattr(root, adder)()
+        ba.treename = 'events'
+        ba.defaultValue = -1.2
+        ba.presel = 'fj1ECFN_2_4_20>0'
+        for v in tagcfg.variables:
+            ba.AddVariable(v[0],v[2])
+        for v in tagcfg.formulae:
+            ba.AddFormula(v[0],v[2])
+        for s in tagcfg.spectators:
+            ba.AddSpectator(s[0])
+        if ba.BookMVA('top_ecf_bdt',data_dir+'/trainings/top_ecfbdt_v8_BDT.weights.xml') == False:
+            continue
+        ba.RunFile('output.root')
+        break
 
 
 def drop_branches(to_drop='fj1ECFN*'):
@@ -14,6 +14,7 @@ import PandaCore.Tools.job_config as cb
 
 sname = 'T3.job_utilities'                                     # name of this module
 data_dir = getenv('CMSSW_BASE') + '/src/PandaAnalysis/data/'   # data directory
+corr_bundle = 'corrections.bin'                                # made by compileCorrections.py, if shipped
 host = socket.gethostname()                                    # where we're running
 IS_T3 = (host[:2] == 't3')                                     # are we on the T3?
 REMOTE_READ = True                                             # should we read from hadoop or copy locally?
@@ -242,6 +243,8 @@ def run_PandaAnalyzer(skimmer, isData, input_name):
         weight_table = None
 
     output_name = input_to_output(input_name)
+    if path.isfile(corr_bundle):
+        skimmer.correctionBundle = corr_bundle
     skimmer.SetDataDir(data_dir)
     if isData:
         add_json(skimmer, data_dir+'/certs/Cert_271036-284044_13TeV_23Sep2016ReReco_Collisions16_JSON.txt')
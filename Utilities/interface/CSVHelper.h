@@ -3,6 +3,8 @@
 
 #include "TFile.h"
 #include "TH1D.h"
+#include "TAxis.h"
+#include <vector>
 
 // Adapted from ttH guys on Nov 21, 2017 ~DGH
 // https://github.com/cms-ttH/MiniAOD/tree/master/MiniAODHelper
@@ -20,14 +22,34 @@ class CSVHelper
     double getCSVWeight(std::vector<double> jetPts, std::vector<double> jetEtas, std::vector<double> jetCSVs,
                        std::vector<int> jetFlavors, int iSys, double &csvWgtHF, double &csvWgtLF, double &csvWgtCF);
 
+    // Total weights of nShifts systematics (iSys values as for getCSVWeight) in one pass:
+    // each jet is binned once, then every shift is a lookup in the flattened histograms.
+    // weights must have room for nShifts entries.
+    void getCSVWeights(unsigned nJets, const double *jetPts, const double *jetEtas, const double *jetCSVs,
+                       const int *jetFlavors, unsigned nShifts, const int *iSys, double *weights);
+
   private:
     void fillCSVHistos(TFile *fileHF, TFile *fileLF);
+    void flattenCSVHistos();
+    static void splitSys(int iSys, int &iSysHF, int &iSysC, int &iSysLF);
+    // pt/eta bin of a jet as used by the histograms; false if it is outside all of them
+    bool findBins(double jetPt, double jetAbsEta, int &iPt, int &iEta) const;
+
+    // all systematic variants of one (pt,eta) histogram, sharing one binning
+    struct Cell {
+      TAxis axis;
+      int nSys = 0;
+      std::vector<double> contents; //!< [iSys*(nBins+2)+bin], including under- and overflow
+    };
+    bool flattenCell(Cell &cell, TH1D **hists, int nSys);
 
     // CSV reweighting
     TH1D *h_csv_wgt_hf[9][6];
     TH1D *c_csv_wgt_hf[9][6];
     TH1D *h_csv_wgt_lf[9][4][3];
     const int nHFptBins;
+    Cell hfCells[6], cCells[6], lfCells[4][3];
+    bool flattened = false; //!< false if some variants do not share a binning
 };
 
 #endif
@@ -2,6 +2,10 @@
 #define ElectroWeakAnalysis_RoccoR
 #include "TRandom3.h"
 #include "TMath.h"
+#include <string>
+#include <vector>
+#include <istream>
+#include <memory>
 
 struct CrystalBall{
     static const double pi;
@@ -137,6 +141,11 @@ class RocRes{
 	double getUrnd(int H, int F, double v) const;
 	void dumpParams();
 	void init(std::string filename);
+	void init(std::istream &in);
+
+	// raw copy of the tables for RoccoR's cache; read() rebuilds cb
+	void write(std::vector<char> &buf) const;
+	bool read(const char *&p, const char *end);
 
 	void reset();
 
@@ -185,6 +194,9 @@ class RocOne{
 	void reset();
 	void init(std::string filename, int iTYPE=0, int iSYS=0, int iMEM=0);
 
+	void write(std::vector<char> &buf) const;
+	bool read(const char *&p, const char *end);
+
 	double kScaleDT(int Q, double pt, double eta, double phi) const;
 	double kScaleMC(int Q, double pt, double eta, double phi, double kSMR=1) const;
 	double kScaleAndSmearMC(int Q, double pt, double eta, double phi, int n, double u, double w) const;
@@ -198,13 +210,22 @@ class RocOne{
 };
 
 
+// Every (set, member) of a directory points to the RocOne of the file it is
+// read from, so a file that is used by many members (all of them, in
+// rcdata.2016.v3) is parsed and held once. With a cache file, the parsed
+// tables are read from it instead; it is (re)written when it is missing,
+// or when config.txt or any of the text files changed since.
 class RoccoR{
     public:
 	RoccoR(); 
 	RoccoR(std::string dirname); 
+	RoccoR(std::string dirname, std::string cachefile); 
 	~RoccoR();
 
 	void init(std::string dirname);
+	void init(std::string dirname, std::string cachefile);
+	bool readCache(std::string cachefile, std::string dirname);
+	bool writeCache(std::string cachefile) const;
 
 	double kGenSmear(double pt, double eta, double v, double u, RocRes::TYPE TT=RocRes::Data, int s=0, int m=0) const;
 	double kScaleDT(int Q, double pt, double eta, double phi, int s=0, int m=0) const;
@@ -213,15 +234,18 @@ class RoccoR{
 	double kScaleFromGenMC(int Q, double pt, double eta, double phi, int n, double gt, double w, int s=0, int m=0) const; 
 
 
-	double getM(int T, int H, int F, int E=0, int m=0) const{return RC[E][m].getM(T,H,F);}
-	double getA(int T, int H, int F, int E=0, int m=0) const{return RC[E][m].getA(T,H,F);}
-	double getK(int T, int H, int E=0, int m=0)        const{return RC[E][m].getK(T,H);}
+	double getM(int T, int H, int F, int E=0, int m=0) const{return RC[E][m]->getM(T,H,F);}
+	double getA(int T, int H, int F, int E=0, int m=0) const{return RC[E][m]->getA(T,H,F);}
+	double getK(int T, int H, int E=0, int m=0)        const{return RC[E][m]->getK(T,H);}
 
 	int Nset() const{return RC.size();}
 	int Nmem(int s=0) const{return RC[s].size();}
 
     private:
-	std::vector<std::vector<RocOne> > RC;
+	std::vector<std::shared_ptr<const RocOne> > tables;	// one per distinct (file, type, set, member)
+	std::vector<std::vector<std::shared_ptr<const RocOne> > > RC;	// [set][member], into tables
+	std::string dir;	// the directory init read
+	std::vector<std::string> sources;	// config.txt and the files of tables
 };
 
 #endif
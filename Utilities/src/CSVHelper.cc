@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 
 #include "../interface/CSVHelper.h"
 
@@ -11,6 +12,7 @@ CSVHelper::CSVHelper(std::string hf, std::string lf, int nHFptBins_):nHFptBins(n
     TFile *f_CSVwgt_LF = new TFile((std::string(getenv("CMSSW_BASE")) + "/src/" + inputFileLF).c_str());
 
     fillCSVHistos(f_CSVwgt_HF, f_CSVwgt_LF);
+    flattenCSVHistos();
 }
 
 // fill the histograms (done once)
@@ -107,11 +109,11 @@ CSVHelper::fillCSVHistos(TFile *fileHF, TFile *fileLF)
     return;
 }
 
-double
-CSVHelper::getCSVWeight(std::vector<double> jetPts, std::vector<double> jetEtas, std::vector<double> jetCSVs,
-                       std::vector<int> jetFlavors, int iSys, double &csvWgtHF, double &csvWgtLF, double &csvWgtCF)
+// map the iSys of getCSVWeight to the HF, C and LF histogram variants
+void
+CSVHelper::splitSys(int iSys, int &iSysHF, int &iSysC, int &iSysLF)
 {
-    int iSysHF = 0;
+    iSysHF = 0;
     switch (iSys) {
         case 7:
             iSysHF = 1;
@@ -142,7 +144,7 @@ CSVHelper::getCSVWeight(std::vector<double> jetPts, std::vector<double> jetEtas,
             break; // NoSys
     }
 
-    int iSysC = 0;
+    iSysC = 0;
     switch (iSys) {
         case 21:
             iSysC = 1;
@@ -161,7 +163,7 @@ CSVHelper::getCSVWeight(std::vector<double> jetPts, std::vector<double> jetEtas,
             break;
     }
 
-    int iSysLF = 0;
+    iSysLF = 0;
     switch (iSys) {
         case 7:
             iSysLF = 1;
@@ -191,6 +193,42 @@ CSVHelper::getCSVWeight(std::vector<double> jetPts, std::vector<double> jetEtas,
             iSysLF = 0;
             break; // NoSys
     }
+}
+
+bool
+CSVHelper::findBins(double jetPt, double jetAbsEta, int &iPt, int &iEta) const
+{
+    iPt = -1;
+    iEta = -1;
+    if (jetPt >= 19.99 && jetPt < 30)
+        iPt = 0;
+    else if (jetPt >= 30 && jetPt < 40)
+        iPt = 1;
+    else if (jetPt >= 40 && jetPt < 60)
+        iPt = 2;
+    else if (jetPt >= 60 && jetPt < 100)
+        iPt = 3;
+    else if (jetPt >= 100 && jetPt < 160)
+        iPt = 4;
+    else if (jetPt >= 160)
+        iPt = 5;
+
+    if (jetAbsEta >= 0 && jetAbsEta < 0.8)
+        iEta = 0;
+    else if (jetAbsEta >= 0.8 && jetAbsEta < 1.6)
+        iEta = 1;
+    else if (jetAbsEta >= 1.6 && jetAbsEta < 2.41)
+        iEta = 2;
+
+    return iPt >= 0 && iEta >= 0;
+}
+
+double
+CSVHelper::getCSVWeight(std::vector<double> jetPts, std::vector<double> jetEtas, std::vector<double> jetCSVs,
+                       std::vector<int> jetFlavors, int iSys, double &csvWgtHF, double &csvWgtLF, double &csvWgtCF)
+{
+    int iSysHF, iSysC, iSysLF;
+    splitSys(iSys, iSysHF, iSysC, iSysLF);
 
     double csvWgthf = 1.;
     double csvWgtC = 1.;
@@ -204,27 +242,7 @@ CSVHelper::getCSVWeight(std::vector<double> jetPts, std::vector<double> jetEtas,
       
       int iPt = -1;
       int iEta = -1;
-      if (jetPt >= 19.99 && jetPt < 30)
-	iPt = 0;
-      else if (jetPt >= 30 && jetPt < 40)
-	iPt = 1;
-      else if (jetPt >= 40 && jetPt < 60)
-	iPt = 2;
-      else if (jetPt >= 60 && jetPt < 100)
-	iPt = 3;
-      else if (jetPt >= 100 && jetPt < 160)
-	iPt = 4;
-      else if (jetPt >= 160)
-	iPt = 5;
-      
-      if (jetAbsEta >= 0 && jetAbsEta < 0.8)
-	iEta = 0;
-      else if (jetAbsEta >= 0.8 && jetAbsEta < 1.6)
-	iEta = 1;
-      else if (jetAbsEta >= 1.6 && jetAbsEta < 2.41)
-	iEta = 2;
-      
-      if (iPt < 0 || iEta < 0)
+      if (!findBins(jetPt, jetAbsEta, iPt, iEta))
 	std::cout << "Error, couldn't find Pt, Eta bins for this b-flavor jet, jetPt = " << jetPt
 		  << ", jetAbsEta = " << jetAbsEta << std::endl;
       
@@ -265,3 +283,125 @@ CSVHelper::getCSVWeight(std::vector<double> jetPts, std::vector<double> jetEtas,
 
     return csvWgtTotal;
 }
+
+// copy the systematic variants of each histogram into one array per (pt,eta) cell,
+// so that getCSVWeights can look up all shifts with a single bin index
+bool
+CSVHelper::flattenCell(Cell &cell, TH1D **hists, int nSys)
+{
+    for (int iSys = 0; iSys < nSys; iSys++) {
+        TH1D *h = hists[iSys];
+        if (!h)
+            return false;
+        if (iSys == 0) {
+            cell.axis = *h->GetXaxis();
+            cell.nSys = nSys;
+            cell.contents.assign(nSys * (cell.axis.GetNbins() + 2), 0.);
+        } else if (h->GetNbins() != cell.axis.GetNbins() ||
+                   h->GetXaxis()->GetXmin() != cell.axis.GetXmin() ||
+                   h->GetXaxis()->GetXmax() != cell.axis.GetXmax() ||
+                   h->GetXaxis()->IsVariableBinSize() != cell.axis.IsVariableBinSize()) {
+            return false;
+        }
+        int nBins = cell.axis.GetNbins() + 2;
+        if (cell.axis.IsVariableBinSize()) {
+            for (int iBin = 1; iBin <= nBins - 2; iBin++) {
+                if (h->GetXaxis()->GetBinLowEdge(iBin) != cell.axis.GetBinLowEdge(iBin))
+                    return false;
+            }
+        }
+        for (int iBin = 0; iBin < nBins; iBin++)
+            cell.contents[iSys * nBins + iBin] = h->GetBinContent(iBin);
+    }
+    return true;
+}
+
+void
+CSVHelper::flattenCSVHistos()
+{
+    TH1D *hf[9], *c[5], *lf[9];
+    flattened = true;
+    for (int iPt = 0; iPt < nHFptBins; iPt++) {
+        for (int iSys = 0; iSys < 9; iSys++)
+            hf[iSys] = h_csv_wgt_hf[iSys][iPt];
+        for (int iSys = 0; iSys < 5; iSys++)
+            c[iSys] = c_csv_wgt_hf[iSys][iPt];
+        flattened = flattened && flattenCell(hfCells[iPt], hf, 9) && flattenCell(cCells[iPt], c, 5);
+    }
+    for (int iPt = 0; iPt < 4; iPt++) {
+        for (int iEta = 0; iEta < 3; iEta++) {
+            for (int iSys = 0; iSys < 9; iSys++)
+                lf[iSys] = h_csv_wgt_lf[iSys][iPt][iEta];
+            flattened = flattened && flattenCell(lfCells[iPt][iEta], lf, 9);
+        }
+    }
+    if (!flattened)
+        std::cout << "CSVHelper: systematic variants do not share a binning, "
+                  << "getCSVWeights falls back to getCSVWeight" << std::endl;
+}
+
+void
+CSVHelper::getCSVWeights(unsigned nJets, const double *jetPts, const double *jetEtas, const double *jetCSVs,
+                         const int *jetFlavors, unsigned nShifts, const int *iSys, double *weights)
+{
+    if (!flattened) {
+        std::vector<double> pts(jetPts, jetPts + nJets), etas(jetEtas, jetEtas + nJets);
+        std::vector<double> csvs(jetCSVs, jetCSVs + nJets);
+        std::vector<int> flavors(jetFlavors, jetFlavors + nJets);
+        double hf, lf, cf;
+        for (unsigned iShift = 0; iShift < nShifts; iShift++)
+            weights[iShift] = getCSVWeight(pts, etas, csvs, flavors, iSys[iShift], hf, lf, cf);
+        return;
+    }
+
+    std::vector<int> iSysHF(nShifts), iSysC(nShifts), iSysLF(nShifts);
+    for (unsigned iShift = 0; iShift < nShifts; iShift++)
+        splitSys(iSys[iShift], iSysHF[iShift], iSysC[iShift], iSysLF[iShift]);
+
+    // three products per shift, multiplied in jet order as in getCSVWeight
+    std::vector<double> csvWgthf(nShifts, 1.), csvWgtC(nShifts, 1.), csvWgtlf(nShifts, 1.);
+
+    for (unsigned iJet = 0; iJet < nJets; iJet++) {
+        double csv = jetCSVs[iJet];
+        double jetPt = jetPts[iJet];
+        double jetAbsEta = fabs(jetEtas[iJet]);
+        int flavor = jetFlavors[iJet];
+
+        int iPt, iEta;
+        if (!findBins(jetPt, jetAbsEta, iPt, iEta)) {
+            std::cout << "Error, couldn't find Pt, Eta bins for this b-flavor jet, jetPt = " << jetPt
+                      << ", jetAbsEta = " << jetAbsEta << std::endl;
+            continue;
+        }
+
+        const Cell *cell;
+        const int *sysIdx;
+        double *wgt;
+        if (abs(flavor) == 5) {
+            cell = &hfCells[std::min(iPt, nHFptBins - 1)];
+            sysIdx = iSysHF.data();
+            wgt = csvWgthf.data();
+        } else if (abs(flavor) == 4) {
+            cell = &cCells[std::min(iPt, nHFptBins - 1)];
+            sysIdx = iSysC.data();
+            wgt = csvWgtC.data();
+        } else {
+            cell = &lfCells[std::min(iPt, 3)][iEta];
+            sysIdx = iSysLF.data();
+            wgt = csvWgtlf.data();
+        }
+
+        // the bin is the same for all variants
+        int nBins = cell->axis.GetNbins() + 2;
+        int useCSVBin = (csv >= 0.) ? cell->axis.FindFixBin(csv) : 1;
+        const double *contents = cell->contents.data() + useCSVBin;
+        for (unsigned iShift = 0; iShift < nShifts; iShift++) {
+            double iCSVWgt = contents[sysIdx[iShift] * nBins];
+            if (iCSVWgt != 0)
+                wgt[iShift] *= iCSVWgt;
+        }
+    }
+
+    for (unsigned iShift = 0; iShift < nShifts; iShift++)
+        weights[iShift] = csvWgthf[iShift] * csvWgtC[iShift] * csvWgtlf[iShift];
+}
@@ -9,6 +9,72 @@
 #include "TMath.h"
 #include "../interface/RoccoR.h"
 #include <assert.h>  
+#include <cstring>
+#include <cstdio>
+#include <map>
+#include <tuple>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    // raw copies of the fixed-size tables, for RoccoR's cache
+    template <typename T>
+    void Put(std::vector<char> &buf, T const& x){
+	const char *c = reinterpret_cast<const char*>(&x);
+	buf.insert(buf.end(), c, c+sizeof(T));
+    }
+
+    template <typename T>
+    bool Get(const char *&p, const char *end, T &x){
+	if(end-p<(long)sizeof(T)) return false;
+	memcpy(&x, p, sizeof(T));
+	p+=sizeof(T);
+	return true;
+    }
+
+    void PutString(std::vector<char> &buf, std::string const& s){
+	Put<uint32_t>(buf, s.size());
+	buf.insert(buf.end(), s.begin(), s.end());
+    }
+
+    bool GetString(const char *&p, const char *end, std::string &s){
+	uint32_t n=0;
+	if(!Get(p, end, n) || end-p<(long)n) return false;
+	s.assign(p, n);
+	p+=n;
+	return true;
+    }
+
+    bool Stat(std::string const& path, int64_t &size, int64_t &mtime){
+	struct stat st;
+	if(stat(path.c_str(), &st)!=0) return false;
+	size=st.st_size;
+	mtime=st.st_mtime;
+	return true;
+    }
+
+    // 64-bit FNV-1a
+    uint64_t Checksum(const char *data, uint64_t n){
+	uint64_t h=14695981039346656037ULL;
+	for(uint64_t i=0; i!=n; ++i){
+	    h^=(unsigned char)data[i];
+	    h*=1099511628211ULL;
+	}
+	return h;
+    }
+
+    const char kCacheMagic[8] = {'R','O','C','C','O','R','C','H'};
+    const uint32_t kCacheVersion = 1;
+
+    struct CacheHeader{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t payloadSize;
+	uint64_t checksum;
+    };
+}
+
 
 const double CrystalBall::pi    = TMath::Pi();
 const double CrystalBall::SPiO2 = sqrt(TMath::Pi()/2.0);
@@ -35,6 +101,9 @@ void RocRes::reset(){
 	    dtrk[H][F]=0;
 	}
 	for(int F=0; F<NMAXTRK; ++F){
+	    rmsA[H][F]=0;
+	    rmsB[H][F]=0;
+	    rmsC[H][F]=0;
 	    width[H][F]=1;
 	    alpha[H][F]=10;
 	    power[H][F]=10;
@@ -90,10 +159,14 @@ void RocRes::dumpParams(){
 void RocRes::init(std::string filename){
     std::ifstream in(filename.c_str());
     assert(in.is_open());
+    init(in);
+    in.close();
+}
+
+void RocRes::init(std::istream &in){
     std::string tag;
     int type, sys, mem, isdt, var, bin;	
     std::string s;
-    assert(in.is_open());
     while(std::getline(in, s)){
 	std::stringstream ss(s); 
 	if(s.substr(0,4)=="RMIN")       ss >> tag >> NMIN;
@@ -133,10 +206,35 @@ void RocRes::init(std::string filename){
 	    cb[H][F].init(0.0, width[H][F], alpha[H][F], power[H][F]);
 	}
     }
-    in.close();
     return;
 }
 
+void RocRes::write(std::vector<char> &buf) const{
+    Put(buf, NETA); Put(buf, NTRK); Put(buf, NMIN);
+    Put(buf, BETA); Put(buf, ntrk); Put(buf, dtrk);
+    Put(buf, width); Put(buf, alpha); Put(buf, power);
+    Put(buf, rmsA); Put(buf, rmsB); Put(buf, rmsC);
+    Put(buf, kDat); Put(buf, kRes);
+}
+
+bool RocRes::read(const char *&p, const char *end){
+    if(!(Get(p, end, NETA) && Get(p, end, NTRK) && Get(p, end, NMIN)
+	 && Get(p, end, BETA) && Get(p, end, ntrk) && Get(p, end, dtrk)
+	 && Get(p, end, width) && Get(p, end, alpha) && Get(p, end, power)
+	 && Get(p, end, rmsA) && Get(p, end, rmsB) && Get(p, end, rmsC)
+	 && Get(p, end, kDat) && Get(p, end, kRes)))
+	return false;
+    if(NETA<1 || NETA>NMAXETA || NTRK<1 || NTRK>NMAXTRK) return false;
+    // as reset followed by init
+    for(int H=0; H<NMAXETA; ++H){
+	for(int F=0; F<NMAXTRK; ++F){
+	    if(H<NETA && F<NTRK) cb[H][F].init(0.0, width[H][F], alpha[H][F], power[H][F]);
+	    else                 cb[H][F].init(0.0, 1, 10, 10);
+	}
+    }
+    return true;
+}
+
 double RocRes::Sigma(double pt, int H, int F) const{
     double dpt=pt-45;
     return rmsA[H][F] + rmsB[H][F]*dpt + rmsC[H][F]*dpt*dpt;
@@ -253,9 +351,17 @@ void RocOne::init(std::string filename, int iTYPE, int iSYS, int iMEM){
 
     reset();
 
-    RR.init(filename);
+    // read once, parse for both the resolution and the scale tables
+    std::ifstream fin(filename.c_str());
+    assert(fin.is_open());
+    std::stringstream text;
+    text << fin.rdbuf();
+    fin.close();
 
-    std::ifstream in(filename.c_str());
+    std::istringstream rin(text.str());
+    RR.init(rin);
+
+    std::istringstream in(text.str());
     std::string tag;
     int type, sys, mem, isdt, var, bin;	
 
@@ -292,7 +398,22 @@ void RocOne::init(std::string filename, int iTYPE, int iSYS, int iMEM){
 	}
     }
     if(!initialized) std::cout << "Problem with input file: " << filename << std::endl;
-    in.close();
+}
+
+void RocOne::write(std::vector<char> &buf) const{
+    Put(buf, NETA); Put(buf, NPHI);
+    Put(buf, BETA); Put(buf, DPHI);
+    Put(buf, M); Put(buf, A); Put(buf, D);
+    RR.write(buf);
+}
+
+bool RocOne::read(const char *&p, const char *end){
+    if(!(Get(p, end, NETA) && Get(p, end, NPHI)
+	 && Get(p, end, BETA) && Get(p, end, DPHI)
+	 && Get(p, end, M) && Get(p, end, A) && Get(p, end, D)))
+	return false;
+    if(NETA<1 || NETA>NMAXETA || NPHI<1 || NPHI>NMAXPHI) return false;
+    return RR.read(p, end);
 }
 
 double RocOne::kScaleDT(int Q, double pt, double eta, double phi) const{
@@ -343,12 +464,36 @@ RoccoR::RoccoR(std::string dirname){
     init(dirname);
 }
 
+RoccoR::RoccoR(std::string dirname, std::string cachefile){
+    init(dirname, cachefile);
+}
+
 
 void 
 RoccoR::init(std::string dirname){
 
     std::string filename=Form("%s/config.txt", dirname.c_str());
 
+    tables.clear();
+    RC.clear();
+    dir=dirname;
+    sources.assign(1, filename);
+
+    // (file, type, set, member) => tables index
+    std::map<std::tuple<std::string,int,int,int>, unsigned> loaded;
+    auto get=[&](std::string const& file, int t, int si, int m){
+	auto key=std::make_tuple(file, t, si, m);
+	auto it=loaded.find(key);
+	if(it==loaded.end()){
+	    auto one=std::make_shared<RocOne>();
+	    one->init(file, t, si, m);
+	    it=loaded.emplace(key, tables.size()).first;
+	    tables.push_back(one);
+	    sources.push_back(file);
+	}
+	return tables[it->second];
+    };
+
     std::ifstream in(filename.c_str());
     std::string s;
     std::string tag;
@@ -359,15 +504,15 @@ RoccoR::init(std::string dirname){
     while(std::getline(in, s)){
 	std::stringstream ss(s); 
 	ss >> tag >> si >> sn; 
-	std::vector<RocOne> v;
+	std::vector<std::shared_ptr<const RocOne> > v;
 	for(int m=0; m<sn; ++m){
 	    std::string inputfile=Form("%s/%d.%d.txt", dirname.c_str(), si, m);
 	    if(true) {//if(gSystem->AccessPathName(inputfile.c_str())) {
 		//std::cout << Form("Missing %8d %3d, using default instead...", si, m) << std::endl;  
-        v.push_back(RocOne(Form("%s/%d.%d.txt", dirname.c_str(),0,0),0,0,0));
+        v.push_back(get(Form("%s/%d.%d.txt", dirname.c_str(),0,0),0,0,0));
 	    }
 	    else{
-		v.push_back(RocOne(inputfile, 0, si, m));
+		v.push_back(get(inputfile, 0, si, m));
 	    }
 	}
 	RC.push_back(v);
@@ -376,24 +521,133 @@ RoccoR::init(std::string dirname){
     in.close();
 }
 
+void 
+RoccoR::init(std::string dirname, std::string cachefile){
+    if(readCache(cachefile, dirname)) return;
+    init(dirname);
+    if(!writeCache(cachefile))
+	std::cout << "RoccoR: could not write the cache " << cachefile << std::endl;
+}
+
+// The cache is
+//   header : magic, format version, payload size, payload checksum
+//   payload: directory, source files with their size and mtime,
+//            the distinct tables, and for every set the table of each member
+bool RoccoR::writeCache(std::string cachefile) const{
+    std::vector<char> payload;
+    PutString(payload, dir);
+    Put<uint32_t>(payload, sources.size());
+    for(auto const& src : sources){
+	int64_t size=0, mtime=0;
+	if(!Stat(src, size, mtime)) return false;
+	PutString(payload, src);
+	Put(payload, size);
+	Put(payload, mtime);
+    }
+
+    Put<uint32_t>(payload, tables.size());
+    for(auto const& t : tables) t->write(payload);
+
+    Put<uint32_t>(payload, RC.size());
+    for(auto const& v : RC){
+	Put<uint32_t>(payload, v.size());
+	for(auto const& one : v){
+	    uint32_t idx=0;
+	    while(tables[idx]!=one) ++idx;
+	    Put(payload, idx);
+	}
+    }
+
+    CacheHeader h;
+    memcpy(h.magic, kCacheMagic, sizeof(h.magic));
+    h.version=kCacheVersion;
+    h.reserved=0;
+    h.payloadSize=payload.size();
+    h.checksum=Checksum(payload.data(), payload.size());
+
+    // write next to the target and rename, so that a concurrent reader never sees half a file
+    std::string tmpfile=Form("%s.%d.tmp", cachefile.c_str(), (int)getpid());
+    std::ofstream out(tmpfile.c_str(), std::ios::binary);
+    if(!out.is_open()) return false;
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.write(payload.data(), payload.size());
+    out.close();
+    if(!out || rename(tmpfile.c_str(), cachefile.c_str())!=0){
+	remove(tmpfile.c_str());
+	return false;
+    }
+    return true;
+}
+
+bool RoccoR::readCache(std::string cachefile, std::string dirname){
+    std::ifstream in(cachefile.c_str(), std::ios::binary);
+    if(!in.is_open()) return false;
+    CacheHeader h;
+    if(!in.read(reinterpret_cast<char*>(&h), sizeof(h))) return false;
+    if(memcmp(h.magic, kCacheMagic, sizeof(h.magic))!=0 || h.version!=kCacheVersion) return false;
+    std::vector<char> payload(h.payloadSize);
+    if(!in.read(payload.data(), payload.size())) return false;
+    if(Checksum(payload.data(), payload.size())!=h.checksum) return false;
+
+    const char *p=payload.data(), *end=p+payload.size();
+    std::string cachedDir;
+    uint32_t nSources=0;
+    if(!GetString(p, end, cachedDir) || cachedDir!=dirname || !Get(p, end, nSources)) return false;
+    std::vector<std::string> newSources(nSources);
+    for(auto& src : newSources){
+	int64_t size=0, mtime=0, curSize=0, curMtime=0;
+	if(!GetString(p, end, src) || !Get(p, end, size) || !Get(p, end, mtime)) return false;
+	if(!Stat(src, curSize, curMtime) || curSize!=size || curMtime!=mtime) return false;
+    }
+
+    uint32_t nTables=0;
+    if(!Get(p, end, nTables)) return false;
+    std::vector<std::shared_ptr<const RocOne> > newTables;
+    for(uint32_t i=0; i!=nTables; ++i){
+	auto one=std::make_shared<RocOne>();
+	if(!one->read(p, end)) return false;
+	newTables.push_back(one);
+    }
+
+    uint32_t nSets=0;
+    if(!Get(p, end, nSets)) return false;
+    std::vector<std::vector<std::shared_ptr<const RocOne> > > newRC(nSets);
+    for(auto& v : newRC){
+	uint32_t nMem=0;
+	if(!Get(p, end, nMem)) return false;
+	for(uint32_t m=0; m!=nMem; ++m){
+	    uint32_t idx=0;
+	    if(!Get(p, end, idx) || idx>=nTables) return false;
+	    v.push_back(newTables[idx]);
+	}
+    }
+    if(p!=end) return false;
+
+    dir=dirname;
+    sources.swap(newSources);
+    tables.swap(newTables);
+    RC.swap(newRC);
+    return true;
+}
+
 RoccoR::~RoccoR(){}
 
 
 
 double RoccoR::kGenSmear(double pt, double eta, double v, double u, RocRes::TYPE TT, int s, int m) const{
-    return RC[s][m].kGenSmear(pt, eta, v, u, TT);
+    return RC[s][m]->kGenSmear(pt, eta, v, u, TT);
 }
 
 double RoccoR::kScaleDT(int Q, double pt, double eta, double phi, int s, int m) const{
-    return RC[s][m].kScaleDT(Q, pt, eta, phi);
+    return RC[s][m]->kScaleDT(Q, pt, eta, phi);
 }
 
 double RoccoR::kScaleAndSmearMC(int Q, double pt, double eta, double phi, int n, double u, double w, int s, int m) const{
-    return RC[s][m].kScaleAndSmearMC(Q, pt, eta, phi, n, u, w);
+    return RC[s][m]->kScaleAndSmearMC(Q, pt, eta, phi, n, u, w);
 }
 
 double RoccoR::kScaleFromGenMC(int Q, double pt, double eta, double phi, int n, double gt, double w, int s, int m) const{
-    return RC[s][m].kScaleFromGenMC(Q, pt, eta, phi, n, gt, w);
+    return RC[s][m]->kScaleFromGenMC(Q, pt, eta, phi, n, gt, w);
 }
 
 